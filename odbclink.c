@@ -1,22 +1,36 @@
 #include "postgres.h"
 
+#include <pthread.h>
+#include <signal.h>
+
 #include "fmgr.h"
 #include "funcapi.h"
+#include "access/hash.h"
 #include "access/htup.h"
+#include "access/xact.h"
 #if PG_VERSION_NUM >= 90300
 #include "access/htup_details.h"
 #include "utils/timestamp.h"
 #endif
 #include "catalog/pg_type.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
 #include "lib/stringinfo.h"
+#include "mb/pg_wchar.h"
+#include "portability/instr_time.h"
+#include "storage/proc.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #if PG_VERSION_NUM >= 80500
 #include "utils/bytea.h"
 #endif
 #include "utils/date.h"
+#include "utils/datetime.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
 #include "utils/memutils.h"
 #include "utils/palloc.h"
+#include "utils/tuplestore.h"
 
 #include "odbclink.h"
 
@@ -29,71 +43,201 @@ PG_FUNCTION_INFO_V1(odbclink_disconnect);
 PG_FUNCTION_INFO_V1(odbclink_query_n);
 PG_FUNCTION_INFO_V1(odbclink_query_dsn);
 PG_FUNCTION_INFO_V1(odbclink_query_connstr);
+PG_FUNCTION_INFO_V1(odbclink_query_params_n);
+PG_FUNCTION_INFO_V1(odbclink_query_partitioned_n);
+PG_FUNCTION_INFO_V1(odbclink_query_partitioned_dsn);
+PG_FUNCTION_INFO_V1(odbclink_query_partitioned_connstr);
+PG_FUNCTION_INFO_V1(odbclink_query_multi_n);
 PG_FUNCTION_INFO_V1(odbclink_exec_n);
 PG_FUNCTION_INFO_V1(odbclink_exec_dsn);
 PG_FUNCTION_INFO_V1(odbclink_exec_connstr);
-
-static odbcconn	*conns;
-static int	n_conn;
-
-static int
+PG_FUNCTION_INFO_V1(odbclink_exec_params_n);
+PG_FUNCTION_INFO_V1(odbclink_exec_batch_n);
+PG_FUNCTION_INFO_V1(odbclink_copy_to_remote_n);
+PG_FUNCTION_INFO_V1(odbclink_set_transactional_n);
+PG_FUNCTION_INFO_V1(odbclink_begin_n);
+PG_FUNCTION_INFO_V1(odbclink_commit_n);
+PG_FUNCTION_INFO_V1(odbclink_rollback_n);
+PG_FUNCTION_INFO_V1(odbclink_send_query_n);
+PG_FUNCTION_INFO_V1(odbclink_is_busy_n);
+PG_FUNCTION_INFO_V1(odbclink_get_result_n);
+PG_FUNCTION_INFO_V1(odbclink_cancel_query_n);
+
+odbcconn	*conns;
+int	n_conn;
+
+/* GUC variables */
+static int	fetch_size = FETCHSIZE;
+static bool	materialize = true;
+static int	prepared_cache_size = PREPCACHESIZE;
+static int	batch_size = BATCHSIZE;
+static int	query_timeout = 0;
+static bool	track_timing = false;
+static int	lob_direct_size = LOBDIRECTSIZE;
+
+static bool	connection_pooling = false;
+
+/* One ODBC environment is shared by all connections of the backend */
+static SQLHENV	hEnv = SQL_NULL_HENV;
+
+/* Connection slots by the hash of their key, and the list of free slots */
+static HTAB	   *conn_hash = NULL;
+static int	free_conn = -1;
+
+/*
+ * Grow the connection array, the slots are addressed
+ * by their index so they can be moved.
+ */
+static void
 realloc_conns(void)
 {
 	odbcconn *new_conns;
-	int	n_new_conn;
+	int	n_new_conn, i;
 
-	n_new_conn = n_conn + CONNCHUNK;
+	n_new_conn = (n_conn > 0 ? n_conn * 2 : CONNCHUNK);
 
 	new_conns = MemoryContextAllocZero(TopMemoryContext, n_new_conn * sizeof(odbcconn));
-	if (new_conns == NULL)
-		return 0;
 
-	memcpy(new_conns, conns, n_conn * sizeof(odbcconn));
 	if (conns)
+	{
+		memcpy(new_conns, conns, n_conn * sizeof(odbcconn));
 		pfree(conns);
+	}
+
+	/* the new slots are used from the lowest one */
+	for (i = n_new_conn - 1; i >= n_conn; i--)
+	{
+		new_conns[i].nextfree = free_conn;
+		free_conn = i;
+	}
 
 	conns = new_conns;
 	n_conn = n_new_conn;
+}
+
+/* The key connections are looked up by */
+char *
+conn_key(const char *dsn, const char *uid, const char *pwd, const char *connstr)
+{
+	StringInfoData	key;
+
+	initStringInfo(&key);
+	if (connstr)
+		appendStringInfo(&key, "C%s", connstr);
+	else
+		appendStringInfo(&key, "D%d:%s%d:%s%d:%s",
+				(int)strlen(dsn), dsn, (int)strlen(uid), uid, (int)strlen(pwd), pwd);
+
+	return key.data;
+}
 
-	return 1;
+static uint32
+conn_key_hash(const char *key)
+{
+	return DatumGetUInt32(hash_any((const unsigned char *)key, strlen(key)));
 }
 
 static int
-find_conn_dsn(const char *dsn, const char *uid, const char *pwd)
+find_conn_key(const char *key)
 {
-	int	i;
-	bool	found = false;
+	uint32		hash;
+	odbcconnhash   *entry;
+	int		i;
+
+	if (conn_hash == NULL)
+		return -1;
+
+	hash = conn_key_hash(key);
+	entry = hash_search(conn_hash, &hash, HASH_FIND, NULL);
+	if (entry == NULL)
+		return -1;
+
+	for (i = entry->first; i >= 0; i = conns[i].hashnext)
+		if (strcmp(conns[i].key, key) == 0)
+			return i;
 
-	for (i = 0; i < n_conn; i++)
-		if (conns[i].connected && conns[i].dsn &&
-			!strcmp(conns[i].dsn, dsn) &&
-			!strcmp(conns[i].uid, uid) &&
-			!strcmp(conns[i].pwd, pwd))
-		{
-			found = true;
-			break;
-		}
-	if (found)
-		return i;
 	return -1;
 }
 
-static int
-find_conn_connstr(const char *connstr)
+/* Make the connection in slot i findable by its key */
+static void
+add_conn_hash(int i)
 {
-	int	i;
-	bool	found = false;
+	odbcconnhash   *entry;
+	bool		found;
 
-	for (i = 0; i < n_conn; i++)
-		if (conns[i].connected && conns[i].connstr && 
-			!strcmp(conns[i].connstr, connstr))
+	if (conn_hash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(uint32);
+		ctl.entrysize = sizeof(odbcconnhash);
+		ctl.hash = tag_hash;
+		conn_hash = hash_create("odbclink connections", 64, &ctl, HASH_ELEM | HASH_FUNCTION);
+	}
+
+	conns[i].hash = conn_key_hash(conns[i].key);
+	conns[i].hashnext = -1;
+
+	entry = hash_search(conn_hash, &conns[i].hash, HASH_ENTER, &found);
+	if (!found)
+		entry->first = i;
+	else
+	{
+		int	j;
+
+		/* the older connections are found first */
+		for (j = entry->first; conns[j].hashnext >= 0; j = conns[j].hashnext)
+			;
+		conns[j].hashnext = i;
+	}
+}
+
+static void
+remove_conn_hash(int i)
+{
+	odbcconnhash   *entry;
+	int		j;
+
+	entry = hash_search(conn_hash, &conns[i].hash, HASH_FIND, NULL);
+	if (entry == NULL)
+		return;
+
+	if (entry->first == i)
+	{
+		entry->first = conns[i].hashnext;
+		if (entry->first < 0)
+			hash_search(conn_hash, &conns[i].hash, HASH_REMOVE, NULL);
+		return;
+	}
+
+	for (j = entry->first; j >= 0; j = conns[j].hashnext)
+		if (conns[j].hashnext == i)
 		{
-			found = true;
+			conns[j].hashnext = conns[i].hashnext;
 			break;
 		}
-	if (found)
-		return i;
-	return -1;
+}
+
+int
+find_conn_dsn(const char *dsn, const char *uid, const char *pwd)
+{
+	char	   *key = conn_key(dsn, uid, pwd, NULL);
+	int		i = find_conn_key(key);
+
+	pfree(key);
+	return i;
+}
+
+int
+find_conn_connstr(const char *connstr)
+{
+	char	   *key = conn_key(NULL, NULL, NULL, connstr);
+	int		i = find_conn_key(key);
+
+	pfree(key);
+	return i;
 }
 
 void
@@ -101,6 +245,125 @@ _PG_init(void)
 {
 	conns = NULL;
 	n_conn = 0;
+
+	DefineCustomIntVariable("odbclink.fetch_size",
+				"Number of rows fetched from ODBC at once by odbclink.query().",
+				NULL,
+				&fetch_size,
+				FETCHSIZE,
+				1,
+				10000,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.prepared_cache_size",
+				"Number of prepared statements kept per connection for parameterized queries.",
+				NULL,
+				&prepared_cache_size,
+				PREPCACHESIZE,
+				0,
+				1000,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.batch_size",
+				"Number of parameter sets sent at once by odbclink.execute_batch().",
+				NULL,
+				&batch_size,
+				BATCHSIZE,
+				1,
+				100000,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.query_timeout",
+				"Seconds a remote statement may run before the driver cancels it, 0 means no limit.",
+				NULL,
+				&query_timeout,
+				0,
+				0,
+				INT_MAX,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomBoolVariable("odbclink.connection_pooling",
+				"Use the connection pooling of the ODBC driver manager.",
+				"Takes effect when the first connection of the session is opened.",
+				&connection_pooling,
+				false,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomBoolVariable("odbclink.materialize",
+				"Return the result of odbclink.query() as a materialized set when the caller allows it.",
+				NULL,
+				&materialize,
+				true,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.lob_direct_size",
+				"Long text values larger than this are read straight into the text value.",
+				"-1 reads all of them into the string buffer of the query first.",
+				&lob_direct_size,
+				LOBDIRECTSIZE,
+				-1,
+				MAX_KILOBYTES,
+				PGC_USERSET,
+				GUC_UNIT_KB,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomBoolVariable("odbclink.track_timing",
+				"Collect the time spent in ODBC calls and conversions for odbclink.stats().",
+				NULL,
+				&track_timing,
+				false,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	prefetch_init();
+	pool_init();
+	cache_init();
+	stats_init();
 }
 
 void
@@ -112,24 +375,118 @@ _PG_fini(void)
 		{
 			SQLDisconnect(conns[i].hCon);
 			SQLFreeConnect(conns[i].hCon);
-			SQLFreeEnv(conns[i].hEnv);
 		}
+	if (hEnv != SQL_NULL_HENV)
+		SQLFreeEnv(hEnv);
 	pfree(conns);
 }
 
 static SQLCHAR		sqlstate[16];
 static SQLINTEGER	nativeerr;
 static SQLCHAR		errormsg[2048];
-static char		totalerrmsg[2120];
+char		totalerrmsg[2120];
 
-static char *
+/* Add the statistics counted on connection i to those of its data source */
+static void
+flush_stats(int i)
+{
+	if (conns[i].key)
+		stats_flush(conns[i].key, &conns[i].stats);
+}
+
+static void
+start_timing(instr_time *start)
+{
+	if (track_timing)
+		INSTR_TIME_SET_CURRENT(*start);
+}
+
+/* Add the milliseconds since start to the counter if timing is on */
+static void
+end_timing(double *counter, instr_time *start)
+{
+	if (track_timing)
+	{
+		instr_time	now;
+
+		INSTR_TIME_SET_CURRENT(now);
+		INSTR_TIME_SUBTRACT(now, *start);
+		*counter += INSTR_TIME_GET_MILLISEC(now);
+	}
+}
+
+/* Milliseconds since start */
+static double
+elapsed_ms(instr_time *start)
+{
+	instr_time	now;
+
+	INSTR_TIME_SET_CURRENT(now);
+	INSTR_TIME_SUBTRACT(now, *start);
+	return INSTR_TIME_GET_MILLISEC(now);
+}
+
+/*
+ * Start collecting the statement statistics of stmt if they are
+ * needed, query must stay valid until the statement is finished.
+ */
+static void
+track_stmt(odbcstmt *stmt, char *query)
+{
+	memset(&stmt->track, 0, sizeof(odbcstmttrack));
+	if (!stmt_stats_enabled())
+		return;
+
+	stmt->track.query = query;
+	INSTR_TIME_SET_CURRENT(stmt->track.start);
+}
+
+/* The remote statement is executed */
+static void
+executed_stmt(odbcstmt *stmt)
+{
+	if (stmt->track.query && !stmt->track.executed)
+	{
+		stmt->track.exec_time = elapsed_ms(&stmt->track.start);
+		stmt->track.executed = true;
+	}
+}
+
+/* All rows of the remote statement are read, account it */
+static void
+finish_stmt(odbcstmt *stmt)
+{
+	odbcstmttrack  *t = &stmt->track;
+	double		total;
+
+	if (t->query == NULL)
+		return;
+
+	executed_stmt(stmt);
+	total = elapsed_ms(&t->start);
+	if (t->rows == 0)
+		t->first_time = total;
+
+	stmt_stats(conns[stmt->conn_idx].key, t->query, t->exec_time, t->first_time,
+			total, t->rows, t->bytes);
+	t->query = NULL;
+}
+
+char *
 get_sql_error(int i, int type, odbcstmt *stmt)
 {
 	SQLSMALLINT	errmsgsize;
+
+	if (i >= 0 && i < n_conn)
+	{
+		conns[i].stats.errors++;
+		flush_stats(i);
+	}
+
 	switch (type)
 	{
 		case SQL_HANDLE_ENV:
-			SQLGetDiagRec(type, conns[i].hEnv, 1, sqlstate, &nativeerr, errormsg, sizeof(errormsg), &errmsgsize);
+			SQLGetDiagRec(type, hEnv, 1, sqlstate, &nativeerr, errormsg, sizeof(errormsg), &errmsgsize);
 			break;
 		case SQL_HANDLE_DBC:
 			SQLGetDiagRec(type, conns[i].hCon, 1, sqlstate, &nativeerr, errormsg, sizeof(errormsg), &errmsgsize);
@@ -151,89 +508,114 @@ get_sql_error(int i, int type, odbcstmt *stmt)
 	return totalerrmsg;
 }
 
+/*
+ * Take a free connection slot and allocate a connection handle in it,
+ * the environment is allocated on the first use.
+ */
 static int
-connect_dsn(const char *dsn, const char *uid, const char *pwd)
+alloc_conn(void)
 {
-	int	i, old_max;
-	bool	found;
+	int	i;
 	SQLRETURN	ret;
 
-	old_max = n_conn;
-	for (i = 0, found = false; i < old_max; i++)
-		if (!conns[i].connected)
+	if (hEnv == SQL_NULL_HENV)
+	{
+		/* pooling is process-wide and must be set before allocating the environment */
+		if (connection_pooling)
+			SQLSetEnvAttr(SQL_NULL_HENV, SQL_ATTR_CONNECTION_POOLING,
+					(SQLPOINTER)SQL_CP_ONE_PER_DRIVER, 0);
+
+		ret = SQLAllocEnv(&hEnv);
+		if (ret != SQL_SUCCESS)
 		{
-			found = true;
-			break;
+			hEnv = SQL_NULL_HENV;
+			elog(ERROR, "odbclink: unsuccessful SQLAllocEnv call");
 		}
-	if (!found)
-		if (!realloc_conns())
-			elog(ERROR, "odbclink: cannot allocate new connections");
+	}
 
-	ret = SQLAllocEnv(&(conns[i].hEnv));
-	if (ret != SQL_SUCCESS)
-		elog(ERROR, "odbclink: unsuccessful SQLAllocEnv call");
+	if (free_conn < 0)
+		realloc_conns();
+	i = free_conn;
 
-	ret = SQLAllocConnect(conns[i].hEnv, &(conns[i].hCon));
+	ret = SQLAllocConnect(hEnv, &(conns[i].hCon));
 	if (ret != SQL_SUCCESS)
 	{
 		get_sql_error(i, SQL_HANDLE_ENV, NULL);
-		SQLFreeEnv(conns[i].hEnv);
 		elog(ERROR, "odbclink: unsuccessful SQLAllocConnect call: %s", totalerrmsg);
 	}
 
+	return i;
+}
+
+/* Register the connection in slot i once it's connected */
+static void
+add_conn(int i, const char *dsn, const char *uid, const char *pwd, const char *connstr)
+{
+	MemoryContext	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+
+	free_conn = conns[i].nextfree;
+	conns[i].nextfree = -1;
+
+	conns[i].dsn = (dsn ? pstrdup(dsn) : NULL);
+	conns[i].uid = (uid ? pstrdup(uid) : NULL);
+	conns[i].pwd = (pwd ? pstrdup(pwd) : NULL);
+	conns[i].connstr = (connstr ? pstrdup(connstr) : NULL);
+	conns[i].key = conn_key(dsn, uid, pwd, connstr);
+	conns[i].connected = 1;
+	memset(&conns[i].stats, 0, sizeof(odbcstats));
+	conns[i].transactional = false;
+	conns[i].explicit_xact = false;
+	conns[i].xactlevel = 0;
+	conns[i].nosavepoints = false;
+	conns[i].xactfailed = false;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	add_conn_hash(i);
+}
+
+int
+connect_dsn(const char *dsn, const char *uid, const char *pwd)
+{
+	int	i;
+	SQLRETURN	ret;
+	instr_time	start;
+
+	i = alloc_conn();
+
+	start_timing(&start);
 	ret = SQLConnect(conns[i].hCon, (SQLCHAR *)dsn, SQL_NTS, (SQLCHAR *)uid, SQL_NTS, (SQLCHAR *)pwd, SQL_NTS);
 	if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO)
 	{
 		get_sql_error(i, SQL_HANDLE_DBC, NULL);
 		SQLFreeConnect(conns[i].hCon);
-		SQLFreeEnv(conns[i].hEnv);
 		elog(ERROR, "odbclink: unsuccessful SQLConnect call: %s", totalerrmsg);
 	}
 
-	conns[i].dsn = MemoryContextAlloc(TopMemoryContext, strlen(dsn) + 1); strcpy(conns[i].dsn, dsn);
-	conns[i].uid = MemoryContextAlloc(TopMemoryContext, strlen(uid) + 1); strcpy(conns[i].uid, uid);
-	conns[i].pwd = MemoryContextAlloc(TopMemoryContext, strlen(uid) + 1); strcpy(conns[i].pwd, pwd);
-	conns[i].connstr = NULL;
-	conns[i].connected = 1;
+	add_conn(i, dsn, uid, pwd, NULL);
+
+	conns[i].stats.connects++;
+	end_timing(&conns[i].stats.connect_time, &start);
+	flush_stats(i);
 
 	return i;
 }
 
-static int
+int
 connect_connstr(const char *connstr)
 {
-	int	i, old_max;
-	bool	found;
+	int	i;
 	SQLRETURN	ret;
+	instr_time	start;
 
-	old_max = n_conn;
-	for (i = 0, found = false; i < old_max; i++)
-		if (!conns[i].connected)
-		{
-			found = true;
-			break;
-		}
-	if (!found)
-		if (!realloc_conns())
-			elog(ERROR, "odbclink: cannot allocate new connections");
-
-	ret = SQLAllocEnv(&(conns[i].hEnv));
-	if (ret != SQL_SUCCESS)
-		elog(ERROR, "odbclink: unsuccessful SQLAllocEnv call");
-
-	ret = SQLAllocConnect(conns[i].hEnv, &(conns[i].hCon));
-	if (ret != SQL_SUCCESS)
-	{
-		get_sql_error(i, SQL_HANDLE_ENV, NULL);
-		SQLFreeEnv(conns[i].hEnv);
-		elog(ERROR, "odbclink: unsuccessful SQLAllocConnect call: %s", totalerrmsg);
-	}
+	i = alloc_conn();
 
 	/*
 	 * Connect using a connection string
 	 * This code runs in the database backend
 	 * so we cannot prompt the user.
 	 */
+	start_timing(&start);
 	ret = SQLDriverConnect(conns[i].hCon, NULL,
 				(SQLCHAR *)connstr, SQL_NTS,
 				NULL, 0, NULL,
@@ -242,15 +624,14 @@ connect_connstr(const char *connstr)
 	{
 		get_sql_error(i, SQL_HANDLE_DBC, NULL);
 		SQLFreeConnect(conns[i].hCon);
-		SQLFreeEnv(conns[i].hEnv);
 		elog(ERROR, "odbclink: unsuccessful SQLConnect call: %s", totalerrmsg);
 	}
 
-	conns[i].dsn = NULL;
-	conns[i].uid = NULL;
-	conns[i].pwd = NULL;
-	conns[i].connstr = MemoryContextAlloc(TopMemoryContext, strlen(connstr) + 1); strcpy(conns[i].connstr, connstr);
-	conns[i].connected = 1;
+	add_conn(i, NULL, NULL, NULL, connstr);
+
+	conns[i].stats.connects++;
+	end_timing(&conns[i].stats.connect_time, &start);
+	flush_stats(i);
 
 	return i;
 }
@@ -388,717 +769,4476 @@ odbclink_connections(PG_FUNCTION_ARGS)
 	}
 }
 
-Datum
-odbclink_disconnect(PG_FUNCTION_ARGS)
+/* Free a prepared statement and its column plan */
+static void
+free_prepared(odbcprep *p)
 {
-	int	i = PG_GETARG_INT32(0) - 1;
-	SQLRETURN	ret;
+	/* a query still reading the statement, e.g. when disconnecting in it */
+	if (p->stmt)
+		prefetch_end(p->stmt);
+	SQLFreeHandle(SQL_HANDLE_STMT, p->hStmt);
+	if (p->cached)
+		MemoryContextDelete(p->cxt);
+}
 
-	if (!(i >= 0 && i < n_conn && conns[i].connected))
-		elog(ERROR, "odbclink: no such connection");
+/* SQLExecDirect(query), or SQLExecute() for a prepared statement if query is NULL */
+static SQLRETURN
+run_stmt(SQLHSTMT hStmt, char *query)
+{
+	if (query)
+		return SQLExecDirect(hStmt, (SQLCHAR *)query, SQL_NTS);
+	return SQLExecute(hStmt);
+}
 
-	ret = SQLDisconnect(conns[i].hCon);
-	if (!SQL_SUCCEEDED(ret))
-		elog(NOTICE, "odbclink: unsuccessful SQLDisconnect call");
+/* Pause before the next poll of an asynchronous statement, growing from none */
+static long
+next_poll_delay(long delay)
+{
+	return (delay == 0 ? POLLMINDELAY : Min(delay * 2, POLLMAXDELAY));
+}
 
-	ret = SQLFreeConnect(conns[i].hCon);
-	if (!SQL_SUCCEEDED(ret))
-		elog(NOTICE, "odbclink: unsuccessful SQLFreeConnect call");
+/*
+ * Cancel a statement, one executing asynchronously must be polled
+ * until the driver gives it up. Returns false if it's still executing
+ * after CANCELWAIT microseconds.
+ */
+static bool
+cancel_stmt(SQLHSTMT hStmt, char *query, bool running)
+{
+	long		delay = 0, waited = 0;
 
-	ret = SQLFreeEnv(conns[i].hEnv);
-	if (!SQL_SUCCEEDED(ret))
-		elog(NOTICE, "odbclink: unsuccessful SQLFreeEnv call");
+	SQLCancel(hStmt);
+	if (running)
+		while (run_stmt(hStmt, query) == SQL_STILL_EXECUTING)
+		{
+			if (waited >= CANCELWAIT)
+				return false;
+			delay = next_poll_delay(delay);
+			pg_usleep(delay);
+			waited += delay;
+		}
 
-	conns[i].connected = 0;
-	if (conns[i].dsn)
-		pfree(conns[i].dsn);
-	if (conns[i].uid)
-		pfree(conns[i].uid);
-	if (conns[i].pwd)
-		pfree(conns[i].pwd);
-	if (conns[i].connstr)
-		pfree(conns[i].connstr);
+	return true;
+}
 
-	PG_RETURN_VOID();
+static void
+set_query_timeout(SQLHSTMT hStmt)
+{
+	/* drivers that can't time out statements just ignore it */
+	if (query_timeout > 0)
+		SQLSetStmtAttr(hStmt, SQL_ATTR_QUERY_TIMEOUT, (SQLPOINTER)(SQLULEN)query_timeout, 0);
 }
 
-static bool
-compatTupleDescs(odbcstmt *stmt)
+/* Start or end a transaction on connection i by the autocommit mode */
+static void
+set_autocommit(int i, bool on)
 {
-	TupleDesc	tupdesc = stmt->tupdesc;
 	SQLRETURN	ret;
-	int		col;
-	int		retval = true;
 
-	ret = SQLNumResultCols(stmt->hStmt, &stmt->cols);
+	ret = SQLSetConnectAttr(conns[i].hCon, SQL_ATTR_AUTOCOMMIT,
+				(SQLPOINTER)(on ? SQL_AUTOCOMMIT_ON : SQL_AUTOCOMMIT_OFF), 0);
 	if (!SQL_SUCCEEDED(ret))
-		return false;
-	if (tupdesc->natts != stmt->cols)
-		return false;
-
-	for (col = 0; col < stmt->cols; col++)
 	{
-		char		colname[50];
-		SQLSMALLINT	colnamesz, type, decimals, nullable;
-		SQLULEN		columnsz;
-		Oid		typeoid = tupdesc->attrs[col]->atttypid;
-		int		typemod = tupdesc->attrs[col]->atttypmod;
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		elog(ERROR, "odbclink: unsuccessful SQLSetConnectAttr call: %s", totalerrmsg);
+	}
+}
 
-		ret = SQLDescribeCol(stmt->hStmt, col + 1,
-					(SQLCHAR *)colname, sizeof(colname), &colnamesz,
-					&type, &columnsz, &decimals, &nullable);
+/* Run a transaction control statement on connection i, false if it fails */
+static bool
+xact_command(int i, const char *sql)
+{
+	odbcstmt	stmt;
+	SQLRETURN	ret;
 
-		switch (type)
-		{
-			case SQL_CHAR:
-			case SQL_VARCHAR:
-				if (typeoid != CHAROID && typeoid != BPCHAROID && typeoid != VARCHAROID && typeoid != TEXTOID)
-				{
-					if (typemod >= 1 && typemod < columnsz) /* maybe >= 0 ? */
-						retval = false;
-				}
-				break;
+	memset(&stmt, 0, sizeof(odbcstmt));
+	stmt.conn_idx = i;
 
-			case SQL_LONGVARCHAR:
-				if (typeoid != TEXTOID)
-					retval = false;
-				break;
+	if (!SQL_SUCCEEDED(SQLAllocStmt(conns[i].hCon, &stmt.hStmt)))
+	{
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		return false;
+	}
+	ret = SQLExecDirect(stmt.hStmt, (SQLCHAR *)sql, SQL_NTS);
+	if (!SQL_SUCCEEDED(ret))
+		get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+	SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
 
-			case SQL_NUMERIC:
-			case SQL_DECIMAL:
-				if (typeoid != INT2OID && typeoid != INT4OID && typeoid != INT8OID && typeoid != NUMERICOID)
-					retval = false;
-				break;
+	return SQL_SUCCEEDED(ret);
+}
 
-			case SQL_BIGINT:
-				if (typeoid != INT8OID)
-					retval = false;
+/* End the remote transaction of connection i, false if it fails */
+static bool
+end_remote_xact(int i, bool commit)
+{
+	bool		ok = SQL_SUCCEEDED(SQLEndTran(SQL_HANDLE_DBC, conns[i].hCon,
+						(commit ? SQL_COMMIT : SQL_ROLLBACK)));
+
+	if (!ok)
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+	conns[i].xactlevel = 0;
+	conns[i].xactfailed = false;
+
+	return ok;
+}
+
+/*
+ * Called before a statement runs on connection i. In transactional mode
+ * autocommit is off, so the driver starts the remote transaction with
+ * the first statement, and every local subtransaction the statement
+ * runs in gets a savepoint, which is rolled back with it.
+ */
+static void
+remote_xact_use(int i)
+{
+	int		level;
+	char		sql[64];
+
+	if (!conns[i].transactional)
+		return;
+
+	level = GetCurrentTransactionNestLevel();
+	if (conns[i].xactlevel == 0)
+		conns[i].xactlevel = 1;
+
+	while (conns[i].xactlevel < level)
+	{
+		conns[i].xactlevel++;
+		if (conns[i].nosavepoints)
+			continue;
+
+		snprintf(sql, sizeof(sql), "SAVEPOINT odbclink_%d", conns[i].xactlevel);
+		if (!xact_command(i, sql))
+		{
+			elog(NOTICE, "odbclink: connection %d doesn't support savepoints: %s", i + 1, totalerrmsg);
+			conns[i].nosavepoints = true;
+		}
+	}
+}
+
+/* True if connection i is in a remote transaction that may have changed data */
+static bool
+remote_xact_open(int i)
+{
+	return ((conns[i].transactional && conns[i].xactlevel > 0) || conns[i].explicit_xact);
+}
+
+/*
+ * Commit or roll back the remote transactions with the local one. The
+ * commit happens before the local one, so a failure aborts it, but the
+ * remote transactions of several connections are not committed atomically.
+ */
+static void
+remote_xact_callback(XactEvent event, void *arg)
+{
+	int		i;
+
+	for (i = 0; i < n_conn; i++)
+	{
+		if (!conns[i].connected || !conns[i].transactional || conns[i].xactlevel == 0)
+			continue;
+
+		switch (event)
+		{
+#if PG_VERSION_NUM >= 90300
+			case XACT_EVENT_PRE_COMMIT:
+				/* the remote transaction is rolled back on the local abort */
+				if (conns[i].xactfailed)
+					ereport(ERROR,
+							(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+								errmsg("odbclink: cannot commit the remote transaction on connection %d", i + 1),
+								errdetail("A rolled back subtransaction changed it and the data source has no savepoints.")));
+				if (!SQL_SUCCEEDED(SQLEndTran(SQL_HANDLE_DBC, conns[i].hCon, SQL_COMMIT)))
+				{
+					get_sql_error(i, SQL_HANDLE_DBC, NULL);
+					elog(ERROR, "odbclink: unsuccessful commit on connection %d: %s", i + 1, totalerrmsg);
+				}
+				conns[i].xactlevel = 0;
+				break;
+
+			case XACT_EVENT_PRE_PREPARE:
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+							errmsg("odbclink: cannot prepare a transaction with a remote transaction on connection %d", i + 1)));
+				break;
+#else
+			case XACT_EVENT_COMMIT:
+				/* too late to abort the local transaction */
+				if (conns[i].xactfailed)
+				{
+					end_remote_xact(i, false);
+					elog(WARNING, "odbclink: the remote transaction on connection %d was rolled back, "
+						"a rolled back subtransaction changed it and the data source has no savepoints", i + 1);
+				}
+				else if (!end_remote_xact(i, true))
+					elog(WARNING, "odbclink: unsuccessful commit on connection %d: %s", i + 1, totalerrmsg);
+				break;
+#endif
+
+			case XACT_EVENT_ABORT:
+				end_remote_xact(i, false);
+				cache_invalidate(conns[i].key);
+				break;
+
+			default:
 				break;
+		}
+	}
+}
+
+/* Release or roll back the savepoint of a local subtransaction */
+static void
+remote_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+		SubTransactionId parentSubid, void *arg)
+{
+	int		level;
+	char		sql[64];
+	int		i;
+
+	if (event != SUBXACT_EVENT_COMMIT_SUB && event != SUBXACT_EVENT_ABORT_SUB)
+		return;
+
+	level = GetCurrentTransactionNestLevel();
+	for (i = 0; i < n_conn; i++)
+	{
+		if (!conns[i].connected || !conns[i].transactional || conns[i].xactlevel < level)
+			continue;
+
+		if (conns[i].nosavepoints)
+		{
+			/* changes of the subtransaction can't be undone alone */
+			if (event == SUBXACT_EVENT_ABORT_SUB)
+				conns[i].xactfailed = true;
+		}
+		else if (event == SUBXACT_EVENT_COMMIT_SUB)
+		{
+			/* some data sources keep the savepoint until the end */
+			snprintf(sql, sizeof(sql), "RELEASE SAVEPOINT odbclink_%d", level);
+			xact_command(i, sql);
+		}
+		else
+		{
+			snprintf(sql, sizeof(sql), "ROLLBACK TO SAVEPOINT odbclink_%d", level);
+			if (!xact_command(i, sql))
+				conns[i].xactfailed = true;
+		}
+		if (event == SUBXACT_EVENT_ABORT_SUB)
+			cache_invalidate(conns[i].key);
+		conns[i].xactlevel = level - 1;
+	}
+}
+
+static void
+register_xact_callbacks(void)
+{
+	static bool	registered = false;
+
+	if (!registered)
+	{
+		RegisterXactCallback(remote_xact_callback, NULL);
+		RegisterSubXactCallback(remote_subxact_callback, NULL);
+		registered = true;
+	}
+}
+
+/* Whether the helper thread of a query sent by odbclink.send_query() is done */
+static bool
+pending_thread_done(odbcasync *a)
+{
+	bool		done;
+
+	pthread_mutex_lock(&a->mutex);
+	done = a->done;
+	pthread_mutex_unlock(&a->mutex);
+
+	return done;
+}
+
+/*
+ * Wait for the helper thread, cancelling the query if it's still running.
+ * A driver that doesn't support SQLCancel() from another thread keeps
+ * the backend waiting until the query is done.
+ */
+static void
+join_pending(odbcasync *a)
+{
+	if (!pending_thread_done(a))
+		SQLCancel(a->stmt->hStmt);
+	pthread_join(a->thread, NULL);
+	pthread_mutex_destroy(&a->mutex);
+	a->threaded = false;
+	a->running = false;
+}
+
+/*
+ * Forget the query sent by odbclink.send_query(), cancelling it if needed.
+ * Returns false if the driver didn't give up the running query.
+ */
+static bool
+free_pending(int i, bool cancel)
+{
+	odbcasync  *a = conns[i].pending;
+	bool		cancelled = true;
+
+	conns[i].pending = NULL;
+
+	/* the thread may still use the statement */
+	if (a->threaded)
+		join_pending(a);
+
+	if (a->stmt->hStmt != SQL_NULL_HSTMT)
+	{
+		if (cancel)
+			cancelled = cancel_stmt(a->stmt->hStmt, a->query, a->running);
+		free_stmt(a->stmt);
+	}
+	pfree(a->query);
+	pfree(a->stmt);
+	pfree(a);
+
+	return cancelled;
+}
+
+void
+disconnect_conn(int i)
+{
+	SQLRETURN	ret;
+
+	if (conns[i].pending && !free_pending(i, true))
+		elog(WARNING, "odbclink: the query on connection %d could not be cancelled", i + 1);
+
+	/* an open remote transaction would keep SQLDisconnect() from succeeding */
+	if (conns[i].xactlevel > 0 || conns[i].explicit_xact)
+		end_remote_xact(i, false);
+
+	while (conns[i].prepared)
+	{
+		odbcprep   *p = conns[i].prepared;
+
+		conns[i].prepared = p->next;
+		free_prepared(p);
+	}
+	conns[i].nprepared = 0;
+
+	flush_stats(i);
+
+	ret = SQLDisconnect(conns[i].hCon);
+	if (!SQL_SUCCEEDED(ret))
+		elog(NOTICE, "odbclink: unsuccessful SQLDisconnect call");
+
+	ret = SQLFreeConnect(conns[i].hCon);
+	if (!SQL_SUCCEEDED(ret))
+		elog(NOTICE, "odbclink: unsuccessful SQLFreeConnect call");
+
+	remove_conn_hash(i);
+
+	conns[i].connected = 0;
+	if (conns[i].dsn)
+		pfree(conns[i].dsn);
+	if (conns[i].uid)
+		pfree(conns[i].uid);
+	if (conns[i].pwd)
+		pfree(conns[i].pwd);
+	if (conns[i].connstr)
+		pfree(conns[i].connstr);
+	pfree(conns[i].key);
+	conns[i].dsn = conns[i].uid = conns[i].pwd = conns[i].connstr = conns[i].key = NULL;
+
+	conns[i].nextfree = free_conn;
+	free_conn = i;
+}
+
+Datum
+odbclink_disconnect(PG_FUNCTION_ARGS)
+{
+	int	i = PG_GETARG_INT32(0) - 1;
+
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	disconnect_conn(i);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Free the statement handle of a query unless it's already done,
+ * cached prepared statements only get their cursor closed.
+ */
+void
+free_stmt(odbcstmt *stmt)
+{
+	if (stmt->hStmt != SQL_NULL_HSTMT)
+	{
+		prefetch_end(stmt);
+		if (stmt->cached)
+			SQLFreeStmt(stmt->hStmt, SQL_CLOSE);
+		else
+			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
+		stmt->hStmt = SQL_NULL_HSTMT;
+		finish_stmt(stmt);
+		flush_stats(stmt->conn_idx);
+	}
+}
+
+/*
+ * Converters from the fetched ODBC values to Datums,
+ * one for every supported (ODBC type, PostgreSQL type) pair.
+ */
+static Datum
+conv_sshort_int2(odbccol *c, char *val, SQLLEN len)
+{
+	return Int16GetDatum(*(int16 *)val);
+}
+
+static Datum
+conv_sshort_int4(odbccol *c, char *val, SQLLEN len)
+{
+	return Int32GetDatum(*(int16 *)val);
+}
+
+static Datum
+conv_sshort_int8(odbccol *c, char *val, SQLLEN len)
+{
+	return Int64GetDatum(*(int16 *)val);
+}
+
+static Datum
+conv_slong_int4(odbccol *c, char *val, SQLLEN len)
+{
+	return Int32GetDatum(*(int32 *)val);
+}
+
+static Datum
+conv_slong_int8(odbccol *c, char *val, SQLLEN len)
+{
+	return Int64GetDatum(*(int32 *)val);
+}
+
+static Datum
+conv_slong_bool(odbccol *c, char *val, SQLLEN len)
+{
+	return BoolGetDatum(*(int32 *)val != 0);
+}
+
+static Datum
+conv_sbigint_int8(odbccol *c, char *val, SQLLEN len)
+{
+	return Int64GetDatum(*(int64 *)val);
+}
+
+static Datum
+conv_float_float4(odbccol *c, char *val, SQLLEN len)
+{
+	return Float4GetDatum(*(float *)val);
+}
+
+static Datum
+conv_double_float8(odbccol *c, char *val, SQLLEN len)
+{
+	return Float8GetDatum(*(double *)val);
+}
+
+/*
+ * Integer data out of numeric/decimal types is fetched as SQL_C_SBIGINT,
+ * the driver truncates the fractional digits, overflow is reported
+ * as error. This is to cause the least surprise, Oracle reports
+ * SQL_DECIMAL for tables created with INTEGER fields.
+ */
+static Datum
+conv_sbigint_int4(odbccol *c, char *val, SQLLEN len)
+{
+	int64		bigint_val = *(int64 *)val;
+
+	if (bigint_val < INT_MIN || bigint_val > INT_MAX)
+		elog(ERROR, "decimal value out of range for 32-bit integer");
+	return Int32GetDatum((int32)bigint_val);
+}
+
+static Datum
+conv_sbigint_int2(odbccol *c, char *val, SQLLEN len)
+{
+	int64		bigint_val = *(int64 *)val;
+
+	if (bigint_val < SHRT_MIN || bigint_val > SHRT_MAX)
+		elog(ERROR, "decimal value out of range for 16-bit integer");
+	return Int16GetDatum((int16)bigint_val);
+}
+
+/*
+ * On-disk layout of a NUMERIC in the long format, the server
+ * reads it in all versions. The digits are in base NUM_NBASE.
+ */
+#define NUM_NBASE		(10000)
+#define NUM_DEC_DIGITS		(4)
+#define NUM_POS			(0x0000)
+#define NUM_NEG			(0x4000)
+#define NUM_DSCALE_MASK		(0x3FFF)
+
+typedef struct {
+	int32		vl_len_;
+#if PG_VERSION_NUM >= 90100
+	uint16		n_sign_dscale;
+	int16		n_weight;
+#else
+	int16		n_weight;
+	uint16		n_sign_dscale;
+#endif
+	int16		n_data[1];
+} odbcnumeric;
+
+/* exponent of the NBASE digit a decimal digit at 10^pos belongs to */
+static int
+num_exponent(int pos)
+{
+	return (pos >= 0 ? pos / NUM_DEC_DIGITS : -((-pos + NUM_DEC_DIGITS - 1) / NUM_DEC_DIGITS));
+}
+
+/*
+ * Build a NUMERIC directly from the SQL_NUMERIC_STRUCT: the 128-bit
+ * little endian magnitude is split into decimal digits which are then
+ * regrouped into NBASE digits around the decimal point.
+ */
+static Datum
+conv_numeric_numeric(odbccol *c, char *val, SQLLEN len)
+{
+	static const int16	pow10[NUM_DEC_DIGITS] = { 1, 10, 100, 1000 };
+	SQL_NUMERIC_STRUCT *ns = (SQL_NUMERIC_STRUCT *)val;
+	uint8		mag[SQL_MAX_NUMERIC_LEN];
+	char		dig[SQL_MAX_NUMERIC_LEN * 3];	/* least significant first */
+	int16		digits[SQL_MAX_NUMERIC_LEN];
+	int		nbytes, ndig = 0, ndigits = 0, weight = 0;
+	int		scale = ns->scale;
+	int		i, k;
+	odbcnumeric    *result;
+	Size		size;
+
+	memcpy(mag, ns->val, SQL_MAX_NUMERIC_LEN);
+	nbytes = SQL_MAX_NUMERIC_LEN;
+	while (nbytes > 0 && mag[nbytes - 1] == 0)
+		nbytes--;
+
+	/* long division of the magnitude by NBASE */
+	while (nbytes > 0)
+	{
+		uint32	rem = 0;
+
+		for (i = nbytes - 1; i >= 0; i--)
+		{
+			uint32	cur = (rem << 8) | mag[i];
+
+			mag[i] = cur / NUM_NBASE;
+			rem = cur % NUM_NBASE;
+		}
+		for (i = 0; i < NUM_DEC_DIGITS; i++)
+		{
+			dig[ndig++] = rem % 10;
+			rem /= 10;
+		}
+		while (nbytes > 0 && mag[nbytes - 1] == 0)
+			nbytes--;
+	}
+	while (ndig > 0 && dig[ndig - 1] == 0)
+		ndig--;
+
+	if (ndig > 0)
+	{
+		int	emax = num_exponent(ndig - 1 - scale);
+		int	emin = num_exponent(-scale);
+
+		ndigits = emax - emin + 1;
+		memset(digits, 0, ndigits * sizeof(int16));
+		for (k = 0; k < ndig; k++)
+		{
+			int	e = num_exponent(k - scale);
+
+			digits[emax - e] += dig[k] * pow10[k - scale - e * NUM_DEC_DIGITS];
+		}
+
+		/* trailing zero digits are implied by the weight */
+		while (ndigits > 0 && digits[ndigits - 1] == 0)
+			ndigits--;
+		weight = emax;
+	}
+
+	size = offsetof(odbcnumeric, n_data) + ndigits * sizeof(int16);
+	result = palloc(size);
+	SET_VARSIZE(result, size);
+	result->n_sign_dscale = ((ndig > 0 && ns->sign == 0) ? NUM_NEG : NUM_POS) |
+				((scale > 0 ? scale : 0) & NUM_DSCALE_MASK);
+	result->n_weight = weight;
+	memcpy(result->n_data, digits, ndigits * sizeof(int16));
+
+	/* apply the precision and scale of the result column */
+	if (c->typmod >= (int32)VARHDRSZ)
+		return DirectFunctionCall2(numeric, PointerGetDatum(result), Int32GetDatum(c->typmod));
+
+	return PointerGetDatum(result);
+}
+
+static Datum
+conv_char_char(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall1(charin, CStringGetDatum(val));
+}
+
+/*
+ * Check that a fetched string is valid in the server encoding.
+ * Plain ASCII without zero bytes is skipped 8 bytes at a time,
+ * the rest goes through the encoding's validator.
+ */
+static void
+verify_string(const char *s, SQLLEN len)
+{
+	const char *p = s;
+	const char *end = s + len;
+
+	for (; p + sizeof(uint64) <= end; p += sizeof(uint64))
+	{
+		uint64		w;
+
+		memcpy(&w, p, sizeof(uint64));
+		if ((w & UINT64CONST(0x8080808080808080)) ||
+				((w - UINT64CONST(0x0101010101010101)) & ~w & UINT64CONST(0x8080808080808080)))
+			break;
+	}
+	for (; p < end; p++)
+		if (IS_HIGHBIT_SET(*p) || *p == '\0')
+			break;
+
+	if (p < end)
+		(void) pg_verifymbstr(p, end - p, false);
+}
+
+/*
+ * Make a text, varchar or bpchar datum of len bytes of val, padded with
+ * spaces to padded bytes. The values of bound columns of these types
+ * have room for the varlena header in front of them (see bind_column),
+ * so the datum is finished in place there. It stays valid until the
+ * next row is fetched, the header overwrites the end of the previous
+ * value of the column.
+ */
+static Datum
+make_varlena(odbccol *c, char *val, SQLLEN len, SQLLEN padded)
+{
+	char	   *result;
+
+	if (c->varlena && padded <= c->buflen)
+		result = val - VARHDRSZ;
+	else
+	{
+		result = palloc(VARHDRSZ + padded);
+		memcpy(result + VARHDRSZ, val, len);
+	}
+	if (padded > len)
+		memset(result + VARHDRSZ + len, ' ', padded - len);
+	SET_VARSIZE(result, VARHDRSZ + padded);
+
+	return PointerGetDatum(result);
+}
+
+/* Bytes of the first maxlen characters of val, the rest must be spaces like in the input functions */
+static SQLLEN
+clip_string(char *val, SQLLEN len, int32 maxlen, const char *type)
+{
+	SQLLEN		mblen = pg_mbcharcliplen(val, len, maxlen);
+	SQLLEN		j;
+
+	for (j = mblen; j < len; j++)
+		if (val[j] != ' ')
+			ereport(ERROR,
+					(errcode(ERRCODE_STRING_DATA_RIGHT_TRUNCATION),
+						errmsg("value too long for type %s(%d)", type, maxlen)));
+
+	return mblen;
+}
+
+static Datum
+conv_char_bpchar(odbccol *c, char *val, SQLLEN len)
+{
+	int32		maxlen = c->typmod - VARHDRSZ;
+	SQLLEN		padded = len;
+
+	verify_string(val, len);
+
+	if (c->typmod >= (int32)VARHDRSZ)
+	{
+		int		charlen = pg_mbstrlen_with_len(val, len);
+
+		if (charlen > maxlen)
+			len = padded = clip_string(val, len, maxlen, "character");
+		else
+			padded = len + (maxlen - charlen);
+	}
+
+	return make_varlena(c, val, len, padded);
+}
+
+static Datum
+conv_char_varchar(odbccol *c, char *val, SQLLEN len)
+{
+	int32		maxlen = c->typmod - VARHDRSZ;
+
+	verify_string(val, len);
+
+	if (c->typmod >= (int32)VARHDRSZ && len > maxlen)
+		len = clip_string(val, len, maxlen, "character varying");
+
+	return make_varlena(c, val, len, len);
+}
+
+static Datum
+conv_char_text(odbccol *c, char *val, SQLLEN len)
+{
+	verify_string(val, len);
+
+	return make_varlena(c, val, len, len);
+}
+
+static void
+invalid_wchar(void)
+{
+	ereport(ERROR,
+			(errcode(ERRCODE_CHARACTER_NOT_IN_REPERTOIRE),
+				errmsg("odbclink: invalid wide character string from the data source")));
+}
+
+/*
+ * Transcode n SQLWCHARs of UTF-16, or UTF-32 where SQLWCHAR is 4 bytes,
+ * into UTF-8 at dst, which has room for 3 bytes a unit (4 for UTF-32).
+ * Runs of ASCII are copied 4 units at a time. Returns the bytes written.
+ */
+static Size
+wchar_to_utf8(const SQLWCHAR *src, Size n, char *dst)
+{
+	const SQLWCHAR *end = src + n;
+	unsigned char *p = (unsigned char *)dst;
+
+	while (src < end)
+	{
+		uint32		u;
+
+		if (sizeof(SQLWCHAR) == 2)
+		{
+			for (; src + 4 <= end; src += 4, p += 4)
+			{
+				uint64		w;
+
+				memcpy(&w, src, sizeof(uint64));
+				if ((w & UINT64CONST(0xFF80FF80FF80FF80)) ||
+						((w - UINT64CONST(0x0001000100010001)) & ~w & UINT64CONST(0x8000800080008000)))
+					break;
+				p[0] = (unsigned char)src[0];
+				p[1] = (unsigned char)src[1];
+				p[2] = (unsigned char)src[2];
+				p[3] = (unsigned char)src[3];
+			}
+			if (src == end)
+				break;
+		}
+
+		u = *src++;
+		if (u == 0)
+			invalid_wchar();
+		if (u < 0x80)
+		{
+			*p++ = u;
+			continue;
+		}
+		if (sizeof(SQLWCHAR) == 2 && u >= 0xD800 && u <= 0xDFFF)
+		{
+			/* a high surrogate followed by a low one */
+			if (u >= 0xDC00 || src == end || *src < 0xDC00 || *src > 0xDFFF)
+				invalid_wchar();
+			u = 0x10000 + ((u - 0xD800) << 10) + (*src++ - 0xDC00);
+		}
+		else if (u > 0x10FFFF || (u >= 0xD800 && u <= 0xDFFF))
+			invalid_wchar();
+
+		if (u < 0x800)
+		{
+			p[0] = 0xC0 | (u >> 6);
+			p[1] = 0x80 | (u & 0x3F);
+			p += 2;
+		}
+		else if (u < 0x10000)
+		{
+			p[0] = 0xE0 | (u >> 12);
+			p[1] = 0x80 | ((u >> 6) & 0x3F);
+			p[2] = 0x80 | (u & 0x3F);
+			p += 3;
+		}
+		else
+		{
+			p[0] = 0xF0 | (u >> 18);
+			p[1] = 0x80 | ((u >> 12) & 0x3F);
+			p[2] = 0x80 | ((u >> 6) & 0x3F);
+			p[3] = 0x80 | (u & 0x3F);
+			p += 4;
+		}
+	}
+
+	return (char *)p - dst;
+}
+
+/*
+ * Convert an SQL_C_WCHAR value: transcode it into UTF-8 and from there
+ * into the server encoding, then hand it to the string converter of the
+ * column. A text value in a UTF-8 database is finished where it's
+ * transcoded, it's valid by construction.
+ */
+static Datum
+conv_wchar(odbccol *c, char *val, SQLLEN len)
+{
+	Size		n = len / sizeof(SQLWCHAR);
+	char	   *result, *str;
+	Size		size;
+
+	result = palloc(VARHDRSZ + n * (sizeof(SQLWCHAR) == 2 ? 3 : 4) + 1);
+	str = result + VARHDRSZ;
+	size = wchar_to_utf8((const SQLWCHAR *)val, n, str);
+	str[size] = '\0';
+
+	if (GetDatabaseEncoding() == PG_UTF8)
+	{
+		if (c->charconv == conv_char_text)
+		{
+			SET_VARSIZE(result, VARHDRSZ + size);
+			return PointerGetDatum(result);
+		}
+	}
+	else
+	{
+		char	   *conv = (char *)pg_do_encoding_conversion((unsigned char *)str, size,
+						PG_UTF8, GetDatabaseEncoding());
+
+		if (conv != str)
+		{
+			str = conv;
+			size = strlen(conv);
+		}
+	}
+
+	return c->charconv(c, str, size);
+}
+
+static Datum
+conv_char_numeric(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall3(numeric_in, CStringGetDatum(val), ObjectIdGetDatum(c->typeoid), Int32GetDatum(c->typmod));
+}
+
+static Datum
+conv_char_date(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall1(date_in, CStringGetDatum(val));
+}
+
+static Datum
+conv_char_time(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall1(time_in, CStringGetDatum(val));
+}
+
+static Datum
+conv_char_timetz(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall1(timetz_in, CStringGetDatum(val));
+}
+
+static Datum
+conv_char_timestamp(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall3(timestamp_in, CStringGetDatum(val), ObjectIdGetDatum(c->typeoid), Int32GetDatum(c->typmod));
+}
+
+static Datum
+conv_char_timestamptz(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall3(timestamptz_in, CStringGetDatum(val), ObjectIdGetDatum(c->typeoid), Int32GetDatum(c->typmod));
+}
+
+/*
+ * Date and time values are fetched in the ODBC structs
+ * and converted without formatting and parsing them as text.
+ */
+static bool
+valid_date(int year, int month, int day)
+{
+	return (month >= 1 && month <= 12 && day >= 1 &&
+			day <= day_tab[isleap(year)][month - 1]);
+}
+
+/* 24:00:00 is allowed as the end of the day, as by the date/time input */
+static bool
+valid_time(int hour, int minute, int second, SQLUINTEGER fraction)
+{
+	return (hour >= 0 && minute >= 0 && minute < MINS_PER_HOUR &&
+			second >= 0 && second <= SECS_PER_MINUTE &&
+			(hour < HOURS_PER_DAY ||
+				(hour == HOURS_PER_DAY && minute == 0 && second == 0 && fraction == 0)));
+}
+
+static Datum
+conv_date_date(odbccol *c, char *val, SQLLEN len)
+{
+	DATE_STRUCT *d = (DATE_STRUCT *)val;
+
+	if (!valid_date(d->year, d->month, d->day) ||
+			!IS_VALID_JULIAN(d->year, d->month, d->day))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+					errmsg("date out of range: \"%d-%02d-%02d\"",
+						d->year, d->month, d->day)));
+
+	return DateADTGetDatum(date2j(d->year, d->month, d->day) - POSTGRES_EPOCH_JDATE);
+}
+
+static TimeADT
+odbc_time(TIME_STRUCT *t)
+{
+	if (!valid_time(t->hour, t->minute, t->second, 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+					errmsg("time out of range: \"%02d:%02d:%02d\"",
+						t->hour, t->minute, t->second)));
+
+#ifdef HAVE_INT64_TIMESTAMP
+	return (((int64)t->hour * MINS_PER_HOUR + t->minute) * SECS_PER_MINUTE + t->second) * USECS_PER_SEC;
+#else
+	return ((double)t->hour * MINS_PER_HOUR + t->minute) * SECS_PER_MINUTE + t->second;
+#endif
+}
+
+static Datum
+conv_time_time(odbccol *c, char *val, SQLLEN len)
+{
+	return TimeADTGetDatum(odbc_time((TIME_STRUCT *)val));
+}
+
+static Datum
+conv_time_timetz(odbccol *c, char *val, SQLLEN len)
+{
+	return DirectFunctionCall1(time_timetz, TimeADTGetDatum(odbc_time((TIME_STRUCT *)val)));
+}
+
+/*
+ * The fraction of ODBC timestamps is in nanoseconds,
+ * round it to microseconds and then to the typmod precision.
+ */
+static int64
+fraction_usecs(SQLUINTEGER fraction, int32 typmod)
+{
+	int64		usecs = ((int64)fraction + 500) / 1000;
+
+	if (typmod >= 0 && typmod < MAX_TIMESTAMP_PRECISION)
+	{
+		int64	scale = 1;
+		int	i;
+
+		for (i = typmod; i < MAX_TIMESTAMP_PRECISION; i++)
+			scale *= 10;
+		usecs = ((usecs + scale / 2) / scale) * scale;
+	}
+
+	return usecs;
+}
+
+static Timestamp
+odbc_timestamp(odbccol *c, TIMESTAMP_STRUCT *ts, bool withtz)
+{
+	struct pg_tm	tm;
+	int		tz = 0;
+	int64		usecs;
+	Timestamp	result;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = ts->year;
+	tm.tm_mon = ts->month;
+	tm.tm_mday = ts->day;
+	tm.tm_hour = ts->hour;
+	tm.tm_min = ts->minute;
+	tm.tm_sec = ts->second;
+
+	if (withtz)
+		tz = DetermineTimeZoneOffset(&tm, session_timezone);
+
+	if (!valid_date(ts->year, ts->month, ts->day) ||
+			!valid_time(ts->hour, ts->minute, ts->second, ts->fraction) ||
+			tm2timestamp(&tm, 0, withtz ? &tz : NULL, &result) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+					errmsg("timestamp out of range")));
+
+	/* rounding may carry over to the next second */
+	usecs = fraction_usecs(ts->fraction, c->typmod);
+#ifdef HAVE_INT64_TIMESTAMP
+	result += usecs;
+#else
+	result += (double)usecs / USECS_PER_SEC;
+#endif
+
+	return result;
+}
+
+static Datum
+conv_timestamp_timestamp(odbccol *c, char *val, SQLLEN len)
+{
+	return TimestampGetDatum(odbc_timestamp(c, (TIMESTAMP_STRUCT *)val, false));
+}
+
+static Datum
+conv_timestamp_timestamptz(odbccol *c, char *val, SQLLEN len)
+{
+	return TimestampTzGetDatum(odbc_timestamp(c, (TIMESTAMP_STRUCT *)val, true));
+}
+
+/* also used for strings fetched into bytea, the bytes are taken as is */
+static Datum
+conv_binary_bytea(odbccol *c, char *val, SQLLEN len)
+{
+	bytea	   *result = palloc(VARHDRSZ + len);
+
+	SET_VARSIZE(result, VARHDRSZ + len);
+	memcpy(VARDATA(result), val, len);
+
+	return PointerGetDatum(result);
+}
+
+/*
+ * Fetch a numeric/decimal column as text: digits, sign,
+ * decimal point and the terminating zero.
+ */
+static void
+plan_numeric_as_char(odbccol *c)
+{
+	c->ctype = SQL_C_CHAR;
+	c->buflen = (c->columnsz > 0 ? c->columnsz + 3 : 0);
+	c->conv = (c->typeoid == NUMERICOID ? conv_char_numeric : NULL);
+}
+
+/*
+ * Set up the conversion plan of a result column: the C type
+ * to fetch it as, the size of one value and the converter.
+ * Returns false if there's no conversion for the pair of types.
+ */
+static bool
+plan_column(odbccol *c, Oid typeoid, int32 typmod)
+{
+	c->typeoid = typeoid;
+	c->typmod = typmod;
+	c->conv = NULL;
+
+	switch (c->type)
+	{
+		case SQL_SMALLINT:
+			c->ctype = SQL_C_SSHORT;
+			c->buflen = sizeof(int16);
+			switch (typeoid)
+			{
+				case INT2OID:
+					c->conv = conv_sshort_int2;
+					break;
+				case INT4OID:
+					c->conv = conv_sshort_int4;
+					break;
+				case INT8OID:
+					c->conv = conv_sshort_int8;
+					break;
+			}
+			break;
+
+		case SQL_INTEGER:
+		case SQL_BIT:
+			c->ctype = SQL_C_SLONG;
+			c->buflen = sizeof(int32);
+			switch (typeoid)
+			{
+				case INT4OID:
+					c->conv = conv_slong_int4;
+					break;
+				case INT8OID:
+					c->conv = conv_slong_int8;
+					break;
+				case BOOLOID:
+					c->conv = conv_slong_bool;
+					break;
+			}
+			break;
+
+		case SQL_BIGINT:
+			c->ctype = SQL_C_SBIGINT;
+			c->buflen = sizeof(int64);
+			if (typeoid == INT8OID)
+				c->conv = conv_sbigint_int8;
+			break;
+
+		case SQL_FLOAT:
+		case SQL_REAL:
+			c->ctype = SQL_C_FLOAT;
+			c->buflen = sizeof(float);
+			if (typeoid == FLOAT4OID)
+				c->conv = conv_float_float4;
+			break;
+
+		case SQL_DOUBLE:
+			c->ctype = SQL_C_DOUBLE;
+			c->buflen = sizeof(double);
+			if (typeoid == FLOAT8OID)
+				c->conv = conv_double_float8;
+			break;
+
+		case SQL_NUMERIC:
+		case SQL_DECIMAL:
+			c->ctype = SQL_C_SBIGINT;
+			c->buflen = sizeof(int64);
+			switch (typeoid)
+			{
+				case INT2OID:
+					c->conv = conv_sbigint_int2;
+					break;
+				case INT4OID:
+					c->conv = conv_sbigint_int4;
+					break;
+				case INT8OID:
+					c->conv = conv_sbigint_int8;
+					break;
+				case NUMERICOID:
+					if (c->columnsz >= 1 && c->columnsz <= MAXNUMERICPREC &&
+							c->decimals >= 0 && c->decimals <= c->columnsz)
+					{
+						c->ctype = SQL_C_NUMERIC;
+						c->buflen = sizeof(SQL_NUMERIC_STRUCT);
+						c->conv = conv_numeric_numeric;
+						break;
+					}
+					/* fall through */
+				default:
+					plan_numeric_as_char(c);
+					break;
+			}
+			break;
+
+		case SQL_DATE:
+			c->ctype = SQL_C_DATE;
+			c->buflen = sizeof(DATE_STRUCT);
+			if (typeoid == DATEOID)
+				c->conv = conv_date_date;
+			break;
+
+		case SQL_TIME:
+			c->ctype = SQL_C_TIME;
+			c->buflen = sizeof(TIME_STRUCT);
+			switch (typeoid)
+			{
+				case TIMEOID:
+					c->conv = conv_time_time;
+					break;
+				case TIMETZOID:
+					c->conv = conv_time_timetz;
+					break;
+			}
+			break;
+
+		case SQL_TIMESTAMP:
+			c->ctype = SQL_C_TIMESTAMP;
+			c->buflen = sizeof(TIMESTAMP_STRUCT);
+			switch (typeoid)
+			{
+				case TIMESTAMPOID:
+					c->conv = conv_timestamp_timestamp;
+					break;
+				case TIMESTAMPTZOID:
+					c->conv = conv_timestamp_timestamptz;
+					break;
+			}
+			break;
+
+		case SQL_CHAR:
+		case SQL_VARCHAR:
+			c->ctype = SQL_C_CHAR;
+			c->buflen = (c->columnsz > 0 ? c->columnsz * pg_database_encoding_max_length() + 1 : 0);
+			break;
+
+		case SQL_BINARY:
+		case SQL_VARBINARY:
+		case SQL_LONGVARBINARY:
+			c->ctype = SQL_C_BINARY;
+			c->buflen = (c->type != SQL_LONGVARBINARY ? c->columnsz : 0);
+#if PG_VERSION_NUM >= 80500
+			if (typeoid == BYTEAOID)
+				c->conv = conv_binary_bytea;
+#endif
+			break;
+
+		case SQL_LONGVARCHAR:
+			c->ctype = SQL_C_CHAR;
+			c->buflen = 0;
+			break;
+
+		case SQL_WCHAR:
+		case SQL_WVARCHAR:
+			c->ctype = SQL_C_WCHAR;
+			c->buflen = (c->columnsz > 0 ? (c->columnsz + 1) * sizeof(SQLWCHAR) : 0);
+			break;
+
+		case SQL_WLONGVARCHAR:
+			c->ctype = SQL_C_WCHAR;
+			c->buflen = 0;
+			break;
+
+		default:
+			return false;
+	}
+
+	/* Everything fetched as a string goes through the type input functions */
+	if ((c->ctype == SQL_C_CHAR || c->ctype == SQL_C_WCHAR) && c->conv == NULL)
+		switch (typeoid)
+		{
+			case CHAROID:
+				c->conv = conv_char_char;
+				break;
+			case BPCHAROID:
+				c->conv = conv_char_bpchar;
+				break;
+			case VARCHAROID:
+				c->conv = conv_char_varchar;
+				break;
+			case TEXTOID:
+				c->conv = conv_char_text;
+				break;
+			case NUMERICOID:
+				c->conv = conv_char_numeric;
+				break;
+			case DATEOID:
+				c->conv = conv_char_date;
+				break;
+			case TIMEOID:
+				c->conv = conv_char_time;
+				break;
+			case TIMETZOID:
+				c->conv = conv_char_timetz;
+				break;
+			case TIMESTAMPOID:
+				c->conv = conv_char_timestamp;
+				break;
+			case TIMESTAMPTZOID:
+				c->conv = conv_char_timestamptz;
+				break;
+#if PG_VERSION_NUM >= 80500
+			case BYTEAOID:
+				c->conv = conv_binary_bytea;
+				break;
+#endif
+		}
+
+	/* wide strings are made into UTF-8 first */
+	if (c->ctype == SQL_C_WCHAR && c->conv != NULL)
+	{
+		c->charconv = c->conv;
+		c->conv = conv_wchar;
+	}
+
+	return (c->conv != NULL);
+}
+
+static bool
+compatTupleDescs(odbcstmt *stmt)
+{
+	TupleDesc	tupdesc = stmt->tupdesc;
+	SQLRETURN	ret;
+	int		col;
+	int		retval = true;
+
+	ret = SQLNumResultCols(stmt->hStmt, &stmt->cols);
+	if (!SQL_SUCCEEDED(ret))
+		return false;
+	if (tupdesc->natts != stmt->cols)
+		return false;
+
+	stmt->col = palloc0(stmt->cols * sizeof(odbccol));
+
+	for (col = 0; col < stmt->cols; col++)
+	{
+		char		colname[50];
+		SQLSMALLINT	colnamesz, type, decimals, nullable;
+		SQLULEN		columnsz;
+		Oid		typeoid = tupdesc->attrs[col]->atttypid;
+		int		typemod = tupdesc->attrs[col]->atttypmod;
+
+		ret = SQLDescribeCol(stmt->hStmt, col + 1,
+					(SQLCHAR *)colname, sizeof(colname), &colnamesz,
+					&type, &columnsz, &decimals, &nullable);
+
+		stmt->col[col].type = type;
+		stmt->col[col].columnsz = columnsz;
+		stmt->col[col].decimals = decimals;
+
+		switch (type)
+		{
+			case SQL_CHAR:
+			case SQL_VARCHAR:
+			case SQL_WCHAR:
+			case SQL_WVARCHAR:
+				if (typeoid != CHAROID && typeoid != BPCHAROID && typeoid != VARCHAROID && typeoid != TEXTOID)
+				{
+					if (typemod >= 1 && typemod < columnsz) /* maybe >= 0 ? */
+						retval = false;
+				}
+				break;
+
+			case SQL_LONGVARCHAR:
+			case SQL_WLONGVARCHAR:
+				if (typeoid != TEXTOID)
+					retval = false;
+				break;
+
+			case SQL_NUMERIC:
+			case SQL_DECIMAL:
+				if (typeoid != INT2OID && typeoid != INT4OID && typeoid != INT8OID && typeoid != NUMERICOID)
+					retval = false;
+				break;
+
+			case SQL_BIGINT:
+				if (typeoid != INT8OID)
+					retval = false;
+				break;
+
+			case SQL_INTEGER:
+				if (typeoid != INT4OID && typeoid != INT8OID)
+					retval = false;
+				break;
+			case SQL_SMALLINT:
+				if (typeoid != INT2OID && typeoid != INT4OID && typeoid != INT8OID)
+					retval = false;
+				break;
+
+			case SQL_FLOAT:
+			case SQL_REAL:
+				if (typeoid != FLOAT4OID)
+					retval = false;
+				break;
+
+			case SQL_DOUBLE:
+				if (typeoid != FLOAT8OID)
+					retval = false;
+				break;
+
+			case SQL_DATE:
+				if (typeoid != DATEOID)
+					retval = false;
+				break;
+
+			case SQL_TIME:
+				if (typeoid != TIMEOID && typeoid != TIMETZOID)
+					retval = false;
+				break;
+
+			case SQL_TIMESTAMP:
+				if (typeoid != TIMESTAMPOID && typeoid != TIMESTAMPTZOID)
+					retval = false;
+				break;
+
+			case SQL_BINARY:
+			case SQL_VARBINARY:
+			case SQL_LONGVARBINARY:
+#if PG_VERSION_NUM >= 80500
+				if (typeoid != BYTEAOID)
+#endif
+					retval = false;
+				break;
+
+			case SQL_BIT:
+				if (typeoid != BOOLOID)
+					retval = false;
+				break;
+		}
+		if (retval && !plan_column(&stmt->col[col], typeoid, typemod))
+			retval = false;
+		if (!retval)
+		{
+			elog(NOTICE, "field index %d input type from ODBC: %d output type for PG: %d", col, type, typeoid);
+			break;
+		}
+	}
+
+	return retval;
+}
+
+static void
+bind_column(odbcstmt *stmt, int col)
+{
+	odbccol	   *c = &stmt->col[col];
+	SQLRETURN	ret;
+
+	/*
+	 * String values made into varlenas get room for the header in
+	 * front of every value: one in front of the buffer and the end
+	 * of the previous value for the others, which stays aligned.
+	 */
+	c->varlena = (c->conv == conv_char_text || c->conv == conv_char_varchar ||
+			c->conv == conv_char_bpchar);
+	if (c->varlena)
+	{
+		c->buflen = INTALIGN(c->buflen + VARHDRSZ);
+		c->buf = (char *)palloc(VARHDRSZ + stmt->rowset * c->buflen) + VARHDRSZ;
+	}
+	else
+		c->buf = palloc(stmt->rowset * c->buflen);
+	c->ind = palloc(stmt->rowset * sizeof(SQLLEN));
+
+	ret = SQLBindCol(stmt->hStmt, col + 1, c->ctype, (SQLPOINTER)c->buf, c->buflen, c->ind);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+		free_stmt(stmt);
+		elog(ERROR, "odbclink: unsuccessful SQLBindCol call: %s", totalerrmsg);
+	}
+}
+
+/*
+ * Drivers fill SQL_NUMERIC_STRUCT with their default precision
+ * and scale (usually scale 0) unless they are set in the ARD record
+ * of the column. The data pointer must be set last, setting any other
+ * field unbinds the column. Returns false if the driver refuses it.
+ */
+bool
+set_numeric_desc(odbcstmt *stmt, int col)
+{
+	odbccol	   *c = &stmt->col[col];
+	SQLHDESC	hDesc;
+
+	if (!SQL_SUCCEEDED(SQLGetStmtAttr(stmt->hStmt, SQL_ATTR_APP_ROW_DESC, (SQLPOINTER)&hDesc, 0, NULL)))
+		return false;
+
+	if (!SQL_SUCCEEDED(SQLSetDescField(hDesc, col + 1, SQL_DESC_TYPE, (SQLPOINTER)SQL_C_NUMERIC, 0)) ||
+			!SQL_SUCCEEDED(SQLSetDescField(hDesc, col + 1, SQL_DESC_PRECISION, (SQLPOINTER)(SQLLEN)c->columnsz, 0)) ||
+			!SQL_SUCCEEDED(SQLSetDescField(hDesc, col + 1, SQL_DESC_SCALE, (SQLPOINTER)(SQLLEN)c->decimals, 0)) ||
+			!SQL_SUCCEEDED(SQLSetDescField(hDesc, col + 1, SQL_DESC_DATA_PTR, (SQLPOINTER)c->buf, 0)))
+		return false;
+
+	return true;
+}
+
+/*
+ * Size of the first SQLGetData() call of an unbound column: the whole
+ * value, with the terminator of a string, if the driver says it's not
+ * too long, otherwise a probe that reports the length of the rest,
+ * which is then read in one call.
+ */
+static Size
+first_chunk(odbccol *c)
+{
+	if (c->octetlen > 0 && c->octetlen < LOBFIRSTCHUNK)
+	{
+		if (c->ctype == SQL_C_BINARY)
+			return c->octetlen;
+		return c->octetlen + (c->ctype == SQL_C_WCHAR ? sizeof(SQLWCHAR) : 1);
+	}
+	return CHARVALCHUNK;
+}
+
+/*
+ * Set up block fetching: values of fixed size and reasonably short
+ * strings are bound to per-column buffers holding a whole rowset,
+ * LOBs and anything without a usable size are left to SQLGetData.
+ */
+static void
+bind_columns(odbcstmt *stmt)
+{
+	SQLRETURN	ret;
+	SQLUINTEGER	getdata_ext = 0;
+	int		col;
+	int		first_unbound = stmt->cols;
+
+	for (col = 0; col < stmt->cols; col++)
+	{
+		odbccol	   *c = &stmt->col[col];
+
+		c->bound = (c->buflen > 0 && c->buflen <= MAXBINDLEN);
+		if (!c->bound && first_unbound == stmt->cols)
+			first_unbound = col;
+	}
+
+	/*
+	 * Unless the driver says otherwise, SQLGetData() only works
+	 * for unbound columns after the last bound one and only with
+	 * single row fetches.
+	 */
+	if (first_unbound < stmt->cols)
+	{
+		stmt->unbound = true;
+
+		ret = SQLGetInfo(conns[stmt->conn_idx].hCon, SQL_GETDATA_EXTENSIONS,
+					(SQLPOINTER)&getdata_ext, sizeof(getdata_ext), NULL);
+		if (!SQL_SUCCEEDED(ret))
+			getdata_ext = 0;
+
+		if (!(getdata_ext & SQL_GD_ANY_COLUMN))
+			for (col = first_unbound; col < stmt->cols; col++)
+				stmt->col[col].bound = false;
+	}
+
+	stmt->rowset = fetch_size;
+	if (stmt->unbound && !(getdata_ext & SQL_GD_BLOCK))
+		stmt->rowset = 1;
+
+	if (stmt->rowset > 1)
+	{
+		ret = SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)stmt->rowset, 0);
+		if (ret == SQL_SUCCESS_WITH_INFO)
+		{
+			/* the driver substituted a value of its own */
+			ret = SQLGetStmtAttr(stmt->hStmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)&stmt->rowset, 0, NULL);
+			if (!SQL_SUCCEEDED(ret) || stmt->rowset < 1)
+				stmt->rowset = 1;
+		}
+		else if (!SQL_SUCCEEDED(ret))
+			stmt->rowset = 1;
+	}
+
+	stmt->nrows = 0;
+	stmt->currow = 0;
+	stmt->rowstatus = palloc0(stmt->rowset * sizeof(SQLUSMALLINT));
+
+	SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROWS_FETCHED_PTR, (SQLPOINTER)&stmt->nrows, 0);
+	SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROW_STATUS_PTR, (SQLPOINTER)stmt->rowstatus, 0);
+
+	for (col = 0; col < stmt->cols; col++)
+	{
+		odbccol	   *c = &stmt->col[col];
+
+		if (!c->bound)
+		{
+			/* SQL_C_NUMERIC needs the precision and scale set in the ARD */
+			if (c->ctype == SQL_C_NUMERIC)
+				plan_numeric_as_char(c);
+
+			/* fixed size values read with SQLGetData still need a place */
+			if (c->ctype != SQL_C_CHAR && c->ctype != SQL_C_WCHAR && c->ctype != SQL_C_BINARY)
+			{
+				c->buf = palloc(c->buflen);
+				continue;
+			}
+
+			/* the first SQLGetData() call is sized from the octet length */
+			if (!SQL_SUCCEEDED(SQLColAttribute(stmt->hStmt, col + 1, SQL_DESC_OCTET_LENGTH,
+							NULL, 0, NULL, &c->octetlen)) || c->octetlen < 0)
+				c->octetlen = 0;
+
+			/* the string buffer takes the first chunk of any unbound string column */
+			if (c->ctype != SQL_C_BINARY)
+			{
+				Size		first = first_chunk(c);
+
+				if (stmt->charbuf == NULL)
+				{
+					stmt->charbuf = palloc(first);
+					stmt->charbuflen = first;
+				}
+				else if (stmt->charbuflen < first)
+				{
+					stmt->charbuf = repalloc(stmt->charbuf, first);
+					stmt->charbuflen = first;
+				}
+			}
+			continue;
+		}
+
+		bind_column(stmt, col);
+
+		if (c->ctype == SQL_C_NUMERIC && !set_numeric_desc(stmt, col))
+		{
+			plan_numeric_as_char(c);
+			bind_column(stmt, col);
+		}
+	}
+
+	/* the rows are converted into the same buffers and row context */
+	stmt->values = palloc(stmt->cols * sizeof(Datum));
+	stmt->nulls = palloc(stmt->cols * sizeof(bool));
+	stmt->rowcxt = AllocSetContextCreate(CurrentMemoryContext,
+					"odbclink row context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+/*
+ * Read the rest of a long string value straight into a text value,
+ * so it isn't held twice. The first pos bytes are in the string buffer,
+ * remain is the length of the rest if the driver reported it, or -1.
+ */
+static text *
+get_text_rest(odbcstmt *stmt, int col, Size pos, SQLLEN remain)
+{
+	SQLRETURN	ret;
+	SQLLEN		size_ind;
+	Size		alloc, avail;
+	text	   *result;
+
+	alloc = VARHDRSZ + pos + (remain >= 0 ? remain : pos) + 1;
+	if (!AllocSizeIsValid(alloc))
+		elog(ERROR, "odbclink: string value in column %d is too large", col);
+	result = palloc(alloc);
+	memcpy(VARDATA(result), stmt->charbuf, pos);
+
+	for (;;)
+	{
+		avail = alloc - VARHDRSZ - pos;
+		ret = SQLGetData(stmt->hStmt, col, SQL_C_CHAR, VARDATA(result) + pos, avail, &size_ind);
+		if (ret == SQL_NO_DATA)
+			break;
+		if (!SQL_SUCCEEDED(ret))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
+		}
+		if (size_ind != SQL_NO_TOTAL && size_ind < avail)
+		{
+			pos += size_ind;
+			break;
+		}
+
+		pos += avail - 1;
+		if (size_ind != SQL_NO_TOTAL)
+			alloc = VARHDRSZ + pos + (size_ind - (avail - 1)) + 1;
+		else
+			alloc = 2 * alloc;
+		if (!AllocSizeIsValid(alloc))
+			elog(ERROR, "odbclink: string value in column %d is too large", col);
+		result = repalloc(result, alloc);
+	}
+
+	SET_VARSIZE(result, VARHDRSZ + pos);
+	verify_string(VARDATA(result), pos);
+
+	return result;
+}
+
+/*
+ * Read a string value into the string buffer of the statement, in pieces
+ * if it's long. The buffer is grown to the reported length of the value,
+ * or doubled if the driver doesn't know it, and kept for the next values,
+ * the value is valid until the next call. Wide strings are read whole
+ * characters at a time. If direct is given, values longer than
+ * odbclink.lob_direct_size are read into a text value returned there
+ * instead.
+ */
+static SQLRETURN
+get_char_data(odbcstmt *stmt, int col, char **value, int *length, text **direct, bool *isnull)
+{
+	SQLSMALLINT	ctype = stmt->col[col - 1].ctype;
+	Size		term = (ctype == SQL_C_WCHAR ? sizeof(SQLWCHAR) : 1);
+	SQLRETURN	ret;
+	SQLLEN		size_ind = 0;
+	Size		pos = 0, avail, alloc;
+
+	if (direct)
+		*direct = NULL;
+
+	for (;;)
+	{
+		avail = stmt->charbuflen - pos;
+		avail -= avail % term;
+		ret = SQLGetData(stmt->hStmt, col, ctype, stmt->charbuf + pos, avail, &size_ind);
+		if (ret == SQL_NO_DATA)
+			break;
+		if (!SQL_SUCCEEDED(ret))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
+		}
+		if (size_ind == SQL_NULL_DATA)
+			break;
+		if (size_ind != SQL_NO_TOTAL && size_ind + term <= avail)
+		{
+			pos += size_ind;
+			break;
+		}
+
+		/* the buffer was filled but the terminating zero, size_ind is what was left before this call */
+		pos += avail - term;
+
+		if (direct && lob_direct_size >= 0 &&
+				pos + (size_ind != SQL_NO_TOTAL ? size_ind - (avail - term) : 0) > (Size)lob_direct_size * 1024)
+		{
+			*direct = get_text_rest(stmt, col, pos,
+					(size_ind != SQL_NO_TOTAL ? size_ind - (avail - term) : -1));
+			*isnull = false;
+			return SQL_SUCCESS;
+		}
+
+		alloc = 2 * stmt->charbuflen;
+		if (size_ind != SQL_NO_TOTAL && alloc < pos + (size_ind - (avail - term)) + term)
+			alloc = pos + (size_ind - (avail - term)) + term;
+		if (!AllocSizeIsValid(alloc))
+			elog(ERROR, "odbclink: string value in column %d is too large", col);
+		stmt->charbuf = repalloc(stmt->charbuf, alloc);
+		stmt->charbuflen = alloc;
+	}
+	stmt->charbuf[pos] = '\0';
+
+	if (value)
+		*value = stmt->charbuf;
+	if (length)
+		*length = pos;
+	if (isnull)
+		*isnull = (size_ind == SQL_NULL_DATA);
+	return ret;
+}
+
+/*
+ * Read a binary value with SQLGetData directly into a bytea,
+ * starting with the column size if it's reasonable and growing
+ * the buffer to the remaining length reported by the driver,
+ * or doubling it if the driver can't tell.
+ */
+static bytea *
+get_binary_data(odbcstmt *stmt, int col, bool *isnull)
+{
+	odbccol	   *c = &stmt->col[col - 1];
+	SQLRETURN	ret;
+	SQLLEN		size_ind;
+	Size		alloc, pos = 0, avail;
+	bytea	   *result;
+
+	alloc = VARHDRSZ + first_chunk(c);
+	result = palloc(alloc);
+
+	*isnull = false;
+	for (;;)
+	{
+		avail = alloc - VARHDRSZ - pos;
+		ret = SQLGetData(stmt->hStmt, col, SQL_C_BINARY,
+				(SQLPOINTER)(VARDATA(result) + pos), avail, &size_ind);
+		if (ret == SQL_NO_DATA)
+			break;
+		if (!SQL_SUCCEEDED(ret))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
+		}
+		if (size_ind == SQL_NULL_DATA)
+		{
+			*isnull = true;
+			pfree(result);
+			return NULL;
+		}
+		if (size_ind != SQL_NO_TOTAL && size_ind <= avail)
+		{
+			pos += size_ind;
+			break;
+		}
+
+		/* the buffer was filled, size_ind is what was left before this call */
+		pos += avail;
+		if (size_ind != SQL_NO_TOTAL)
+			alloc = VARHDRSZ + pos + (size_ind - avail);
+		else
+			alloc = 2 * alloc;
+		if (!AllocSizeIsValid(alloc))
+			elog(ERROR, "odbclink: binary value in column %d is too large", col);
+		result = repalloc(result, alloc);
+	}
+
+	SET_VARSIZE(result, VARHDRSZ + pos);
+
+	return result;
+}
+
+/*
+ * Get the value of a column in the given row of the current rowset
+ * and convert it with the converter chosen by plan_column().
+ */
+static void
+get_data(odbcstmt *stmt, int col, SQLULEN row, Datum *value, bool *isnull)
+{
+	SQLRETURN	ret;
+	odbccol	   *c = &stmt->col[col - 1];
+	odbcstats  *stats = &conns[stmt->conn_idx].stats;
+	instr_time	start;
+	char	   *val;
+	int		len;
+	SQLLEN		size_ind;
+
+	if (c->bound)
+	{
+		val = c->buf + row * c->buflen;
+		size_ind = c->ind[row];
+		if (size_ind != SQL_NULL_DATA &&
+				(((c->ctype == SQL_C_CHAR || c->ctype == SQL_C_WCHAR) &&
+					(size_ind == SQL_NO_TOTAL || size_ind >= c->buflen)) ||
+				(c->ctype == SQL_C_BINARY && (size_ind == SQL_NO_TOTAL || size_ind > c->buflen))))
+			elog(ERROR, "odbclink: value of column %d does not fit into the fetch buffer", col);
+	}
+	else if (c->ctype == SQL_C_BINARY)
+	{
+		/* read straight into the bytea, no conversion needed */
+		bytea	   *bin_val;
+
+		start_timing(&start);
+		bin_val = get_binary_data(stmt, col, isnull);
+		end_timing(&stats->fetch_time, &start);
+
+		if (!*isnull)
+		{
+			stats->bytes += VARSIZE(bin_val) - VARHDRSZ;
+			stmt->track.bytes += VARSIZE(bin_val) - VARHDRSZ;
+			*value = PointerGetDatum(bin_val);
+		}
+		return;
+	}
+	else if (c->ctype == SQL_C_CHAR || c->ctype == SQL_C_WCHAR)
+	{
+		text	   *direct;
+
+		/* long text values may be read into the result directly */
+		start_timing(&start);
+		get_char_data(stmt, col, &val, &len,
+				(c->conv == conv_char_text ? &direct : NULL), isnull);
+		end_timing(&stats->fetch_time, &start);
+
+		if (c->conv == conv_char_text && direct)
+		{
+			stats->bytes += VARSIZE(direct) - VARHDRSZ;
+			stmt->track.bytes += VARSIZE(direct) - VARHDRSZ;
+			*value = PointerGetDatum(direct);
+		}
+		else if (!*isnull)
+		{
+			stats->bytes += len;
+			stmt->track.bytes += len;
+			start_timing(&start);
+			*value = c->conv(c, val, len);
+			end_timing(&stats->conv_time, &start);
+		}
+		return;
+	}
+	else
+	{
+		start_timing(&start);
+		ret = SQLGetData(stmt->hStmt, col, c->ctype,
+				(SQLPOINTER)c->buf, c->buflen, &size_ind);
+		end_timing(&stats->fetch_time, &start);
+		if (!SQL_SUCCEEDED(ret))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
+		}
+		val = c->buf;
+	}
+
+	*isnull = (size_ind == SQL_NULL_DATA);
+	if (!*isnull)
+	{
+		stats->bytes += size_ind;
+		stmt->track.bytes += size_ind;
+		start_timing(&start);
+		*value = c->conv(c, val, size_ind);
+		end_timing(&stats->conv_time, &start);
+	}
+}
+
+/*
+ * Allocate a statement on connection i for fetching rows of tupdesc,
+ * the statement and its buffers are allocated in the current memory context.
+ */
+static odbcstmt *
+alloc_query(int i, TupleDesc tupdesc)
+{
+	SQLRETURN	ret;
+	odbcstmt	   *stmt;
+
+	stmt = palloc0(sizeof(odbcstmt));
+	stmt->conn_idx = i;
+	stmt->tupdesc = tupdesc;
+
+	/*
+	 * The allocated statement handle is the only thing
+	 * that must be freed manually. All the other allocations
+	 * are dealt by PostgreSQL's garbage collection.
+	 */
+	ret = SQLAllocStmt(conns[i].hCon, &stmt->hStmt);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+	}
+
+	return stmt;
+}
+
+/* Check the columns of the executed query and bind them */
+static void
+setup_query(odbcstmt *stmt)
+{
+	/*
+	 * Check that return tupdesc is compatible with the data we got from SPI,
+	 * at least based on number and type of attributes
+	 */
+	if (!compatTupleDescs(stmt))
+	{
+		free_stmt(stmt);
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+					errmsg("return and sql tuple descriptions are " \
+						"incompatible")));
+	}
+
+	bind_columns(stmt);
+}
+
+/*
+ * Poll a statement started asynchronously until it's done. If the backend
+ * is interrupted meanwhile, e.g. by statement_timeout or pg_cancel_backend(),
+ * the remote statement is cancelled and freed.
+ */
+static SQLRETURN
+wait_stmt(odbcstmt *stmt, char *query)
+{
+	volatile SQLRETURN	ret = SQL_STILL_EXECUTING;
+	long		delay = 0;
+
+	PG_TRY();
+	{
+		while (ret == SQL_STILL_EXECUTING)
+		{
+			CHECK_FOR_INTERRUPTS();
+			/* in a pool worker the backend waiting for the result may give up */
+			if (pool_cancel_requested())
+				ereport(ERROR,
+						(errcode(ERRCODE_QUERY_CANCELED),
+							errmsg("odbclink: the request was cancelled by the backend")));
+			/* short statements are seen done at once, long ones polled less often */
+			if (delay > 0)
+				pg_usleep(delay);
+			delay = next_poll_delay(delay);
+
+			/* polling repeats the original call */
+			ret = run_stmt(stmt->hStmt, query);
+		}
+	}
+	PG_CATCH();
+	{
+		if (!cancel_stmt(stmt->hStmt, query, true))
+			elog(WARNING, "odbclink: the query on connection %d could not be cancelled", stmt->conn_idx + 1);
+		free_stmt(stmt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	return ret;
+}
+
+/*
+ * Get a statement ready to be executed on its connection. Returns
+ * whether it runs asynchronously, so the wait for the remote side
+ * can be interrupted.
+ */
+static bool
+begin_exec(odbcstmt *stmt)
+{
+	/* the driver can't run another statement meanwhile */
+	if (conns[stmt->conn_idx].pending)
+	{
+		free_stmt(stmt);
+		elog(ERROR, "odbclink: another query is already running on connection %d", stmt->conn_idx + 1);
+	}
+
+	remote_xact_use(stmt->conn_idx);
+	set_query_timeout(stmt->hStmt);
+
+	return SQL_SUCCEEDED(SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ASYNC_ENABLE,
+				(SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0));
+}
+
+/* The statement begun by begin_exec() at start is executed */
+static void
+end_exec(odbcstmt *stmt, bool async, instr_time *start)
+{
+	end_timing(&conns[stmt->conn_idx].stats.exec_time, start);
+	executed_stmt(stmt);
+
+	if (async)
+		SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ASYNC_ENABLE,
+				(SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+}
+
+/* Execute a statement, asynchronously if the driver can */
+static SQLRETURN
+exec_stmt(odbcstmt *stmt, char *query)
+{
+	SQLRETURN	ret;
+	bool		async;
+	instr_time	start;
+
+	async = begin_exec(stmt);
+
+	start_timing(&start);
+	ret = run_stmt(stmt->hStmt, query);
+	if (ret == SQL_STILL_EXECUTING)
+		ret = wait_stmt(stmt, query);
+	end_exec(stmt, async, &start);
+
+	return ret;
+}
+
+/* Execute the query and set up the statement for fetching rows of tupdesc */
+odbcstmt *
+open_query(int i, char *query, TupleDesc tupdesc)
+{
+	SQLRETURN	ret;
+	odbcstmt	   *stmt;
+
+	stmt = alloc_query(i, tupdesc);
+
+	conns[i].stats.queries++;
+	if (stmt_stats_enabled())
+		track_stmt(stmt, pstrdup(query));
+	ret = exec_stmt(stmt, query);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_STMT, stmt);
+		free_stmt(stmt);
+		elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+	}
+
+	setup_query(stmt);
+	prefetch_start(stmt);
+
+	return stmt;
+}
+
+/*
+ * Prepare query on connection i and describe its parameters,
+ * the entry is allocated in the current memory context.
+ */
+static odbcprep *
+prepare_query(int i, char *query)
+{
+	SQLRETURN	ret;
+	SQLUSMALLINT	describe = SQL_FALSE;
+	odbcprep   *p;
+	odbcstmt	stmt;
+	int		k;
+
+	p = palloc0(sizeof(odbcprep));
+	p->query = pstrdup(query);
+	p->cxt = CurrentMemoryContext;
+
+	stmt.conn_idx = i;
+	ret = SQLAllocStmt(conns[i].hCon, &stmt.hStmt);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+	}
+
+	ret = SQLPrepare(stmt.hStmt, (SQLCHAR *)query, SQL_NTS);
+	if (SQL_SUCCEEDED(ret))
+		ret = SQLNumParams(stmt.hStmt, &p->nparams);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+		elog(ERROR, "odbclink: unsuccessful SQLPrepare call: %s", totalerrmsg);
+	}
+	p->hStmt = stmt.hStmt;
+
+	p->paramtype = palloc(Max(p->nparams, 1) * sizeof(SQLSMALLINT));
+	p->paramsize = palloc(Max(p->nparams, 1) * sizeof(SQLULEN));
+	p->paramdigits = palloc(Max(p->nparams, 1) * sizeof(SQLSMALLINT));
+
+	/* the values are passed as strings, the driver converts them */
+	SQLGetFunctions(conns[i].hCon, SQL_API_SQLDESCRIBEPARAM, &describe);
+	p->described = (describe == SQL_TRUE && p->nparams > 0);
+	for (k = 0; k < p->nparams; k++)
+	{
+		SQLSMALLINT	nullable;
+
+		if (describe != SQL_TRUE ||
+				!SQL_SUCCEEDED(SQLDescribeParam(p->hStmt, k + 1, &p->paramtype[k],
+						&p->paramsize[k], &p->paramdigits[k], &nullable)))
+		{
+			p->paramtype[k] = SQL_VARCHAR;
+			p->paramsize[k] = 0;
+			p->paramdigits[k] = 0;
+		}
+	}
+
+	return p;
+}
+
+/*
+ * Look up query in the prepared statement cache of connection i,
+ * preparing it if it's not there. The most recently used entries
+ * are kept, up to odbclink.prepared_cache_size. If the cached one
+ * has an open cursor in this transaction (e.g. the same query is
+ * nested in itself), a one-off statement is returned instead.
+ */
+static odbcprep *
+get_prepared(int i, char *query)
+{
+	odbcprep   *p, *prev;
+	MemoryContext	cxt, oldcontext;
+
+	for (p = conns[i].prepared, prev = NULL; p; prev = p, p = p->next)
+		if (strcmp(p->query, query) == 0)
+			break;
+
+	if (p)
+	{
+		if (p->stmt && p->stmt->hStmt != SQL_NULL_HSTMT && p->lxid == MyProc->lxid)
+			return prepare_query(i, query);
+
+		/* move it to the front */
+		if (prev)
+		{
+			prev->next = p->next;
+			p->next = conns[i].prepared;
+			conns[i].prepared = p;
+		}
+
+		/* a cursor left open by an aborted transaction */
+		SQLFreeStmt(p->hStmt, SQL_CLOSE);
+		if (p->stmt)
+			p->stmt->hStmt = SQL_NULL_HSTMT;
+
+		return p;
+	}
+
+	if (prepared_cache_size == 0)
+		return prepare_query(i, query);
+
+	cxt = AllocSetContextCreate(TopMemoryContext,
+					"odbclink prepared statement",
+					ALLOCSET_SMALL_MINSIZE,
+					ALLOCSET_SMALL_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+	oldcontext = MemoryContextSwitchTo(cxt);
+	PG_TRY();
+	{
+		p = prepare_query(i, query);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		MemoryContextDelete(cxt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	p->cached = true;
+	p->plancxt = AllocSetContextCreate(cxt,
+					"odbclink column plan",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+	MemoryContextSwitchTo(oldcontext);
+
+	p->next = conns[i].prepared;
+	conns[i].prepared = p;
+	conns[i].nprepared++;
+
+	/* Evict the least recently used entries that have no open cursor */
+	while (conns[i].nprepared > prepared_cache_size)
+	{
+		odbcprep   *victim = NULL, *victimprev = NULL;
+		odbcprep   *q;
+
+		for (q = conns[i].prepared->next, prev = conns[i].prepared; q; prev = q, q = q->next)
+			if (!(q->stmt && q->stmt->hStmt != SQL_NULL_HSTMT && q->lxid == MyProc->lxid))
+			{
+				victim = q;
+				victimprev = prev;
+			}
+		if (victim == NULL)
+			break;
+
+		victimprev->next = victim->next;
+		conns[i].nprepared--;
+		free_prepared(victim);
+	}
+
+	return p;
+}
+
+/* Bind the elements of a text array as the parameters of p */
+static void
+bind_params(int i, odbcprep *p, ArrayType *params)
+{
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int		nelems, k;
+	SQLLEN	   *ind;
+
+	deconstruct_array(params, TEXTOID, -1, false, 'i', &elems, &elemnulls, &nelems);
+	if (nelems != p->nparams)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("odbclink: the query has %d parameters but %d were given",
+						p->nparams, nelems)));
+
+	/* must stay valid until SQLExecute() */
+	ind = palloc(Max(nelems, 1) * sizeof(SQLLEN));
+
+	for (k = 0; k < nelems; k++)
+	{
+		char	   *val = NULL;
+		SQLULEN		size = p->paramsize[k];
+		SQLRETURN	ret;
+
+		if (elemnulls[k])
+			ind[k] = SQL_NULL_DATA;
+		else
+		{
+			val = TextDatumGetCString(elems[k]);
+			ind[k] = strlen(val);
+		}
+		if (size == 0)
+			size = (ind[k] > 0 ? ind[k] : 1);
+
+		ret = SQLBindParameter(p->hStmt, k + 1, SQL_PARAM_INPUT, SQL_C_CHAR,
+					p->paramtype[k], size, p->paramdigits[k],
+					val, (val ? ind[k] + 1 : 0), &ind[k]);
+		if (!SQL_SUCCEEDED(ret))
+		{
+			odbcstmt	stmt;
+
+			stmt.hStmt = p->hStmt;
+			get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLBindParameter call: %s", totalerrmsg);
+		}
+	}
+}
+
+/*
+ * Execute a prepared query with the given parameters and set up
+ * the statement for fetching rows of tupdesc. Without tupdesc the
+ * result is discarded and NULL is returned. The column plan of
+ * a cached statement is reused as long as tupdesc is the same.
+ */
+static odbcstmt *
+exec_prepared(int i, char *query, ArrayType *params, TupleDesc tupdesc)
+{
+	odbcprep   *p;
+	odbcstmt   *stmt;
+	odbcstmt	execstmt;
+	SQLRETURN	ret;
+
+	p = get_prepared(i, query);
+
+	PG_TRY();
+	{
+		bind_params(i, p, params);
+
+		/* an interrupted execution only closes the cursor, p is freed below */
+		memset(&execstmt, 0, sizeof(odbcstmt));
+		execstmt.conn_idx = i;
+		execstmt.hStmt = p->hStmt;
+		execstmt.cached = true;
+
+		if (tupdesc)
+			conns[i].stats.queries++;
+		else
+			conns[i].stats.executes++;
+		track_stmt(&execstmt, p->query);
+		ret = exec_stmt(&execstmt, NULL);
+		if (!SQL_SUCCEEDED(ret) && ret != SQL_NO_DATA)
+		{
+			get_sql_error(i, SQL_HANDLE_STMT, &execstmt);
+			elog(ERROR, "odbclink: unsuccessful SQLExecute call: %s", totalerrmsg);
+		}
+	}
+	PG_CATCH();
+	{
+		if (!p->cached)
+			free_prepared(p);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (tupdesc == NULL)
+	{
+		finish_stmt(&execstmt);
+		if (p->cached)
+			SQLFreeStmt(p->hStmt, SQL_CLOSE);
+		else
+			free_prepared(p);
+		flush_stats(i);
+		return NULL;
+	}
+
+	if (!p->cached)
+	{
+		stmt = palloc0(sizeof(odbcstmt));
+		stmt->conn_idx = i;
+		stmt->tupdesc = tupdesc;
+		stmt->hStmt = p->hStmt;
+		setup_query(stmt);
+		prefetch_start(stmt);
+		/* p isn't kept, the query text must live as long as stmt */
+		stmt->track = execstmt.track;
+		if (stmt->track.query)
+			stmt->track.query = pstrdup(query);
+		return stmt;
+	}
+
+	/* the buffers of a prefetched plan went with its prefetch ring */
+	if (p->stmt == NULL || p->stmt->prefetched || !equalTupleDescs(p->stmt->tupdesc, tupdesc))
+	{
+		MemoryContext	oldcontext;
+
+		if (p->stmt)
+		{
+			SQLFreeStmt(p->hStmt, SQL_UNBIND);
+			if (p->stmt->prefetched)
+				SQLSetStmtAttr(p->hStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, NULL, 0);
+			p->stmt = NULL;
+		}
+		MemoryContextReset(p->plancxt);
+
+		oldcontext = MemoryContextSwitchTo(p->plancxt);
+		stmt = palloc0(sizeof(odbcstmt));
+		stmt->conn_idx = i;
+		stmt->tupdesc = CreateTupleDescCopy(tupdesc);
+		stmt->hStmt = p->hStmt;
+		stmt->cached = true;
+		setup_query(stmt);
+		MemoryContextSwitchTo(oldcontext);
+
+		p->stmt = stmt;
+	}
+	else
+	{
+		stmt = p->stmt;
+		stmt->hStmt = p->hStmt;
+		stmt->nrows = 0;
+		stmt->currow = 0;
+	}
+	stmt->track = execstmt.track;
+	p->lxid = MyProc->lxid;
+
+	/* the thread is stopped at the end of the query, the plan outlives it */
+	prefetch_start(stmt);
+
+	return stmt;
+}
+
+static TupleDesc
+result_desc(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+
+	/* get a tuple descriptor for our result type */
+	switch (get_call_result_type(fcinfo, NULL, &tupdesc))
+	{
+		case TYPEFUNC_COMPOSITE:
+			/* success */
+			break;
+		case TYPEFUNC_RECORD:
+			/* failed to determine actual type of RECORD */
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("function returning record called in context "
+							"that cannot accept type record")));
+			break;
+		default:
+			/* result type isn't composite */
+			elog(ERROR, "return type must be a row type");
+			break;
+	}
+
+	return tupdesc;
+}
+
+/* Run the query, a prepared one if there are parameters */
+static odbcstmt *
+start_query(PG_FUNCTION_ARGS, int i, char *query, ArrayType *params)
+{
+	if (params)
+		return exec_prepared(i, query, params, result_desc(fcinfo));
+
+	return open_query(i, query, result_desc(fcinfo));
+}
+
+/*
+ * Fetch the next row into values/nulls, returns false
+ * and frees the statement handle after the last row.
+ * The values are valid until the next row is fetched.
+ */
+bool
+fetch_row(odbcstmt *stmt, Datum *values, bool *nulls)
+{
+	MemoryContext	oldcontext;
+	SQLRETURN	ret;
+	SQLULEN		row;
+	int		i;
+
+	/* Fetch the next rowset when the current one is used up */
+	if (stmt->currow >= stmt->nrows)
+	{
+		instr_time	start;
+
+		stmt->nrows = 0;
+		stmt->currow = 0;
+
+		start_timing(&start);
+		if (stmt->prefetch)
+			ret = prefetch_next(stmt);
+		else
+			ret = SQLFetch(stmt->hStmt);
+		end_timing(&conns[stmt->conn_idx].stats.fetch_time, &start);
+		if (!SQL_SUCCEEDED(ret))
+		{
+			if (ret != SQL_NO_DATA)
+			{
+				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+				free_stmt(stmt);
+				elog(ERROR, "odbclink: unsuccessful SQLFetch call: %s", totalerrmsg);
+			}
+			free_stmt(stmt);
+			return false;
+		}
+
+		/* some drivers don't maintain SQL_ATTR_ROWS_FETCHED_PTR for single rows */
+		if (stmt->rowset == 1)
+			stmt->nrows = 1;
+	}
+
+	row = stmt->currow++;
+
+	if (stmt->rowstatus[row] == SQL_ROW_ERROR)
+	{
+		get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+		free_stmt(stmt);
+		elog(ERROR, "odbclink: unsuccessful SQLFetch call: %s", totalerrmsg);
+	}
+
+	/* SQLGetData() works on the row the cursor is positioned on */
+	if (stmt->unbound && stmt->rowset > 1)
+	{
+		ret = SQLSetPos(stmt->hStmt, row + 1, SQL_POSITION, SQL_LOCK_NO_CHANGE);
+		if (!SQL_SUCCEEDED(ret))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			free_stmt(stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLSetPos call: %s", totalerrmsg);
+		}
+	}
+
+	/* the values of the previous row are not needed any more */
+	MemoryContextReset(stmt->rowcxt);
+	oldcontext = MemoryContextSwitchTo(stmt->rowcxt);
+
+	PG_TRY();
+	{
+		/*
+		 * Some functions called by get_data() can throw an error,
+		 * catch them and don't leak the STMT handle...
+		 */
+		for (i = 0; i < stmt->cols; i++)
+			get_data(stmt, i + 1, row, &values[i], &nulls[i]);
+	}
+	PG_CATCH();
+	{
+		MemoryContextSwitchTo(oldcontext);
+		free_stmt(stmt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(oldcontext);
+
+	conns[stmt->conn_idx].stats.rows++;
+	if (stmt->track.query && stmt->track.rows++ == 0)
+		stmt->track.first_time = elapsed_ms(&stmt->track.start);
+
+	return true;
+}
+
+/* Close the remote cursor if the executor stops before the last row */
+static void
+query_shutdown(Datum arg)
+{
+	free_stmt((odbcstmt *)DatumGetPointer(arg));
+}
+
+static void
+init_query_common(PG_FUNCTION_ARGS, int i, char *query, ArrayType *params)
+{
+	FuncCallContext	   *funcctx;
+	MemoryContext	oldcontext;
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	odbcstmt	   *stmt;
+
+	funcctx = SRF_FIRSTCALL_INIT();
+
+	oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+	stmt = start_query(fcinfo, i, query, params);
+
+	if (rsinfo && IsA(rsinfo, ReturnSetInfo))
+		RegisterExprContextCallback(rsinfo->econtext, query_shutdown, PointerGetDatum(stmt));
+
+	funcctx->user_fctx = stmt;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static Datum
+query_common(PG_FUNCTION_ARGS)
+{
+	FuncCallContext	   *funcctx;
+	odbcstmt	   *stmt;
+	HeapTuple	tuple;
+
+	funcctx = SRF_PERCALL_SETUP();
+
+	stmt = funcctx->user_fctx;
+
+	if (!fetch_row(stmt, stmt->values, stmt->nulls))
+	{
+		ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+
+		/* stmt goes away with the multi-call memory context */
+		if (rsinfo && IsA(rsinfo, ReturnSetInfo))
+			UnregisterExprContextCallback(rsinfo->econtext, query_shutdown, PointerGetDatum(stmt));
+		SRF_RETURN_DONE(funcctx);
+	}
+
+	tuple = heap_form_tuple(stmt->tupdesc, stmt->values, stmt->nulls);
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+/*
+ * Materialize mode is used if the caller allows it, unless
+ * it's disabled by odbclink.materialize.
+ */
+static bool
+use_materialize(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+
+	return (materialize && rsinfo && IsA(rsinfo, ReturnSetInfo) &&
+		(rsinfo->allowedModes & SFRM_Materialize) != 0);
+}
+
+/*
+ * Drain the rows of an executed statement into a tuplestore and return
+ * it as the materialized result, called in the per-query memory context.
+ */
+static void
+materialize_stmt(ReturnSetInfo *rsinfo, odbcstmt *stmt)
+{
+	Tuplestorestate	   *tupstore;
+
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	/* the converted values of a row are freed when the next one is fetched */
+	PG_TRY();
+	{
+		while (fetch_row(stmt, stmt->values, stmt->nulls))
+			tuplestore_putvalues(tupstore, stmt->tupdesc, stmt->values, stmt->nulls);
+	}
+	PG_CATCH();
+	{
+		free_stmt(stmt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	/* the executor frees setDesc, the cached one must stay */
+	rsinfo->setDesc = (stmt->cached ? CreateTupleDescCopy(stmt->tupdesc) : stmt->tupdesc);
+}
+
+/*
+ * Drain the whole remote result into a tuplestore at once, it spills
+ * to disk beyond work_mem. The remote cursor is closed before
+ * the executor sees the first row.
+ */
+static void
+materialize_query(PG_FUNCTION_ARGS, int i, char *query, ArrayType *params)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+
+	odbccachekey	key;
+	/* other sessions must not see what an open remote transaction reads */
+	bool		local = remote_xact_open(i);
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (cache_enabled())
+	{
+		TupleDesc	tupdesc = result_desc(fcinfo);
+
+		cache_key(&key, conns[i].key, query, params, tupdesc);
+		if (cache_fetch(&key, local, rsinfo, tupdesc))
+		{
+			conns[i].stats.cache_hits++;
+			flush_stats(i);
+			MemoryContextSwitchTo(oldcontext);
+			return;
+		}
+	}
+
+	materialize_stmt(rsinfo, start_query(fcinfo, i, query, params));
+
+	if (cache_enabled())
+		cache_store(&key, local, rsinfo);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/* Materialize the result of a query run by a pool worker */
+static void
+materialize_pool(PG_FUNCTION_ARGS, const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	TupleDesc	tupdesc;
+	odbccachekey	key;
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = result_desc(fcinfo);
+
+	if (cache_enabled())
+	{
+		char	   *connkey = conn_key(dsn, uid, pwd, connstr);
+
+		cache_key(&key, connkey, query, NULL, tupdesc);
+		if (cache_fetch(&key, false, rsinfo, tupdesc))
+		{
+			odbcstats	stats;
+
+			memset(&stats, 0, sizeof(odbcstats));
+			stats.cache_hits = 1;
+			stats_flush(connkey, &stats);
+			pfree(connkey);
+			MemoryContextSwitchTo(oldcontext);
+			return;
+		}
+		pfree(connkey);
+	}
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = pool_query(dsn, uid, pwd, connstr, query, tupdesc,
+					(rsinfo->allowedModes & SFRM_Materialize_Random) != 0);
+	rsinfo->setDesc = tupdesc;
+
+	if (cache_enabled())
+		cache_store(&key, false, rsinfo);
+
+	MemoryContextSwitchTo(oldcontext);
+}
+
+Datum
+odbclink_query_n(PG_FUNCTION_ARGS)
+{
+	if (SRF_IS_FIRSTCALL())
+	{
+		int		i;
+		char	   *query;
+
+		i = PG_GETARG_INT32(0) - 1;
+		if (!(i >= 0 && i < n_conn && conns[i].connected))
+			elog(ERROR, "odbclink: no such connection");
+
+		query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+		if (use_materialize(fcinfo))
+		{
+			materialize_query(fcinfo, i, query, NULL);
+			pfree(query);
+			return (Datum) 0;
+		}
+
+		init_query_common(fcinfo, i, query, NULL);
+	}
+
+	return query_common(fcinfo);
+}
+
+Datum
+odbclink_query_dsn(PG_FUNCTION_ARGS)
+{
+	if (SRF_IS_FIRSTCALL())
+	{
+		int		i;
+		char	   *dsn, *uid, *pwd;
+		char	   *query;
+
+		dsn = TextDatumGetCString(PG_GETARG_DATUM(0));
+		uid = TextDatumGetCString(PG_GETARG_DATUM(1));
+		pwd = TextDatumGetCString(PG_GETARG_DATUM(2));
+		query = TextDatumGetCString(PG_GETARG_DATUM(3));
+
+		i = find_conn_dsn(dsn, uid, pwd);
+
+		if (use_materialize(fcinfo) && pool_usable(i, result_desc(fcinfo)))
+		{
+			materialize_pool(fcinfo, dsn, uid, pwd, NULL, query);
+			pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+			return (Datum) 0;
+		}
+
+		if (i < 0)
+			i = connect_dsn(dsn, uid, pwd);
+
+		if (use_materialize(fcinfo))
+		{
+			materialize_query(fcinfo, i, query, NULL);
+			pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+			return (Datum) 0;
+		}
+
+		init_query_common(fcinfo, i, query, NULL);
+
+		pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+	}
+
+	return query_common(fcinfo);
+}
+
+Datum
+odbclink_query_connstr(PG_FUNCTION_ARGS)
+{
+	if (SRF_IS_FIRSTCALL())
+	{
+		int		i;
+		char	   *connstr;
+		char	   *query;
+
+		connstr = TextDatumGetCString(PG_GETARG_DATUM(0));
+		query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+		i = find_conn_connstr(connstr);
+
+		if (use_materialize(fcinfo) && pool_usable(i, result_desc(fcinfo)))
+		{
+			materialize_pool(fcinfo, NULL, NULL, NULL, connstr, query);
+			pfree(connstr); pfree(query);
+			return (Datum) 0;
+		}
+
+		if (i < 0)
+			i = connect_connstr(connstr);
+
+		if (use_materialize(fcinfo))
+		{
+			materialize_query(fcinfo, i, query, NULL);
+			pfree(connstr); pfree(query);
+			return (Datum) 0;
+		}
+
+		init_query_common(fcinfo, i, query, NULL);
+
+		pfree(connstr); pfree(query);
+	}
+
+	return query_common(fcinfo);
+}
+
+Datum
+odbclink_query_params_n(PG_FUNCTION_ARGS)
+{
+	if (SRF_IS_FIRSTCALL())
+	{
+		int		i;
+		char	   *query;
+		ArrayType  *params;
+
+		i = PG_GETARG_INT32(0) - 1;
+		if (!(i >= 0 && i < n_conn && conns[i].connected))
+			elog(ERROR, "odbclink: no such connection");
+
+		query = TextDatumGetCString(PG_GETARG_DATUM(1));
+		params = PG_GETARG_ARRAYTYPE_P(2);
+
+		if (use_materialize(fcinfo))
+		{
+			materialize_query(fcinfo, i, query, params);
+			pfree(query);
+			return (Datum) 0;
+		}
+
+		init_query_common(fcinfo, i, query, params);
+
+		pfree(query);
+	}
+
+	return query_common(fcinfo);
+}
+
+/*
+ * Get the range of the split column of a partitioned query,
+ * returns false if the result is empty.
+ */
+static bool
+get_split_range(int i, char *query, char *column, int64 *min, int64 *max)
+{
+	SQLRETURN	ret;
+	odbcstmt	stmt;
+	StringInfoData	sql;
+	SQLLEN		minind, maxind;
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "SELECT MIN(%s), MAX(%s) FROM (%s) odbclink_range",
+				column, column, query);
+
+	memset(&stmt, 0, sizeof(odbcstmt));
+	stmt.conn_idx = i;
+	ret = SQLAllocStmt(conns[i].hCon, &stmt.hStmt);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+	}
+
+	conns[i].stats.queries++;
+	ret = exec_stmt(&stmt, sql.data);
+	if (SQL_SUCCEEDED(ret))
+		ret = SQLFetch(stmt.hStmt);
+	if (SQL_SUCCEEDED(ret))
+		ret = SQLGetData(stmt.hStmt, 1, SQL_C_SBIGINT, min, sizeof(int64), &minind);
+	if (SQL_SUCCEEDED(ret))
+		ret = SQLGetData(stmt.hStmt, 2, SQL_C_SBIGINT, max, sizeof(int64), &maxind);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+		elog(ERROR, "odbclink: cannot get the range of split column \"%s\": %s", column, totalerrmsg);
+	}
+
+	SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+	flush_stats(i);
+	pfree(sql.data);
+
+	return (minind != SQL_NULL_DATA && maxind != SQL_NULL_DATA);
+}
+
+/*
+ * The query of partition k out of nparts. The first and the last
+ * partitions are open ended so every row is returned exactly once
+ * even if the range was truncated to integers, NULLs go to the first.
+ */
+static char *
+partition_query(char *query, char *column, int64 min, uint64 span, int k, int nparts)
+{
+	StringInfoData	sql;
+	int64		lo, hi;
+
+	lo = (int64)((uint64)min + (uint64)k * (span / nparts) + (uint64)k * (span % nparts) / nparts);
+	hi = (int64)((uint64)min + (uint64)(k + 1) * (span / nparts) + (uint64)(k + 1) * (span % nparts) / nparts);
+
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "SELECT * FROM (%s) odbclink_part", query);
+	if (nparts == 1)
+		return sql.data;
+
+	if (k == 0)
+		appendStringInfo(&sql, " WHERE %s < " INT64_FORMAT " OR %s IS NULL", column, hi, column);
+	else if (k == nparts - 1)
+		appendStringInfo(&sql, " WHERE %s >= " INT64_FORMAT, column, lo);
+	else
+		appendStringInfo(&sql, " WHERE %s >= " INT64_FORMAT " AND %s < " INT64_FORMAT,
+					column, lo, column, hi);
+
+	return sql.data;
+}
+
+/* Free the statements and the extra connections of a partitioned query */
+static void
+close_partitions(odbcpartscan *scan)
+{
+	int	k;
+
+	for (k = 0; k < scan->nparts; k++)
+	{
+		if (scan->stmt[k] && scan->stmt[k]->hStmt != SQL_NULL_HSTMT)
+		{
+			/* it may still be executing asynchronously */
+			SQLCancel(scan->stmt[k]->hStmt);
+			free_stmt(scan->stmt[k]);
+		}
+		if (k > 0 && scan->ownconns && scan->conn_idx[k] >= 0)
+		{
+			disconnect_conn(scan->conn_idx[k]);
+			scan->conn_idx[k] = -1;
+		}
+	}
+}
+
+/*
+ * Execute queries[k] on the connections of the scan. The queries are
+ * executed asynchronously if the driver supports it, so the remote
+ * sides work on all of them at once, and the statements are set up
+ * in the order they finish.
+ */
+static void
+start_partitions(odbcpartscan *scan, char **queries, TupleDesc tupdesc)
+{
+	bool	   *running = palloc0(scan->nparts * sizeof(bool));
+	bool	   *async = palloc0(scan->nparts * sizeof(bool));
+	int		nrunning = 0;
+	SQLRETURN	ret;
+	instr_time	start;
+	long		delay = 0;
+	int		k;
+
+	/* the execution time of each partition counts from here */
+	start_timing(&start);
+
+	PG_TRY();
+	{
+		for (k = 0; k < scan->nparts; k++)
+		{
+			scan->stmt[k] = alloc_query(scan->conn_idx[k], tupdesc);
+			conns[scan->conn_idx[k]].stats.queries++;
+			if (stmt_stats_enabled())
+				track_stmt(scan->stmt[k], pstrdup(queries[k]));
+
+			async[k] = begin_exec(scan->stmt[k]);
+			ret = run_stmt(scan->stmt[k]->hStmt, queries[k]);
+			if (ret == SQL_STILL_EXECUTING)
+			{
+				running[k] = true;
+				nrunning++;
+				continue;
+			}
+			if (!SQL_SUCCEEDED(ret))
+			{
+				get_sql_error(scan->conn_idx[k], SQL_HANDLE_STMT, scan->stmt[k]);
+				elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+			}
+			end_exec(scan->stmt[k], async[k], &start);
+			setup_query(scan->stmt[k]);
+		}
+
+		while (nrunning > 0)
+		{
+			CHECK_FOR_INTERRUPTS();
+			if (delay > 0)
+				pg_usleep(delay);
+			delay = next_poll_delay(delay);
+
+			for (k = 0; k < scan->nparts; k++)
+			{
+				if (!running[k])
+					continue;
+
+				/* polling repeats the original call */
+				ret = run_stmt(scan->stmt[k]->hStmt, queries[k]);
+				if (ret == SQL_STILL_EXECUTING)
+					continue;
+				running[k] = false;
+				nrunning--;
+				if (!SQL_SUCCEEDED(ret))
+				{
+					get_sql_error(scan->conn_idx[k], SQL_HANDLE_STMT, scan->stmt[k]);
+					elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+				}
+
+				end_exec(scan->stmt[k], async[k], &start);
+				setup_query(scan->stmt[k]);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		/* the statements are freed by the caller */
+		for (k = 0; k < scan->nparts; k++)
+			if (running[k] && !cancel_stmt(scan->stmt[k]->hStmt, queries[k], true))
+				elog(WARNING, "odbclink: the query on connection %d could not be cancelled",
+					scan->conn_idx[k] + 1);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	pfree(running);
+	pfree(async);
+}
+
+/*
+ * Open the partitions of the query on connection i and the same
+ * number of new connections to the same data source.
+ */
+static void
+open_partitions(odbcpartscan *scan, int i, char *query, TupleDesc tupdesc)
+{
+	char	   *dsn = conns[i].dsn ? pstrdup(conns[i].dsn) : NULL;
+	char	   *uid = conns[i].uid ? pstrdup(conns[i].uid) : NULL;
+	char	   *pwd = conns[i].pwd ? pstrdup(conns[i].pwd) : NULL;
+	char	   *connstr = conns[i].connstr ? pstrdup(conns[i].connstr) : NULL;
+	char	  **queries = palloc(scan->nparts * sizeof(char *));
+	int64		min = 0, max = 0;
+	uint64		span;
+	int		k;
+
+	if (!get_split_range(i, query, scan->column, &min, &max))
+		scan->nparts = 1;
+
+	/* don't use more partitions than values */
+	span = (uint64)max - (uint64)min;
+	if (span < (uint64)scan->nparts - 1)
+		scan->nparts = (int)span + 1;
+
+	for (k = 0; k < scan->nparts; k++)
+	{
+		if (k == 0)
+			scan->conn_idx[k] = i;
+		else if (connstr)
+			scan->conn_idx[k] = connect_connstr(connstr);
+		else
+			scan->conn_idx[k] = connect_dsn(dsn, uid, pwd);
+
+		queries[k] = partition_query(query, scan->column, min, span, k, scan->nparts);
+	}
+
+	start_partitions(scan, queries, tupdesc);
+}
+
+/*
+ * Fetch the next row of a partitioned query. The partitions are
+ * read in turns, one rowset at a time, so the remote side can send
+ * the next rowsets of the others in the meantime.
+ */
+static bool
+fetch_part_row(odbcpartscan *scan, Datum *values, bool *nulls)
+{
+	int	active, k;
+
+	for (;;)
+	{
+		odbcstmt   *stmt = scan->stmt[scan->cur];
+
+		if (stmt->hStmt != SQL_NULL_HSTMT)
+		{
+			if (!(scan->fetched && stmt->currow >= stmt->nrows))
+			{
+				if (fetch_row(stmt, values, nulls))
+				{
+					scan->fetched = true;
+					return true;
+				}
+				/* this partition is done, free its connection early */
+				if (scan->cur > 0 && scan->ownconns)
+				{
+					disconnect_conn(scan->conn_idx[scan->cur]);
+					scan->conn_idx[scan->cur] = -1;
+				}
+			}
+		}
+
+		for (k = 0, active = 0; k < scan->nparts; k++)
+			if (scan->stmt[k]->hStmt != SQL_NULL_HSTMT)
+				active++;
+		if (active == 0)
+			return false;
+
+		scan->cur = (scan->cur + 1) % scan->nparts;
+		scan->fetched = false;
+	}
+}
+
+/*
+ * Read a partitioned query into a tuplestore, always in materialize
+ * mode since the extra connections must be closed before returning.
+ */
+static void
+materialize_partitioned(PG_FUNCTION_ARGS, int i, char *query, char *column, int nparts)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	MemoryContext	rowcontext;
+	Tuplestorestate	   *tupstore;
+	TupleDesc	tupdesc;
+	odbcpartscan	scan;
+	Datum	   *values;
+	bool	   *nulls;
+	int		k;
+
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+			(rsinfo->allowedModes & SFRM_Materialize) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("odbclink: materialize mode required, but it is not allowed in this context")));
+
+	if (nparts < 1 || nparts > MAXPARTITIONS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("odbclink: the number of partitions must be between 1 and %d", MAXPARTITIONS)));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = result_desc(fcinfo);
+
+	scan.nparts = nparts;
+	scan.column = column;
+	scan.ownconns = true;
+	scan.conn_idx = palloc(nparts * sizeof(int));
+	scan.stmt = palloc0(nparts * sizeof(odbcstmt *));
+	scan.cur = 0;
+	scan.fetched = false;
+	for (k = 0; k < nparts; k++)
+		scan.conn_idx[k] = -1;
+
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	values = palloc(tupdesc->natts * sizeof(Datum));
+	nulls = palloc(tupdesc->natts * sizeof(bool));
+
+	rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+					"odbclink row context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+
+	PG_TRY();
+	{
+		open_partitions(&scan, i, query, tupdesc);
+
+		MemoryContextSwitchTo(rowcontext);
+
+		while (fetch_part_row(&scan, values, nulls))
+		{
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			MemoryContextReset(rowcontext);
+		}
+	}
+	PG_CATCH();
+	{
+		close_partitions(&scan);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	close_partitions(&scan);
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextDelete(rowcontext);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+}
+
+/*
+ * Run the same query on all connections of conns at once and merge
+ * the rows, with the number of their connection first if with_source.
+ */
+static void
+materialize_multi(PG_FUNCTION_ARGS, ArrayType *conns_arr, char *query, bool with_source)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	MemoryContext	rowcontext;
+	Tuplestorestate	   *tupstore;
+	TupleDesc	tupdesc, remotedesc;
+	odbcpartscan	scan;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	char	  **queries;
+	Datum	   *values;
+	bool	   *nulls;
+	int		nelems;
+	int		k, l;
+
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+			(rsinfo->allowedModes & SFRM_Materialize) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("odbclink: materialize mode required, but it is not allowed in this context")));
+
+	if (ARR_ELEMTYPE(conns_arr) != INT4OID)
+		elog(ERROR, "odbclink: the connections must be given as int4[]");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	deconstruct_array(conns_arr, INT4OID, sizeof(int32), true, 'i',
+				&elems, &elemnulls, &nelems);
+
+	if (nelems < 1 || nelems > MAXPARTITIONS)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("odbclink: the number of connections must be between 1 and %d", MAXPARTITIONS)));
+
+	tupdesc = result_desc(fcinfo);
+
+	/* the remote queries return the columns after the source column */
+	remotedesc = tupdesc;
+	if (with_source)
+	{
+		if (tupdesc->natts < 2 || tupdesc->attrs[0]->atttypid != INT4OID)
+			ereport(ERROR,
+					(errcode(ERRCODE_SYNTAX_ERROR),
+						errmsg("odbclink: the first result column must be the int4 source connection")));
+
+		remotedesc = CreateTemplateTupleDesc(tupdesc->natts - 1, false);
+		for (k = 1; k < tupdesc->natts; k++)
+			TupleDescInitEntry(remotedesc, k, NULL,
+					tupdesc->attrs[k]->atttypid, tupdesc->attrs[k]->atttypmod, 0);
+	}
+
+	scan.nparts = nelems;
+	scan.column = NULL;
+	scan.ownconns = false;
+	scan.conn_idx = palloc(nelems * sizeof(int));
+	scan.stmt = palloc0(nelems * sizeof(odbcstmt *));
+	scan.cur = 0;
+	scan.fetched = false;
+	queries = palloc(nelems * sizeof(char *));
+
+	for (k = 0; k < nelems; k++)
+	{
+		int		i = (elemnulls[k] ? -1 : DatumGetInt32(elems[k]) - 1);
+
+		if (!(i >= 0 && i < n_conn && conns[i].connected))
+			elog(ERROR, "odbclink: no such connection");
+
+		/* a connection can run one statement at a time */
+		for (l = 0; l < k; l++)
+			if (scan.conn_idx[l] == i)
+				elog(ERROR, "odbclink: connection %d is listed more than once", i + 1);
+
+		scan.conn_idx[k] = i;
+		queries[k] = query;
+	}
+
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	values = palloc(tupdesc->natts * sizeof(Datum));
+	nulls = palloc(tupdesc->natts * sizeof(bool));
+
+	rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+					"odbclink row context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+
+	PG_TRY();
+	{
+		start_partitions(&scan, queries, remotedesc);
+
+		MemoryContextSwitchTo(rowcontext);
+
+		while (fetch_part_row(&scan, values + (with_source ? 1 : 0), nulls + (with_source ? 1 : 0)))
+		{
+			if (with_source)
+			{
+				values[0] = Int32GetDatum(scan.conn_idx[scan.cur] + 1);
+				nulls[0] = false;
+			}
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			MemoryContextReset(rowcontext);
+		}
+	}
+	PG_CATCH();
+	{
+		close_partitions(&scan);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	close_partitions(&scan);
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextDelete(rowcontext);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+}
+
+Datum
+odbclink_query_partitioned_n(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *query, *column;
+
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	column = TextDatumGetCString(PG_GETARG_DATUM(2));
+
+	materialize_partitioned(fcinfo, i, query, column, PG_GETARG_INT32(3));
+
+	pfree(query); pfree(column);
+
+	return (Datum) 0;
+}
+
+Datum
+odbclink_query_partitioned_dsn(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *dsn, *uid, *pwd;
+	char	   *query, *column;
+
+	dsn = TextDatumGetCString(PG_GETARG_DATUM(0));
+	uid = TextDatumGetCString(PG_GETARG_DATUM(1));
+	pwd = TextDatumGetCString(PG_GETARG_DATUM(2));
+	query = TextDatumGetCString(PG_GETARG_DATUM(3));
+	column = TextDatumGetCString(PG_GETARG_DATUM(4));
+
+	i = find_conn_dsn(dsn, uid, pwd);
+	if (i < 0)
+		i = connect_dsn(dsn, uid, pwd);
+
+	materialize_partitioned(fcinfo, i, query, column, PG_GETARG_INT32(5));
+
+	pfree(dsn); pfree(uid); pfree(pwd); pfree(query); pfree(column);
+
+	return (Datum) 0;
+}
+
+Datum
+odbclink_query_partitioned_connstr(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *connstr;
+	char	   *query, *column;
+
+	connstr = TextDatumGetCString(PG_GETARG_DATUM(0));
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	column = TextDatumGetCString(PG_GETARG_DATUM(2));
+
+	i = find_conn_connstr(connstr);
+	if (i < 0)
+		i = connect_connstr(connstr);
+
+	materialize_partitioned(fcinfo, i, query, column, PG_GETARG_INT32(3));
+
+	pfree(connstr); pfree(query); pfree(column);
+
+	return (Datum) 0;
+}
+
+Datum
+odbclink_query_multi_n(PG_FUNCTION_ARGS)
+{
+	char	   *query;
+
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+	materialize_multi(fcinfo, PG_GETARG_ARRAYTYPE_P(0), query,
+				(PG_NARGS() > 2 ? PG_GETARG_BOOL(2) : false));
+
+	pfree(query);
+
+	return (Datum) 0;
+}
+
+void
+exec_query(int i, char *query)
+{
+	SQLRETURN	ret;
+	odbcstmt	stmt;
+
+	/* Store the connection index. */
+	memset(&stmt, 0, sizeof(odbcstmt));
+	stmt.conn_idx = i;
+
+	/*
+	 * The allocated statement handle is the only thing
+	 * that must be freed manually. All the other allocations
+	 * are dealt by PostgreSQL's garbage collection.
+	 */
+	ret = SQLAllocStmt(conns[i].hCon, &stmt.hStmt);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_DBC, NULL);
+		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+	}
+
+	conns[i].stats.executes++;
+	track_stmt(&stmt, query);
+	ret = exec_stmt(&stmt, query);
+	if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+		SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+		elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+	}
+
+	SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+	finish_stmt(&stmt);
+	flush_stats(i);
+
+	/* the statement may have changed what the cached results show */
+	cache_invalidate(conns[i].key);
+}
+
+Datum
+odbclink_exec_n(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *query;
+
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+	exec_query(i, query);
+
+	pfree(query);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+odbclink_exec_dsn(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *dsn, *uid, *pwd;
+	char	   *query;
+
+	dsn = TextDatumGetCString(PG_GETARG_DATUM(0));
+	uid = TextDatumGetCString(PG_GETARG_DATUM(1));
+	pwd = TextDatumGetCString(PG_GETARG_DATUM(2));
+	query = TextDatumGetCString(PG_GETARG_DATUM(3));
+
+	i = find_conn_dsn(dsn, uid, pwd);
+	if (pool_usable(i, NULL))
+		pool_exec(dsn, uid, pwd, NULL, query);
+	else
+	{
+		if (i < 0)
+			i = connect_dsn(dsn, uid, pwd);
+
+		exec_query(i, query);
+	}
+
+	pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+odbclink_exec_connstr(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *connstr;
+	char	   *query;
+
+	connstr = TextDatumGetCString(PG_GETARG_DATUM(0));
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+	i = find_conn_connstr(connstr);
+	if (pool_usable(i, NULL))
+		pool_exec(NULL, NULL, NULL, connstr, query);
+	else
+	{
+		if (i < 0)
+			i = connect_connstr(connstr);
 
-			case SQL_INTEGER:
-				if (typeoid != INT4OID && typeoid != INT8OID)
-					retval = false;
-				break;
-			case SQL_SMALLINT:
-				if (typeoid != INT2OID && typeoid != INT4OID && typeoid != INT8OID)
-					retval = false;
-				break;
+		exec_query(i, query);
+	}
 
-			case SQL_FLOAT:
-			case SQL_REAL:
-				if (typeoid != FLOAT4OID)
-					retval = false;
-				break;
+	pfree(connstr); pfree(query);
 
-			case SQL_DOUBLE:
-				if (typeoid != FLOAT8OID)
-					retval = false;
-				break;
+	PG_RETURN_VOID();
+}
 
-			case SQL_DATE:
-				if (typeoid != DATEOID)
-					retval = false;
-				break;
+Datum
+odbclink_exec_params_n(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *query;
 
-			case SQL_TIME:
-				if (typeoid != TIMEOID && typeoid != TIMETZOID)
-					retval = false;
-				break;
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
 
-			case SQL_TIMESTAMP:
-				if (typeoid != TIMESTAMPOID && typeoid != TIMESTAMPTZOID)
-					retval = false;
-				break;
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
 
-			case SQL_BINARY:
-			case SQL_VARBINARY:
-			case SQL_LONGVARBINARY:
-#if PG_VERSION_NUM >= 80500
-				if (typeoid != BYTEAOID)
+	exec_prepared(i, query, PG_GETARG_ARRAYTYPE_P(2), NULL);
+	cache_invalidate(conns[i].key);
+
+	pfree(query);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Choose how the values of a parameter column are bound: the types
+ * get_data() converts from are sent in their native ODBC form,
+ * the rest as strings made by the output function of the type.
+ */
+static void
+plan_batch_col(odbcbatchcol *c, Oid typeoid)
+{
+	Oid		outfunc;
+	bool		isvarlena;
+
+	c->typeoid = typeoid;
+	c->size = 0;
+	c->digits = 0;
+
+	switch (typeoid)
+	{
+		case BOOLOID:
+			c->ctype = SQL_C_BIT;
+			c->sqltype = SQL_BIT;
+			c->width = sizeof(unsigned char);
+			return;
+
+		case INT2OID:
+			c->ctype = SQL_C_SSHORT;
+			c->sqltype = SQL_SMALLINT;
+			c->width = sizeof(SQLSMALLINT);
+			return;
+
+		case INT4OID:
+			c->ctype = SQL_C_SLONG;
+			c->sqltype = SQL_INTEGER;
+			c->width = sizeof(SQLINTEGER);
+			return;
+
+		case INT8OID:
+			c->ctype = SQL_C_SBIGINT;
+			c->sqltype = SQL_BIGINT;
+			c->width = sizeof(int64);
+			return;
+
+		case FLOAT4OID:
+			c->ctype = SQL_C_FLOAT;
+			c->sqltype = SQL_REAL;
+			c->width = sizeof(float4);
+			return;
+
+		case FLOAT8OID:
+			c->ctype = SQL_C_DOUBLE;
+			c->sqltype = SQL_DOUBLE;
+			c->width = sizeof(float8);
+			return;
+
+		case DATEOID:
+			c->ctype = SQL_C_DATE;
+			c->sqltype = SQL_DATE;
+			c->width = sizeof(DATE_STRUCT);
+			c->size = 10;
+			return;
+
+#ifdef HAVE_INT64_TIMESTAMP
+		case TIMEOID:
+			c->ctype = SQL_C_TIME;
+			c->sqltype = SQL_TIME;
+			c->width = sizeof(TIME_STRUCT);
+			c->size = 8;
+			return;
+
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+			c->ctype = SQL_C_TIMESTAMP;
+			c->sqltype = SQL_TIMESTAMP;
+			c->width = sizeof(TIMESTAMP_STRUCT);
+			c->size = 26;
+			c->digits = 6;
+			return;
 #endif
-					retval = false;
-				break;
 
-			case SQL_BIT:
-				if (typeoid != BOOLOID)
-					retval = false;
-				break;
-		}
-		if (!retval)
-		{
-			elog(NOTICE, "field index %d input type from ODBC: %d output type for PG: %d", col, type, typeoid);
-			break;
-		}
+		case BYTEAOID:
+			c->ctype = SQL_C_BINARY;
+			c->sqltype = SQL_LONGVARBINARY;
+			c->width = 0;
+			return;
 	}
 
-	return retval;
+	c->ctype = SQL_C_CHAR;
+	c->sqltype = SQL_VARCHAR;
+	c->width = 0;
+	getTypeOutputInfo(typeoid, &outfunc, &isvarlena);
+	fmgr_info(outfunc, &c->outfunc);
 }
 
-static SQLRETURN
-get_char_data(odbcstmt *stmt, int col, char **value, int *length, bool *isnull)
+/* Store a fixed width value into its parameter buffer */
+static void
+put_batch_value(odbcbatchcol *c, Datum value, char *buf)
 {
-	SQLRETURN	ret;
-	char	   *char_val;
-	int	char_len = 0, char_pos = 0;
-	SQLLEN	size_ind;
-
-	ret = SQL_SUCCESS;
-	char_val = palloc(CHARVALCHUNK);
-	char_pos = 0;
-	char_len = CHARVALCHUNK;
-	while (ret != SQL_NO_DATA)
+	switch (c->ctype)
 	{
-		ret = SQLGetData(stmt->hStmt, col, SQL_C_CHAR, char_val + char_pos, CHARVALCHUNK, &size_ind);
+		case SQL_C_BIT:
+			*(unsigned char *)buf = DatumGetBool(value) ? 1 : 0;
+			break;
 
-		if (size_ind == SQL_NULL_DATA)
+		case SQL_C_SSHORT:
+			*(SQLSMALLINT *)buf = DatumGetInt16(value);
 			break;
 
-		if (ret == SQL_NO_DATA)
+		case SQL_C_SLONG:
+			*(SQLINTEGER *)buf = DatumGetInt32(value);
 			break;
 
-		if (size_ind == CHARVALCHUNK)
+		case SQL_C_SBIGINT:
 		{
-			char_len += CHARVALCHUNK;
-			char_val = repalloc(char_val, char_len);
+			int64	val = DatumGetInt64(value);
+
+			memcpy(buf, &val, sizeof(int64));
+			break;
 		}
-		char_pos += size_ind;
-	}
-	if (char_pos == char_len)
-	{
-		char_len += CHARVALCHUNK;
-		char_val = realloc(char_val, char_len);
-	}
-	char_val[char_pos] = '\0';
 
-	if (value)
-		*value = char_val;
-	if (*length)
-		*length = char_pos;
-	if (isnull)
-		*isnull = (size_ind == SQL_NULL_DATA);
-	return ret;
+		case SQL_C_FLOAT:
+			*(float4 *)buf = DatumGetFloat4(value);
+			break;
+
+		case SQL_C_DOUBLE:
+			*(float8 *)buf = DatumGetFloat8(value);
+			break;
+
+		case SQL_C_DATE:
+		{
+			DATE_STRUCT    *d = (DATE_STRUCT *)buf;
+			DateADT		date = DatumGetDateADT(value);
+			int		year, mon, mday;
+
+			if (DATE_NOT_FINITE(date))
+				ereport(ERROR,
+						(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+							errmsg("odbclink: infinite dates can't be sent")));
+			j2date(date + POSTGRES_EPOCH_JDATE, &year, &mon, &mday);
+			d->year = year;
+			d->month = mon;
+			d->day = mday;
+			break;
+		}
+
+#ifdef HAVE_INT64_TIMESTAMP
+		case SQL_C_TIME:
+		{
+			TIME_STRUCT    *t = (TIME_STRUCT *)buf;
+			TimeADT		time = DatumGetTimeADT(value);
+
+			/* TIME_STRUCT has no fraction */
+			t->hour = time / USECS_PER_HOUR;
+			t->minute = time / USECS_PER_MINUTE % MINS_PER_HOUR;
+			t->second = time / USECS_PER_SEC % SECS_PER_MINUTE;
+			break;
+		}
+
+		case SQL_C_TIMESTAMP:
+		{
+			TIMESTAMP_STRUCT   *ts = (TIMESTAMP_STRUCT *)buf;
+			Timestamp	val = DatumGetTimestamp(value);
+			struct pg_tm	tm;
+			fsec_t		fsec;
+			int		tz;
+
+			/* timestamptz values are sent in the session time zone */
+			if (TIMESTAMP_NOT_FINITE(val) ||
+					timestamp2tm(val, (c->typeoid == TIMESTAMPTZOID ? &tz : NULL),
+							&tm, &fsec, NULL, NULL) != 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+							errmsg("timestamp out of range")));
+			ts->year = tm.tm_year;
+			ts->month = tm.tm_mon;
+			ts->day = tm.tm_mday;
+			ts->hour = tm.tm_hour;
+			ts->minute = tm.tm_min;
+			ts->second = tm.tm_sec;
+			ts->fraction = fsec * 1000;
+			break;
+		}
+#endif
+	}
 }
 
+/*
+ * Bind the parameter sets [first, first + n) of the batch columns,
+ * the buffers are allocated in the current memory context.
+ */
 static void
-get_data(odbcstmt *stmt, int col, Datum *value, bool *isnull)
+bind_batch(int i, odbcbatch *b, int first, int n)
 {
-	SQLRETURN	ret;
-	char		colname[50];
-	SQLSMALLINT	colnamesz, type, decimals, nullable;
-	SQLULEN		columnsz;
-	Oid		typeoid = stmt->tupdesc->attrs[col - 1]->atttypid;
-	int		typemod = stmt->tupdesc->attrs[col - 1]->atttypmod;
-
-	/* These are the values SQLGetData() puts data into */
-	int16	smallint_val = 0;
-	int32	int_val = 0;
-	int64	bigint_val = 0;
-	float	float_val = 0;
-	double	double_val = 0;
-	char	*char_val = NULL;
-	int	char_pos = 0;
-	SQLLEN	size_ind;
-
-	ret = SQLDescribeCol(stmt->hStmt, col,
-				(SQLCHAR *)colname, sizeof(colname), &colnamesz,
-				&type, &columnsz, &decimals, &nullable);
-	if (!SQL_SUCCEEDED(ret))
-	{
-		get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-		elog(ERROR, "odbclink: unsuccessful SQLDescribeCol call: %s", totalerrmsg);
-	}
+	odbcprep   *p = b->p;
+	int		k, row;
 
-	switch (type)
+	for (k = 0; k < p->nparams; k++)
 	{
-		case SQL_SMALLINT:
-			ret = SQLGetData(stmt->hStmt, col, SQL_C_SSHORT,
-					(SQLPOINTER)&smallint_val, sizeof(smallint_val), &size_ind);
-			if (!SQL_SUCCEEDED(ret))
-			{
-				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-				elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
-			}
-			*isnull = (size_ind == SQL_NULL_DATA);
-			if (!*isnull)
-				switch (typeoid)
-				{
-					case INT2OID:
-						*value = Int16GetDatum(smallint_val);
-						break;
-					case INT4OID:
-						*value = Int32GetDatum(smallint_val);
-						break;
-					case INT8OID:
-						*value = Int64GetDatum(smallint_val);
-						break;
-				}
-			break;
+		odbcbatchcol   *c = &b->cols[k];
+		SQLLEN		width = c->width;
+		SQLSMALLINT	sqltype = (p->described ? p->paramtype[k] : c->sqltype);
+		SQLULEN		size = (p->described ? p->paramsize[k] : c->size);
+		SQLSMALLINT	digits = (p->described ? p->paramdigits[k] : c->digits);
+		SQLRETURN	ret;
 
-		case SQL_INTEGER:
-		case SQL_BIT:
-			ret = SQLGetData(stmt->hStmt, col, SQL_C_SLONG,
-					(SQLPOINTER)&int_val, sizeof(int_val), &size_ind);
-			if (!SQL_SUCCEEDED(ret))
+		c->ind = palloc(n * sizeof(SQLLEN));
+
+		if (width > 0)
+		{
+			c->buf = palloc(n * width);
+			for (row = 0; row < n; row++)
 			{
-				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-				elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
-			}
-			*isnull = (size_ind == SQL_NULL_DATA);
-			if (!*isnull)
-				switch (typeoid)
+				if (c->nulls[first + row])
 				{
-					case INT4OID:
-						*value = Int32GetDatum(int_val);
-						break;
-					case INT8OID:
-						*value = Int64GetDatum(int_val);
-						break;
-					case BOOLOID:
-						*value = BoolGetDatum(int_val != 0);
+					c->ind[row] = SQL_NULL_DATA;
+					continue;
 				}
-			break;
-
-		case SQL_BIGINT:
-			ret = SQLGetData(stmt->hStmt, col, SQL_C_SBIGINT,
-					(SQLPOINTER)&bigint_val, sizeof(bigint_val), &size_ind);
-			if (!SQL_SUCCEEDED(ret))
-			{
-				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-				elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
+				put_batch_value(c, c->elems[first + row], c->buf + row * width);
+				c->ind[row] = width;
 			}
-			*isnull = (size_ind == SQL_NULL_DATA);
-			if (!*isnull)
-				*value = Int64GetDatum(bigint_val);
-			break;
+		}
+		else
+		{
+			/* strings and binary values are as wide as the longest one */
+			char	  **vals = palloc(n * sizeof(char *));
 
-		case SQL_NUMERIC:
-		case SQL_DECIMAL:
-			/*
-			 * give truncated integer data out of numeric/decimal types
-			 * report overflow as error
-			 * this is to cause the least surprise, Oracle reports SQL_DECIMAL
-			 * for tables created with INTEGER fields.
-			 */
-			if (typeoid == INT2OID || typeoid == INT4OID || typeoid == INT8OID)
+			width = 1;
+			for (row = 0; row < n; row++)
 			{
-				ret = get_char_data(stmt, col, &char_val, &char_pos, isnull);
-				if (!*isnull)
+				if (c->nulls[first + row])
 				{
-					char *endptr;
-
-					bigint_val = strtoll(char_val, &endptr, 10);
+					vals[row] = NULL;
+					c->ind[row] = SQL_NULL_DATA;
+					continue;
+				}
+				if (c->ctype == SQL_C_BINARY)
+				{
+					bytea	   *val = DatumGetByteaPP(c->elems[first + row]);
 
-					switch (typeoid)
-					{
-						case INT8OID:
-							if (endptr && *endptr != '\0' && *endptr != '.')
-								elog(ERROR, "too large decimal value for 64-bit integer");
-							*value = Int64GetDatum(bigint_val);
-							break;
-						case INT4OID:
-							if (bigint_val > INT_MAX)
-								elog(ERROR, "too large decimal value for 32-bit integer");
-							int_val = bigint_val;
-							*value = Int32GetDatum(int_val);
-							break;
-						case INT2OID:
-							if (bigint_val > SHRT_MAX)
-								elog(ERROR, "too large decimal value for 16-bit integer");
-							smallint_val = bigint_val;
-							*value = Int16GetDatum(smallint_val);
-							break;
-					}
+					vals[row] = VARDATA_ANY(val);
+					c->ind[row] = VARSIZE_ANY_EXHDR(val);
 				}
-				break;
+				else
+				{
+					vals[row] = OutputFunctionCall(&c->outfunc, c->elems[first + row]);
+					c->ind[row] = strlen(vals[row]);
+				}
+				if (c->ind[row] + 1 > width)
+					width = c->ind[row] + 1;
 			}
-			/* fall through */
-		case SQL_CHAR:
-		case SQL_VARCHAR:
-		case SQL_LONGVARCHAR:
-		case SQL_DATE:
-		case SQL_TIME:
-		case SQL_TIMESTAMP:
-		case SQL_BINARY:
-		case SQL_VARBINARY:
-		case SQL_LONGVARBINARY:
-			ret = get_char_data(stmt, col, &char_val, &char_pos, isnull);
-			if (!*isnull)
-				switch (typeoid)
+
+			c->buf = palloc(n * width);
+			for (row = 0; row < n; row++)
+				if (vals[row])
 				{
-					case CHAROID:
-						*value = DirectFunctionCall1(charin, CStringGetDatum(char_val));
-						break;
-					case BPCHAROID:
-						*value = DirectFunctionCall3(bpcharin, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-					case VARCHAROID:
-						*value = DirectFunctionCall3(varcharin, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-					case TEXTOID:
-						*value = DirectFunctionCall3(textin, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-					case NUMERICOID:
-						*value = DirectFunctionCall3(numeric_in, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-					case DATEOID:
-						*value = DirectFunctionCall1(date_in, CStringGetDatum(char_val));
-						break;
-					case TIMEOID:
-						*value = DirectFunctionCall1(time_in, CStringGetDatum(char_val));
-						break;
-					case TIMETZOID:
-						*value = DirectFunctionCall1(timetz_in, CStringGetDatum(char_val));
-						break;
-					case TIMESTAMPOID:
-						*value = DirectFunctionCall3(timestamp_in, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-					case TIMESTAMPTZOID:
-						*value = DirectFunctionCall3(timestamptz_in, CStringGetDatum(char_val), ObjectIdGetDatum(typeoid), Int32GetDatum(typemod));
-						break;
-#if PG_VERSION_NUM >= 80500
-					case BYTEAOID:
-					{
-						char	*bin_val;
-						bin_val = palloc(2 * char_pos + 1);
-						hex_encode(char_val, char_pos, bin_val);
-						bin_val[2 * char_pos] = '\0';
-						*value = DirectFunctionCall1(byteain, CStringGetDatum(bin_val));
-						pfree(bin_val);
-					}
-#endif
+					memcpy(c->buf + row * width, vals[row], c->ind[row]);
+					c->buf[row * width + c->ind[row]] = '\0';
 				}
 
-			pfree(char_val);
-			break;
+			if (size == 0)
+				size = Max(width - 1, 1);
+			if (!p->described && c->ctype == SQL_C_CHAR && width - 1 > MAXBINDLEN)
+				sqltype = SQL_LONGVARCHAR;
+		}
 
-		case SQL_FLOAT:
-		case SQL_REAL:
-			ret = SQLGetData(stmt->hStmt, col, SQL_C_FLOAT,
-					(SQLPOINTER)&float_val, sizeof(float_val), &size_ind);
-			if (!SQL_SUCCEEDED(ret))
-			{
-				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-				elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
-			}
-			*isnull = (size_ind == SQL_NULL_DATA);
-			if (!*isnull)
-				*value = Float4GetDatum(float_val);
-			break;
+		ret = SQLBindParameter(p->hStmt, k + 1, SQL_PARAM_INPUT, c->ctype,
+					sqltype, size, digits, c->buf, width, c->ind);
+		if (!SQL_SUCCEEDED(ret))
+		{
+			odbcstmt	stmt;
 
-		case SQL_DOUBLE:
-			ret = SQLGetData(stmt->hStmt, col, SQL_C_DOUBLE,
-					(SQLPOINTER)&double_val, sizeof(double_val), &size_ind);
-			if (!SQL_SUCCEEDED(ret))
-			{
-				get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-				elog(ERROR, "odbclink: unsuccessful SQLGetData call: %s", totalerrmsg);
-			}
-			*isnull = (size_ind == SQL_NULL_DATA);
-			if (!*isnull)
-				*value = Float8GetDatum(double_val);
-			break;
+			stmt.hStmt = p->hStmt;
+			get_sql_error(i, SQL_HANDLE_STMT, &stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLBindParameter call: %s", totalerrmsg);
+		}
 	}
 }
 
-static void
-init_query_common(PG_FUNCTION_ARGS, int i, char *query)
+/*
+ * Set up the prepared statement of a batch for parameter arrays of
+ * odbclink.batch_size sets, bound column-wise. Without driver support
+ * the sets are executed one by one.
+ */
+static odbcbatch *
+init_batch(odbcprep *p, odbcbatchcol *cols)
 {
-	FuncCallContext	   *funcctx;
-	MemoryContext	oldcontext;
+	odbcbatch  *b = palloc0(sizeof(odbcbatch));
+
+	b->p = p;
+	b->cols = cols;
+	b->size = batch_size;
+	b->status = palloc(batch_size * sizeof(SQLUSMALLINT));
+
+	b->arrays = (p->nparams > 0 &&
+		SQL_SUCCEEDED(SQLSetStmtAttr(p->hStmt, SQL_ATTR_PARAM_BIND_TYPE,
+					(SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0)) &&
+		SQL_SUCCEEDED(SQLSetStmtAttr(p->hStmt, SQL_ATTR_PARAMSET_SIZE,
+					(SQLPOINTER)(SQLULEN)b->size, 0)) &&
+		SQL_SUCCEEDED(SQLSetStmtAttr(p->hStmt, SQL_ATTR_PARAMS_PROCESSED_PTR,
+					&b->processed, 0)) &&
+		SQL_SUCCEEDED(SQLSetStmtAttr(p->hStmt, SQL_ATTR_PARAM_STATUS_PTR,
+					b->status, 0)));
+
+	return b;
+}
+
+/*
+ * Execute the parameter sets [first, first + n) of a batch, at most
+ * odbclink.batch_size of them. Returns the number of processed sets.
+ */
+static int64
+exec_batch(int i, odbcbatch *b, int first, int n)
+{
+	odbcstmt	execstmt;
 	SQLRETURN	ret;
-	odbcstmt	   *stmt;
+	int		row;
 
-	funcctx = SRF_FIRSTCALL_INIT();
+	/* an interrupted execution only closes the cursor, b->p is freed by the caller */
+	memset(&execstmt, 0, sizeof(odbcstmt));
+	execstmt.conn_idx = i;
+	execstmt.hStmt = b->p->hStmt;
+	execstmt.cached = true;
+	track_stmt(&execstmt, b->p->query);
 
-	oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+	if (!b->arrays)
+	{
+		for (row = 0; row < n; row++)
+		{
+			bind_batch(i, b, first + row, 1);
+			conns[i].stats.executes++;
+			ret = exec_stmt(&execstmt, NULL);
+			if (!SQL_SUCCEEDED(ret) && ret != SQL_NO_DATA)
+			{
+				get_sql_error(i, SQL_HANDLE_STMT, &execstmt);
+				elog(ERROR, "odbclink: unsuccessful SQLExecute call in parameter set %d: %s",
+					first + row + 1, totalerrmsg);
+			}
+			SQLFreeStmt(b->p->hStmt, SQL_CLOSE);
+		}
+		finish_stmt(&execstmt);
+		flush_stats(i);
+		return n;
+	}
 
-	stmt = palloc(sizeof(odbcstmt));
-	stmt->conn_idx = i;
+	bind_batch(i, b, first, n);
 
-	/*
-	 * The allocated statement handle is the only thing
-	 * that must be freed manually. All the other allocations
-	 * are dealt by PostgreSQL's garbage collection.
-	 */
-	ret = SQLAllocStmt(conns[i].hCon, &stmt->hStmt);
-	if (!SQL_SUCCEEDED(ret))
+	if (n != b->size)
 	{
-		get_sql_error(i, SQL_HANDLE_DBC, NULL);
-		MemoryContextSwitchTo(oldcontext);
-		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+		SQLSetStmtAttr(b->p->hStmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)(SQLULEN)n, 0);
+		b->size = n;
 	}
 
-	ret = SQLExecDirect(stmt->hStmt, (SQLCHAR *)query, SQL_NTS);
-	if (!SQL_SUCCEEDED(ret))
+	b->processed = 0;
+	conns[i].stats.executes++;
+	ret = exec_stmt(&execstmt, NULL);
+	if (!SQL_SUCCEEDED(ret) && ret != SQL_NO_DATA)
 	{
-		get_sql_error(i, SQL_HANDLE_STMT, stmt);
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-		elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+		get_sql_error(i, SQL_HANDLE_STMT, &execstmt);
+		elog(ERROR, "odbclink: unsuccessful SQLExecute call in parameter set %d: %s",
+			first + (int)b->processed, totalerrmsg);
 	}
+	/* with SQL_SUCCESS_WITH_INFO some of the sets may have failed */
+	for (row = 0; row < (int)b->processed; row++)
+		if (b->status[row] == SQL_PARAM_ERROR)
+		{
+			get_sql_error(i, SQL_HANDLE_STMT, &execstmt);
+			elog(ERROR, "odbclink: unsuccessful SQLExecute call in parameter set %d: %s",
+				first + row + 1, totalerrmsg);
+		}
+	SQLFreeStmt(b->p->hStmt, SQL_CLOSE);
+	finish_stmt(&execstmt);
+	flush_stats(i);
 
-	/* get a tuple descriptor for our result type */
-	switch (get_call_result_type(fcinfo, NULL, &(stmt->tupdesc)))
-	{
-		case TYPEFUNC_COMPOSITE:
-			/* success */
-			break;
-		case TYPEFUNC_RECORD:
-			/* failed to determine actual type of RECORD */
-			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-			ereport(ERROR,
-					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						errmsg("function returning record called in context "
-							"that cannot accept type record")));
-			break;
-		default:
-			/* result type isn't composite */
-			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-			elog(ERROR, "return type must be a row type");
-			break;
+	return b->processed;
+}
+
+/*
+ * Execute a query once for every parameter set. Every parameter is
+ * an array, the n-th elements make the n-th parameter set. The sets
+ * are sent in batches of odbclink.batch_size as parameter arrays,
+ * or one by one if the driver doesn't support those. Returns the
+ * number of parameter sets processed in each batch.
+ */
+Datum
+odbclink_exec_batch_n(PG_FUNCTION_ARGS)
+{
+	int		i;
+	char	   *query;
+	odbcprep   *p;
+	odbcbatch  *b;
+	odbcbatchcol   *cols;
+	int		nsets = 0, nbatches, batch, first, k;
+	Datum	   *counts;
+	MemoryContext	batchcontext, oldcontext;
+
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+
+	cols = palloc0(Max(PG_NARGS() - 2, 1) * sizeof(odbcbatchcol));
+	for (k = 0; k < PG_NARGS() - 2; k++)
+	{
+		Oid		argtype = get_fn_expr_argtype(fcinfo->flinfo, k + 2);
+		Oid		elemtype = get_element_type(argtype);
+		int16		typlen;
+		bool		typbyval;
+		char		typalign;
+		int		n;
+
+		if (!OidIsValid(elemtype))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+						errmsg("odbclink: the parameters of execute_batch() must be arrays")));
+
+		get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+		deconstruct_array(PG_GETARG_ARRAYTYPE_P(k + 2), elemtype, typlen, typbyval, typalign,
+					&cols[k].elems, &cols[k].nulls, &n);
+
+		if (k == 0)
+			nsets = n;
+		else if (n != nsets)
+			ereport(ERROR,
+					(errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+						errmsg("odbclink: the parameter arrays of execute_batch() must have the same length")));
+
+		plan_batch_col(&cols[k], elemtype);
 	}
 
-	/*
-	 * Check that return tupdesc is compatible with the data we got from SPI,
-	 * at least based on number and type of attributes
-	 */
-	if (!compatTupleDescs(stmt))
+	p = prepare_query(i, query);
+	if (p->nparams != PG_NARGS() - 2)
 	{
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
+		free_prepared(p);
 		ereport(ERROR,
-				(errcode(ERRCODE_SYNTAX_ERROR),
-					errmsg("return and sql tuple descriptions are " \
-						"incompatible")));
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("odbclink: the query has %d parameters but %d were given",
+						p->nparams, PG_NARGS() - 2)));
 	}
 
-	funcctx->user_fctx = stmt;
+	b = init_batch(p, cols);
 
-	MemoryContextSwitchTo(oldcontext);
+	nbatches = (nsets + batch_size - 1) / batch_size;
+	counts = palloc(Max(nbatches, 1) * sizeof(Datum));
+
+	batchcontext = AllocSetContextCreate(CurrentMemoryContext,
+					"odbclink batch context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+
+	PG_TRY();
+	{
+		for (batch = 0, first = 0; batch < nbatches; batch++, first += batch_size)
+		{
+			CHECK_FOR_INTERRUPTS();
+
+			oldcontext = MemoryContextSwitchTo(batchcontext);
+			counts[batch] = Int64GetDatum(exec_batch(i, b, first, Min(batch_size, nsets - first)));
+			MemoryContextSwitchTo(oldcontext);
+			MemoryContextReset(batchcontext);
+		}
+	}
+	PG_CATCH();
+	{
+		/* the batches before the failed one may be committed */
+		cache_invalidate(conns[i].key);
+		free_prepared(p);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	free_prepared(p);
+	MemoryContextDelete(batchcontext);
+	pfree(query);
+	cache_invalidate(conns[i].key);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(counts, nbatches, INT8OID,
+					sizeof(int64), FLOAT8PASSBYVAL, 'd'));
 }
 
-static Datum
-query_common(PG_FUNCTION_ARGS)
+/*
+ * Insert the result of a local query into a remote table. The rows
+ * are read from an SPI cursor in chunks of odbclink.batch_size and
+ * inserted by a prepared INSERT with parameter arrays, all in one
+ * remote transaction, or in the one already open on the connection.
+ * Returns the number of inserted rows.
+ */
+Datum
+odbclink_copy_to_remote_n(PG_FUNCTION_ARGS)
 {
-	FuncCallContext	   *funcctx;
-	SQLRETURN	ret;
-	odbcstmt	   *stmt;
+	int		i;
+	char	   *local_query, *remote_table;
+	SPIPlanPtr	plan;
+	Portal		portal;
+	TupleDesc	tupdesc;
+	odbcprep   *p = NULL;
+	odbcbatch  *b = NULL;
+	odbcbatchcol   *cols;
+	StringInfoData	sql;
+	MemoryContext	batchcontext, oldcontext;
+	int64		total = 0;
+	int		natts, k, row;
+	bool		own_xact;
 
-	funcctx = SRF_PERCALL_SETUP();
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+	own_xact = !(conns[i].transactional || conns[i].explicit_xact);
 
-	stmt = funcctx->user_fctx;
+	local_query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	remote_table = TextDatumGetCString(PG_GETARG_DATUM(2));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "odbclink: SPI_connect failed");
+
+	plan = SPI_prepare(local_query, 0, NULL);
+	if (plan == NULL)
+		elog(ERROR, "odbclink: SPI_prepare failed for \"%s\"", local_query);
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
 
-	ret = SQLFetch(stmt->hStmt);
+	SPI_cursor_fetch(portal, true, batch_size);
+	tupdesc = SPI_tuptable->tupdesc;
+	natts = tupdesc->natts;
 
-	if (SQL_SUCCEEDED(ret))  /* do when there is more left to send */
+	/* the columns of the local query fill the remote table in order */
+	initStringInfo(&sql);
+	appendStringInfo(&sql, "INSERT INTO %s VALUES (", remote_table);
+	for (k = 0; k < natts; k++)
+		appendStringInfoString(&sql, (k > 0 ? ", ?" : "?"));
+	appendStringInfoChar(&sql, ')');
+
+	cols = palloc0(natts * sizeof(odbcbatchcol));
+	for (k = 0; k < natts; k++)
 	{
-		Datum	   *values;
-		bool	   *nulls;
-		HeapTuple	tuple;
-		int		i;
+		plan_batch_col(&cols[k], tupdesc->attrs[k]->atttypid);
+		cols[k].elems = palloc(batch_size * sizeof(Datum));
+		cols[k].nulls = palloc(batch_size * sizeof(bool));
+	}
 
-		if (!SQL_SUCCEEDED(ret))
-		{
-			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-			elog(ERROR, "odbclink: unsuccessful SQLFetch call: %s", totalerrmsg);
-		}
+	batchcontext = AllocSetContextCreate(CurrentMemoryContext,
+					"odbclink batch context",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+
+	p = prepare_query(i, sql.data);
+
+	PG_TRY();
+	{
+		if (p->nparams != natts)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						errmsg("odbclink: the INSERT has %d parameters but the query has %d columns",
+							p->nparams, natts)));
+
+		b = init_batch(p, cols);
 
-		values = palloc(stmt->cols * sizeof(Datum));
-		nulls = palloc(stmt->cols * sizeof(bool));
+		if (own_xact)
+			set_autocommit(i, false);
 
-		PG_TRY();
+		while (SPI_processed > 0)
 		{
-			/*
-			 * Some functions called by get_data() can throw an error,
-			 * catch them and don't leak the STMT handle...
-			 */
-			for (i = 0; i < stmt->cols; i++)
-				get_data(stmt, i + 1, &values[i], &nulls[i]);
+			CHECK_FOR_INTERRUPTS();
+
+			for (row = 0; row < (int)SPI_processed; row++)
+				for (k = 0; k < natts; k++)
+					cols[k].elems[row] = heap_getattr(SPI_tuptable->vals[row], k + 1,
+								tupdesc, &cols[k].nulls[row]);
+
+			oldcontext = MemoryContextSwitchTo(batchcontext);
+			total += exec_batch(i, b, 0, (int)SPI_processed);
+			MemoryContextSwitchTo(oldcontext);
+			MemoryContextReset(batchcontext);
+
+			SPI_freetuptable(SPI_tuptable);
+			SPI_cursor_fetch(portal, true, batch_size);
 		}
-		PG_CATCH();
+
+		if (own_xact)
 		{
-			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-			PG_RE_THROW();
+			if (!SQL_SUCCEEDED(SQLEndTran(SQL_HANDLE_DBC, conns[i].hCon, SQL_COMMIT)))
+			{
+				get_sql_error(i, SQL_HANDLE_DBC, NULL);
+				elog(ERROR, "odbclink: unsuccessful commit: %s", totalerrmsg);
+			}
+			set_autocommit(i, true);
 		}
-		PG_END_TRY();
-
-		tuple = heap_form_tuple(stmt->tupdesc, values, nulls);
-
-		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
 	}
-	else
+	PG_CATCH();
 	{
-		if (ret != SQL_NO_DATA)
+		/* an open remote transaction is ended by its owner */
+		if (own_xact)
 		{
-			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
-			SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-			elog(ERROR, "odbclink: unsuccessful SQLFetch call: %s", totalerrmsg);
+			SQLEndTran(SQL_HANDLE_DBC, conns[i].hCon, SQL_ROLLBACK);
+			SQLSetConnectAttr(conns[i].hCon, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_ON, 0);
 		}
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt->hStmt);
-		SRF_RETURN_DONE(funcctx);
+		free_prepared(p);
+		PG_RE_THROW();
 	}
+	PG_END_TRY();
+
+	free_prepared(p);
+	SPI_cursor_close(portal);
+	SPI_finish();
+	cache_invalidate(conns[i].key);
+
+	pfree(local_query); pfree(remote_table);
+
+	PG_RETURN_INT64(total);
 }
 
+/*
+ * Turn the transactional mode of a connection on or off. In it the
+ * statements run in a remote transaction that is committed or rolled
+ * back with the local one.
+ */
 Datum
-odbclink_query_n(PG_FUNCTION_ARGS)
+odbclink_set_transactional_n(PG_FUNCTION_ARGS)
 {
-	if (SRF_IS_FIRSTCALL())
-	{
-		int		i;
-		char	   *query;
+	int		i = PG_GETARG_INT32(0) - 1;
+	bool		on = PG_GETARG_BOOL(1);
 
-		i = PG_GETARG_INT32(0) - 1;
-		if (!(i >= 0 && i < n_conn && conns[i].connected))
-			elog(ERROR, "odbclink: no such connection");
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
 
-		query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	if (on == conns[i].transactional)
+		PG_RETURN_VOID();
+	if (conns[i].explicit_xact)
+		elog(ERROR, "odbclink: connection %d is in a transaction begun by odbclink.begin()", i + 1);
+	if (conns[i].xactlevel > 0)
+		elog(ERROR, "odbclink: connection %d has an open remote transaction", i + 1);
 
-		init_query_common(fcinfo, i, query);
-	}
+	register_xact_callbacks();
+	set_autocommit(i, !on);
+	conns[i].transactional = on;
 
-	return query_common(fcinfo);
+	PG_RETURN_VOID();
 }
 
+/* Begin a remote transaction, ended by odbclink.commit() or odbclink.rollback() */
 Datum
-odbclink_query_dsn(PG_FUNCTION_ARGS)
+odbclink_begin_n(PG_FUNCTION_ARGS)
 {
-	if (SRF_IS_FIRSTCALL())
-	{
-		int		i;
-		char	   *dsn, *uid, *pwd;
-		char	   *query;
+	int		i = PG_GETARG_INT32(0) - 1;
 
-		dsn = TextDatumGetCString(PG_GETARG_DATUM(0));
-		uid = TextDatumGetCString(PG_GETARG_DATUM(1));
-		pwd = TextDatumGetCString(PG_GETARG_DATUM(2));
-		query = TextDatumGetCString(PG_GETARG_DATUM(3));
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
 
-		i = find_conn_dsn(dsn, uid, pwd);
-		if (i < 0)
-			i = connect_dsn(dsn, uid, pwd);
+	if (conns[i].transactional)
+		elog(ERROR, "odbclink: connection %d is in transactional mode", i + 1);
+	if (conns[i].explicit_xact)
+		elog(ERROR, "odbclink: connection %d is already in a transaction", i + 1);
 
-		init_query_common(fcinfo, i, query);
+	set_autocommit(i, false);
+	conns[i].explicit_xact = true;
 
-		pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+	PG_RETURN_VOID();
+}
+
+/*
+ * End the remote transaction of a connection, one begun by odbclink.begin()
+ * or, in transactional mode, the current one before the local transaction ends.
+ */
+static void
+end_xact(int i, bool commit)
+{
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	if (conns[i].explicit_xact)
+	{
+		if (!commit)
+			cache_invalidate(conns[i].key);
+		if (!end_remote_xact(i, commit))
+			elog(ERROR, "odbclink: unsuccessful %s: %s", (commit ? "commit" : "rollback"), totalerrmsg);
+		conns[i].explicit_xact = false;
+		set_autocommit(i, true);
+	}
+	else if (conns[i].transactional && conns[i].xactlevel > 0)
+	{
+		if (commit && conns[i].xactfailed)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						errmsg("odbclink: cannot commit the remote transaction on connection %d", i + 1),
+						errdetail("A rolled back subtransaction changed it and the data source has no savepoints.")));
+		if (!commit)
+			cache_invalidate(conns[i].key);
+		if (!end_remote_xact(i, commit))
+			elog(ERROR, "odbclink: unsuccessful %s: %s", (commit ? "commit" : "rollback"), totalerrmsg);
 	}
+	else
+		elog(WARNING, "odbclink: there is no transaction in progress on connection %d", i + 1);
+}
 
-	return query_common(fcinfo);
+Datum
+odbclink_commit_n(PG_FUNCTION_ARGS)
+{
+	end_xact(PG_GETARG_INT32(0) - 1, true);
+
+	PG_RETURN_VOID();
 }
 
 Datum
-odbclink_query_connstr(PG_FUNCTION_ARGS)
+odbclink_rollback_n(PG_FUNCTION_ARGS)
 {
-	if (SRF_IS_FIRSTCALL())
-	{
-		int		i;
-		char	   *connstr;
-		char	   *query;
+	end_xact(PG_GETARG_INT32(0) - 1, false);
 
-		connstr = TextDatumGetCString(PG_GETARG_DATUM(0));
-		query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	PG_RETURN_VOID();
+}
 
-		i = find_conn_connstr(connstr);
-		if (i < 0)
-			i = connect_connstr(connstr);
+/*
+ * Helper thread of a query sent by odbclink.send_query() to a driver
+ * without asynchronous execution. It only calls ODBC, the statement
+ * and the query text aren't touched by the backend until it's joined.
+ */
+static void *
+pending_main(void *arg)
+{
+	odbcasync  *a = (odbcasync *)arg;
+	SQLRETURN	ret;
 
-		init_query_common(fcinfo, i, query);
+	ret = SQLExecDirect(a->stmt->hStmt, (SQLCHAR *)a->query, SQL_NTS);
 
-		pfree(connstr); pfree(query);
-	}
+	pthread_mutex_lock(&a->mutex);
+	a->ret = ret;
+	a->done = true;
+	pthread_mutex_unlock(&a->mutex);
 
-	return query_common(fcinfo);
+	return NULL;
 }
 
-static void
-exec_common(PG_FUNCTION_ARGS, int i, char *query)
+/* Run the query in a helper thread, false if it can't be started */
+static bool
+start_pending_thread(odbcasync *a)
 {
-	SQLRETURN	ret;
-	odbcstmt	stmt;
+	sigset_t	sigs, oldsigs;
+	int		err;
 
-	/* Store the connection index. */
-	stmt.conn_idx = i;
+	pthread_mutex_init(&a->mutex, NULL);
 
-	/*
-	 * The allocated statement handle is the only thing
-	 * that must be freed manually. All the other allocations
-	 * are dealt by PostgreSQL's garbage collection.
-	 */
-	ret = SQLAllocStmt(conns[i].hCon, &stmt.hStmt);
-	if (!SQL_SUCCEEDED(ret))
+	/* signals are left to the backend */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+	err = pthread_create(&a->thread, NULL, pending_main, a);
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+	if (err != 0)
 	{
-		get_sql_error(i, SQL_HANDLE_DBC, NULL);
-		elog(ERROR, "odbclink: unsuccessful SQLAllocStmt call: %s", totalerrmsg);
+		pthread_mutex_destroy(&a->mutex);
+		return false;
 	}
 
-	ret = SQLExecDirect(stmt.hStmt, (SQLCHAR *)query, SQL_NTS);
-	if (!SQL_SUCCEEDED(ret))
+	a->threaded = true;
+	a->running = true;
+	return true;
+}
+
+/* Wait for the helper thread of a query, it's cancelled on an interrupt */
+static void
+wait_pending_thread(odbcasync *a)
+{
+	long		delay = 0;
+
+	while (!pending_thread_done(a))
 	{
-		get_sql_error(i, SQL_HANDLE_STMT, &stmt);
-		SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
-		elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+		CHECK_FOR_INTERRUPTS();
+		if (delay > 0)
+			pg_usleep(delay);
+		delay = next_poll_delay(delay);
 	}
-
-	SQLFreeHandle(SQL_HANDLE_STMT, stmt.hStmt);
+	join_pending(a);
 }
 
+/*
+ * Start a query without waiting for its result, the result
+ * is returned by odbclink.get_result(). The query runs in the
+ * background asynchronously if the driver supports it, otherwise
+ * in a helper thread.
+ */
 Datum
-odbclink_exec_n(PG_FUNCTION_ARGS)
+odbclink_send_query_n(PG_FUNCTION_ARGS)
 {
 	int		i;
 	char	   *query;
+	odbcasync  *a;
+	MemoryContext	oldcontext;
+	SQLRETURN	ret;
 
 	i = PG_GETARG_INT32(0) - 1;
 	if (!(i >= 0 && i < n_conn && conns[i].connected))
 		elog(ERROR, "odbclink: no such connection");
 
+	if (conns[i].pending)
+		elog(ERROR, "odbclink: another query is already running on connection %d", i + 1);
+
 	query = TextDatumGetCString(PG_GETARG_DATUM(1));
 
-	exec_common(fcinfo, i, query);
+	/* kept across transactions until the result is read */
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	a = palloc0(sizeof(odbcasync));
+	a->query = pstrdup(query);
+	a->stmt = alloc_query(i, NULL);
+	MemoryContextSwitchTo(oldcontext);
+
+	conns[i].pending = a;
+
+	remote_xact_use(i);
+	set_query_timeout(a->stmt->hStmt);
+
+	a->async = SQL_SUCCEEDED(SQLSetStmtAttr(a->stmt->hStmt, SQL_ATTR_ASYNC_ENABLE,
+				(SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0));
+
+	conns[i].stats.queries++;
+	track_stmt(a->stmt, a->query);
+	if (!a->async && start_pending_thread(a))
+	{
+		pfree(query);
+		PG_RETURN_VOID();
+	}
+
+	ret = SQLExecDirect(a->stmt->hStmt, (SQLCHAR *)a->query, SQL_NTS);
+	if (ret == SQL_STILL_EXECUTING)
+		a->running = true;
+	else if (!SQL_SUCCEEDED(ret))
+	{
+		get_sql_error(i, SQL_HANDLE_STMT, a->stmt);
+		free_pending(i, false);
+		elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+	}
+	else
+		executed_stmt(a->stmt);
+	a->ret = ret;
 
 	pfree(query);
 
 	PG_RETURN_VOID();
 }
 
+/* Poll the query sent on the connection, true while it's still running */
 Datum
-odbclink_exec_dsn(PG_FUNCTION_ARGS)
+odbclink_is_busy_n(PG_FUNCTION_ARGS)
 {
 	int		i;
-	char	   *dsn, *uid, *pwd;
-	char	   *query;
-
-	dsn = TextDatumGetCString(PG_GETARG_DATUM(0));
-	uid = TextDatumGetCString(PG_GETARG_DATUM(1));
-	pwd = TextDatumGetCString(PG_GETARG_DATUM(2));
-	query = TextDatumGetCString(PG_GETARG_DATUM(3));
+	odbcasync  *a;
 
-	i = find_conn_dsn(dsn, uid, pwd);
-	if (i < 0)
-		i = connect_dsn(dsn, uid, pwd);
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
 
-	exec_common(fcinfo, i, query);
+	a = conns[i].pending;
+	if (a == NULL || !a->running)
+		PG_RETURN_BOOL(false);
 
-	pfree(dsn); pfree(uid); pfree(pwd); pfree(query);
+	if (a->threaded)
+	{
+		if (!pending_thread_done(a))
+			PG_RETURN_BOOL(true);
+		join_pending(a);
+	}
+	else
+	{
+		/* polling repeats the original call, an error is reported by get_result() */
+		a->ret = SQLExecDirect(a->stmt->hStmt, (SQLCHAR *)a->query, SQL_NTS);
+		a->running = (a->ret == SQL_STILL_EXECUTING);
+	}
+	if (!a->running)
+		executed_stmt(a->stmt);
 
-	PG_RETURN_VOID();
+	PG_RETURN_BOOL(a->running);
 }
 
+/*
+ * Wait for the query sent on the connection and return its result as
+ * a materialized set, the result of a statement without one is empty.
+ */
 Datum
-odbclink_exec_connstr(PG_FUNCTION_ARGS)
+odbclink_get_result_n(PG_FUNCTION_ARGS)
 {
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
 	int		i;
-	char	   *connstr;
-	char	   *query;
+	odbcasync  *a;
+	odbcstmt   *stmt;
+	SQLSMALLINT	cols;
 
-	connstr = TextDatumGetCString(PG_GETARG_DATUM(0));
-	query = TextDatumGetCString(PG_GETARG_DATUM(1));
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
 
-	i = find_conn_connstr(connstr);
-	if (i < 0)
-		i = connect_connstr(connstr);
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+			(rsinfo->allowedModes & SFRM_Materialize) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("odbclink: get_result() must be called in a context that accepts a set")));
 
-	exec_common(fcinfo, i, query);
+	a = conns[i].pending;
+	if (a == NULL)
+		elog(ERROR, "odbclink: no query was sent on connection %d", i + 1);
 
-	pfree(connstr); pfree(query);
+	stmt = a->stmt;
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	PG_TRY();
+	{
+		if (a->threaded)
+		{
+			wait_pending_thread(a);
+			executed_stmt(stmt);
+		}
+		else if (a->running)
+		{
+			a->ret = wait_stmt(stmt, a->query);
+			a->running = false;
+			executed_stmt(stmt);
+		}
+
+		if (a->async)
+			SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ASYNC_ENABLE,
+					(SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+
+		if (!SQL_SUCCEEDED(a->ret))
+		{
+			get_sql_error(i, SQL_HANDLE_STMT, stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLExecDirect call: %s", totalerrmsg);
+		}
+
+		stmt->tupdesc = result_desc(fcinfo);
+
+		if (SQL_SUCCEEDED(SQLNumResultCols(stmt->hStmt, &cols)) && cols == 0)
+		{
+			rsinfo->returnMode = SFRM_Materialize;
+			rsinfo->setResult = tuplestore_begin_heap(false, false, work_mem);
+			rsinfo->setDesc = stmt->tupdesc;
+		}
+		else
+		{
+			setup_query(stmt);
+			materialize_stmt(rsinfo, stmt);
+		}
+	}
+	PG_CATCH();
+	{
+		/* the result is gone either way */
+		free_pending(i, false);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	MemoryContextSwitchTo(oldcontext);
+
+	free_pending(i, false);
+
+	return (Datum) 0;
+}
+
+/* Cancel the query sent on the connection, its result is discarded */
+Datum
+odbclink_cancel_query_n(PG_FUNCTION_ARGS)
+{
+	int		i;
+
+	i = PG_GETARG_INT32(0) - 1;
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	if (conns[i].pending && !free_pending(i, true))
+		elog(ERROR, "odbclink: the query on connection %d could not be cancelled", i + 1);
 
 	PG_RETURN_VOID();
 }
@@ -1,27 +1,264 @@
 #ifndef ODBCLINK_H
 #define ODBCLINK_H
 
+#include <pthread.h>
 #include <sql.h>
 #include <sqlext.h>
 
+#include "nodes/execnodes.h"
+#include "portability/instr_time.h"
+#include "utils/array.h"
+#include "utils/tuplestore.h"
+
+typedef struct odbcprep odbcprep;
+typedef struct odbcasync odbcasync;
+typedef struct odbcprefetch odbcprefetch;
+
+/* Statistics counters of a connection, times are in milliseconds */
+typedef struct {
+	int64		connects;
+	int64		queries;	/* statements returning rows */
+	int64		executes;	/* other statements */
+	int64		rows;
+	int64		bytes;
+	int64		errors;
+	int64		cache_hits;
+	double		connect_time;
+	double		exec_time;	/* in SQLExecDirect()/SQLExecute() */
+	double		fetch_time;	/* in SQLFetch()/SQLGetData() */
+	double		conv_time;	/* converting the values to Datums */
+} odbcstats;
+
 typedef struct {
 	int	connected;
 	char	   *dsn, *uid, *pwd;
 	char	   *connstr;
-	SQLHENV	hEnv;
 	SQLHDBC	hCon;
+	char	   *key;		/* (dsn, uid, pwd) or connstr, for the lookup */
+	uint32		hash;
+	int		hashnext;	/* next slot with the same hash */
+	int		nextfree;	/* next slot in the free list */
+	odbcprep   *prepared;	/* prepared statement cache, most recently used first */
+	int		nprepared;
+	odbcasync  *pending;	/* query sent by odbclink.send_query() */
+	odbcstats	stats;		/* not yet added to the shared statistics */
+	bool		transactional;	/* remote transactions follow the local ones */
+	bool		explicit_xact;	/* in a transaction begun by odbclink.begin() */
+	int		xactlevel;	/* local nesting level the remote transaction reaches, 0 if none */
+	bool		nosavepoints;	/* the data source refused a savepoint */
+	bool		xactfailed;	/* a subtransaction could not be rolled back remotely */
 } odbcconn;
 
+/* Entry of the connection hash table */
+typedef struct {
+	uint32		hash;		/* hash key */
+	int		first;		/* first connection slot with this hash */
+} odbcconnhash;
+
+typedef struct odbccol odbccol;
+
+/* Turns one fetched value into a Datum of the result column's type */
+typedef Datum (*odbcconv)(odbccol *c, char *val, SQLLEN len);
+
+/* Conversion plan of a result column, set up once per statement */
+struct odbccol {
+	SQLSMALLINT	type;		/* ODBC SQL type of the result column */
+	SQLULEN		columnsz;
+	SQLSMALLINT	decimals;
+	SQLSMALLINT	ctype;		/* C type the values are fetched as */
+	SQLLEN		buflen;		/* size of one value in buf */
+	SQLLEN		octetlen;	/* SQL_DESC_OCTET_LENGTH if unbound, 0 if unknown */
+	Oid		typeoid;	/* type of the PostgreSQL result column */
+	int32		typmod;
+	odbcconv	conv;
+	odbcconv	charconv;	/* converts the UTF-8 string of an SQL_C_WCHAR value */
+	bool		bound;		/* buf is bound with SQLBindCol */
+	bool		varlena;	/* the bound values have room for a varlena header */
+	char	   *buf;		/* rowset * buflen bytes if bound */
+	SQLLEN	   *ind;		/* rowset length/indicator values if bound */
+};
+
+/* Statement statistics of a remote statement, collected if query is set */
+typedef struct {
+	char	   *query;
+	instr_time	start;
+	bool		executed;
+	double		exec_time;	/* milliseconds from start to the end of the execution */
+	double		first_time;	/* to the first row */
+	int64		rows;
+	int64		bytes;
+} odbcstmttrack;
+
 typedef struct {
 	TupleDesc	tupdesc;
 	SQLHSTMT	hStmt;
 	SQLSMALLINT	cols;
 	int		conn_idx;
+	odbccol	   *col;
+	SQLULEN		rowset;		/* rows fetched by one SQLFetch */
+	SQLULEN		nrows;		/* rows in the current rowset */
+	SQLULEN		currow;		/* next row to return from the rowset */
+	SQLUSMALLINT   *rowstatus;
+	bool		unbound;	/* some columns are read with SQLGetData */
+	bool		cached;		/* hStmt belongs to the prepared statement cache */
+	Datum	   *values;	/* row buffers, allocated once with the column plan */
+	bool	   *nulls;
+	char	   *charbuf;	/* long strings read with SQLGetData(), doubled as needed */
+	Size		charbuflen;
+	MemoryContext	rowcxt;		/* the converted values of the current row */
+	odbcstmttrack	track;
+	odbcprefetch   *prefetch;	/* rowsets fetched ahead by a helper thread */
+	bool		prefetched;	/* the bound buffers were moved into a prefetch ring */
 } odbcstmt;
 
+/* A prepared statement, kept in the cache of its connection */
+struct odbcprep {
+	odbcprep   *next;
+	char	   *query;
+	SQLHSTMT	hStmt;
+	bool		cached;		/* false for a one-off statement */
+	MemoryContext	cxt;		/* holds the entry */
+	MemoryContext	plancxt;	/* holds the column plan, reset on replanning */
+	SQLSMALLINT	nparams;
+	bool		described;	/* the driver supports SQLDescribeParam() */
+	SQLSMALLINT    *paramtype;	/* from SQLDescribeParam() */
+	SQLULEN	       *paramsize;
+	SQLSMALLINT    *paramdigits;
+	odbcstmt   *stmt;		/* column plan, set up on the first execution */
+	LocalTransactionId	lxid;	/* transaction the last cursor was opened in */
+};
+
+/* A query sent by odbclink.send_query(), kept until its result is read */
+struct odbcasync {
+	odbcstmt   *stmt;		/* without tupdesc until odbclink.get_result() */
+	char	   *query;
+	bool		running;	/* SQLExecDirect() still executing */
+	bool		async;		/* the statement executes asynchronously */
+	SQLRETURN	ret;		/* result of SQLExecDirect() once done */
+	bool		threaded;	/* otherwise it runs in a helper thread, not joined yet */
+	pthread_t	thread;
+	pthread_mutex_t	mutex;
+	bool		done;		/* the thread set ret, under mutex */
+};
+
+/*
+ * A query split into ranges of a column, each read over its own connection,
+ * or the same query read from several connections
+ */
+typedef struct {
+	int		nparts;
+	char	   *column;	/* integer column the ranges are taken on */
+	int	   *conn_idx;	/* conn_idx[0] is the caller's connection */
+	bool		ownconns;	/* the other connections were opened for the scan */
+	odbcstmt  **stmt;
+	int		cur;		/* partition rows are returned from */
+	bool		fetched;	/* a row of the current rowset of cur was returned */
+} odbcpartscan;
+
+/* A parameter column of a batch, bound column-wise */
+typedef struct {
+	Oid		typeoid;
+	SQLSMALLINT	ctype;
+	SQLSMALLINT	sqltype;	/* used if the driver can't describe the parameter */
+	SQLULEN		size;
+	SQLSMALLINT	digits;
+	SQLLEN		width;		/* fixed size of a value, 0 for strings and binary */
+	FmgrInfo	outfunc;	/* makes the strings of the SQL_C_CHAR columns */
+	Datum	   *elems;
+	bool	   *nulls;
+	char	   *buf;
+	SQLLEN	   *ind;
+} odbcbatchcol;
+
+/* A prepared statement executed with arrays of parameter sets */
+typedef struct {
+	odbcprep   *p;
+	odbcbatchcol   *cols;
+	bool		arrays;		/* the driver takes parameter arrays */
+	SQLULEN		size;		/* current SQL_ATTR_PARAMSET_SIZE */
+	SQLULEN		processed;	/* SQL_ATTR_PARAMS_PROCESSED_PTR */
+	SQLUSMALLINT   *status;	/* SQL_ATTR_PARAM_STATUS_PTR */
+} odbcbatch;
+
+/* Identifies a result in the result cache */
+typedef struct {
+	uint32		hash;		/* of the connection, query, parameters and result columns */
+	uint32		check;		/* second hash of the same */
+	uint32		connhash;	/* of the connection, for invalidating its results */
+	/* not hashed, compared on a hit against collisions */
+	uint32		querylen;	/* length of the query */
+	uint32		keylen;		/* length of everything hashed */
+	uint32		queryhash;	/* of the query alone */
+} odbccachekey;
+
+#define CACHEKEYSIZE	offsetof(odbccachekey, querylen)
+
 #define CONNCHUNK	(4)
 
 #define CHARVALCHUNK	(4096)
+#define LOBFIRSTCHUNK	(65536)
+#define LOBDIRECTSIZE	(1024)
+
+#define FETCHSIZE	(100)
+#define MAXBINDLEN	(32768)
+#define MAXNUMERICPREC	(38)
+#define MAXPARTITIONS	(64)
+#define PREPCACHESIZE	(16)
+#define BATCHSIZE	(1000)
+#define PREFETCHBLOCKS	(4)
+
+#define POLLMINDELAY	(100L)		/* microseconds */
+#define POLLMAXDELAY	(10000L)
+#define CANCELWAIT	(10000000L)
+
+extern odbcconn	*conns;
+extern int	n_conn;
+extern char	totalerrmsg[];
+
+extern char *conn_key(const char *dsn, const char *uid, const char *pwd, const char *connstr);
+extern int  find_conn_dsn(const char *dsn, const char *uid, const char *pwd);
+extern int  find_conn_connstr(const char *connstr);
+extern int  connect_dsn(const char *dsn, const char *uid, const char *pwd);
+extern int  connect_connstr(const char *connstr);
+extern void disconnect_conn(int i);
+extern char *get_sql_error(int i, int type, odbcstmt *stmt);
+extern odbcstmt *open_query(int i, char *query, TupleDesc tupdesc);
+extern bool fetch_row(odbcstmt *stmt, Datum *values, bool *nulls);
+extern void free_stmt(odbcstmt *stmt);
+extern void exec_query(int i, char *query);
+extern bool set_numeric_desc(odbcstmt *stmt, int col);
+
+/* odbclink_pool.c */
+extern void pool_init(void);
+extern bool pool_usable(int i, TupleDesc tupdesc);
+extern bool pool_cancel_requested(void);
+extern Tuplestorestate *pool_query(const char *dsn, const char *uid, const char *pwd,
+				const char *connstr, char *query, TupleDesc tupdesc, bool randomAccess);
+extern void pool_exec(const char *dsn, const char *uid, const char *pwd,
+				const char *connstr, char *query);
+extern void odbclink_pool_main(Datum main_arg);
+
+/* odbclink_prefetch.c */
+extern void prefetch_init(void);
+extern void prefetch_start(odbcstmt *stmt);
+extern SQLRETURN prefetch_next(odbcstmt *stmt);
+extern void prefetch_end(odbcstmt *stmt);
+
+/* odbclink_cache.c */
+extern void cache_init(void);
+extern bool cache_enabled(void);
+extern void cache_key(odbccachekey *key, const char *connkey, const char *query,
+				ArrayType *params, TupleDesc tupdesc);
+extern bool cache_fetch(odbccachekey *key, bool local, ReturnSetInfo *rsinfo, TupleDesc tupdesc);
+extern void cache_store(odbccachekey *key, bool local, ReturnSetInfo *rsinfo);
+extern void cache_invalidate(const char *connkey);
+
+/* odbclink_stats.c */
+extern void stats_init(void);
+extern void stats_flush(const char *connkey, odbcstats *stats);
+extern bool stmt_stats_enabled(void);
+extern void stmt_stats(const char *connkey, const char *query, double exec_time,
+				double first_time, double total_time, int64 rows, int64 bytes);
 
 extern void  _PG_init(void);
 extern void  _PG_fini(void);
@@ -32,8 +269,31 @@ extern Datum odbclink_disconnect(PG_FUNCTION_ARGS);
 extern Datum odbclink_query_n(PG_FUNCTION_ARGS);
 extern Datum odbclink_query_dsn(PG_FUNCTION_ARGS);
 extern Datum odbclink_query_connstr(PG_FUNCTION_ARGS); 
+extern Datum odbclink_query_params_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_query_partitioned_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_query_partitioned_dsn(PG_FUNCTION_ARGS);
+extern Datum odbclink_query_partitioned_connstr(PG_FUNCTION_ARGS);
+extern Datum odbclink_query_multi_n(PG_FUNCTION_ARGS);
 extern Datum odbclink_exec_n(PG_FUNCTION_ARGS);
 extern Datum odbclink_exec_dsn(PG_FUNCTION_ARGS);
 extern Datum odbclink_exec_connstr(PG_FUNCTION_ARGS); 
+extern Datum odbclink_exec_params_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_exec_batch_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_copy_to_remote_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_set_transactional_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_begin_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_commit_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_rollback_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_send_query_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_is_busy_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_get_result_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_cancel_query_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_cache_invalidate(PG_FUNCTION_ARGS);
+extern Datum odbclink_cache_invalidate_n(PG_FUNCTION_ARGS);
+extern Datum odbclink_stats(PG_FUNCTION_ARGS);
+extern Datum odbclink_stats_reset(PG_FUNCTION_ARGS);
+extern Datum odbclink_statement_stats(PG_FUNCTION_ARGS);
+extern Datum odbclink_fdw_handler(PG_FUNCTION_ARGS);
+extern Datum odbclink_fdw_validator(PG_FUNCTION_ARGS);
 
 #endif
@@ -0,0 +1,68 @@
+#!/bin/sh
+#
+# Measure the fetch throughput of odbclink.query() per column type and
+# fetch mode. Needs a database with odbclink installed and a server
+# started with ODBCSYSINI pointing to the test directory, the rows come
+# from gen() of the test driver (see the README):
+#
+#   ./odbclink_bench.sh [database [rows [width [lob]]]]
+#   ./odbclink_bench.sh mydb 1000000 32 4000
+#
+# width is the size of the short string and binary columns, lob the size
+# of the long ones. Run it as a superuser, it resets the counters with
+# odbclink.stats_reset(). For every column and mode it prints the rows
+# fetched, rows per second and MB per second of odbclink.stats()
+# fetch_time plus conv_time.
+
+DB=${1:-${PGDATABASE:-postgres}}
+ROWS=${2:-100000}
+WIDTH=${3:-32}
+LOB=${4:-1000}
+
+# column:local type
+COLUMNS="c_int4:int4 c_int8:int8 c_float4:float4 c_numeric:numeric c_varchar:varchar c_text:text c_wtext:text c_timestamp:timestamp c_blob:bytea"
+
+# fetch_size:materialize:prefetch
+MODES="1:on:off 100:on:off 1000:on:off 100:off:off 100:on:on 1000:on:on"
+
+script()
+{
+	cat <<EOF
+\\set ON_ERROR_STOP on
+\\pset format unaligned
+\\pset tuples_only on
+\\pset fieldsep ' '
+\\o /dev/null
+SELECT odbclink.connect('DSN=odbclink_test');
+SET odbclink.track_timing = on;
+\\o
+SELECT 'column', 'fetch_size', 'materialize', 'prefetch', 'rows', 'rows/s', 'MB/s';
+EOF
+	for col in $COLUMNS
+	do
+		name=${col%%:*}
+		type=${col#*:}
+		for mode in $MODES
+		do
+			fs=${mode%%:*}
+			rest=${mode#*:}
+			mat=${rest%%:*}
+			pf=${rest#*:}
+			cat <<EOF
+SET odbclink.fetch_size = $fs;
+SET odbclink.materialize = $mat;
+SET odbclink.prefetch = $pf;
+\\o /dev/null
+SELECT odbclink.stats_reset();
+SELECT count(*) FROM odbclink.query(1, 'SELECT $name FROM gen($ROWS, 0, $WIDTH, $LOB)') AS t(v $type);
+\\o
+SELECT '$name', $fs, '$mat', '$pf', rows,
+	round((rows / (nullif(fetch_time + conv_time, 0) / 1000))::numeric),
+	round((bytes / (nullif(fetch_time + conv_time, 0) * 1000))::numeric, 1)
+	FROM odbclink.stats();
+EOF
+		done
+	done
+}
+
+script | psql -X -q -d "$DB" | column -t
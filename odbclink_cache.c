@@ -0,0 +1,618 @@
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "access/hash.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "lib/stringinfo.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#if PG_VERSION_NUM >= 100000
+#include "utils/dsa.h"
+#endif
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "odbclink.h"
+
+PG_FUNCTION_INFO_V1(odbclink_cache_invalidate);
+PG_FUNCTION_INFO_V1(odbclink_cache_invalidate_n);
+
+/*
+ * Cache of materialized query results. A result is stored as its
+ * tuples one after the other, each preceded by its length:
+ * MAXALIGN(uint32) bytes of length, then the MAXALIGN'ed tuple data.
+ */
+#define CACHE_OFF		0
+#define CACHE_TRANSACTION	1
+#define CACHE_SHARED		2
+
+static const struct config_enum_entry cache_options[] = {
+	{ "off", CACHE_OFF, false },
+	{ "transaction", CACHE_TRANSACTION, false },
+	{ "shared", CACHE_SHARED, false },
+	{ NULL, 0, false }
+};
+
+#define CACHETTL	(60)
+#define CACHEENTRIES	(1024)
+
+static int	result_cache = CACHE_OFF;
+static int	cache_ttl = CACHETTL;
+static int	cache_size = 0;
+
+/* A cached result of the current transaction */
+typedef struct {
+	odbccachekey	key;
+	char	   *data;
+	Size		len;
+} odbclocalentry;
+
+static HTAB	   *local_cache = NULL;
+static LocalTransactionId	local_cache_lxid = InvalidLocalTransactionId;
+
+/* Whether the entry found under key was stored for the same query */
+static bool
+same_query(odbccachekey *entry, odbccachekey *key)
+{
+	return (entry->querylen == key->querylen &&
+			entry->keylen == key->keylen &&
+			entry->queryhash == key->queryhash);
+}
+
+#if PG_VERSION_NUM >= 100000
+
+/*
+ * The shared cache keeps the results in a DSA area created in place in
+ * the main shared memory, so its size is fixed at server start. The
+ * entries are found through a shared hash table, both are protected
+ * by one LWLock. Least recently used results are evicted for new ones.
+ */
+typedef struct {
+	LWLock	   *lock;
+	int		tranche;	/* of the DSA area */
+	Size		size;		/* bytes of the DSA area */
+	uint64		clock;		/* use counter for the LRU eviction */
+} odbccache;
+
+typedef struct {
+	odbccachekey	key;
+	dsa_pointer	data;
+	Size		len;
+	TimestampTz	expires;
+	uint64		lastused;
+} odbcsharedentry;
+
+#define CACHEAREA(c)	((char *)(c) + MAXALIGN(sizeof(odbccache)))
+
+static odbccache   *cache = NULL;
+static HTAB	   *cache_hash = NULL;
+static dsa_area	   *cache_area = NULL;
+static shmem_startup_hook_type	prev_shmem_startup_hook = NULL;
+
+static Size
+cache_shmem_size(void)
+{
+	return add_size(MAXALIGN(sizeof(odbccache)), mul_size(cache_size, 1024));
+}
+
+static void
+cache_shmem_startup(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	cache = ShmemInitStruct("odbclink cache", cache_shmem_size(), &found);
+	if (!found)
+	{
+		cache->lock = &(GetNamedLWLockTranche("odbclink cache"))->lock;
+		cache->tranche = LWLockNewTrancheId();
+		cache->size = (Size)cache_size * 1024;
+		cache->clock = 0;
+
+		/* the backends attach to it when they first use it */
+		dsa_set_size_limit(dsa_create_in_place(CACHEAREA(cache), cache->size,
+						cache->tranche, NULL), cache->size);
+	}
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = CACHEKEYSIZE;
+	info.entrysize = sizeof(odbcsharedentry);
+	cache_hash = ShmemInitHash("odbclink cache entries", CACHEENTRIES, CACHEENTRIES,
+					&info, HASH_ELEM | HASH_BLOBS | HASH_FIXED_SIZE);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+attach_cache(void)
+{
+	MemoryContext	oldcontext;
+
+	if (cache_area)
+		return;
+
+	LWLockRegisterTranche(cache->tranche, "odbclink cache area");
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	cache_area = dsa_attach_in_place(CACHEAREA(cache), NULL);
+	dsa_pin_mapping(cache_area);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/* Free a shared entry, called with the lock held exclusively */
+static void
+remove_shared(odbcsharedentry *entry)
+{
+	dsa_free(cache_area, entry->data);
+	hash_search(cache_hash, &entry->key, HASH_REMOVE, NULL);
+}
+
+static bool
+evict_shared(void)
+{
+	HASH_SEQ_STATUS	status;
+	odbcsharedentry	   *entry;
+	odbcsharedentry	   *lru = NULL;
+
+	hash_seq_init(&status, cache_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+		if (lru == NULL || entry->lastused < lru->lastused)
+			lru = entry;
+
+	if (lru == NULL)
+		return false;
+
+	remove_shared(lru);
+	return true;
+}
+
+static char *
+fetch_shared(odbccachekey *key, Size *len)
+{
+	odbcsharedentry	   *entry;
+	char	   *data = NULL;
+
+	attach_cache();
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	entry = hash_search(cache_hash, key, HASH_FIND, NULL);
+	if (entry && (entry->expires <= GetCurrentTimestamp() || !same_query(&entry->key, key)))
+		remove_shared(entry);
+	else if (entry)
+	{
+		data = palloc(entry->len);
+		memcpy(data, dsa_get_address(cache_area, entry->data), entry->len);
+		*len = entry->len;
+		entry->lastused = ++cache->clock;
+	}
+
+	LWLockRelease(cache->lock);
+
+	return data;
+}
+
+static void
+store_shared(odbccachekey *key, char *data, Size len)
+{
+	odbcsharedentry	   *entry;
+	dsa_pointer	dp;
+
+	attach_cache();
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	entry = hash_search(cache_hash, key, HASH_FIND, NULL);
+	if (entry)
+		remove_shared(entry);
+
+	while ((dp = dsa_allocate_extended(cache_area, len, DSA_ALLOC_NO_OOM)) == InvalidDsaPointer)
+		if (!evict_shared())
+			break;
+
+	while (dp != InvalidDsaPointer &&
+			(entry = hash_search(cache_hash, key, HASH_ENTER_NULL, NULL)) == NULL)
+		if (!evict_shared())
+		{
+			dsa_free(cache_area, dp);
+			dp = InvalidDsaPointer;
+		}
+
+	if (dp != InvalidDsaPointer)
+	{
+		memcpy(dsa_get_address(cache_area, dp), data, len);
+		entry->key = *key;
+		entry->data = dp;
+		entry->len = len;
+		entry->expires = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), cache_ttl * 1000);
+		entry->lastused = ++cache->clock;
+	}
+
+	LWLockRelease(cache->lock);
+}
+
+static void
+invalidate_shared(uint32 connhash, bool all)
+{
+	HASH_SEQ_STATUS	status;
+	odbcsharedentry	   *entry;
+
+	if (cache == NULL)
+		return;
+
+	attach_cache();
+
+	LWLockAcquire(cache->lock, LW_EXCLUSIVE);
+
+	/* removing the entry just returned is allowed */
+	hash_seq_init(&status, cache_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+		if (all || entry->key.connhash == connhash)
+			remove_shared(entry);
+
+	LWLockRelease(cache->lock);
+}
+
+#endif	/* PG_VERSION_NUM >= 100000 */
+
+void
+cache_init(void)
+{
+	DefineCustomEnumVariable("odbclink.result_cache",
+				"Caches the materialized results of odbclink.query().",
+				"transaction keeps them until the end of the transaction, "
+				"shared keeps them in shared memory for odbclink.cache_ttl seconds.",
+				&result_cache,
+				CACHE_OFF,
+				cache_options,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.cache_ttl",
+				"Seconds a result is kept in the shared result cache.",
+				NULL,
+				&cache_ttl,
+				CACHETTL,
+				1,
+				INT_MAX / 1000,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+#if PG_VERSION_NUM >= 100000
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomIntVariable("odbclink.cache_size",
+				"Kilobytes of shared memory for the shared result cache.",
+				"odbclink must be in shared_preload_libraries to use it.",
+				&cache_size,
+				0,
+				0,
+				MAX_KILOBYTES,
+				PGC_POSTMASTER,
+				GUC_UNIT_KB,
+				NULL,
+				NULL,
+				NULL);
+
+	if (cache_size == 0)
+		return;
+
+	if ((Size)cache_size * 1024 < dsa_minimum_size())
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("odbclink: odbclink.cache_size must be at least %d kB",
+						(int)((dsa_minimum_size() + 1023) / 1024))));
+
+	RequestAddinShmemSpace(add_size(cache_shmem_size(),
+				hash_estimate_size(CACHEENTRIES, sizeof(odbcsharedentry))));
+	RequestNamedLWLockTranche("odbclink cache", 1);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = cache_shmem_startup;
+#endif
+}
+
+bool
+cache_enabled(void)
+{
+	return (result_cache != CACHE_OFF);
+}
+
+/* The shared cache is used if it's enabled and was set up at server start */
+static bool
+use_shared(void)
+{
+#if PG_VERSION_NUM >= 100000
+	return (result_cache == CACHE_SHARED && cache != NULL);
+#else
+	return false;
+#endif
+}
+
+/*
+ * Hash the connection, the query, its parameters and the result columns.
+ * Two hashes of the key are kept instead of the key itself, so the
+ * credentials in the connection key don't get into the shared cache.
+ * The lengths and the hash of the query alone are checked on a hit.
+ */
+void
+cache_key(odbccachekey *key, const char *connkey, const char *query,
+		ArrayType *params, TupleDesc tupdesc)
+{
+	StringInfoData	buf;
+	int		k;
+
+	initStringInfo(&buf);
+	appendBinaryStringInfo(&buf, connkey, strlen(connkey) + 1);
+	appendBinaryStringInfo(&buf, query, strlen(query) + 1);
+
+	if (params)
+	{
+		Datum	   *elems;
+		bool	   *nulls;
+		int		nelems;
+
+		deconstruct_array(params, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+		appendBinaryStringInfo(&buf, (char *)&nelems, sizeof(int));
+		for (k = 0; k < nelems; k++)
+		{
+			if (nulls[k])
+				appendStringInfoChar(&buf, 'N');
+			else
+			{
+				text	   *t = DatumGetTextPP(elems[k]);
+				int		len = VARSIZE_ANY_EXHDR(t);
+
+				appendStringInfoChar(&buf, 'V');
+				appendBinaryStringInfo(&buf, (char *)&len, sizeof(int));
+				appendBinaryStringInfo(&buf, VARDATA_ANY(t), len);
+			}
+		}
+	}
+
+	appendBinaryStringInfo(&buf, (char *)&tupdesc->natts, sizeof(int));
+	for (k = 0; k < tupdesc->natts; k++)
+	{
+		appendBinaryStringInfo(&buf, (char *)&tupdesc->attrs[k]->atttypid, sizeof(Oid));
+		appendBinaryStringInfo(&buf, (char *)&tupdesc->attrs[k]->atttypmod, sizeof(int32));
+	}
+
+	key->connhash = DatumGetUInt32(hash_any((const unsigned char *)connkey, strlen(connkey)));
+	key->hash = DatumGetUInt32(hash_any((const unsigned char *)buf.data, buf.len));
+	appendStringInfoChar(&buf, 'K');
+	key->check = DatumGetUInt32(hash_any((const unsigned char *)buf.data, buf.len));
+	key->querylen = strlen(query);
+	key->keylen = buf.len;
+	key->queryhash = DatumGetUInt32(hash_any((const unsigned char *)query, key->querylen));
+
+	pfree(buf.data);
+}
+
+/* The transaction cache is forgotten with the memory of the transaction */
+static HTAB *
+get_local_cache(void)
+{
+	HASHCTL		info;
+
+	if (local_cache && local_cache_lxid == MyProc->lxid)
+		return local_cache;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = CACHEKEYSIZE;
+	info.entrysize = sizeof(odbclocalentry);
+	info.hash = tag_hash;
+	info.hcxt = TopTransactionContext;
+	local_cache = hash_create("odbclink transaction cache", 16, &info,
+					HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+	local_cache_lxid = MyProc->lxid;
+
+	return local_cache;
+}
+
+/*
+ * Return the cached result of key as the materialized result of the call,
+ * false if it's not cached. With local only the transaction cache is used.
+ */
+bool
+cache_fetch(odbccachekey *key, bool local, ReturnSetInfo *rsinfo, TupleDesc tupdesc)
+{
+	Tuplestorestate	   *tupstore;
+	char	   *data = NULL;
+	Size		len = 0;
+	Size		pos;
+	bool		shared = (!local && use_shared());
+
+	if (shared)
+	{
+#if PG_VERSION_NUM >= 100000
+		data = fetch_shared(key, &len);
+#endif
+	}
+	else
+	{
+		odbclocalentry	   *entry;
+
+		entry = hash_search(get_local_cache(), key, HASH_FIND, NULL);
+		if (entry && same_query(&entry->key, key))
+		{
+			data = entry->data;
+			len = entry->len;
+		}
+	}
+
+	if (data == NULL)
+		return false;
+
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	for (pos = 0; pos < len; )
+	{
+		HeapTupleData	tuple;
+
+		tuple.t_len = *(uint32 *)(data + pos);
+		pos += MAXALIGN(sizeof(uint32));
+		tuple.t_data = (HeapTupleHeader)(data + pos);
+		pos += MAXALIGN(tuple.t_len);
+		ItemPointerSetInvalid(&tuple.t_self);
+		tuple.t_tableOid = InvalidOid;
+		tuplestore_puttuple(tupstore, &tuple);
+	}
+
+	if (shared)
+		pfree(data);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	return true;
+}
+
+/*
+ * Store the materialized result of the call under key, in the transaction
+ * cache only with local. Results larger than a quarter of the shared cache
+ * or work_mem for the transaction cache aren't kept.
+ */
+void
+cache_store(odbccachekey *key, bool local, ReturnSetInfo *rsinfo)
+{
+	Tuplestorestate	   *tupstore = rsinfo->setResult;
+	TupleTableSlot	   *slot;
+	StringInfoData	buf;
+	Size		limit;
+	bool		fits = true;
+	bool		shared = (!local && use_shared());
+	static const char	zeros[MAXIMUM_ALIGNOF];
+
+	limit = (Size)work_mem * 1024;
+#if PG_VERSION_NUM >= 100000
+	if (shared)
+		limit = cache->size / 4;
+#endif
+
+	initStringInfo(&buf);
+	slot = MakeSingleTupleTableSlot(rsinfo->setDesc);
+
+#if PG_VERSION_NUM >= 90000
+	while (tuplestore_gettupleslot(tupstore, true, false, slot))
+#else
+	while (tuplestore_gettupleslot(tupstore, true, slot))
+#endif
+	{
+		HeapTuple	tuple = ExecFetchSlotTuple(slot);
+		uint32		len = tuple->t_len;
+
+		if (buf.len + MAXALIGN(sizeof(uint32)) + MAXALIGN(len) > limit)
+		{
+			fits = false;
+			break;
+		}
+
+		appendBinaryStringInfo(&buf, (char *)&len, sizeof(uint32));
+		appendBinaryStringInfo(&buf, zeros, MAXALIGN(sizeof(uint32)) - sizeof(uint32));
+		appendBinaryStringInfo(&buf, (char *)tuple->t_data, len);
+		appendBinaryStringInfo(&buf, zeros, MAXALIGN(len) - len);
+	}
+
+	ExecDropSingleTupleTableSlot(slot);
+
+	/* the executor reads the result from the start */
+	tuplestore_rescan(tupstore);
+
+	if (fits && shared)
+	{
+#if PG_VERSION_NUM >= 100000
+		store_shared(key, buf.data, buf.len);
+#endif
+	}
+	else if (fits)
+	{
+		HTAB	   *local = get_local_cache();
+		odbclocalentry	   *entry;
+		bool		found;
+
+		entry = hash_search(local, key, HASH_ENTER, &found);
+		if (found)
+			pfree(entry->data);
+		entry->key = *key;
+		entry->data = MemoryContextAlloc(TopTransactionContext, buf.len + 1);
+		memcpy(entry->data, buf.data, buf.len);
+		entry->len = buf.len;
+	}
+
+	pfree(buf.data);
+}
+
+/* Drop the cached results of a connection, or all of them if connkey is NULL */
+void
+cache_invalidate(const char *connkey)
+{
+	HASH_SEQ_STATUS	status;
+	odbclocalentry	   *entry;
+	uint32		connhash = 0;
+
+	if (connkey)
+		connhash = DatumGetUInt32(hash_any((const unsigned char *)connkey, strlen(connkey)));
+
+	if (local_cache && local_cache_lxid == MyProc->lxid)
+	{
+		hash_seq_init(&status, local_cache);
+		while ((entry = hash_seq_search(&status)) != NULL)
+			if (connkey == NULL || entry->key.connhash == connhash)
+			{
+				pfree(entry->data);
+				hash_search(local_cache, &entry->key, HASH_REMOVE, NULL);
+			}
+	}
+
+#if PG_VERSION_NUM >= 100000
+	invalidate_shared(connhash, connkey == NULL);
+#endif
+}
+
+Datum
+odbclink_cache_invalidate(PG_FUNCTION_ARGS)
+{
+	cache_invalidate(NULL);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+odbclink_cache_invalidate_n(PG_FUNCTION_ARGS)
+{
+	int	i = PG_GETARG_INT32(0) - 1;
+
+	if (!(i >= 0 && i < n_conn && conns[i].connected))
+		elog(ERROR, "odbclink: no such connection");
+
+	cache_invalidate(conns[i].key);
+
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,936 @@
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "access/reloptions.h"
+#include "access/sysattr.h"
+#include "access/transam.h"
+#include "catalog/pg_foreign_server.h"
+#include "catalog/pg_foreign_table.h"
+#include "catalog/pg_type.h"
+#include "catalog/pg_user_mapping.h"
+#include "commands/defrem.h"
+#include "commands/explain.h"
+#include "foreign/fdwapi.h"
+#include "foreign/foreign.h"
+#include "lib/stringinfo.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/cost.h"
+#include "optimizer/pathnode.h"
+#include "optimizer/planmain.h"
+#include "optimizer/restrictinfo.h"
+#include "optimizer/var.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datetime.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/timestamp.h"
+
+#include "odbclink.h"
+
+PG_FUNCTION_INFO_V1(odbclink_fdw_handler);
+PG_FUNCTION_INFO_V1(odbclink_fdw_validator);
+
+#if PG_VERSION_NUM >= 90200
+
+/*
+ * Valid options of odbclink_fdw objects:
+ * the server needs either dsn or connstr, the credentials for a dsn
+ * come from the user mapping, the remote table name defaults to the
+ * name of the foreign table and the remote column name to the
+ * name of the column.
+ */
+typedef struct {
+	const char *optname;
+	Oid		optcontext;
+} odbcfdwoption;
+
+static const odbcfdwoption valid_options[] = {
+	{ "dsn", ForeignServerRelationId },
+	{ "connstr", ForeignServerRelationId },
+	{ "uid", UserMappingRelationId },
+	{ "pwd", UserMappingRelationId },
+	{ "table_name", ForeignTableRelationId },
+	{ "column_name", AttributeRelationId },
+	{ NULL, InvalidOid }
+};
+
+/* Planner information of a foreign table, kept in baserel->fdw_private */
+typedef struct {
+	int		conn_idx;
+	char	   *table_name;
+	char	  **colnames;	/* remote column names by attnum - 1 */
+	char		quote[4];	/* SQL_IDENTIFIER_QUOTE_CHAR, empty if none */
+	SQLUINTEGER	predicates;	/* SQL_SQL92_PREDICATES */
+	List	   *remote_conds;	/* deparsed conditions shipped to the remote side */
+	List	   *local_conds;	/* RestrictInfos evaluated locally */
+} odbcfdwrel;
+
+/* Execution state of a foreign scan */
+typedef struct {
+	int		conn_idx;
+	char	   *query;
+	List	   *retrieved_attrs;	/* attnums of the columns in the remote SELECT list */
+	TupleDesc	tupdesc;	/* descriptor of the remote SELECT list */
+	MemoryContext	scancxt;	/* holds the statement, reset on rescan */
+	odbcstmt   *stmt;
+	bool		eof;
+	Datum	   *values;
+	bool	   *nulls;
+} odbcfdwstate;
+
+/* State of deparsing one condition */
+typedef struct {
+	RelOptInfo *baserel;
+	odbcfdwrel *fpinfo;
+	StringInfo	buf;
+	bool		recheck;	/* the remote result may be a superset */
+} odbcdeparse;
+
+static bool deparse_expr(Node *node, odbcdeparse *ctx);
+
+/*
+ * Get the connection of a foreign table by the options of its server
+ * and the user mapping, connecting if it's not open yet.
+ */
+static int
+fdw_get_conn(Oid foreigntableid)
+{
+	ForeignTable   *table = GetForeignTable(foreigntableid);
+	ForeignServer  *server = GetForeignServer(table->serverid);
+	UserMapping    *user = GetUserMapping(GetUserId(), table->serverid);
+	char	   *dsn = NULL, *connstr = NULL;
+	char	   *uid = "", *pwd = "";
+	ListCell   *lc;
+	int		i;
+
+	foreach(lc, server->options)
+	{
+		DefElem	   *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "dsn") == 0)
+			dsn = defGetString(def);
+		else if (strcmp(def->defname, "connstr") == 0)
+			connstr = defGetString(def);
+	}
+	foreach(lc, user->options)
+	{
+		DefElem	   *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "uid") == 0)
+			uid = defGetString(def);
+		else if (strcmp(def->defname, "pwd") == 0)
+			pwd = defGetString(def);
+	}
+
+	if (connstr)
+	{
+		i = find_conn_connstr(connstr);
+		if (i < 0)
+			i = connect_connstr(connstr);
+	}
+	else if (dsn)
+	{
+		i = find_conn_dsn(dsn, uid, pwd);
+		if (i < 0)
+			i = connect_dsn(dsn, uid, pwd);
+	}
+	else
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_OPTION_NAME_NOT_FOUND),
+					errmsg("odbclink: server \"%s\" needs either a dsn or a connstr option",
+						server->servername)));
+		i = -1;		/* keep compiler quiet */
+	}
+
+	return i;
+}
+
+/*
+ * Remote identifiers are only quoted if they aren't plain lowercase
+ * identifiers, so the remote side can fold them to its own case.
+ * Use the table_name and column_name options for the exact names.
+ */
+static char *
+fdw_quote_ident(const char *ident, const char *quote)
+{
+	const char *p;
+	bool		plain = (*ident >= 'a' && *ident <= 'z') || *ident == '_';
+	StringInfoData	buf;
+
+	for (p = ident; plain && *p; p++)
+		if (!((*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '_'))
+			plain = false;
+
+	if (plain || quote[0] == '\0')
+		return pstrdup(ident);
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, quote);
+	for (p = ident; *p; p++)
+	{
+		/* double the quote character inside the identifier */
+		if (*p == quote[0])
+			appendStringInfoChar(&buf, *p);
+		appendStringInfoChar(&buf, *p);
+	}
+	appendStringInfoString(&buf, quote);
+
+	return buf.data;
+}
+
+/* Types whose comparisons and constants can be sent to the remote side */
+static bool
+shippable_type(Oid typeoid)
+{
+	switch (typeoid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+		case DATEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+			return true;
+	}
+	return false;
+}
+
+/*
+ * String comparisons depend on the remote collation and case
+ * sensitivity, these are only shipped where the remote result
+ * can only be a superset and they are rechecked locally.
+ */
+static bool
+string_type(Oid typeoid)
+{
+	return (typeoid == TEXTOID || typeoid == VARCHAROID || typeoid == BPCHAROID);
+}
+
+static bool
+deparse_var(Var *var, odbcdeparse *ctx)
+{
+	if (var->varno != ctx->baserel->relid || var->varlevelsup != 0 ||
+			var->varattno <= 0 || !shippable_type(var->vartype))
+		return false;
+
+	appendStringInfoString(ctx->buf, ctx->fpinfo->colnames[var->varattno - 1]);
+	if (string_type(var->vartype))
+		ctx->recheck = true;
+
+	return true;
+}
+
+/*
+ * Constants are written as plain SQL literals or ODBC escape
+ * sequences for dates and times, so the driver can translate
+ * them for the remote dialect.
+ */
+static bool
+deparse_value(Oid typeoid, Datum value, odbcdeparse *ctx)
+{
+	switch (typeoid)
+	{
+		case INT2OID:
+			appendStringInfo(ctx->buf, "%d", (int) DatumGetInt16(value));
+			return true;
+
+		case INT4OID:
+			appendStringInfo(ctx->buf, "%d", DatumGetInt32(value));
+			return true;
+
+		case INT8OID:
+			appendStringInfo(ctx->buf, INT64_FORMAT, DatumGetInt64(value));
+			return true;
+
+		case FLOAT4OID:
+		case FLOAT8OID:
+		{
+			double	val = (typeoid == FLOAT4OID ? DatumGetFloat4(value) : DatumGetFloat8(value));
+
+			if (isnan(val) || isinf(val))
+				return false;
+			appendStringInfo(ctx->buf, "%.*g", (typeoid == FLOAT4OID ? 9 : 17), val);
+			return true;
+		}
+
+		case NUMERICOID:
+		{
+			char	   *str = DatumGetCString(DirectFunctionCall1(numeric_out, value));
+
+			if (strcmp(str, "NaN") == 0)
+				return false;
+			appendStringInfoString(ctx->buf, str);
+			return true;
+		}
+
+		case DATEOID:
+		{
+			DateADT	date = DatumGetDateADT(value);
+			int	year, mon, mday;
+
+			if (DATE_NOT_FINITE(date))
+				return false;
+			j2date(date + POSTGRES_EPOCH_JDATE, &year, &mon, &mday);
+			if (year <= 0)
+				return false;
+			appendStringInfo(ctx->buf, "{d '%04d-%02d-%02d'}", year, mon, mday);
+			return true;
+		}
+
+#ifdef HAVE_INT64_TIMESTAMP
+		case TIMEOID:
+		{
+			TimeADT	time = DatumGetTimeADT(value);
+
+			/* the ODBC time escape has no fraction */
+			if (time % USECS_PER_SEC != 0)
+				return false;
+			appendStringInfo(ctx->buf, "{t '%02d:%02d:%02d'}",
+					(int) (time / USECS_PER_HOUR),
+					(int) (time / USECS_PER_MINUTE % MINS_PER_HOUR),
+					(int) (time / USECS_PER_SEC % SECS_PER_MINUTE));
+			return true;
+		}
+
+		case TIMESTAMPOID:
+		{
+			Timestamp	ts = DatumGetTimestamp(value);
+			struct pg_tm	tm;
+			fsec_t		fsec;
+
+			if (TIMESTAMP_NOT_FINITE(ts) ||
+					timestamp2tm(ts, NULL, &tm, &fsec, NULL, NULL) != 0 ||
+					tm.tm_year <= 0)
+				return false;
+			appendStringInfo(ctx->buf, "{ts '%04d-%02d-%02d %02d:%02d:%02d",
+					tm.tm_year, tm.tm_mon, tm.tm_mday,
+					tm.tm_hour, tm.tm_min, tm.tm_sec);
+			if (fsec != 0)
+				appendStringInfo(ctx->buf, ".%06d", (int) fsec);
+			appendStringInfoString(ctx->buf, "'}");
+			return true;
+		}
+#endif
+
+		case TEXTOID:
+		case VARCHAROID:
+		case BPCHAROID:
+		{
+			char	   *str = TextDatumGetCString(value);
+			char	   *p;
+
+			/*
+			 * Backslashes are escapes in some dialects and non-ASCII
+			 * characters may be converted by the driver, both could
+			 * make the remote side miss rows.
+			 */
+			for (p = str; *p; p++)
+				if (*p == '\\' || IS_HIGHBIT_SET(*p) || (unsigned char) *p < ' ')
+					return false;
+
+			appendStringInfoChar(ctx->buf, '\'');
+			for (p = str; *p; p++)
+			{
+				if (*p == '\'')
+					appendStringInfoChar(ctx->buf, '\'');
+				appendStringInfoChar(ctx->buf, *p);
+			}
+			appendStringInfoChar(ctx->buf, '\'');
+			ctx->recheck = true;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool
+deparse_const(Const *con, odbcdeparse *ctx)
+{
+	if (con->constisnull || !shippable_type(con->consttype))
+		return false;
+
+	return deparse_value(con->consttype, con->constvalue, ctx);
+}
+
+/*
+ * Only built-in comparison operators are shipped, strings only with
+ * the operators that can't make the remote side miss rows.
+ */
+static bool
+deparse_opexpr(OpExpr *op, odbcdeparse *ctx)
+{
+	char	   *opname;
+	Oid		ltype, rtype;
+	bool		strings;
+
+	if (op->opno >= FirstNormalObjectId || list_length(op->args) != 2)
+		return false;
+
+	opname = get_opname(op->opno);
+	if (opname == NULL)
+		return false;
+
+	ltype = exprType((Node *) linitial(op->args));
+	rtype = exprType((Node *) lsecond(op->args));
+	strings = string_type(ltype) || string_type(rtype);
+
+	if (strcmp(opname, "~~") == 0)
+	{
+		if (!string_type(ltype) || !string_type(rtype) ||
+				(ctx->fpinfo->predicates != 0 && !(ctx->fpinfo->predicates & SQL_SP_LIKE)))
+			return false;
+		opname = "LIKE";
+	}
+	else if (strcmp(opname, "=") == 0)
+		;
+	else if (strings)
+		return false;
+	else if (strcmp(opname, "<>") != 0 && strcmp(opname, "<") != 0 &&
+			strcmp(opname, "<=") != 0 && strcmp(opname, ">") != 0 &&
+			strcmp(opname, ">=") != 0)
+		return false;
+
+	appendStringInfoChar(ctx->buf, '(');
+	if (!deparse_expr((Node *) linitial(op->args), ctx))
+		return false;
+	appendStringInfo(ctx->buf, " %s ", opname);
+	if (!deparse_expr((Node *) lsecond(op->args), ctx))
+		return false;
+	appendStringInfoChar(ctx->buf, ')');
+
+	return true;
+}
+
+/* col = ANY ('{...}') is sent as col IN (...) */
+static bool
+deparse_scalararrayopexpr(ScalarArrayOpExpr *saop, odbcdeparse *ctx)
+{
+	Node	   *arg;
+	Const	   *arr;
+	ArrayType  *array;
+	Oid		elemtype;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	Datum	   *elems;
+	bool	   *elemnulls;
+	int		nelems, i;
+	char	   *opname;
+
+	if (!saop->useOr || saop->opno >= FirstNormalObjectId || list_length(saop->args) != 2)
+		return false;
+	if (ctx->fpinfo->predicates != 0 && !(ctx->fpinfo->predicates & SQL_SP_IN))
+		return false;
+
+	opname = get_opname(saop->opno);
+	if (opname == NULL || strcmp(opname, "=") != 0)
+		return false;
+
+	arg = (Node *) linitial(saop->args);
+	if (!IsA(lsecond(saop->args), Const))
+		return false;
+	arr = (Const *) lsecond(saop->args);
+	if (arr->constisnull)
+		return false;
+
+	array = DatumGetArrayTypeP(arr->constvalue);
+	elemtype = ARR_ELEMTYPE(array);
+	if (!shippable_type(elemtype))
+		return false;
+
+	get_typlenbyvalalign(elemtype, &typlen, &typbyval, &typalign);
+	deconstruct_array(array, elemtype, typlen, typbyval, typalign,
+				&elems, &elemnulls, &nelems);
+	if (nelems == 0)
+		return false;
+
+	appendStringInfoChar(ctx->buf, '(');
+	if (!deparse_expr(arg, ctx))
+		return false;
+	appendStringInfoString(ctx->buf, " IN (");
+	for (i = 0; i < nelems; i++)
+	{
+		if (elemnulls[i])
+			return false;
+		if (i > 0)
+			appendStringInfoString(ctx->buf, ", ");
+		if (!deparse_value(elemtype, elems[i], ctx))
+			return false;
+	}
+	appendStringInfoString(ctx->buf, "))");
+
+	return true;
+}
+
+static bool
+deparse_nulltest(NullTest *nt, odbcdeparse *ctx)
+{
+	SQLUINTEGER	needed = (nt->nulltesttype == IS_NULL ? SQL_SP_ISNULL : SQL_SP_ISNOTNULL);
+
+	if (nt->argisrow)
+		return false;
+	if (ctx->fpinfo->predicates != 0 && !(ctx->fpinfo->predicates & needed))
+		return false;
+
+	appendStringInfoChar(ctx->buf, '(');
+	if (!deparse_expr((Node *) nt->arg, ctx))
+		return false;
+	appendStringInfoString(ctx->buf, (nt->nulltesttype == IS_NULL ? " IS NULL)" : " IS NOT NULL)"));
+
+	return true;
+}
+
+static bool
+deparse_boolexpr(BoolExpr *b, odbcdeparse *ctx)
+{
+	ListCell   *lc;
+	bool		first = true;
+	bool		recheck = ctx->recheck;
+
+	if (b->boolop == NOT_EXPR)
+	{
+		/* the negation of a superset would be a subset */
+		ctx->recheck = false;
+		appendStringInfoString(ctx->buf, "(NOT ");
+		if (!deparse_expr((Node *) linitial(b->args), ctx) || ctx->recheck)
+			return false;
+		appendStringInfoChar(ctx->buf, ')');
+		ctx->recheck = recheck;
+		return true;
+	}
+
+	appendStringInfoChar(ctx->buf, '(');
+	foreach(lc, b->args)
+	{
+		if (!first)
+			appendStringInfoString(ctx->buf, (b->boolop == AND_EXPR ? " AND " : " OR "));
+		if (!deparse_expr((Node *) lfirst(lc), ctx))
+			return false;
+		first = false;
+	}
+	appendStringInfoChar(ctx->buf, ')');
+
+	return true;
+}
+
+/*
+ * Append the remote SQL form of node to ctx->buf,
+ * returns false if it can't be evaluated remotely.
+ */
+static bool
+deparse_expr(Node *node, odbcdeparse *ctx)
+{
+	if (node == NULL)
+		return false;
+
+	switch (nodeTag(node))
+	{
+		case T_Var:
+			return deparse_var((Var *) node, ctx);
+		case T_Const:
+			return deparse_const((Const *) node, ctx);
+		case T_RelabelType:
+			return deparse_expr((Node *) ((RelabelType *) node)->arg, ctx);
+		case T_OpExpr:
+			return deparse_opexpr((OpExpr *) node, ctx);
+		case T_ScalarArrayOpExpr:
+			return deparse_scalararrayopexpr((ScalarArrayOpExpr *) node, ctx);
+		case T_NullTest:
+			return deparse_nulltest((NullTest *) node, ctx);
+		case T_BoolExpr:
+			return deparse_boolexpr((BoolExpr *) node, ctx);
+		default:
+			return false;
+	}
+}
+
+/* Ask the driver what the remote dialect supports */
+static void
+fdw_get_dialect(odbcfdwrel *fpinfo)
+{
+	SQLRETURN	ret;
+	SQLSMALLINT	len;
+
+	ret = SQLGetInfo(conns[fpinfo->conn_idx].hCon, SQL_SQL92_PREDICATES,
+				(SQLPOINTER) &fpinfo->predicates, sizeof(fpinfo->predicates), NULL);
+	if (!SQL_SUCCEEDED(ret))
+		fpinfo->predicates = 0;
+
+	ret = SQLGetInfo(conns[fpinfo->conn_idx].hCon, SQL_IDENTIFIER_QUOTE_CHAR,
+				(SQLPOINTER) fpinfo->quote, sizeof(fpinfo->quote), &len);
+	if (!SQL_SUCCEEDED(ret) || fpinfo->quote[0] == ' ')
+		fpinfo->quote[0] = '\0';
+}
+
+static void
+odbclinkGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+{
+	odbcfdwrel *fpinfo;
+	ForeignTable   *table;
+	Relation	rel;
+	TupleDesc	tupdesc;
+	ListCell   *lc;
+	int		i;
+
+	fpinfo = palloc0(sizeof(odbcfdwrel));
+	baserel->fdw_private = fpinfo;
+
+	fpinfo->conn_idx = fdw_get_conn(foreigntableid);
+	fdw_get_dialect(fpinfo);
+
+	table = GetForeignTable(foreigntableid);
+	foreach(lc, table->options)
+	{
+		DefElem	   *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "table_name") == 0)
+			fpinfo->table_name = defGetString(def);
+	}
+	if (fpinfo->table_name == NULL)
+		fpinfo->table_name = fdw_quote_ident(get_rel_name(foreigntableid), fpinfo->quote);
+
+	rel = heap_open(foreigntableid, NoLock);
+	tupdesc = RelationGetDescr(rel);
+	fpinfo->colnames = palloc0(tupdesc->natts * sizeof(char *));
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		char	   *colname = NULL;
+
+		if (tupdesc->attrs[i]->attisdropped)
+			continue;
+
+		foreach(lc, GetForeignColumnOptions(foreigntableid, i + 1))
+		{
+			DefElem	   *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "column_name") == 0)
+				colname = defGetString(def);
+		}
+		if (colname == NULL)
+			colname = fdw_quote_ident(NameStr(tupdesc->attrs[i]->attname), fpinfo->quote);
+		fpinfo->colnames[i] = colname;
+	}
+	heap_close(rel, NoLock);
+
+	/* Split the conditions into shippable and local ones */
+	foreach(lc, baserel->baserestrictinfo)
+	{
+		RestrictInfo   *ri = (RestrictInfo *) lfirst(lc);
+		odbcdeparse	ctx;
+		StringInfoData	buf;
+
+		initStringInfo(&buf);
+		ctx.baserel = baserel;
+		ctx.fpinfo = fpinfo;
+		ctx.buf = &buf;
+		ctx.recheck = false;
+
+		if (deparse_expr((Node *) ri->clause, &ctx))
+		{
+			fpinfo->remote_conds = lappend(fpinfo->remote_conds, makeString(buf.data));
+			if (ctx.recheck)
+				fpinfo->local_conds = lappend(fpinfo->local_conds, ri);
+		}
+		else
+			fpinfo->local_conds = lappend(fpinfo->local_conds, ri);
+	}
+
+	/* Without statistics assume a moderately large table */
+	if (baserel->tuples <= 0)
+		baserel->tuples = 1000;
+	baserel->rows = clamp_row_est(baserel->tuples *
+			clauselist_selectivity(root, baserel->baserestrictinfo, 0, JOIN_INNER, NULL));
+}
+
+static void
+odbclinkGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+{
+	Cost		startup_cost = 100.0;
+	Cost		total_cost = startup_cost + baserel->rows * cpu_tuple_cost * 10;
+
+	add_path(baserel, (Path *)
+		create_foreignscan_path(root, baserel,
+#if PG_VERSION_NUM >= 90600
+					NULL,
+#endif
+					baserel->rows,
+					startup_cost,
+					total_cost,
+					NIL,
+					NULL,
+#if PG_VERSION_NUM >= 90500
+					NULL,
+#endif
+					NIL));
+}
+
+static ForeignScan *
+odbclinkGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel,
+			Oid foreigntableid, ForeignPath *best_path,
+			List *tlist, List *scan_clauses
+#if PG_VERSION_NUM >= 90500
+			, Plan *outer_plan
+#endif
+			)
+{
+	odbcfdwrel *fpinfo = (odbcfdwrel *) baserel->fdw_private;
+	Index		scan_relid = baserel->relid;
+	Bitmapset  *attrs_used = NULL;
+	List	   *local_exprs = NIL;
+	List	   *retrieved_attrs = NIL;
+	StringInfoData	sql;
+	ListCell   *lc;
+	bool		first = true;
+	bool		all_attrs;
+	int		i;
+
+	/* Only the conditions that weren't shipped (or need a recheck) stay local */
+	foreach(lc, scan_clauses)
+	{
+		RestrictInfo   *ri = (RestrictInfo *) lfirst(lc);
+
+		if (ri->pseudoconstant || list_member_ptr(fpinfo->local_conds, ri))
+			local_exprs = lappend(local_exprs, ri->clause);
+	}
+
+	/* Fetch only the columns used by the query or by the local conditions */
+#if PG_VERSION_NUM >= 90600
+	pull_varattnos((Node *) baserel->reltarget->exprs, scan_relid, &attrs_used);
+#else
+	pull_varattnos((Node *) baserel->reltargetlist, scan_relid, &attrs_used);
+#endif
+	pull_varattnos((Node *) local_exprs, scan_relid, &attrs_used);
+	all_attrs = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber, attrs_used);
+
+	initStringInfo(&sql);
+	appendStringInfoString(&sql, "SELECT ");
+	for (i = 1; i <= baserel->max_attr; i++)
+	{
+		if (fpinfo->colnames[i - 1] == NULL)
+			continue;
+		if (!all_attrs && !bms_is_member(i - FirstLowInvalidHeapAttributeNumber, attrs_used))
+			continue;
+
+		if (!first)
+			appendStringInfoString(&sql, ", ");
+		appendStringInfoString(&sql, fpinfo->colnames[i - 1]);
+		retrieved_attrs = lappend_int(retrieved_attrs, i);
+		first = false;
+	}
+	/* something has to be selected even for count(*) */
+	if (retrieved_attrs == NIL)
+		for (i = 1; i <= baserel->max_attr; i++)
+			if (fpinfo->colnames[i - 1] != NULL)
+			{
+				appendStringInfoString(&sql, fpinfo->colnames[i - 1]);
+				retrieved_attrs = lappend_int(retrieved_attrs, i);
+				break;
+			}
+
+	appendStringInfo(&sql, " FROM %s", fpinfo->table_name);
+
+	first = true;
+	foreach(lc, fpinfo->remote_conds)
+	{
+		appendStringInfoString(&sql, (first ? " WHERE " : " AND "));
+		appendStringInfoString(&sql, strVal(lfirst(lc)));
+		first = false;
+	}
+
+	return make_foreignscan(tlist,
+				local_exprs,
+				scan_relid,
+				NIL,
+				list_make2(makeString(sql.data), retrieved_attrs)
+#if PG_VERSION_NUM >= 90500
+				, NIL,
+				NIL,
+				outer_plan
+#endif
+				);
+}
+
+static void
+odbclinkExplainForeignScan(ForeignScanState *node, ExplainState *es)
+{
+	ForeignScan    *fsplan = (ForeignScan *) node->ss.ps.plan;
+
+	ExplainPropertyText("Remote SQL", strVal(linitial(fsplan->fdw_private)), es);
+}
+
+static void
+odbclinkBeginForeignScan(ForeignScanState *node, int eflags)
+{
+	ForeignScan    *fsplan = (ForeignScan *) node->ss.ps.plan;
+	EState	   *estate = node->ss.ps.state;
+	TupleDesc	reldesc = RelationGetDescr(node->ss.ss_currentRelation);
+	odbcfdwstate   *festate;
+	ListCell   *lc;
+	int		i;
+
+	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+		return;
+
+	festate = palloc0(sizeof(odbcfdwstate));
+	node->fdw_state = festate;
+
+	festate->conn_idx = fdw_get_conn(RelationGetRelid(node->ss.ss_currentRelation));
+	festate->query = strVal(linitial(fsplan->fdw_private));
+	festate->retrieved_attrs = (List *) lsecond(fsplan->fdw_private);
+
+	/* compatTupleDescs() checks the remote columns against this */
+	festate->tupdesc = CreateTemplateTupleDesc(list_length(festate->retrieved_attrs), false);
+	i = 0;
+	foreach(lc, festate->retrieved_attrs)
+	{
+		Form_pg_attribute	attr = reldesc->attrs[lfirst_int(lc) - 1];
+
+		TupleDescInitEntry(festate->tupdesc, (AttrNumber) ++i, NameStr(attr->attname),
+					attr->atttypid, attr->atttypmod, 0);
+	}
+
+	festate->values = palloc(list_length(festate->retrieved_attrs) * sizeof(Datum));
+	festate->nulls = palloc(list_length(festate->retrieved_attrs) * sizeof(bool));
+
+	festate->scancxt = AllocSetContextCreate(estate->es_query_cxt,
+					"odbclink_fdw scan",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+}
+
+static TupleTableSlot *
+odbclinkIterateForeignScan(ForeignScanState *node)
+{
+	odbcfdwstate   *festate = (odbcfdwstate *) node->fdw_state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+	TupleDesc	slotdesc = slot->tts_tupleDescriptor;
+	ListCell   *lc;
+	int		i;
+
+	/* The remote query is only executed when the first row is needed */
+	if (festate->stmt == NULL && !festate->eof)
+	{
+		MemoryContext	oldcontext = MemoryContextSwitchTo(festate->scancxt);
+
+		festate->stmt = open_query(festate->conn_idx, festate->query, festate->tupdesc);
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	ExecClearTuple(slot);
+
+	if (festate->eof || !fetch_row(festate->stmt, festate->values, festate->nulls))
+	{
+		festate->eof = true;
+		return slot;
+	}
+
+	memset(slot->tts_isnull, true, slotdesc->natts * sizeof(bool));
+	i = 0;
+	foreach(lc, festate->retrieved_attrs)
+	{
+		int	attnum = lfirst_int(lc);
+
+		slot->tts_values[attnum - 1] = festate->values[i];
+		slot->tts_isnull[attnum - 1] = festate->nulls[i];
+		i++;
+	}
+	ExecStoreVirtualTuple(slot);
+
+	return slot;
+}
+
+static void
+odbclinkReScanForeignScan(ForeignScanState *node)
+{
+	odbcfdwstate   *festate = (odbcfdwstate *) node->fdw_state;
+
+	if (festate->stmt)
+		free_stmt(festate->stmt);
+	festate->stmt = NULL;
+	festate->eof = false;
+	MemoryContextReset(festate->scancxt);
+}
+
+static void
+odbclinkEndForeignScan(ForeignScanState *node)
+{
+	odbcfdwstate   *festate = (odbcfdwstate *) node->fdw_state;
+
+	if (festate && festate->stmt)
+		free_stmt(festate->stmt);
+}
+
+Datum
+odbclink_fdw_handler(PG_FUNCTION_ARGS)
+{
+	FdwRoutine *routine = makeNode(FdwRoutine);
+
+	routine->GetForeignRelSize = odbclinkGetForeignRelSize;
+	routine->GetForeignPaths = odbclinkGetForeignPaths;
+	routine->GetForeignPlan = odbclinkGetForeignPlan;
+	routine->ExplainForeignScan = odbclinkExplainForeignScan;
+	routine->BeginForeignScan = odbclinkBeginForeignScan;
+	routine->IterateForeignScan = odbclinkIterateForeignScan;
+	routine->ReScanForeignScan = odbclinkReScanForeignScan;
+	routine->EndForeignScan = odbclinkEndForeignScan;
+
+	PG_RETURN_POINTER(routine);
+}
+
+Datum
+odbclink_fdw_validator(PG_FUNCTION_ARGS)
+{
+	List	   *options = untransformRelOptions(PG_GETARG_DATUM(0));
+	Oid		catalog = PG_GETARG_OID(1);
+	ListCell   *lc;
+
+	foreach(lc, options)
+	{
+		DefElem	   *def = (DefElem *) lfirst(lc);
+		const odbcfdwoption *opt;
+		bool		found = false;
+
+		for (opt = valid_options; opt->optname; opt++)
+			if (opt->optcontext == catalog && strcmp(opt->optname, def->defname) == 0)
+				found = true;
+
+		if (!found)
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
+						errmsg("odbclink: invalid option \"%s\"", def->defname)));
+	}
+
+	PG_RETURN_VOID();
+}
+
+#else	/* PG_VERSION_NUM < 90200 */
+
+Datum
+odbclink_fdw_handler(PG_FUNCTION_ARGS)
+{
+	elog(ERROR, "odbclink: the foreign data wrapper needs PostgreSQL 9.2 or later");
+	PG_RETURN_NULL();
+}
+
+Datum
+odbclink_fdw_validator(PG_FUNCTION_ARGS)
+{
+	elog(ERROR, "odbclink: the foreign data wrapper needs PostgreSQL 9.2 or later");
+	PG_RETURN_VOID();
+}
+
+#endif
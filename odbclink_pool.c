@@ -0,0 +1,823 @@
+#include "postgres.h"
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#if PG_VERSION_NUM >= 100000
+#include "pgstat.h"
+#endif
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "lib/stringinfo.h"
+#include "mb/pg_wchar.h"
+#include "postmaster/bgworker.h"
+#include "storage/dsm.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+#include "storage/proc.h"
+#include "storage/shm_mq.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "odbclink.h"
+
+#if PG_VERSION_NUM >= 90500
+
+/*
+ * Connection pool in background workers: every worker keeps its own
+ * connections, at most one per DSN/UID/PWD triplet or connection string.
+ * A backend creates a DSM segment with the request and a queue for the
+ * result, hands it to an idle worker and reads the rows from the queue.
+ */
+typedef struct {
+	pid_t		pid;		/* 0 if the worker isn't running */
+	PGPROC	   *proc;
+	bool		busy;		/* claimed by a backend */
+	bool		requested;	/* request is set, not yet taken by the worker */
+	bool		cancel;		/* the backend gave up on the request */
+	dsm_handle	request;
+	uint32		keyhash;	/* connection of the last request served */
+} odbcpoolworker;
+
+typedef struct {
+	slock_t		mutex;
+	int		nworkers;
+	int		encoding;	/* database encoding of the workers, -1 until one started */
+	odbcpoolworker	workers[FLEXIBLE_ARRAY_MEMBER];
+} odbcpool;
+
+/* Header of the request in the DSM segment, the queue follows the request */
+typedef struct {
+	char		kind;		/* POOL_QUERY or POOL_EXEC */
+	bool		isconnstr;
+	Size		len;		/* length of the request data */
+	char		data[FLEXIBLE_ARRAY_MEMBER];
+} odbcpoolrequest;
+
+#define POOL_QUERY	'Q'
+#define POOL_EXEC	'X'
+
+/* Message types sent back by the worker */
+#define POOL_ROW	'D'
+#define POOL_ERROR	'E'
+#define POOL_DONE	'C'
+
+#define POOLQUEUESIZE	(65536)
+#define POOLPOLLTIMEOUT	(1000L)
+#define POOLCLAIMTIMEOUT	(10L)
+#define MAXPOOLWORKERS	(64)
+
+/* Settings of the backend the worker serves its request with */
+static const char *const pool_settings[] = {
+	"TimeZone",
+	"DateStyle",
+	"odbclink.query_timeout",
+	"odbclink.fetch_size",
+	"odbclink.lob_direct_size"
+};
+
+#define NPOOLSETTINGS	(sizeof(pool_settings) / sizeof(pool_settings[0]))
+
+static int	pool_workers = 0;
+static char    *pool_database = NULL;
+static bool	use_pool = true;
+
+static odbcpool    *pool = NULL;
+static shmem_startup_hook_type	prev_shmem_startup_hook = NULL;
+
+static Size
+pool_shmem_size(void)
+{
+	return add_size(offsetof(odbcpool, workers),
+			mul_size(pool_workers, sizeof(odbcpoolworker)));
+}
+
+static void
+pool_shmem_startup(void)
+{
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	pool = ShmemInitStruct("odbclink pool", pool_shmem_size(), &found);
+	if (!found)
+	{
+		SpinLockInit(&pool->mutex);
+		pool->nworkers = pool_workers;
+		pool->encoding = -1;
+		memset(pool->workers, 0, pool_workers * sizeof(odbcpoolworker));
+	}
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+void
+pool_init(void)
+{
+	BackgroundWorker	worker;
+	int		k;
+
+	DefineCustomBoolVariable("odbclink.use_pool",
+				"Run the queries on DSN/UID/PWD triplets and connection strings in the pool workers.",
+				NULL,
+				&use_pool,
+				true,
+				PGC_USERSET,
+				0,
+				NULL,
+				NULL,
+				NULL);
+
+	/* the workers can only be set up at server start */
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	DefineCustomIntVariable("odbclink.pool_workers",
+				"Number of background workers keeping pooled ODBC connections.",
+				"odbclink must be in shared_preload_libraries to start them.",
+				&pool_workers,
+				0,
+				0,
+				MAXPOOLWORKERS,
+				PGC_POSTMASTER,
+				0,
+				NULL,
+				NULL,
+				NULL);
+
+	DefineCustomStringVariable("odbclink.pool_database",
+				"Database the pool workers connect to.",
+				NULL,
+				&pool_database,
+				"postgres",
+				PGC_POSTMASTER,
+				0,
+				NULL,
+				NULL,
+				NULL);
+
+	if (pool_workers == 0)
+		return;
+
+	RequestAddinShmemSpace(pool_shmem_size());
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = pool_shmem_startup;
+
+	memset(&worker, 0, sizeof(worker));
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = 10;
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "odbclink");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "odbclink_pool_main");
+
+	for (k = 0; k < pool_workers; k++)
+	{
+		snprintf(worker.bgw_name, BGW_MAXLEN, "odbclink pool worker %d", k + 1);
+		worker.bgw_main_arg = Int32GetDatum(k);
+		RegisterBackgroundWorker(&worker);
+	}
+}
+
+static uint32
+pool_key_hash(const char *dsn, const char *uid, const char *pwd, const char *connstr)
+{
+	char	   *key = conn_key(dsn, uid, pwd, connstr);
+	uint32		hash = DatumGetUInt32(hash_any((const unsigned char *)key, strlen(key)));
+
+	pfree(key);
+	return hash;
+}
+
+static int
+pool_wait(int events, long timeout)
+{
+#if PG_VERSION_NUM >= 100000
+	return WaitLatch(MyLatch, events, timeout, PG_WAIT_EXTENSION);
+#else
+	return WaitLatch(MyLatch, events, timeout);
+#endif
+}
+
+/*
+ * The pool is used for built-in result types only, the workers
+ * are connected to another database, and only if the values
+ * are converted to the same encoding. A session that has its
+ * own connection i to the data source keeps using it, -1 if
+ * it has none.
+ */
+bool
+pool_usable(int i, TupleDesc tupdesc)
+{
+	int		k;
+
+	if (i >= 0 || !use_pool || pool == NULL || pool->nworkers == 0 ||
+			pool->encoding != GetDatabaseEncoding())
+		return false;
+
+	if (tupdesc)
+		for (k = 0; k < tupdesc->natts; k++)
+			if (tupdesc->attrs[k]->atttypid >= FirstNormalObjectId)
+				return false;
+
+	return true;
+}
+
+/*
+ * Claim an idle worker for the request, preferring the one that
+ * served the same connection last. Waits while all workers are busy.
+ */
+static int
+pool_claim(uint32 keyhash, dsm_handle request, pid_t *pid)
+{
+	for (;;)
+	{
+		PGPROC	   *proc = NULL;
+		int		found = -1;
+		int		running = 0;
+		int		k;
+
+		SpinLockAcquire(&pool->mutex);
+		for (k = 0; k < pool->nworkers; k++)
+		{
+			odbcpoolworker *w = &pool->workers[k];
+
+			if (w->pid == 0)
+				continue;
+			running++;
+			if (w->busy)
+				continue;
+			if (found < 0 || w->keyhash == keyhash)
+				found = k;
+			if (w->keyhash == keyhash)
+				break;
+		}
+		if (found >= 0)
+		{
+			odbcpoolworker *w = &pool->workers[found];
+
+			w->busy = true;
+			w->requested = true;
+			w->cancel = false;
+			w->request = request;
+			*pid = w->pid;
+			proc = w->proc;
+		}
+		SpinLockRelease(&pool->mutex);
+
+		if (found >= 0)
+		{
+			SetLatch(&proc->procLatch);
+			return found;
+		}
+		if (running == 0)
+			elog(ERROR, "odbclink: no pool worker is running");
+
+		pool_wait(WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, POOLCLAIMTIMEOUT);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+static bool
+pool_worker_alive(int k, pid_t pid)
+{
+	bool		alive;
+
+	SpinLockAcquire(&pool->mutex);
+	alive = (pool->workers[k].pid == pid);
+	SpinLockRelease(&pool->mutex);
+
+	return alive;
+}
+
+/*
+ * Create the DSM segment with the request and the result queue,
+ * and hand it to a worker.
+ */
+static dsm_segment *
+pool_dispatch(char kind, const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query, TupleDesc tupdesc,
+		shm_mq_handle **mqh, int *worker, pid_t *pid)
+{
+	StringInfoData	data;
+	dsm_segment    *seg;
+	odbcpoolrequest	   *req;
+	shm_mq	   *mq;
+	Size		reqsize;
+	int32		natts = (tupdesc ? tupdesc->natts : 0);
+	int		k;
+
+	/*
+	 * Strings are NUL terminated, the settings are in the order of
+	 * pool_settings, the result columns are (type, typmod) pairs.
+	 */
+	initStringInfo(&data);
+	if (connstr)
+		appendBinaryStringInfo(&data, connstr, strlen(connstr) + 1);
+	else
+	{
+		appendBinaryStringInfo(&data, dsn, strlen(dsn) + 1);
+		appendBinaryStringInfo(&data, uid, strlen(uid) + 1);
+		appendBinaryStringInfo(&data, pwd, strlen(pwd) + 1);
+	}
+	appendBinaryStringInfo(&data, query, strlen(query) + 1);
+	for (k = 0; k < NPOOLSETTINGS; k++)
+	{
+		appendStringInfoString(&data, GetConfigOption(pool_settings[k], false, false));
+		appendStringInfoChar(&data, '\0');
+	}
+	appendBinaryStringInfo(&data, (char *)&natts, sizeof(int32));
+	for (k = 0; k < natts; k++)
+	{
+		Oid		typeoid = tupdesc->attrs[k]->atttypid;
+		int32		typmod = tupdesc->attrs[k]->atttypmod;
+
+		appendBinaryStringInfo(&data, (char *)&typeoid, sizeof(Oid));
+		appendBinaryStringInfo(&data, (char *)&typmod, sizeof(int32));
+	}
+
+	reqsize = MAXALIGN(offsetof(odbcpoolrequest, data) + data.len);
+	seg = dsm_create(reqsize + POOLQUEUESIZE, 0);
+
+	req = dsm_segment_address(seg);
+	req->kind = kind;
+	req->isconnstr = (connstr != NULL);
+	req->len = data.len;
+	memcpy(req->data, data.data, data.len);
+	pfree(data.data);
+
+	mq = shm_mq_create((char *)req + reqsize, POOLQUEUESIZE);
+	shm_mq_set_receiver(mq, MyProc);
+	*mqh = shm_mq_attach(mq, seg, NULL);
+
+	*worker = pool_claim(pool_key_hash(dsn, uid, pwd, connstr),
+				dsm_segment_handle(seg), pid);
+
+	return seg;
+}
+
+/*
+ * Read the next message of the worker, the worker dying
+ * before or while answering is an error.
+ */
+static char *
+pool_receive(shm_mq_handle *mqh, int worker, pid_t pid, Size *len)
+{
+	for (;;)
+	{
+		shm_mq_result	res;
+		void	   *data;
+
+		res = shm_mq_receive(mqh, len, &data, true);
+		if (res == SHM_MQ_SUCCESS)
+			return data;
+		if (res == SHM_MQ_DETACHED || !pool_worker_alive(worker, pid))
+			elog(ERROR, "odbclink: the pool worker exited");
+
+		pool_wait(WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, POOLPOLLTIMEOUT);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+	}
+}
+
+/*
+ * Tell the worker to cancel the request if it's still serving it,
+ * e.g. after the backend was interrupted while waiting for it.
+ */
+static void
+pool_cancel(int worker, pid_t pid, dsm_handle request)
+{
+	odbcpoolworker *w = &pool->workers[worker];
+	PGPROC	   *proc = NULL;
+
+	SpinLockAcquire(&pool->mutex);
+	if (w->pid == pid && w->busy && w->request == request)
+	{
+		w->cancel = true;
+		proc = w->proc;
+	}
+	SpinLockRelease(&pool->mutex);
+
+	if (proc)
+		SetLatch(&proc->procLatch);
+}
+
+/* Rethrow an error reported by the worker */
+static void
+pool_error(char *msg)
+{
+	int		sqlerrcode;
+
+	memcpy(&sqlerrcode, msg + 1, sizeof(int));
+	ereport(ERROR,
+			(errcode(sqlerrcode),
+				errmsg("%s", msg + 1 + sizeof(int))));
+}
+
+Tuplestorestate *
+pool_query(const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query, TupleDesc tupdesc, bool randomAccess)
+{
+	Tuplestorestate	   *tupstore;
+	dsm_segment    *seg;
+	shm_mq_handle  *mqh;
+	HeapTupleData	tuple;
+	int		worker;
+	pid_t		pid;
+
+	seg = pool_dispatch(POOL_QUERY, dsn, uid, pwd, connstr, query, tupdesc,
+				&mqh, &worker, &pid);
+
+	tupstore = tuplestore_begin_heap(randomAccess, false, work_mem);
+
+	PG_TRY();
+	{
+		for (;;)
+		{
+			char	   *msg;
+			Size		len;
+
+			msg = pool_receive(mqh, worker, pid, &len);
+			if (msg[0] == POOL_DONE)
+				break;
+			if (msg[0] == POOL_ERROR)
+				pool_error(msg);
+
+			/* the tuple follows the message type, copy it to align it */
+			tuple.t_len = len - 1;
+			tuple.t_data = palloc(tuple.t_len);
+			memcpy(tuple.t_data, msg + 1, tuple.t_len);
+			ItemPointerSetInvalid(&tuple.t_self);
+			tuple.t_tableOid = InvalidOid;
+			tuplestore_puttuple(tupstore, &tuple);
+			pfree(tuple.t_data);
+		}
+	}
+	PG_CATCH();
+	{
+		pool_cancel(worker, pid, dsm_segment_handle(seg));
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	/* the worker is released when it sees the segment detached */
+	dsm_detach(seg);
+
+	return tupstore;
+}
+
+void
+pool_exec(const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query)
+{
+	dsm_segment    *seg;
+	shm_mq_handle  *mqh;
+	char	   *msg;
+	char	   *key;
+	Size		len;
+	int		worker;
+	pid_t		pid;
+
+	seg = pool_dispatch(POOL_EXEC, dsn, uid, pwd, connstr, query, NULL,
+				&mqh, &worker, &pid);
+
+	PG_TRY();
+	{
+		msg = pool_receive(mqh, worker, pid, &len);
+	}
+	PG_CATCH();
+	{
+		pool_cancel(worker, pid, dsm_segment_handle(seg));
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (msg[0] == POOL_ERROR)
+		pool_error(msg);
+
+	dsm_detach(seg);
+
+	key = conn_key(dsn, uid, pwd, connstr);
+	cache_invalidate(key);
+	pfree(key);
+}
+
+/*
+ * Worker side
+ */
+
+static odbcpoolworker  *myworker = NULL;
+
+/* Whether the backend cancelled the request the worker is serving */
+bool
+pool_cancel_requested(void)
+{
+	bool		cancel;
+
+	if (myworker == NULL)
+		return false;
+
+	SpinLockAcquire(&pool->mutex);
+	cancel = myworker->cancel;
+	SpinLockRelease(&pool->mutex);
+
+	return cancel;
+}
+
+static void
+pool_worker_exit(int code, Datum arg)
+{
+	SpinLockAcquire(&pool->mutex);
+	myworker->pid = 0;
+	myworker->proc = NULL;
+	myworker->busy = false;
+	myworker->requested = false;
+	myworker->cancel = false;
+	SpinLockRelease(&pool->mutex);
+}
+
+static char *
+next_string(char **pos)
+{
+	char	   *s = *pos;
+
+	*pos += strlen(s) + 1;
+	return s;
+}
+
+/* Send a message of the given type, false if the backend went away */
+static bool
+pool_send(shm_mq_handle *mqh, char type, const char *data, Size len)
+{
+	shm_mq_iovec	iov[2];
+
+	iov[0].data = &type;
+	iov[0].len = 1;
+	iov[1].data = data;
+	iov[1].len = len;
+
+	return (shm_mq_sendv(mqh, iov, (len ? 2 : 1), false) == SHM_MQ_SUCCESS);
+}
+
+/* Drop a connection that broke while serving a request */
+static void
+check_conn_dead(int i)
+{
+	SQLRETURN	ret;
+	SQLUINTEGER	dead = SQL_CD_FALSE;
+
+	ret = SQLGetConnectAttr(conns[i].hCon, SQL_ATTR_CONNECTION_DEAD, &dead, 0, NULL);
+	if (SQL_SUCCEEDED(ret) && dead == SQL_CD_TRUE)
+		disconnect_conn(i);
+}
+
+static void
+serve_request(dsm_handle handle, MemoryContext workcxt)
+{
+	dsm_segment    *seg;
+	shm_mq_handle  *volatile mqh = NULL;
+	odbcstmt   *volatile stmt = NULL;
+	volatile int	i = -1;
+	volatile uint32	keyhash = 0;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+
+	PG_TRY();
+	{
+		seg = dsm_attach(handle);
+
+		/* NULL if the backend already gave up */
+		if (seg)
+		{
+			odbcpoolrequest	   *req = dsm_segment_address(seg);
+			Size		reqsize = MAXALIGN(offsetof(odbcpoolrequest, data) + req->len);
+			shm_mq	   *mq = (shm_mq *)((char *)req + reqsize);
+			char	   *pos = req->data;
+			char	   *dsn = NULL, *uid = NULL, *pwd = NULL, *connstr = NULL;
+			char	   *query;
+			int		k;
+
+			shm_mq_set_sender(mq, MyProc);
+			mqh = shm_mq_attach(mq, seg, NULL);
+
+			if (req->isconnstr)
+				connstr = next_string(&pos);
+			else
+			{
+				dsn = next_string(&pos);
+				uid = next_string(&pos);
+				pwd = next_string(&pos);
+			}
+			query = next_string(&pos);
+			for (k = 0; k < NPOOLSETTINGS; k++)
+				SetConfigOption(pool_settings[k], next_string(&pos), PGC_USERSET, PGC_S_SESSION);
+
+			keyhash = pool_key_hash(dsn, uid, pwd, connstr);
+
+			if (connstr)
+			{
+				i = find_conn_connstr(connstr);
+				if (i < 0)
+					i = connect_connstr(connstr);
+			}
+			else
+			{
+				i = find_conn_dsn(dsn, uid, pwd);
+				if (i < 0)
+					i = connect_dsn(dsn, uid, pwd);
+			}
+
+			if (req->kind == POOL_EXEC)
+				exec_query(i, query);
+			else
+			{
+				TupleDesc	tupdesc;
+				MemoryContext	rowcontext, oldcontext;
+				int32		natts;
+				bool		sent = true;
+
+				memcpy(&natts, pos, sizeof(int32));
+				pos += sizeof(int32);
+				tupdesc = CreateTemplateTupleDesc(natts, false);
+				for (k = 0; k < natts; k++)
+				{
+					Oid		typeoid;
+					int32		typmod;
+
+					memcpy(&typeoid, pos, sizeof(Oid));
+					memcpy(&typmod, pos + sizeof(Oid), sizeof(int32));
+					pos += sizeof(Oid) + sizeof(int32);
+					TupleDescInitEntry(tupdesc, k + 1, NULL, typeoid, typmod, 0);
+				}
+
+				stmt = open_query(i, query, tupdesc);
+
+				rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+								"odbclink pool row context",
+								ALLOCSET_DEFAULT_MINSIZE,
+								ALLOCSET_DEFAULT_INITSIZE,
+								ALLOCSET_DEFAULT_MAXSIZE);
+				oldcontext = MemoryContextSwitchTo(rowcontext);
+
+				while (sent && !pool_cancel_requested() &&
+						fetch_row(stmt, stmt->values, stmt->nulls))
+				{
+					HeapTuple	tuple = heap_form_tuple(tupdesc, stmt->values, stmt->nulls);
+
+					sent = pool_send(mqh, POOL_ROW, (char *)tuple->t_data, tuple->t_len);
+					MemoryContextReset(rowcontext);
+				}
+
+				MemoryContextSwitchTo(oldcontext);
+				MemoryContextDelete(rowcontext);
+
+				/* closes the cursor if the backend stopped reading early */
+				free_stmt(stmt);
+				stmt = NULL;
+			}
+
+			pool_send(mqh, POOL_DONE, NULL, 0);
+			dsm_detach(seg);
+		}
+
+		CommitTransactionCommand();
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+		StringInfoData	msg;
+
+		MemoryContextSwitchTo(workcxt);
+		EmitErrorReport();
+		edata = CopyErrorData();
+		FlushErrorState();
+
+		if (stmt)
+			free_stmt(stmt);
+
+		if (mqh)
+		{
+			initStringInfo(&msg);
+			appendBinaryStringInfo(&msg, (char *)&edata->sqlerrcode, sizeof(int));
+			appendStringInfoString(&msg, edata->message);
+			pool_send(mqh, POOL_ERROR, msg.data, msg.len + 1);
+		}
+
+		if (i >= 0 && conns[i].connected)
+			check_conn_dead(i);
+
+		AbortCurrentTransaction();
+		MemoryContextReset(workcxt);
+	}
+	PG_END_TRY();
+
+	SpinLockAcquire(&pool->mutex);
+	myworker->busy = false;
+	if (i >= 0)
+		myworker->keyhash = keyhash;
+	SpinLockRelease(&pool->mutex);
+}
+
+void
+odbclink_pool_main(Datum main_arg)
+{
+	MemoryContext	workcxt;
+
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(pool_database, NULL);
+
+	workcxt = AllocSetContextCreate(TopMemoryContext,
+					"odbclink pool worker",
+					ALLOCSET_DEFAULT_MINSIZE,
+					ALLOCSET_DEFAULT_INITSIZE,
+					ALLOCSET_DEFAULT_MAXSIZE);
+
+	myworker = &pool->workers[DatumGetInt32(main_arg)];
+
+	SpinLockAcquire(&pool->mutex);
+	myworker->pid = MyProcPid;
+	myworker->proc = MyProc;
+	myworker->busy = false;
+	myworker->requested = false;
+	myworker->cancel = false;
+	pool->encoding = GetDatabaseEncoding();
+	SpinLockRelease(&pool->mutex);
+
+	on_shmem_exit(pool_worker_exit, (Datum) 0);
+
+	for (;;)
+	{
+		dsm_handle	handle = 0;
+		bool		requested;
+		int		rc;
+
+		rc = pool_wait(WL_LATCH_SET | WL_POSTMASTER_DEATH, 0);
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+		ResetLatch(MyLatch);
+		CHECK_FOR_INTERRUPTS();
+
+		SpinLockAcquire(&pool->mutex);
+		requested = myworker->requested;
+		if (requested)
+			handle = myworker->request;
+		myworker->requested = false;
+		SpinLockRelease(&pool->mutex);
+
+		if (requested)
+			serve_request(handle, workcxt);
+	}
+}
+
+#else	/* PG_VERSION_NUM < 90500 */
+
+void
+pool_init(void)
+{
+}
+
+bool
+pool_usable(int i, TupleDesc tupdesc)
+{
+	return false;
+}
+
+bool
+pool_cancel_requested(void)
+{
+	return false;
+}
+
+Tuplestorestate *
+pool_query(const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query, TupleDesc tupdesc, bool randomAccess)
+{
+	elog(ERROR, "odbclink: the connection pool needs PostgreSQL 9.5 or later");
+	return NULL;
+}
+
+void
+pool_exec(const char *dsn, const char *uid, const char *pwd,
+		const char *connstr, char *query)
+{
+	elog(ERROR, "odbclink: the connection pool needs PostgreSQL 9.5 or later");
+}
+
+void
+odbclink_pool_main(Datum main_arg)
+{
+}
+
+#endif
@@ -0,0 +1,414 @@
+#include "postgres.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "fmgr.h"
+#include "miscadmin.h"
+#if PG_VERSION_NUM >= 90500
+#include "port/atomics.h"
+#endif
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+#include "odbclink.h"
+
+#if PG_VERSION_NUM >= 90500
+
+/*
+ * Prefetching: a helper thread fetches the next rowsets of a query while
+ * the backend converts the current one. The thread only calls ODBC and
+ * works in malloc'd memory, a ring of PREFETCHBLOCKS blocks of the same
+ * layout, each with the bound buffers of a whole rowset. The columns are
+ * bound to the first block, the driver is pointed at the others with
+ * SQL_ATTR_ROW_BIND_OFFSET_PTR.
+ *
+ * The thread fills blocks up to head and the backend gives them back up
+ * to tail, each counter is only advanced by its own side, so handing over
+ * a block takes no lock. A side that has to wait sleeps on the condition
+ * variable, which is only signalled if it says it's waiting.
+ */
+typedef struct {
+	SQLRETURN	ret;		/* of SQLFetch, the last block unless a success */
+	SQLULEN		nrows;
+	SQLUSMALLINT   *rowstatus;
+} odbcprefetchblock;
+
+struct odbcprefetch {
+	SQLHSTMT	hStmt;
+	SQLULEN		rowset;
+	char	   *blocks;		/* PREFETCHBLOCKS blocks of blocksize bytes */
+	Size		blocksize;
+	SQLLEN		offset;		/* SQL_ATTR_ROW_BIND_OFFSET_PTR */
+	SQLULEN		nrows;		/* SQL_ATTR_ROWS_FETCHED_PTR */
+	SQLUSMALLINT   *rowstatus;	/* SQL_ATTR_ROW_STATUS_PTR */
+	char	  **buf;		/* bound buffers of the columns in the first block */
+	SQLLEN	  **ind;
+	odbcprefetchblock	block[PREFETCHBLOCKS];
+	pg_atomic_uint32	head;	/* blocks filled by the thread */
+	pg_atomic_uint32	tail;	/* blocks given back by the backend */
+	uint32		taken;		/* blocks taken by the backend */
+	pg_atomic_uint32	stop;
+	pg_atomic_uint32	done;	/* the thread doesn't call ODBC any more */
+	pg_atomic_uint32	producer_waiting;
+	pg_atomic_uint32	consumer_waiting;
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	pthread_t	thread;
+	bool		running;	/* the thread isn't joined yet */
+	MemoryContextCallback  *cb;	/* stops the thread with the memory context */
+};
+
+/* GUC variable */
+static bool	prefetch = false;
+
+void
+prefetch_init(void)
+{
+	DefineCustomBoolVariable("odbclink.prefetch",
+				"Fetch the next rowsets of odbclink.query() in a helper thread while the rows are converted.",
+				"The ODBC driver must be thread safe.",
+				&prefetch,
+				false,
+				PGC_USERSET,
+				0,
+				NULL,
+				NULL,
+				NULL);
+}
+
+static bool
+producer_ready(odbcprefetch *pf)
+{
+	return (pg_atomic_read_u32(&pf->head) - pg_atomic_read_u32(&pf->tail) < PREFETCHBLOCKS ||
+			pg_atomic_read_u32(&pf->stop));
+}
+
+static bool
+consumer_ready(odbcprefetch *pf)
+{
+	return (pg_atomic_read_u32(&pf->head) != pf->taken);
+}
+
+/*
+ * Sleep until woken up by the other side or for at most 10ms. The state
+ * is checked again after saying we're waiting, so a wakeup is not lost.
+ */
+static void
+prefetch_sleep(odbcprefetch *pf, pg_atomic_uint32 *waiting, bool (*ready)(odbcprefetch *))
+{
+	struct timespec	ts;
+
+	pthread_mutex_lock(&pf->mutex);
+	pg_atomic_write_u32(waiting, 1);
+	pg_memory_barrier();
+	if (!ready(pf))
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 10 * 1000 * 1000;
+		if (ts.tv_nsec >= 1000 * 1000 * 1000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000 * 1000 * 1000;
+		}
+		pthread_cond_timedwait(&pf->cond, &pf->mutex, &ts);
+	}
+	pg_atomic_write_u32(waiting, 0);
+	pthread_mutex_unlock(&pf->mutex);
+}
+
+static void
+prefetch_wake(odbcprefetch *pf, pg_atomic_uint32 *waiting)
+{
+	pg_memory_barrier();
+	if (pg_atomic_read_u32(waiting))
+	{
+		pthread_mutex_lock(&pf->mutex);
+		pthread_cond_broadcast(&pf->cond);
+		pthread_mutex_unlock(&pf->mutex);
+	}
+}
+
+/* The helper thread, no PostgreSQL functions may be called here */
+static void *
+prefetch_main(void *arg)
+{
+	odbcprefetch   *pf = (odbcprefetch *)arg;
+	uint32		head = 0;
+
+	for (;;)
+	{
+		odbcprefetchblock  *b;
+
+		while (!producer_ready(pf))
+			prefetch_sleep(pf, &pf->producer_waiting, producer_ready);
+		if (pg_atomic_read_u32(&pf->stop))
+			break;
+
+		b = &pf->block[head % PREFETCHBLOCKS];
+		pf->offset = (head % PREFETCHBLOCKS) * pf->blocksize;
+		pf->nrows = 0;
+		b->ret = SQLFetch(pf->hStmt);
+		b->nrows = pf->nrows;
+		memcpy(b->rowstatus, pf->rowstatus, pf->rowset * sizeof(SQLUSMALLINT));
+
+		/* the block is complete before it's handed over */
+		pg_write_barrier();
+		pg_atomic_write_u32(&pf->head, ++head);
+		prefetch_wake(pf, &pf->consumer_waiting);
+
+		if (!SQL_SUCCEEDED(b->ret))
+			break;
+	}
+
+	pg_atomic_write_u32(&pf->done, 1);
+	return NULL;
+}
+
+/*
+ * Stop the thread and wait for it. A fetch still running is cancelled,
+ * unless the thread ended with an error, whose diagnostics SQLCancel()
+ * would clear.
+ */
+static void
+prefetch_join(odbcprefetch *pf, bool cancel)
+{
+	if (!pf->running)
+		return;
+
+	pg_atomic_write_u32(&pf->stop, 1);
+	prefetch_wake(pf, &pf->producer_waiting);
+	if (cancel && !pg_atomic_read_u32(&pf->done))
+		SQLCancel(pf->hStmt);
+	pthread_join(pf->thread, NULL);
+	pf->running = false;
+}
+
+/* Stop prefetching for a statement and free the ring */
+void
+prefetch_end(odbcstmt *stmt)
+{
+	odbcprefetch   *pf = stmt->prefetch;
+
+	if (pf == NULL)
+		return;
+
+	prefetch_join(pf, true);
+	/* a cached statement may be gone when the context is reset */
+	pf->cb->arg = NULL;
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->mutex);
+	stmt->prefetch = NULL;
+	free(pf);
+}
+
+/* The statement goes away with its memory context, e.g. on an error */
+static void
+prefetch_reset(void *arg)
+{
+	if (arg)
+		prefetch_end((odbcstmt *)arg);
+}
+
+/*
+ * Start prefetching for a query executed and bound by setup_query(),
+ * if odbclink.prefetch is on and all columns are bound to block buffers.
+ * The thread is stopped when the current memory context goes away, if
+ * the statement isn't done before. The bound buffers are freed, so a
+ * cached statement has to be set up again for its next execution.
+ */
+void
+prefetch_start(odbcstmt *stmt)
+{
+	odbcprefetch   *pf;
+	MemoryContextCallback  *cb;
+	Size	   *bufoff, *indoff;
+	Size		off = 0, size;
+	char	   *p;
+	sigset_t	sigs, oldsigs;
+	int		col, k, err;
+
+	if (!prefetch || stmt->unbound || stmt->rowset < 2)
+		return;
+
+	/* the layout of a block */
+	bufoff = palloc(stmt->cols * sizeof(Size));
+	indoff = palloc(stmt->cols * sizeof(Size));
+	for (col = 0; col < stmt->cols; col++)
+	{
+		odbccol	   *c = &stmt->col[col];
+
+		off = MAXALIGN(off);
+		if (c->varlena)
+			off += VARHDRSZ;
+		bufoff[col] = off;
+		off = MAXALIGN(off + stmt->rowset * c->buflen);
+		indoff[col] = off;
+		off += stmt->rowset * sizeof(SQLLEN);
+	}
+
+	size = MAXALIGN(sizeof(odbcprefetch)) +
+		2 * MAXALIGN(stmt->cols * sizeof(char *)) +
+		(PREFETCHBLOCKS + 1) * MAXALIGN(stmt->rowset * sizeof(SQLUSMALLINT)) +
+		PREFETCHBLOCKS * MAXALIGN(off);
+	p = malloc(size);
+	if (p == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+					errmsg("out of memory")));
+	memset(p, 0, MAXALIGN(sizeof(odbcprefetch)));
+
+	pf = (odbcprefetch *)p;
+	p += MAXALIGN(sizeof(odbcprefetch));
+	pf->hStmt = stmt->hStmt;
+	pf->rowset = stmt->rowset;
+	pf->buf = (char **)p;
+	p += MAXALIGN(stmt->cols * sizeof(char *));
+	pf->ind = (SQLLEN **)p;
+	p += MAXALIGN(stmt->cols * sizeof(char *));
+	pf->rowstatus = (SQLUSMALLINT *)p;
+	p += MAXALIGN(stmt->rowset * sizeof(SQLUSMALLINT));
+	for (k = 0; k < PREFETCHBLOCKS; k++)
+	{
+		pf->block[k].rowstatus = (SQLUSMALLINT *)p;
+		p += MAXALIGN(stmt->rowset * sizeof(SQLUSMALLINT));
+	}
+	pf->blocks = p;
+	pf->blocksize = MAXALIGN(off);
+	for (col = 0; col < stmt->cols; col++)
+	{
+		pf->buf[col] = pf->blocks + bufoff[col];
+		pf->ind[col] = (SQLLEN *)(pf->blocks + indoff[col]);
+	}
+	pfree(bufoff);
+	pfree(indoff);
+
+	pg_atomic_init_u32(&pf->head, 0);
+	pg_atomic_init_u32(&pf->tail, 0);
+	pg_atomic_init_u32(&pf->stop, 0);
+	pg_atomic_init_u32(&pf->done, 0);
+	pg_atomic_init_u32(&pf->producer_waiting, 0);
+	pg_atomic_init_u32(&pf->consumer_waiting, 0);
+	pthread_mutex_init(&pf->mutex, NULL);
+	pthread_cond_init(&pf->cond, NULL);
+
+	/* without bind offsets the driver can only fill one rowset */
+	if (!SQL_SUCCEEDED(SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROW_BIND_OFFSET_PTR, (SQLPOINTER)&pf->offset, 0)))
+	{
+		pthread_cond_destroy(&pf->cond);
+		pthread_mutex_destroy(&pf->mutex);
+		free(pf);
+		return;
+	}
+
+	stmt->prefetch = pf;
+	cb = palloc(sizeof(MemoryContextCallback));
+	cb->func = prefetch_reset;
+	cb->arg = stmt;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, cb);
+	pf->cb = cb;
+
+	SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROWS_FETCHED_PTR, (SQLPOINTER)&pf->nrows, 0);
+	SQLSetStmtAttr(stmt->hStmt, SQL_ATTR_ROW_STATUS_PTR, (SQLPOINTER)pf->rowstatus, 0);
+
+	/* move the bound buffers into the first block */
+	for (col = 0; col < stmt->cols; col++)
+	{
+		odbccol	   *c = &stmt->col[col];
+
+		pfree(c->varlena ? c->buf - VARHDRSZ : c->buf);
+		pfree(c->ind);
+		c->buf = pf->buf[col];
+		c->ind = pf->ind[col];
+		stmt->prefetched = true;
+
+		if (!SQL_SUCCEEDED(SQLBindCol(stmt->hStmt, col + 1, c->ctype, (SQLPOINTER)c->buf, c->buflen, c->ind)) ||
+				(c->ctype == SQL_C_NUMERIC && !set_numeric_desc(stmt, col)))
+		{
+			get_sql_error(stmt->conn_idx, SQL_HANDLE_STMT, stmt);
+			free_stmt(stmt);
+			elog(ERROR, "odbclink: unsuccessful SQLBindCol call: %s", totalerrmsg);
+		}
+	}
+
+	/* signals are left to the backend */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+	err = pthread_create(&pf->thread, NULL, prefetch_main, pf);
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+	if (err != 0)
+	{
+		free_stmt(stmt);
+		elog(ERROR, "odbclink: could not start the prefetch thread: %s", strerror(err));
+	}
+	pf->running = true;
+}
+
+/*
+ * Take the next block filled by the thread in place of SQLFetch(),
+ * giving back the previous one, whose values are not used any more.
+ */
+SQLRETURN
+prefetch_next(odbcstmt *stmt)
+{
+	odbcprefetch   *pf = stmt->prefetch;
+	odbcprefetchblock  *b;
+	Size		delta;
+	int		col;
+
+	pg_memory_barrier();
+	pg_atomic_write_u32(&pf->tail, pf->taken);
+	prefetch_wake(pf, &pf->producer_waiting);
+
+	while (!consumer_ready(pf))
+	{
+		CHECK_FOR_INTERRUPTS();
+		prefetch_sleep(pf, &pf->consumer_waiting, consumer_ready);
+	}
+	pg_read_barrier();
+
+	b = &pf->block[pf->taken % PREFETCHBLOCKS];
+	delta = (pf->taken % PREFETCHBLOCKS) * pf->blocksize;
+	pf->taken++;
+
+	for (col = 0; col < stmt->cols; col++)
+	{
+		stmt->col[col].buf = pf->buf[col] + delta;
+		stmt->col[col].ind = (SQLLEN *)((char *)pf->ind[col] + delta);
+	}
+	stmt->nrows = b->nrows;
+	stmt->rowstatus = b->rowstatus;
+
+	/* the diagnostics are read after the thread is gone */
+	if (!SQL_SUCCEEDED(b->ret))
+		prefetch_join(pf, false);
+
+	return b->ret;
+}
+
+#else	/* PG_VERSION_NUM < 90500 */
+
+void
+prefetch_init(void)
+{
+}
+
+void
+prefetch_start(odbcstmt *stmt)
+{
+}
+
+SQLRETURN
+prefetch_next(odbcstmt *stmt)
+{
+	elog(ERROR, "odbclink: prefetching needs PostgreSQL 9.5 or later");
+	return SQL_ERROR;
+}
+
+void
+prefetch_end(odbcstmt *stmt)
+{
+}
+
+#endif
@@ -0,0 +1,782 @@
+#include "postgres.h"
+
+#include <ctype.h>
+#include <math.h>
+
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/hash.h"
+#include "access/htup_details.h"
+#include "lib/stringinfo.h"
+#include "mb/pg_wchar.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
+
+#include "odbclink.h"
+
+PG_FUNCTION_INFO_V1(odbclink_stats);
+PG_FUNCTION_INFO_V1(odbclink_stats_reset);
+PG_FUNCTION_INFO_V1(odbclink_statement_stats);
+
+/*
+ * Statistics of the remote connections. The backends count into the
+ * odbcstats of their connections and add them to the entry of the
+ * data source when a statement is done. The entries are keyed by the
+ * DSN and UID or the connection string with the password masked, so
+ * the connections of all sessions to a data source are summed up.
+ *
+ * The entries are kept in shared memory if odbclink is preloaded
+ * (PostgreSQL 9.6+), otherwise every backend sees only its own.
+ */
+#define STATSLABELLEN	(256)
+#define STATSENTRIES	(256)
+
+typedef struct {
+	char		label[STATSLABELLEN];	/* hash key, must be first */
+	slock_t		mutex;		/* protects the counters */
+	odbcstats	counters;
+} odbcstatsentry;
+
+static HTAB	   *stats_hash = NULL;
+
+/*
+ * Statistics of the remote statements, keyed by the hash of the
+ * normalized query text (literals replaced by ?, comments and extra
+ * white space removed) and the data source. When the table is full
+ * the least used statement is dropped. The usage is the number of calls
+ * decayed at every eviction as in pg_stat_statements, so statements
+ * called often long ago make room for the current ones.
+ */
+#define STMTTEXTLEN	(1024)
+#define STMTENTRIES	(1024)
+#define USAGEDECAY	(0.99)
+
+/* Aggregated times of a phase, the variance is computed as in pg_stat_statements */
+typedef struct {
+	double		total;
+	double		min;
+	double		max;
+	double		mean;
+	double		sum_var;
+} odbcphase;
+
+typedef struct {
+	uint32		queryid;
+	uint32		connid;		/* hash of the label of the data source */
+} odbcstmtkey;
+
+typedef struct {
+	odbcstmtkey	key;		/* hash key, must be first */
+	slock_t		mutex;		/* protects the counters */
+	char		label[STATSLABELLEN];
+	char		query[STMTTEXTLEN];
+	int64		calls;
+	int64		rows;
+	int64		bytes;
+	double		usage;		/* decayed calls, for the eviction */
+	odbcphase	exec;		/* prepare and execute */
+	odbcphase	first;		/* until the first row */
+	odbcphase	total;		/* until the last row */
+} odbcstmtentry;
+
+static HTAB	   *stmt_hash = NULL;
+
+/* GUC variables */
+static bool	track_statements = false;
+static int	log_min_duration = -1;
+
+#if PG_VERSION_NUM >= 90600
+
+/* Adding and removing entries needs the lock exclusively, updating them shared */
+typedef struct {
+	LWLock	   *lock;
+} odbcstatsshared;
+
+static odbcstatsshared	   *stats_shared = NULL;
+static shmem_startup_hook_type	prev_shmem_startup_hook = NULL;
+
+static void
+stats_shmem_startup(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	stats_shared = ShmemInitStruct("odbclink stats", sizeof(odbcstatsshared), &found);
+	if (!found)
+		stats_shared->lock = &(GetNamedLWLockTranche("odbclink stats"))->lock;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = STATSLABELLEN;
+	info.entrysize = sizeof(odbcstatsentry);
+	stats_hash = ShmemInitHash("odbclink stats entries", STATSENTRIES, STATSENTRIES,
+					&info, HASH_ELEM | HASH_FIXED_SIZE);
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(odbcstmtkey);
+	info.entrysize = sizeof(odbcstmtentry);
+	stmt_hash = ShmemInitHash("odbclink statement entries", STMTENTRIES, STMTENTRIES,
+					&info, HASH_ELEM | HASH_BLOBS | HASH_FIXED_SIZE);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+#endif	/* PG_VERSION_NUM >= 90600 */
+
+void
+stats_init(void)
+{
+	DefineCustomBoolVariable("odbclink.track_statements",
+				"Collect statistics of the remote statements for odbclink.statement_stats().",
+				NULL,
+				&track_statements,
+				false,
+				PGC_USERSET,
+				0,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+	DefineCustomIntVariable("odbclink.log_min_duration",
+				"Logs the remote statements running at least this long, with the time of their phases.",
+				"-1 disables it, 0 logs all remote statements.",
+				&log_min_duration,
+				-1,
+				-1,
+				INT_MAX,
+				PGC_USERSET,
+				GUC_UNIT_MS,
+#if PG_VERSION_NUM >= 90100
+				NULL,
+#endif
+				NULL,
+				NULL);
+
+#if PG_VERSION_NUM >= 90600
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	RequestAddinShmemSpace(add_size(add_size(MAXALIGN(sizeof(odbcstatsshared)),
+				hash_estimate_size(STATSENTRIES, sizeof(odbcstatsentry))),
+				hash_estimate_size(STMTENTRIES, sizeof(odbcstmtentry))));
+	RequestNamedLWLockTranche("odbclink stats", 1);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = stats_shmem_startup;
+#endif
+}
+
+static void
+stats_lock(LWLockMode mode)
+{
+#if PG_VERSION_NUM >= 90600
+	if (stats_shared)
+		LWLockAcquire(stats_shared->lock, mode);
+#endif
+}
+
+static void
+stats_unlock(void)
+{
+#if PG_VERSION_NUM >= 90600
+	if (stats_shared)
+		LWLockRelease(stats_shared->lock);
+#endif
+}
+
+/* The shared tables are fixed in size, the local ones grow as needed */
+static HASHACTION
+enter_action(void)
+{
+#if PG_VERSION_NUM >= 90600
+	if (stats_shared)
+		return HASH_ENTER_NULL;
+#endif
+	return HASH_ENTER;
+}
+
+/* The entries of this backend if they aren't in shared memory */
+static HTAB *
+get_stats_hash(void)
+{
+	if (stats_hash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = STATSLABELLEN;
+		ctl.entrysize = sizeof(odbcstatsentry);
+		ctl.hcxt = TopMemoryContext;
+		stats_hash = hash_create("odbclink stats entries", 16, &ctl, HASH_ELEM | HASH_CONTEXT);
+	}
+
+	return stats_hash;
+}
+
+static HTAB *
+get_stmt_hash(void)
+{
+	if (stmt_hash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(odbcstmtkey);
+		ctl.entrysize = sizeof(odbcstmtentry);
+		ctl.hcxt = TopMemoryContext;
+		stmt_hash = hash_create("odbclink statement entries", 64, &ctl,
+					HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	return stmt_hash;
+}
+
+/* Append the connection string with the value of PWD masked */
+static void
+append_masked_connstr(StringInfo buf, const char *connstr)
+{
+	const char *p = connstr;
+
+	while (*p)
+	{
+		const char *name = p;
+		const char *eq;
+		bool		secret;
+
+		while (*name == ' ')
+			name++;
+		eq = name;
+		while (*eq && *eq != '=' && *eq != ';')
+			eq++;
+		secret = (*eq == '=' &&
+				((eq - name == 3 && pg_strncasecmp(name, "PWD", 3) == 0) ||
+				(eq - name == 8 && pg_strncasecmp(name, "PASSWORD", 8) == 0)));
+
+		/* the value ends at the next ';', unless it's in braces */
+		p = eq;
+		if (*p == '=')
+		{
+			p++;
+			if (*p == '{')
+			{
+				while (*p && *p != '}')
+					p++;
+				if (*p)
+					p++;
+			}
+			while (*p && *p != ';')
+				p++;
+		}
+		if (*p)
+			p++;
+
+		if (secret)
+		{
+			appendBinaryStringInfo(buf, name, eq - name);
+			appendStringInfoString(buf, "=********;");
+		}
+		else
+			appendBinaryStringInfo(buf, name, p - name);
+	}
+}
+
+/* Turn a connection key made by conn_key() into the label of its entry */
+static void
+stats_label(const char *connkey, char *label)
+{
+	StringInfoData	buf;
+	int		len;
+
+	initStringInfo(&buf);
+
+	if (connkey[0] == 'C')
+		append_masked_connstr(&buf, connkey + 1);
+	else
+	{
+		const char *p = connkey + 1;
+		char	   *end;
+
+		/* D<len>:<dsn><len>:<uid><len>:<pwd> */
+		len = (int)strtol(p, &end, 10);
+		p = end + 1;
+		appendStringInfoString(&buf, "DSN=");
+		appendBinaryStringInfo(&buf, p, len);
+		p += len;
+		len = (int)strtol(p, &end, 10);
+		p = end + 1;
+		appendStringInfoString(&buf, ";UID=");
+		appendBinaryStringInfo(&buf, p, len);
+		appendStringInfoChar(&buf, ';');
+	}
+
+	len = pg_mbcliplen(buf.data, buf.len, STATSLABELLEN - 1);
+	memset(label, 0, STATSLABELLEN);
+	memcpy(label, buf.data, len);
+	pfree(buf.data);
+}
+
+/*
+ * Add the counters of a connection to the entry of its data source
+ * and clear them. If the shared table is full they are lost.
+ */
+void
+stats_flush(const char *connkey, odbcstats *stats)
+{
+	char		label[STATSLABELLEN];
+	odbcstatsentry	   *entry;
+	odbcstats  *c;
+	bool		found;
+
+	stats_label(connkey, label);
+
+	stats_lock(LW_SHARED);
+
+	entry = hash_search(get_stats_hash(), label, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		/* retry with the lock held exclusively to add the entry */
+		stats_unlock();
+		stats_lock(LW_EXCLUSIVE);
+
+		entry = hash_search(get_stats_hash(), label, enter_action(), &found);
+		if (entry && !found)
+		{
+			SpinLockInit(&entry->mutex);
+			memset(&entry->counters, 0, sizeof(odbcstats));
+		}
+	}
+
+	if (entry)
+	{
+		SpinLockAcquire(&entry->mutex);
+		c = &entry->counters;
+		c->connects += stats->connects;
+		c->queries += stats->queries;
+		c->executes += stats->executes;
+		c->rows += stats->rows;
+		c->bytes += stats->bytes;
+		c->errors += stats->errors;
+		c->cache_hits += stats->cache_hits;
+		c->connect_time += stats->connect_time;
+		c->exec_time += stats->exec_time;
+		c->fetch_time += stats->fetch_time;
+		c->conv_time += stats->conv_time;
+		SpinLockRelease(&entry->mutex);
+	}
+
+	stats_unlock();
+
+	memset(stats, 0, sizeof(odbcstats));
+}
+
+bool
+stmt_stats_enabled(void)
+{
+	return (track_statements || log_min_duration >= 0);
+}
+
+/*
+ * Append the query with the literals replaced by ?, the comments
+ * removed and white space reduced to single spaces
+ */
+static void
+normalize_query(StringInfo buf, const char *query)
+{
+	const char *p = query;
+	bool		space = false;
+
+	while (*p)
+	{
+		if (*p == '-' && p[1] == '-')
+		{
+			while (*p && *p != '\n')
+				p++;
+			space = true;
+			continue;
+		}
+		if (*p == '/' && p[1] == '*')
+		{
+			p += 2;
+			while (*p && !(*p == '*' && p[1] == '/'))
+				p++;
+			if (*p)
+				p += 2;
+			space = true;
+			continue;
+		}
+		if (isspace((unsigned char)*p))
+		{
+			p++;
+			space = true;
+			continue;
+		}
+
+		if (space && buf->len > 0)
+			appendStringInfoChar(buf, ' ');
+		space = false;
+
+		if (*p == '\'')
+		{
+			/* '' is a quote within the string */
+			for (p++; *p; p++)
+				if (*p == '\'')
+				{
+					if (p[1] != '\'')
+						break;
+					p++;
+				}
+			if (*p)
+				p++;
+			appendStringInfoChar(buf, '?');
+		}
+		else if (*p == '"' || *p == '[' || *p == '`')
+		{
+			/* quoted identifiers are kept */
+			char		close = (*p == '[' ? ']' : *p);
+			const char *start = p;
+
+			for (p++; *p && *p != close; p++)
+				;
+			if (*p)
+				p++;
+			appendBinaryStringInfo(buf, start, p - start);
+		}
+		else if (isdigit((unsigned char)*p) ||
+				(*p == '.' && isdigit((unsigned char)p[1])))
+		{
+			while (isalnum((unsigned char)*p) || *p == '.' ||
+					((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E')))
+				p++;
+			appendStringInfoChar(buf, '?');
+		}
+		else if (isalpha((unsigned char)*p) || *p == '_' || IS_HIGHBIT_SET(*p))
+		{
+			/* digits within identifiers aren't literals */
+			const char *start = p;
+
+			while (isalnum((unsigned char)*p) || *p == '_' || *p == '$' || IS_HIGHBIT_SET(*p))
+				p++;
+			appendBinaryStringInfo(buf, start, p - start);
+		}
+		else
+			appendStringInfoChar(buf, *p++);
+	}
+}
+
+static void
+add_phase(odbcphase *phase, int64 calls, double t)
+{
+	if (calls == 1)
+	{
+		phase->min = phase->max = phase->mean = t;
+		phase->sum_var = 0.0;
+	}
+	else
+	{
+		double		old_mean = phase->mean;
+
+		phase->mean += (t - old_mean) / calls;
+		phase->sum_var += (t - old_mean) * (t - phase->mean);
+		if (t < phase->min)
+			phase->min = t;
+		if (t > phase->max)
+			phase->max = t;
+	}
+	phase->total += t;
+}
+
+/* Drop the least used statement to make room for a new one, called with the lock held exclusively */
+static void
+evict_stmt(void)
+{
+	HASH_SEQ_STATUS	status;
+	odbcstmtentry	   *entry;
+	odbcstmtkey	victim;
+	double		minusage = -1;
+
+	hash_seq_init(&status, stmt_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		entry->usage *= USAGEDECAY;
+		if (minusage < 0 || entry->usage < minusage)
+		{
+			minusage = entry->usage;
+			victim = entry->key;
+		}
+	}
+
+	if (minusage >= 0)
+		hash_search(stmt_hash, &victim, HASH_REMOVE, NULL);
+}
+
+/*
+ * Account a finished remote statement, the times are in milliseconds
+ * from the start of its execution. Logs it if it took at least
+ * odbclink.log_min_duration.
+ */
+void
+stmt_stats(const char *connkey, const char *query, double exec_time,
+		double first_time, double total_time, int64 rows, int64 bytes)
+{
+	char		label[STATSLABELLEN];
+	StringInfoData	norm;
+	odbcstmtkey	key;
+	odbcstmtentry	   *entry;
+	bool		found;
+	int		len;
+
+	stats_label(connkey, label);
+
+	if (log_min_duration >= 0 && total_time >= log_min_duration)
+		ereport(LOG,
+				(errmsg("odbclink: duration: %.3f ms  execute: %.3f ms  first row: %.3f ms  "
+						"rows: " INT64_FORMAT "  bytes: " INT64_FORMAT "  data source: %s  statement: %s",
+						total_time, exec_time, first_time, rows, bytes, label, query)));
+
+	if (!track_statements)
+		return;
+
+	initStringInfo(&norm);
+	normalize_query(&norm, query);
+
+	memset(&key, 0, sizeof(key));
+	key.queryid = DatumGetUInt32(hash_any((const unsigned char *)norm.data, norm.len));
+	key.connid = DatumGetUInt32(hash_any((const unsigned char *)label, strlen(label)));
+
+	stats_lock(LW_SHARED);
+
+	entry = hash_search(get_stmt_hash(), &key, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		/* retry with the lock held exclusively to add the entry */
+		stats_unlock();
+		stats_lock(LW_EXCLUSIVE);
+
+		entry = hash_search(stmt_hash, &key, HASH_FIND, NULL);
+		if (entry == NULL)
+		{
+			if (hash_get_num_entries(stmt_hash) >= STMTENTRIES)
+				evict_stmt();
+
+			entry = hash_search(stmt_hash, &key, enter_action(), &found);
+			if (entry)
+			{
+				SpinLockInit(&entry->mutex);
+				memcpy(entry->label, label, STATSLABELLEN);
+				len = pg_mbcliplen(norm.data, norm.len, STMTTEXTLEN - 1);
+				memcpy(entry->query, norm.data, len);
+				entry->query[len] = '\0';
+				entry->calls = entry->rows = entry->bytes = 0;
+				entry->usage = 0;
+				memset(&entry->exec, 0, sizeof(odbcphase));
+				memset(&entry->first, 0, sizeof(odbcphase));
+				memset(&entry->total, 0, sizeof(odbcphase));
+			}
+		}
+	}
+
+	if (entry)
+	{
+		SpinLockAcquire(&entry->mutex);
+		entry->calls++;
+		entry->usage += 1;
+		entry->rows += rows;
+		entry->bytes += bytes;
+		add_phase(&entry->exec, entry->calls, exec_time);
+		add_phase(&entry->first, entry->calls, first_time);
+		add_phase(&entry->total, entry->calls, total_time);
+		SpinLockRelease(&entry->mutex);
+	}
+
+	stats_unlock();
+
+	pfree(norm.data);
+}
+
+/* Return the statistics of every data source, times are in milliseconds */
+Datum
+odbclink_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate	   *tupstore;
+	HASH_SEQ_STATUS	status;
+	odbcstatsentry	   *entry;
+
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+			(rsinfo->allowedModes & SFRM_Materialize) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("odbclink: stats() must be called in a context that accepts a set")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	stats_lock(LW_SHARED);
+
+	hash_seq_init(&status, get_stats_hash());
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum	   values[12];
+		bool	   nulls[12];
+		odbcstats	c;
+
+		SpinLockAcquire(&entry->mutex);
+		c = entry->counters;
+		SpinLockRelease(&entry->mutex);
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = CStringGetTextDatum(entry->label);
+		values[1] = Int64GetDatum(c.connects);
+		values[2] = Float8GetDatum(c.connect_time);
+		values[3] = Int64GetDatum(c.queries);
+		values[4] = Int64GetDatum(c.executes);
+		values[5] = Int64GetDatum(c.rows);
+		values[6] = Int64GetDatum(c.bytes);
+		values[7] = Int64GetDatum(c.errors);
+		values[8] = Int64GetDatum(c.cache_hits);
+		values[9] = Float8GetDatum(c.exec_time);
+		values[10] = Float8GetDatum(c.fetch_time);
+		values[11] = Float8GetDatum(c.conv_time);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	stats_unlock();
+
+	MemoryContextSwitchTo(oldcontext);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	return (Datum) 0;
+}
+
+/* Drop the statistics of all data sources and statements, and the ones not yet added */
+Datum
+odbclink_stats_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS	status;
+	odbcstatsentry	   *entry;
+	odbcstmtentry	   *stmtentry;
+	int		i;
+
+	stats_lock(LW_EXCLUSIVE);
+
+	hash_seq_init(&status, get_stats_hash());
+	while ((entry = hash_seq_search(&status)) != NULL)
+		hash_search(stats_hash, entry->label, HASH_REMOVE, NULL);
+
+	hash_seq_init(&status, get_stmt_hash());
+	while ((stmtentry = hash_seq_search(&status)) != NULL)
+		hash_search(stmt_hash, &stmtentry->key, HASH_REMOVE, NULL);
+
+	stats_unlock();
+
+	for (i = 0; i < n_conn; i++)
+		memset(&conns[i].stats, 0, sizeof(odbcstats));
+
+	PG_RETURN_VOID();
+}
+
+static void
+phase_values(odbcphase *phase, int64 calls, Datum *values)
+{
+	values[0] = Float8GetDatum(phase->total);
+	values[1] = Float8GetDatum(phase->min);
+	values[2] = Float8GetDatum(phase->max);
+	values[3] = Float8GetDatum(phase->mean);
+	values[4] = Float8GetDatum(calls > 1 ? sqrt(phase->sum_var / calls) : 0.0);
+}
+
+/* Return the statistics of every remote statement, times are in milliseconds */
+Datum
+odbclink_statement_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo	   *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	TupleDesc	tupdesc;
+	Tuplestorestate	   *tupstore;
+	HASH_SEQ_STATUS	status;
+	odbcstmtentry	   *entry;
+
+	if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+			(rsinfo->allowedModes & SFRM_Materialize) == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					errmsg("odbclink: statement_stats() must be called in a context that accepts a set")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap((rsinfo->allowedModes & SFRM_Materialize_Random) != 0,
+					false, work_mem);
+
+	stats_lock(LW_SHARED);
+
+	hash_seq_init(&status, get_stmt_hash());
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum	   values[21];
+		bool	   nulls[21];
+		int64		calls, rows, bytes;
+		odbcphase	exec, first, total;
+
+		SpinLockAcquire(&entry->mutex);
+		calls = entry->calls;
+		rows = entry->rows;
+		bytes = entry->bytes;
+		exec = entry->exec;
+		first = entry->first;
+		total = entry->total;
+		SpinLockRelease(&entry->mutex);
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = CStringGetTextDatum(entry->label);
+		values[1] = Int64GetDatum((int64)entry->key.queryid);
+		values[2] = CStringGetTextDatum(entry->query);
+		values[3] = Int64GetDatum(calls);
+		values[4] = Int64GetDatum(rows);
+		values[5] = Int64GetDatum(bytes);
+		phase_values(&exec, calls, &values[6]);
+		phase_values(&first, calls, &values[11]);
+		phase_values(&total, calls, &values[16]);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	stats_unlock();
+
+	MemoryContextSwitchTo(oldcontext);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	return (Datum) 0;
+}
@@ -0,0 +1,42 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.send_query(1, 'SELECT id, id * 2 AS twice FROM gen(3)');
+SELECT * FROM odbclink.get_result(1) AS t(id int4, twice int4);
+SELECT odbclink.is_busy(1);
+SELECT * FROM odbclink.get_result(1) AS t(id int4);
+SELECT odbclink.send_query(1, 'SELECT * FROM nosuch');
+SELECT odbclink.send_query(1, 'SELECT sleep(100) FROM nosuch');
+SELECT * FROM odbclink.get_result(1) AS t(s int4);
+SELECT odbclink.send_query(1, 'CREATE TABLE odbclink_async (i integer)');
+SELECT * FROM odbclink.get_result(1) AS t(i int4);
+
+-- one query at a time per connection
+SELECT odbclink.send_query(1, 'SELECT sleep(5000) FROM gen(1)');
+SELECT odbclink.is_busy(1);
+SELECT odbclink.send_query(1, 'SELECT id FROM gen(1)');
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_async VALUES (1)');
+SELECT odbclink.cancel_query(1);
+SELECT odbclink.is_busy(1);
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(1)') AS t(id int4);
+
+-- a cancelled local statement cancels the remote one
+SET statement_timeout = '200ms';
+SELECT odbclink.execute(1, 'SELECT sleep(5000) FROM gen(1)');
+RESET statement_timeout;
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(1)') AS t(id int4);
+
+-- without asynchronous execution the query runs in a helper thread
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT odbclink.send_query(2, 'SELECT sleep(100) AS s, id FROM gen(2)');
+SELECT * FROM odbclink.get_result(2) AS t(s int4, id int4);
+SELECT odbclink.send_query(2, 'SELECT * FROM nosuch');
+SELECT * FROM odbclink.get_result(2) AS t(s int4);
+SELECT odbclink.send_query(2, 'SELECT sleep(5000) FROM gen(1)');
+SELECT odbclink.is_busy(2);
+SELECT odbclink.cancel_query(2);
+SELECT * FROM odbclink.query(2, 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.execute(1, 'DROP TABLE odbclink_async');
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,33 @@
+SET datestyle = 'ISO, YMD';
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_batch (i integer, t varchar(5), d date, f double, n numeric(10,2), b varbinary(4))');
+
+-- three parameter sets in batches of two
+SET odbclink.batch_size = 2;
+SELECT odbclink.execute_batch(1, 'INSERT INTO odbclink_batch VALUES (?, ?, ?, ?, ?, ?)',
+	array[1, 2, 3], array['a', 'bb', NULL], array[date '2024-02-29', NULL, date '2000-01-01'],
+	array[1.5, NULL, -0.25]::float8[], array[1.5, 2.25, NULL]::numeric[], array['\x01'::bytea, NULL, '\xdeadbeef']);
+SELECT * FROM odbclink.query(1, 'SELECT i, t, d, f, n, b FROM odbclink_batch ORDER BY i')
+	AS t(i int4, t text, d date, f float8, n numeric, b bytea);
+SELECT odbclink.execute_batch(1, 'UPDATE odbclink_batch SET t = ? WHERE i = ?', array['x', 'y'], array[1, 3]);
+SELECT * FROM odbclink.query(1, 'SELECT i, t, d, f, n, b FROM odbclink_batch ORDER BY i')
+	AS t(i int4, t text, d date, f float8, n numeric, b bytea);
+
+-- one set at a time without parameter arrays
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT odbclink.execute_batch(2, 'INSERT INTO odbclink_batch (i, t) VALUES (?, ?)', array[4, 5, 6], array['d', 'e', 'f']);
+SELECT odbclink.disconnect(2);
+SELECT * FROM odbclink.query(1, 'SELECT count(*), sum(i) FROM odbclink_batch') AS t(n int8, s int8);
+
+-- the sets before a failed one stay inserted
+SELECT odbclink.execute_batch(1, 'INSERT INTO odbclink_batch (i, t) VALUES (?, ?)', array[7, 8], array['g', 'toolong']);
+SELECT * FROM odbclink.query(1, 'SELECT count(*), sum(i) FROM odbclink_batch') AS t(n int8, s int8);
+RESET odbclink.batch_size;
+
+-- the parameter arrays must match the query
+SELECT odbclink.execute_batch(1, 'INSERT INTO odbclink_batch (i, t) VALUES (?, ?)', array[1, 2], array['a']);
+SELECT odbclink.execute_batch(1, 'INSERT INTO odbclink_batch (i, t) VALUES (?, ?)', array[1]);
+SELECT odbclink.execute_batch(1, 'INSERT INTO odbclink_batch (i, t) VALUES (?, ?)', 1, 'a');
+
+SELECT odbclink.disconnect(1);
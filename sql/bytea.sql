@@ -0,0 +1,11 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_binary, c_blob FROM gen(4, 20, 4, 6)')
+	AS t(id int4, c_binary bytea, c_blob bytea);
+SELECT count(*), sum(length(c_binary)), sum(length(c_blob))
+	FROM odbclink.query(1, 'SELECT c_binary, c_blob FROM gen(100, 0, 16, 1000)') AS t(c_binary bytea, c_blob bytea);
+
+-- strings are taken as they are
+SELECT * FROM odbclink.query(1, 'SELECT c_varchar FROM gen(2, 0, 3)') AS t(b bytea);
+
+SELECT odbclink.disconnect(1);
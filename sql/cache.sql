@@ -0,0 +1,32 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_cache (i integer)');
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_cache VALUES (1)');
+SELECT odbclink.stats_reset();
+SET odbclink.result_cache = 'transaction';
+
+BEGIN;
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT cache_hits FROM odbclink.stats();
+-- other result columns are another result
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int8);
+SELECT cache_hits FROM odbclink.stats();
+SELECT odbclink.cache_invalidate(1);
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT cache_hits FROM odbclink.stats();
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT cache_hits FROM odbclink.stats();
+-- a statement on the connection drops its results
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_cache VALUES (2)');
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT cache_hits FROM odbclink.stats();
+COMMIT;
+
+-- the transaction cache is gone with the transaction
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_cache') AS t(i int4);
+SELECT cache_hits FROM odbclink.stats();
+RESET odbclink.result_cache;
+
+SELECT odbclink.execute(1, 'DROP TABLE odbclink_cache');
+SELECT odbclink.disconnect(1);
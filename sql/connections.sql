@@ -0,0 +1,25 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+SELECT odbclink.connect('odbclink_test', 'user', 'secret');
+
+-- a query by data source reuses the connection to it
+SELECT * FROM odbclink.query('odbclink_test', 'user', 'secret', 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query('DSN=odbclink_test', 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query('DSN=odbclink_test', 'SELECT id FROM gen(2)') AS t(id int4);
+SELECT * FROM odbclink.connections() ORDER BY id;
+
+-- the slot of a closed connection is used again
+SELECT odbclink.disconnect(2);
+SELECT * FROM odbclink.connections() ORDER BY id;
+SELECT * FROM odbclink.query('odbclink_test', 'user', 'secret', 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT odbclink.connect('odbclink_test_minimal', '', '') FROM generate_series(1, 3);
+SELECT * FROM odbclink.connections() ORDER BY id;
+
+SELECT odbclink.disconnect(2);
+SELECT odbclink.disconnect(2);
+SELECT odbclink.disconnect(9);
+SELECT odbclink.disconnect(3);
+SELECT odbclink.disconnect(4);
+SELECT odbclink.disconnect(5);
+SELECT odbclink.disconnect(6);
+SELECT odbclink.disconnect(1);
+SELECT count(*) FROM odbclink.connections() WHERE connected;
@@ -0,0 +1,8 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+-- integers into wider types, strings through the type input functions
+SELECT * FROM odbclink.query(1, $$SELECT c_int2, c_int2, c_int4, c_char, c_varchar, c_varchar, '12.50', c_bit FROM gen(3, 0, 6)$$)
+	AS t(i2_4 int4, i2_8 int8, i4_8 int8, c text, v bpchar, v6 varchar(6), n numeric, b bool);
+SELECT * FROM odbclink.query(1, 'SELECT c_varchar FROM gen(1)') AS t(n numeric);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,26 @@
+SET datestyle = 'ISO, YMD';
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_copy (i integer, t varchar(6), ts timestamp, b varbinary(4))');
+SET odbclink.batch_size = 3;
+SELECT odbclink.copy_to_remote(1, $$SELECT g, 'row ' || g, timestamp '2024-01-01' + g * interval '1 hour', decode(lpad(to_hex(g), 2, '0'), 'hex')
+	FROM generate_series(1, 10) g$$, 'odbclink_copy');
+SELECT * FROM odbclink.query(1, 'SELECT i, t, ts, b FROM odbclink_copy WHERE i <= 3 ORDER BY i')
+	AS t(i int4, t text, ts timestamp, b bytea);
+SELECT * FROM odbclink.query(1, 'SELECT count(*), sum(i) FROM odbclink_copy') AS t(n int8, s int8);
+
+-- the rows are inserted in one remote transaction
+SELECT odbclink.copy_to_remote(1, $$SELECT g, 'row ' || g, timestamp '2024-01-01' + g * interval '1 hour', decode(lpad(to_hex(g), 2, '0'), 'hex')
+	FROM generate_series(98, 102) g$$, 'odbclink_copy');
+SELECT * FROM odbclink.query(1, 'SELECT count(*), sum(i) FROM odbclink_copy') AS t(n int8, s int8);
+SELECT odbclink.copy_to_remote(1, 'SELECT 1', 'odbclink_nosuch');
+
+-- one row at a time without parameter arrays
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT odbclink.copy_to_remote(2, $$SELECT g, 'row ' || g, timestamp '2024-01-01' + g * interval '1 hour', decode(lpad(to_hex(g), 2, '0'), 'hex')
+	FROM generate_series(11, 15) g$$, 'odbclink_copy');
+SELECT odbclink.disconnect(2);
+SELECT * FROM odbclink.query(1, 'SELECT count(*), sum(i) FROM odbclink_copy') AS t(n int8, s int8);
+RESET odbclink.batch_size;
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,17 @@
+SET datestyle = 'ISO, YMD';
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_date, c_time, c_timestamp, c_timestamp FROM gen(5, 20)')
+	AS t(id int4, c_date date, c_time time, c_timestamp timestamp, c_timestamptz timestamptz);
+
+-- the end of the day and fractions rounded to the precision of the local column
+SELECT * FROM odbclink.query(1, $$SELECT {d '2024-02-29'}, {t '24:00:00'}, {ts '2024-02-29 12:34:56.25'}, {ts '2024-02-29 23:59:59.9999996'} FROM gen(1)$$)
+	AS t(d date, tm time, ts timestamp, ts_round timestamp);
+SELECT * FROM odbclink.query(1, $$SELECT {d '2024-02-29'}, {t '24:00:00'}, {ts '2024-02-29 12:34:56.25'}, {ts '2024-02-29 23:59:59.9999996'} FROM gen(1)$$)
+	AS t(d date, tm time(0), ts timestamp(1), ts_round timestamp(3));
+
+-- strings go through the input functions
+SELECT * FROM odbclink.query(1, $$SELECT '2024-02-29', '12:34:56', '2024-02-29 12:34:56' FROM gen(1)$$)
+	AS t(d date, tm time, ts timestamp);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,44 @@
+SET client_min_messages = warning;
+\set ECHO none
+\i odbclink_fdw.sql
+\set ECHO all
+RESET client_min_messages;
+SET datestyle = 'ISO, YMD';
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_fdw_remote (i integer, t varchar(10), d date)');
+SELECT odbclink.execute(1, $$INSERT INTO odbclink_fdw_remote VALUES (1, 'one', '2024-01-01'), (2, 'two', '2024-01-02'), (3, NULL, NULL)$$);
+
+CREATE SERVER odbclink_test FOREIGN DATA WRAPPER odbclink_fdw OPTIONS (dsn 'odbclink_test');
+CREATE USER MAPPING FOR current_user SERVER odbclink_test;
+CREATE FOREIGN TABLE odbclink_fdw_local (id int4 OPTIONS (column_name 'i'), t text, d date)
+	SERVER odbclink_test OPTIONS (table_name 'odbclink_fdw_remote');
+
+SELECT * FROM odbclink_fdw_local ORDER BY id;
+EXPLAIN (COSTS OFF) SELECT t FROM odbclink_fdw_local WHERE id > 1;
+SELECT t FROM odbclink_fdw_local WHERE id > 1 ORDER BY t;
+EXPLAIN (COSTS OFF) SELECT id FROM odbclink_fdw_local WHERE d = '2024-01-02';
+SELECT id FROM odbclink_fdw_local WHERE d = '2024-01-02';
+SELECT id FROM odbclink_fdw_local WHERE id IN (1, 3) ORDER BY id;
+SELECT id FROM odbclink_fdw_local WHERE NOT id = 1 ORDER BY id;
+
+-- string conditions are checked again locally
+EXPLAIN (COSTS OFF) SELECT id FROM odbclink_fdw_local WHERE t LIKE 't%';
+SELECT id FROM odbclink_fdw_local WHERE t LIKE 't%';
+SELECT id FROM odbclink_fdw_local WHERE t IS NULL;
+EXPLAIN (COSTS OFF) SELECT id FROM odbclink_fdw_local WHERE t < 'p';
+SELECT id FROM odbclink_fdw_local WHERE t < 'p';
+
+-- generated rows
+CREATE FOREIGN TABLE odbclink_fdw_gen (id int4, c_int8 int8)
+	SERVER odbclink_test OPTIONS (table_name 'gen(1000, 10)');
+EXPLAIN (COSTS OFF) SELECT count(*), sum(c_int8) FROM odbclink_fdw_gen
+	WHERE id BETWEEN 100 AND 199 AND c_int8 IS NOT NULL;
+SELECT count(*), sum(c_int8) FROM odbclink_fdw_gen
+	WHERE id BETWEEN 100 AND 199 AND c_int8 IS NOT NULL;
+
+DROP FOREIGN TABLE odbclink_fdw_gen;
+DROP FOREIGN TABLE odbclink_fdw_local;
+DROP USER MAPPING FOR current_user SERVER odbclink_test;
+DROP SERVER odbclink_test;
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,28 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_bit, c_int2, c_int4, c_int8, c_float4, c_float8 FROM gen(5, 30)')
+	AS t(id int4, c_bit bool, c_int2 int2, c_int4 int4, c_int8 int8, c_float4 float4, c_float8 float8);
+
+-- blocks of 7 rows, the last one is not full
+SET odbclink.fetch_size = 7;
+SELECT count(*), count(c_int4), sum(c_int2), sum(c_int8)
+	FROM odbclink.query(1, 'SELECT id, c_bit, c_int2, c_int4, c_int8, c_float4, c_float8 FROM gen(100, 20)')
+	AS t(id int4, c_bit bool, c_int2 int2, c_int4 int4, c_int8 int8, c_float4 float4, c_float8 float8);
+SET odbclink.fetch_size = 1;
+SELECT count(*), count(c_int4), sum(c_int2), sum(c_int8)
+	FROM odbclink.query(1, 'SELECT id, c_bit, c_int2, c_int4, c_int8, c_float4, c_float8 FROM gen(100, 20)')
+	AS t(id int4, c_bit bool, c_int2 int2, c_int4 int4, c_int8 int8, c_float4 float4, c_float8 float8);
+RESET odbclink.fetch_size;
+
+-- a data source that returns one row per fetch
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT count(*), count(c_int4), sum(c_int2), sum(c_int8)
+	FROM odbclink.query(2, 'SELECT id, c_bit, c_int2, c_int4, c_int8, c_float4, c_float8 FROM gen(100, 20)')
+	AS t(id int4, c_bit bool, c_int2 int2, c_int4 int4, c_int8 int8, c_float4 float4, c_float8 float8);
+SELECT odbclink.disconnect(2);
+
+-- the result columns must match the query
+SELECT * FROM odbclink.query(1, 'SELECT id, c_int4 FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query(1, 'SELECT c_int8 FROM gen(1)') AS t(c_int8 int4);
+
+SELECT odbclink.disconnect(1);
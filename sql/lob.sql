@@ -0,0 +1,33 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_text FROM gen(3, 0, 4, 12)') AS t(id int4, c_text text);
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_text FROM gen(100, 30, 4, 1000)') AS t(id int4, c_text text);
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_text FROM gen(20, 0, 4, 100000)') AS t(id int4, c_text text);
+SELECT count(*), count(c_blob), sum(length(c_blob)), md5(string_agg(c_blob, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_blob FROM gen(20, 0, 4, 100000)') AS t(id int4, c_blob bytea);
+-- values above odbclink.lob_direct_size are read into the result value
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_text FROM gen(2, 0, 4, 1500000)') AS t(id int4, c_text text);
+SET odbclink.lob_direct_size = '64kB';
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_text FROM gen(20, 0, 4, 100000)') AS t(id int4, c_text text);
+SET odbclink.lob_direct_size = -1;
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_text FROM gen(2, 0, 4, 1500000)') AS t(id int4, c_text text);
+RESET odbclink.lob_direct_size;
+
+-- a driver that doesn't report the remaining length
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_text FROM gen(100, 30, 4, 1000)') AS t(id int4, c_text text);
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_text FROM gen(20, 0, 4, 100000)') AS t(id int4, c_text text);
+SELECT count(*), count(c_blob), sum(length(c_blob)), md5(string_agg(c_blob, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_blob FROM gen(20, 10, 4, 100000)') AS t(id int4, c_blob bytea);
+SELECT count(*), count(c_text), sum(length(c_text)), md5(string_agg(c_text, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_text FROM gen(2, 0, 4, 1500000)') AS t(id int4, c_text text);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,17 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+-- a result larger than work_mem spills to disk
+SET work_mem = '64kB';
+SELECT count(*), sum(id), sum(length(c_varchar))
+	FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(20000, 0, 100)') AS t(id int4, c_varchar text);
+RESET work_mem;
+
+-- one row at a time, stopped early
+SET odbclink.materialize = off;
+SELECT count(*), sum(id), sum(length(c_varchar))
+	FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(20000, 0, 100)') AS t(id int4, c_varchar text);
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(20000, 0, 5)') AS t(id int4, c_varchar text) LIMIT 3;
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(3, 0, 5)') AS t(id int4, c_varchar text);
+RESET odbclink.materialize;
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,24 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+SELECT odbclink.connect('odbclink_test', 'user', 'secret');
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+
+-- the connections share the data of the driver, every row comes three times
+SELECT * FROM odbclink.query_multi(array[1, 2, 3], 'SELECT id, c_varchar FROM gen(2, 0, 4)')
+	AS t(id int4, c_varchar text) ORDER BY id;
+SELECT * FROM odbclink.query_multi(array[3, 1], 'SELECT id, c_varchar FROM gen(2, 0, 4)', true)
+	AS t(conn int4, id int4, c_varchar text) ORDER BY conn, id;
+SELECT conn, count(*), sum(id)
+	FROM odbclink.query_multi(array[1, 2], 'SELECT id FROM gen(1000, 10)', true) AS t(conn int4, id int4)
+	GROUP BY conn ORDER BY conn;
+SELECT count(*) FROM odbclink.query_multi(array[2], 'SELECT id FROM gen(0)') AS t(id int4);
+
+SELECT * FROM odbclink.query_multi(array[1, 2], 'SELECT id FROM nosuch') AS t(id int4);
+SELECT * FROM odbclink.query_multi(array[1, 4], 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query_multi(array[1, 2, 1], 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query_multi(array[]::int4[], 'SELECT id FROM gen(1)') AS t(id int4);
+SELECT * FROM odbclink.query_multi(array[1], 'SELECT id FROM gen(1)', true) AS t(id int4);
+SELECT * FROM odbclink.query_multi(array[1, 2], 'SELECT id FROM gen(1)') AS t(id int4);
+
+SELECT odbclink.disconnect(3);
+SELECT odbclink.disconnect(2);
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,15 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_numeric, c_numeric, c_numeric FROM gen(6, 20)')
+	AS t(id int4, n numeric, n_10_2 numeric(10,2), i int8);
+SELECT * FROM odbclink.query(1, 'SELECT 12345678901234.5678, -0.001, sum(c_numeric) FROM gen(100)')
+	AS t(a numeric, b numeric, s numeric);
+SELECT * FROM odbclink.query(1, 'SELECT c_numeric FROM gen(100)') AS t(n numeric(4,2));
+
+-- read with SQLGetData() as text after a long column
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT * FROM odbclink.query(2, 'SELECT c_text, c_numeric FROM gen(3, 0, 4, 5)')
+	AS t(c_text text, c_numeric numeric);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,27 @@
+--
+-- first, define the functions.  Turn off echoing so that expected file
+-- does not depend on contents of odbclink.sql.
+--
+SET client_min_messages = warning;
+\set ECHO none
+\i odbclink.sql
+\set ECHO all
+RESET client_min_messages;
+
+-- the tests run against odbclink_test, the driver in test/
+SELECT odbclink.connect('odbclink_test', '', '');
+SELECT * FROM odbclink.query(1, 'SELECT id, c_int4, c_varchar FROM gen(3, 0, 4)')
+	AS t(id int4, c_int4 int4, c_varchar varchar);
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_t (i int4, t varchar(10))');
+SELECT odbclink.execute(1, $$INSERT INTO odbclink_t VALUES (1, 'one'), (2, NULL)$$);
+SELECT * FROM odbclink.query(1, 'SELECT i, t FROM odbclink_t ORDER BY i') AS t(i int4, t text);
+SELECT odbclink.execute(1, 'DROP TABLE odbclink_nosuch');
+
+-- a connection string or data source of a query stays connected
+SELECT * FROM odbclink.query('DSN=odbclink_test', 'SELECT count(*) FROM odbclink_t') AS t(n int8);
+SELECT * FROM odbclink.connections() ORDER BY id;
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.disconnect(1);
+SELECT * FROM odbclink.query(1, 'SELECT 1') AS t(a int4);
@@ -0,0 +1,35 @@
+SET datestyle = 'ISO, YMD';
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '3')
+	AS t(id int4, c_varchar text);
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '7')
+	AS t(id int4, c_varchar text);
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(10) WHERE id > ? AND id < ?', '3', '6') AS t(id int4);
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_params (i integer, t varchar(5), d date)');
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_params VALUES (?, ?, ?)', '1', 'abc', '2024-02-29');
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_params VALUES (?, ?, ?)', '2', NULL, NULL);
+SELECT odbclink.execute(1, 'UPDATE odbclink_params SET t = ? WHERE i = ?', 'def', '2');
+SELECT * FROM odbclink.query(1, 'SELECT i, t, d FROM odbclink_params ORDER BY i') AS t(i int4, t text, d date);
+
+-- one statement is kept prepared, the others are freed
+SET odbclink.prepared_cache_size = 1;
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '3')
+	AS t(id int4, c_varchar text);
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(10) WHERE id > ? AND id < ?', '3', '6') AS t(id int4);
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '7')
+	AS t(id int4, c_varchar text);
+RESET odbclink.prepared_cache_size;
+-- a cached statement read into other columns
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '3')
+	AS t(id int8, c_varchar varchar(5));
+
+-- errors
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(10) WHERE id > ? AND id < ?', '3') AS t(id int4);
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_params VALUES (?, ?, ?)', '3', 'abcdefg', NULL);
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(10) WHERE id = ?', 'x') AS t(id int4);
+SELECT * FROM odbclink.query(1, 'SELECT id, c_varchar FROM gen(10, 0, 5) WHERE id = ?', '3')
+	AS t(id int4, c_varchar text);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,19 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT count(*), sum(id), min(id), max(id)
+	FROM odbclink.query_partitioned(1, 'SELECT id, c_varchar FROM gen(1000, 10)', 'id', 4) AS t(id int4, c_varchar text);
+-- NULLs of the split column are read with the first partition
+SELECT count(*), count(c_int4), sum(c_int4)
+	FROM odbclink.query_partitioned(1, 'SELECT c_int4 FROM gen(100, 30)', 'c_int4', 3) AS t(c_int4 int4);
+-- no more partitions than values
+SELECT * FROM odbclink.query_partitioned(1, 'SELECT id FROM gen(2)', 'id', 8) AS t(id int4) ORDER BY id;
+SELECT count(*) FROM odbclink.query_partitioned(1, 'SELECT id FROM gen(0)', 'id', 2) AS t(id int4);
+SELECT count(*) FROM odbclink.query_partitioned(1, 'SELECT id FROM gen(10)', 'nosuch', 2) AS t(id int4);
+
+-- only the connection of the first partition stays connected
+SELECT count(*) FROM odbclink.query_partitioned('DSN=odbclink_test', 'SELECT id FROM gen(100) WHERE id > 90', 'id', 3)
+	AS t(id int4);
+SELECT id, connstr FROM odbclink.connections() WHERE connected ORDER BY id;
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,23 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SET odbclink.prefetch = on;
+SET odbclink.fetch_size = 10;
+SELECT count(*), sum(id), sum(c_int8), count(c_varchar)
+	FROM odbclink.query(1, 'SELECT id, c_int8, c_varchar FROM gen(1000, 10)') AS t(id int4, c_int8 int8, c_varchar text);
+-- prepared statements are prefetched too
+SELECT count(*), sum(id) FROM odbclink.query(1, 'SELECT id FROM gen(1000) WHERE id > ?', '100') AS t(id int4);
+SELECT count(*), sum(id) FROM odbclink.query(1, 'SELECT id FROM gen(1000) WHERE id > ?', '900') AS t(id int4);
+
+-- stopped before the end of the result
+SET odbclink.materialize = off;
+SELECT id FROM odbclink.query(1, 'SELECT id FROM gen(1000)') AS t(id int4) LIMIT 3;
+SELECT id FROM odbclink.query(1, 'SELECT id FROM gen(1000) WHERE id > ?', '500') AS t(id int4) LIMIT 2;
+SELECT * FROM odbclink.query(1, 'SELECT id FROM gen(1)') AS t(id int4);
+RESET odbclink.materialize;
+
+-- long values are read one by one, not prefetched
+SELECT count(*), sum(length(c_text)) FROM odbclink.query(1, 'SELECT c_text FROM gen(100, 0, 4, 100)') AS t(c_text text);
+RESET odbclink.fetch_size;
+RESET odbclink.prefetch;
+
+SELECT odbclink.disconnect(1);
@@ -0,0 +1,24 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.stats_reset();
+SET odbclink.track_statements = on;
+-- literals and white space don't tell statements apart
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(1000)') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT   id   FROM gen(10)') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(3) WHERE id IN (1, 2.5e0, 3)') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(5, 0, 4) WHERE c_varchar = ''bcd''') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(5, 0, 4) WHERE c_varchar = ''c''''d''') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(5) WHERE id > ?', '3') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(50) WHERE id > ?', '1') AS t(id int4);
+SELECT odbclink.execute(1, 'SET search_path = public');
+SELECT conn, query, calls, rows, min_time <= max_time AS timed
+	FROM odbclink.statement_stats() ORDER BY query;
+
+SELECT odbclink.stats_reset();
+SELECT count(*) FROM odbclink.statement_stats();
+SET odbclink.track_statements = off;
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(10)') AS t(id int4);
+SELECT count(*) FROM odbclink.statement_stats();
+RESET odbclink.track_statements;
+
+SELECT odbclink.disconnect(1);
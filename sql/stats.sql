@@ -0,0 +1,23 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.stats_reset();
+SET odbclink.track_timing = on;
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(1000)') AS t(id int4);
+SELECT count(*) FROM odbclink.query(1, 'SELECT id FROM gen(10)') AS t(id int4);
+SELECT odbclink.execute(1, 'SET search_path = public');
+SELECT conn, connects, queries, executes, rows, fetch_time > 0 AS timed FROM odbclink.stats();
+
+-- the connections of a data source are summed up, the password is not shown
+SELECT odbclink.connect('odbclink_test', '', '');
+SELECT odbclink.connect('DSN=odbclink_test;PWD=secret');
+SELECT count(*) FROM odbclink.query(2, 'SELECT id FROM gen(5)') AS t(id int4);
+SELECT count(*) FROM odbclink.query(3, 'SELECT id FROM gen(5)') AS t(id int4);
+SELECT conn, connects, queries, rows FROM odbclink.stats() ORDER BY conn;
+SELECT odbclink.disconnect(3);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.stats_reset();
+SELECT count(*) FROM odbclink.stats();
+RESET odbclink.track_timing;
+
+SELECT odbclink.disconnect(1);
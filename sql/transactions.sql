@@ -0,0 +1,66 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+SELECT odbclink.execute(1, 'CREATE TABLE odbclink_xact (i integer)');
+SELECT odbclink.set_transactional(1, true);
+
+BEGIN;
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (1)');
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (2)');
+ROLLBACK;
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+
+BEGIN;
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (1)');
+SAVEPOINT s;
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (2)');
+ROLLBACK TO SAVEPOINT s;
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (3)');
+COMMIT;
+SELECT * FROM odbclink.query(1, 'SELECT i FROM odbclink_xact ORDER BY i') AS t(i int4);
+
+-- ended before the local transaction
+BEGIN;
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (4)');
+SELECT odbclink.rollback(1);
+COMMIT;
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+SELECT odbclink.begin(1);
+SELECT odbclink.set_transactional(1, false);
+
+-- a remote transaction independent of the local ones
+SELECT odbclink.begin(1);
+SELECT odbclink.execute(1, 'DELETE FROM odbclink_xact');
+SELECT odbclink.begin(1);
+SELECT odbclink.set_transactional(1, true);
+SELECT odbclink.rollback(1);
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+SELECT odbclink.commit(1);
+
+-- results read in a remote transaction are dropped when it rolls back
+SET odbclink.result_cache = 'shared';
+BEGIN;
+SELECT odbclink.begin(1);
+SELECT odbclink.execute(1, 'INSERT INTO odbclink_xact VALUES (5)');
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+SELECT odbclink.rollback(1);
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+COMMIT;
+RESET odbclink.result_cache;
+
+-- without remote savepoints a rolled back subtransaction fails the commit
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT odbclink.set_transactional(2, true);
+BEGIN;
+SELECT odbclink.execute(2, 'INSERT INTO odbclink_xact VALUES (6)');
+SAVEPOINT s;
+SELECT odbclink.execute(2, 'INSERT INTO odbclink_xact VALUES (7)');
+RELEASE SAVEPOINT s;
+SAVEPOINT s;
+SELECT odbclink.execute(2, 'INSERT INTO odbclink_xact VALUES (8)');
+ROLLBACK TO SAVEPOINT s;
+COMMIT;
+SELECT count(*) FROM odbclink.query(1, 'SELECT i FROM odbclink_xact') AS t(i int4);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.execute(1, 'DROP TABLE odbclink_xact');
+SELECT odbclink.disconnect(1);
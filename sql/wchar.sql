@@ -0,0 +1,23 @@
+SELECT odbclink.connect('odbclink_test', '', '');
+
+-- a, U+00E4, U+20AC and U+1D11E in turn, the last one is two UTF-16 units
+SELECT id, octet_length(c_wvarchar), md5(c_wvarchar)
+	FROM odbclink.query(1, 'SELECT id, c_wvarchar FROM gen(4, 0, 5)') AS t(id int4, c_wvarchar varchar(10));
+SELECT count(*), count(c_wvarchar), sum(octet_length(c_wvarchar)), md5(string_agg(c_wvarchar, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_wvarchar FROM gen(100, 20, 8, 0)') AS t(id int4, c_wvarchar text);
+SELECT count(*), count(c_wtext), sum(octet_length(c_wtext)), md5(string_agg(c_wtext, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_wtext FROM gen(100, 20, 4, 1000)') AS t(id int4, c_wtext text);
+SELECT count(*), count(c_wtext), sum(octet_length(c_wtext)), md5(string_agg(c_wtext, '' ORDER BY id))
+	FROM odbclink.query(1, 'SELECT id, c_wtext FROM gen(3, 0, 4, 300000)') AS t(id int4, c_wtext text);
+
+-- read with SQLGetData() in pieces
+SELECT odbclink.connect('odbclink_test_minimal', '', '');
+SELECT count(*), count(c_wvarchar), sum(octet_length(c_wvarchar)), md5(string_agg(c_wvarchar, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_wvarchar FROM gen(100, 20, 8, 0)') AS t(id int4, c_wvarchar text);
+SELECT count(*), count(c_wtext), sum(octet_length(c_wtext)), md5(string_agg(c_wtext, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_wtext FROM gen(100, 20, 4, 1000)') AS t(id int4, c_wtext text);
+SELECT count(*), count(c_wtext), sum(octet_length(c_wtext)), md5(string_agg(c_wtext, '' ORDER BY id))
+	FROM odbclink.query(2, 'SELECT id, c_wtext FROM gen(3, 0, 4, 300000)') AS t(id int4, c_wtext text);
+SELECT odbclink.disconnect(2);
+
+SELECT odbclink.disconnect(1);
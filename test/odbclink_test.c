@@ -0,0 +1,5977 @@
+/*
+ * odbclink_test: a synthetic ODBC driver for the regression tests and
+ * the benchmark of odbclink.
+ *
+ * It is loaded by unixODBC like any other driver, see odbcinst.ini.in and
+ * odbc.ini in this directory. The data lives in the memory of the server
+ * process that loaded the driver, shared by its connections, and is gone
+ * when that process exits.
+ *
+ * The driver understands a small SQL dialect:
+ *
+ *	SELECT * | expr [[AS] name], ... [FROM source] [WHERE expr]
+ *		[ORDER BY output column [ASC | DESC], ...]
+ *	INSERT INTO table [(column, ...)] VALUES (expr, ...), ...
+ *	UPDATE table SET column = expr, ... [WHERE expr]
+ *	DELETE FROM table [WHERE expr]
+ *	CREATE TABLE table (column type, ...)
+ *	DROP TABLE [IF EXISTS] table
+ *	SAVEPOINT name, RELEASE [SAVEPOINT] name, ROLLBACK TO [SAVEPOINT] name
+ *	SET ...	(ignored)
+ *
+ * A source is a table, a subquery with an alias or the generator
+ * gen(rows [, nulls [, width [, lob]]]) with the columns of gen_columns
+ * below: nulls is the percentage of NULL values, width the size of the
+ * short string and binary columns and lob the size of the long ones.
+ * Expressions have the usual operators, LIKE, IN, BETWEEN, IS [NOT] NULL,
+ * ODBC date/time escapes, the aggregates count, min, max and sum and the
+ * functions length(x) and sleep(ms). A statement with sleep() takes that
+ * long to execute, it can be cancelled and it honours the query timeout.
+ *
+ * The options of a data source, in odbc.ini or in the connection string:
+ *
+ *	Async				yes: SQL_ATTR_ASYNC_ENABLE is supported
+ *	GetDataExtensions	the SQL_GETDATA_EXTENSIONS bits, default 15
+ *	MaxRowArraySize		larger row arrays are cut down to this, 0: no limit
+ *	NoTotal				yes: SQLGetData() reports SQL_NO_TOTAL for truncated data
+ *	ParamArrays			yes: SQL_ATTR_PARAMSET_SIZE can be above 1
+ *	Savepoints			yes: savepoints are supported
+ */
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sql.h>
+#include <sqlext.h>
+#include <odbcinst.h>
+
+#define DRIVER_NAME "odbclink_test"
+#define NAMELEN 64
+#define MAXTEXT 2147483647
+
+/* Memory of a statement, freed at once */
+typedef struct tblock
+{
+	struct tblock *next;
+	size_t		used;
+	size_t		size;
+} tblock;
+
+#define BLOCKHDR 32
+
+typedef struct
+{
+	tblock	   *head;
+} tarena;
+
+static void *
+xmalloc(size_t size)
+{
+	void	   *p = malloc(size ? size : 1);
+
+	if (p == NULL)
+	{
+		fprintf(stderr, DRIVER_NAME ": out of memory\n");
+		abort();
+	}
+	return p;
+}
+
+static void *
+xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size ? size : 1);
+	if (p == NULL)
+	{
+		fprintf(stderr, DRIVER_NAME ": out of memory\n");
+		abort();
+	}
+	return p;
+}
+
+static void *
+aalloc(tarena *a, size_t size)
+{
+	tblock	   *b = a->head;
+	void	   *p;
+
+	size = (size + 15) & ~(size_t) 15;
+	if (b == NULL || b->size - b->used < size)
+	{
+		size_t		bsize = size > 8192 ? size : 8192;
+
+		b = xmalloc(BLOCKHDR + bsize);
+		b->used = 0;
+		b->size = bsize;
+		b->next = a->head;
+		a->head = b;
+	}
+	p = (char *) b + BLOCKHDR + b->used;
+	b->used += size;
+	return p;
+}
+
+static void *
+azalloc(tarena *a, size_t size)
+{
+	void	   *p = aalloc(a, size);
+
+	memset(p, 0, size);
+	return p;
+}
+
+static char *
+astrndup(tarena *a, const char *s, size_t len)
+{
+	char	   *p = aalloc(a, len + 1);
+
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+static void
+afree(tarena *a)
+{
+	while (a->head)
+	{
+		tblock	   *next = a->head->next;
+
+		free(a->head);
+		a->head = next;
+	}
+}
+
+/* Values */
+enum
+{
+	V_NULL, V_INT, V_FLOAT, V_NUM, V_STR, V_BIN, V_DATE, V_TIME, V_TS
+};
+
+typedef struct
+{
+	int			kind;
+	bool		owned;			/* s was malloc'd for this value */
+	int			scale;			/* V_NUM: the value is i / 10^scale */
+	int64_t		i;
+	double		f;
+	char	   *s;				/* V_STR, V_BIN */
+	size_t		len;
+	SQL_TIMESTAMP_STRUCT dt;	/* V_DATE, V_TIME, V_TS */
+} tvalue;
+
+typedef struct
+{
+	char		name[NAMELEN];
+	SQLSMALLINT type;			/* ODBC 3 SQL type */
+	SQLULEN		size;
+	SQLSMALLINT digits;
+} tcolumn;
+
+static void
+free_value(tvalue *v)
+{
+	if (v->owned)
+		free(v->s);
+	v->owned = false;
+	v->kind = V_NULL;
+}
+
+static void
+free_values(tvalue *v, int n)
+{
+	int			k;
+
+	for (k = 0; k < n; k++)
+		free_value(&v[k]);
+}
+
+/* A copy of v that owns its data, in arena a or malloc'd if a is NULL */
+static tvalue
+copy_value(tvalue *v, tarena *a)
+{
+	tvalue		c = *v;
+
+	c.owned = false;
+	if (v->kind == V_STR || v->kind == V_BIN)
+	{
+		c.s = a ? aalloc(a, v->len + 1) : xmalloc(v->len + 1);
+		memcpy(c.s, v->s, v->len);
+		c.s[v->len] = '\0';
+		c.owned = (a == NULL);
+	}
+	return c;
+}
+
+static bool
+is_wide_type(SQLSMALLINT type)
+{
+	return type == SQL_WCHAR || type == SQL_WVARCHAR || type == SQL_WLONGVARCHAR;
+}
+
+static bool
+is_char_type(SQLSMALLINT type)
+{
+	return type == SQL_CHAR || type == SQL_VARCHAR || type == SQL_LONGVARCHAR ||
+		is_wide_type(type);
+}
+
+static bool
+is_binary_type(SQLSMALLINT type)
+{
+	return type == SQL_BINARY || type == SQL_VARBINARY || type == SQL_LONGVARBINARY;
+}
+
+/* Diagnostics, one record per handle */
+typedef struct
+{
+	bool		set;
+	char		state[6];
+	char		msg[512];
+} tdiag;
+
+static void
+set_diag(tdiag *d, const char *state, const char *fmt, va_list ap)
+{
+	int			n;
+
+	d->set = true;
+	strcpy(d->state, state);
+	n = snprintf(d->msg, sizeof(d->msg), "[" DRIVER_NAME "]");
+	vsnprintf(d->msg + n, sizeof(d->msg) - n, fmt, ap);
+}
+
+static void
+diag(tdiag *d, const char *state, const char *fmt,...)
+{
+	va_list		ap;
+
+	va_start(ap, fmt);
+	set_diag(d, state, fmt, ap);
+	va_end(ap);
+}
+
+/* Handles */
+typedef struct tenv
+{
+	SQLINTEGER	version;
+	tdiag		diag;
+} tenv;
+
+struct ttable;
+
+enum
+{
+	U_INSERT, U_DELETE, U_UPDATE, U_CREATE, U_DROP, U_SAVEPOINT
+};
+
+/* The undo log of a transaction */
+typedef struct tundo
+{
+	struct tundo *prev;
+	int			op;
+	struct ttable *table;
+	int			index;
+	tvalue	   *row;			/* inserted, deleted or the old version */
+	char		name[NAMELEN];	/* U_SAVEPOINT */
+} tundo;
+
+typedef struct tconn
+{
+	tenv	   *env;
+	tdiag		diag;
+	bool		connected;
+	bool		autocommit;
+	SQLULEN		login_timeout;
+	/* options of the data source */
+	char		dsn[NAMELEN];
+	bool		async;
+	SQLUINTEGER getdata_ext;
+	SQLULEN		max_rowset;
+	bool		no_total;
+	bool		param_arrays;
+	bool		savepoints;
+	tundo	   *undo;
+} tconn;
+
+enum
+{
+	D_ARD, D_APD, D_IRD, D_IPD
+};
+
+typedef struct tdesc
+{
+	int			kind;
+	struct tstmt *stmt;
+	tdiag		diag;
+} tdesc;
+
+/* A column of the ARD */
+typedef struct
+{
+	SQLSMALLINT ctype;
+	SQLPOINTER	ptr;
+	SQLLEN		buflen;
+	SQLLEN	   *ind;
+	SQLSMALLINT precision;
+	SQLSMALLINT scale;
+} tbind;
+
+typedef struct
+{
+	SQLSMALLINT ctype;
+	SQLSMALLINT sqltype;
+	SQLULEN		size;
+	SQLSMALLINT digits;
+	SQLPOINTER	ptr;
+	SQLLEN		buflen;
+	SQLLEN	   *ind;
+} tparam;
+
+struct tquery;
+struct tcursor;
+
+enum
+{
+	S_IDLE, S_EXECUTING
+};
+
+typedef struct tstmt
+{
+	tconn	   *conn;
+	tdiag		diag;
+	bool		warning;
+	jmp_buf		jump;
+	tdesc		ard, apd, ird, ipd;
+	/* attributes */
+	SQLULEN		row_array_size;
+	SQLULEN    *rows_fetched;
+	SQLUSMALLINT *row_status;
+	SQLULEN    *bind_offset;
+	SQLULEN		paramset_size;
+	SQLULEN    *params_processed;
+	SQLUSMALLINT *param_status;
+	bool		async;
+	SQLULEN		query_timeout;
+	/* bindings */
+	int			nbinds;
+	tbind	   *binds;
+	int			nparams;
+	tparam	   *params;
+	/* the statement */
+	tarena		parse;
+	struct tquery *query;
+	int			state;
+	struct timespec start;
+	int			cancelled;
+	SQLLEN		rowcount;
+	/* the result */
+	tarena		exec;
+	struct tcursor *cursor;
+	int			ncols;
+	tcolumn    *cols;
+	tvalue	   *rowset;
+	int			rowsetcap;
+	int			nrows;
+	int			pos;
+	size_t	   *gd_offset;		/* read by SQLGetData, GD_DONE when done */
+	char	   *scratch;
+	size_t		scratchlen;
+} tstmt;
+
+#define GD_DONE ((size_t) -1)
+
+static void
+stmt_error(tstmt *stmt, const char *state, const char *fmt,...)
+{
+	va_list		ap;
+
+	va_start(ap, fmt);
+	set_diag(&stmt->diag, state, fmt, ap);
+	va_end(ap);
+	longjmp(stmt->jump, 1);
+}
+
+static void
+stmt_warning(tstmt *stmt, const char *state, const char *msg)
+{
+	diag(&stmt->diag, state, "%s", msg);
+	stmt->warning = true;
+}
+
+static char *
+scratch(tstmt *stmt, size_t len)
+{
+	if (stmt->scratchlen < len)
+	{
+		stmt->scratchlen = len > 256 ? len : 256;
+		stmt->scratch = xrealloc(stmt->scratch, stmt->scratchlen);
+	}
+	return stmt->scratch;
+}
+
+/* Text */
+static int
+utf8_next(const unsigned char **p, const unsigned char *end)
+{
+	const unsigned char *s = *p;
+	int			c = *s++;
+	int			n;
+
+	if (c < 0x80)
+		n = 0;
+	else if ((c & 0xe0) == 0xc0)
+		n = 1, c &= 0x1f;
+	else if ((c & 0xf0) == 0xe0)
+		n = 2, c &= 0x0f;
+	else if ((c & 0xf8) == 0xf0)
+		n = 3, c &= 0x07;
+	else
+		return -1;
+	if (end - s < n)
+		return -1;
+	while (n-- > 0)
+	{
+		if ((*s & 0xc0) != 0x80)
+			return -1;
+		c = (c << 6) | (*s++ & 0x3f);
+	}
+	*p = s;
+	return c;
+}
+
+static size_t
+utf8_put(char *out, int c)
+{
+	unsigned char *o = (unsigned char *) out;
+
+	if (c < 0x80)
+	{
+		o[0] = c;
+		return 1;
+	}
+	if (c < 0x800)
+	{
+		o[0] = 0xc0 | (c >> 6);
+		o[1] = 0x80 | (c & 0x3f);
+		return 2;
+	}
+	if (c < 0x10000)
+	{
+		o[0] = 0xe0 | (c >> 12);
+		o[1] = 0x80 | ((c >> 6) & 0x3f);
+		o[2] = 0x80 | (c & 0x3f);
+		return 3;
+	}
+	o[0] = 0xf0 | (c >> 18);
+	o[1] = 0x80 | ((c >> 12) & 0x3f);
+	o[2] = 0x80 | ((c >> 6) & 0x3f);
+	o[3] = 0x80 | (c & 0x3f);
+	return 4;
+}
+
+/* The number of characters of UTF-8 text, or of UTF-16 units if wide */
+static size_t
+text_length(const char *s, size_t len, bool wide)
+{
+	const unsigned char *p = (const unsigned char *) s;
+	const unsigned char *end = p + len;
+	size_t		n = 0;
+
+	while (p < end)
+	{
+		int			c = utf8_next(&p, end);
+
+		if (c < 0)
+			p++;
+		n += (wide && c >= 0x10000) ? 2 : 1;
+	}
+	return n;
+}
+
+/* UTF-8 to UTF-16 in out, which has room for 2 * len units */
+static size_t
+utf8_to_utf16(const char *s, size_t len, SQLWCHAR *out)
+{
+	const unsigned char *p = (const unsigned char *) s;
+	const unsigned char *end = p + len;
+	size_t		n = 0;
+
+	while (p < end)
+	{
+		int			c = utf8_next(&p, end);
+
+		if (c < 0)
+		{
+			c = 0xfffd;
+			p++;
+		}
+		if (c >= 0x10000)
+		{
+			c -= 0x10000;
+			out[n++] = 0xd800 | (c >> 10);
+			out[n++] = 0xdc00 | (c & 0x3ff);
+		}
+		else
+			out[n++] = c;
+	}
+	return n;
+}
+
+/* UTF-16 to UTF-8 in out, which has room for 3 * len bytes */
+static size_t
+utf16_to_utf8(const SQLWCHAR *s, size_t len, char *out)
+{
+	size_t		n = 0;
+	size_t		k;
+
+	for (k = 0; k < len; k++)
+	{
+		int			c = s[k];
+
+		if (c >= 0xd800 && c < 0xdc00 && k + 1 < len &&
+			s[k + 1] >= 0xdc00 && s[k + 1] < 0xe000)
+		{
+			c = 0x10000 + ((c - 0xd800) << 10) + (s[k + 1] - 0xdc00);
+			k++;
+		}
+		n += utf8_put(out + n, c);
+	}
+	return n;
+}
+
+static const int64_t pow10[] = {
+	1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+	100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+	1000000000000LL, 10000000000000LL, 100000000000000LL,
+	1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+	1000000000000000000LL
+};
+
+#define MAXSCALE 18
+
+/* i / 10^from rescaled to 10^to, rounded half away from zero */
+static bool
+rescale(int64_t i, int from, int to, int64_t *result)
+{
+	__int128	v = i;
+
+	if (to >= from)
+	{
+		v *= pow10[to - from];
+		if (v > INT64_MAX || v < INT64_MIN)
+			return false;
+	}
+	else
+	{
+		int64_t		d = pow10[from - to];
+		__int128	r = v % d;
+
+		v /= d;
+		if (r * 2 >= d)
+			v++;
+		else if (r * 2 <= -d)
+			v--;
+	}
+	*result = (int64_t) v;
+	return true;
+}
+
+static void
+format_numeric(char *buf, int64_t i, int scale)
+{
+	uint64_t	u = i < 0 ? -(uint64_t) i : (uint64_t) i;
+	char		digits[32];
+	int			n = snprintf(digits, sizeof(digits), "%llu", (unsigned long long) u);
+	int			k = 0;
+
+	if (i < 0)
+		buf[k++] = '-';
+	if (n <= scale)
+	{
+		buf[k++] = '0';
+		if (scale > 0)
+		{
+			buf[k++] = '.';
+			memset(buf + k, '0', scale - n);
+			k += scale - n;
+			memcpy(buf + k, digits, n);
+			k += n;
+		}
+	}
+	else
+	{
+		memcpy(buf + k, digits, n - scale);
+		k += n - scale;
+		if (scale > 0)
+		{
+			buf[k++] = '.';
+			memcpy(buf + k, digits + n - scale, scale);
+			k += scale;
+		}
+	}
+	buf[k] = '\0';
+}
+
+/* The shortest text that reads back as the same value */
+static void
+format_float(char *buf, double f, bool real)
+{
+	int			p;
+
+	for (p = real ? 6 : 15; p < (real ? 9 : 17); p++)
+	{
+		snprintf(buf, 64, "%.*g", p, f);
+		if (real ? (float) strtod(buf, NULL) == (float) f : strtod(buf, NULL) == f)
+			return;
+	}
+	snprintf(buf, 64, "%.*g", p, f);
+}
+
+/* A decimal number as i / 10^scale, false if it is not one */
+static bool
+parse_numeric(const char *s, size_t len, int scale, int64_t *result)
+{
+	const char *end = s + len;
+	__int128	v = 0;
+	int			digits = 0;
+	int			frac = -1;
+	bool		neg = false;
+	bool		round = false;
+
+	while (s < end && isspace((unsigned char) *s))
+		s++;
+	while (end > s && isspace((unsigned char) end[-1]))
+		end--;
+	if (memchr(s, 'e', end - s) || memchr(s, 'E', end - s))
+	{
+		char		buf[64];
+		char	   *e;
+		double		f;
+
+		/* leave exponents to strtod */
+		if (end - s >= (int) sizeof(buf))
+			return false;
+		memcpy(buf, s, end - s);
+		buf[end - s] = '\0';
+		f = strtod(buf, &e) * pow10[scale];
+		if (*e != '\0' || e == buf || !(fabs(f) < 9.2e18))
+			return false;
+		*result = llround(f);
+		return true;
+	}
+	if (s < end && (*s == '-' || *s == '+'))
+		neg = (*s++ == '-');
+	for (; s < end; s++)
+	{
+		if (*s == '.' && frac < 0)
+			frac = 0;
+		else if (isdigit((unsigned char) *s))
+		{
+			digits++;
+			if (frac >= scale)
+			{
+				/* beyond the scale, only the first digit rounds */
+				if (frac++ == scale)
+					round = (*s >= '5');
+				continue;
+			}
+			v = v * 10 + (*s - '0');
+			if (v > INT64_MAX)
+				return false;
+			if (frac >= 0)
+				frac++;
+		}
+		else
+			return false;
+	}
+	if (digits == 0)
+		return false;
+	if (frac < 0)
+		frac = 0;
+	if (frac > scale)
+		frac = scale;
+	while (frac < scale)
+	{
+		v *= 10;
+		frac++;
+		if (v > INT64_MAX)
+			return false;
+	}
+	if (round)
+		v++;
+	*result = (int64_t) (neg ? -v : v);
+	return true;
+}
+
+/* Dates and times */
+static const int mdays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static int
+days_in_month(int y, int m)
+{
+	if (m == 2 && y % 4 == 0 && (y % 100 != 0 || y % 400 == 0))
+		return 29;
+	return mdays[m - 1];
+}
+
+static bool
+valid_datetime(SQL_TIMESTAMP_STRUCT *dt, int kind)
+{
+	if (kind != V_TIME &&
+		(dt->year < 1 || dt->year > 9999 || dt->month < 1 || dt->month > 12 ||
+		 dt->day < 1 || dt->day > days_in_month(dt->year, dt->month)))
+		return false;
+	if (kind == V_DATE)
+		return true;
+	/* 24:00:00 is the end of the day */
+	if (dt->hour == 24)
+		return dt->minute == 0 && dt->second == 0 && dt->fraction == 0;
+	return dt->hour < 24 && dt->minute < 60 && dt->second < 60 &&
+		dt->fraction < 1000000000;
+}
+
+/* The date days after 2000-01-01 */
+static void
+days_to_date(long days, SQL_TIMESTAMP_STRUCT *dt)
+{
+	int			y = 2000;
+	int			m = 1;
+
+	while (days >= 365 + (days_in_month(y, 2) == 29))
+		days -= 365 + (days_in_month(y++, 2) == 29);
+	while (days >= days_in_month(y, m))
+		days -= days_in_month(y, m++);
+	dt->year = y;
+	dt->month = m;
+	dt->day = days + 1;
+}
+
+/* Y-M-D, H:M:S[.f] or both, as of kind */
+static bool
+parse_datetime(const char *s, size_t len, int kind, SQL_TIMESTAMP_STRUCT *dt)
+{
+	char		buf[64];
+	char	   *p = buf;
+	int			y = 0,
+				mo = 0,
+				d = 0,
+				h = 0,
+				mi = 0,
+				sec = 0,
+				n = 0;
+
+	while (len > 0 && isspace((unsigned char) *s))
+		s++, len--;
+	while (len > 0 && isspace((unsigned char) s[len - 1]))
+		len--;
+	if (len >= sizeof(buf))
+		return false;
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	memset(dt, 0, sizeof(*dt));
+	if (kind != V_TIME)
+	{
+		if (sscanf(p, "%4d-%2d-%2d%n", &y, &mo, &d, &n) != 3)
+			return false;
+		p += n;
+		if (kind == V_TS && (*p == ' ' || *p == 'T'))
+			p++;
+		else if (*p == '\0')
+			goto done;
+		else
+			return false;
+	}
+	if (sscanf(p, "%2d:%2d:%2d%n", &h, &mi, &sec, &n) != 3)
+		return false;
+	p += n;
+	if (*p == '.')
+	{
+		SQLUINTEGER f = 0;
+		int			digits = 0;
+
+		for (p++; isdigit((unsigned char) *p); p++)
+			if (digits++ < 9)
+				f = f * 10 + (*p - '0');
+		while (digits++ < 9)
+			f *= 10;
+		dt->fraction = f;
+	}
+	if (*p != '\0')
+		return false;
+done:
+	dt->year = y;
+	dt->month = mo;
+	dt->day = d;
+	dt->hour = h;
+	dt->minute = mi;
+	dt->second = sec;
+	return valid_datetime(dt, kind);
+}
+
+static void
+format_datetime(char *buf, SQL_TIMESTAMP_STRUCT *dt, int kind)
+{
+	int			n = 0;
+
+	if (kind != V_TIME)
+		n = sprintf(buf, "%04d-%02d-%02d%s", dt->year, dt->month, dt->day,
+					kind == V_TS ? " " : "");
+	if (kind != V_DATE)
+	{
+		n += sprintf(buf + n, "%02d:%02d:%02d", dt->hour, dt->minute, dt->second);
+		if (dt->fraction % 1000 != 0)
+			sprintf(buf + n, ".%09u", (unsigned) dt->fraction);
+		else if (dt->fraction != 0)
+			sprintf(buf + n, ".%06u", (unsigned) (dt->fraction / 1000));
+	}
+}
+
+/* The text of a non-NULL value; for V_BIN in hex */
+static const char *
+value_text(tstmt *stmt, tvalue *v, SQLSMALLINT type, size_t *len)
+{
+	char	   *buf;
+
+	if (v->kind == V_STR)
+	{
+		*len = v->len;
+		return v->s;
+	}
+	buf = scratch(stmt, v->kind == V_BIN ? 2 * v->len + 1 : 64);
+	switch (v->kind)
+	{
+		case V_INT:
+			sprintf(buf, "%lld", (long long) v->i);
+			break;
+		case V_FLOAT:
+			format_float(buf, v->f, type == SQL_REAL);
+			break;
+		case V_NUM:
+			format_numeric(buf, v->i, v->scale);
+			break;
+		case V_BIN:
+			{
+				size_t		k;
+
+				for (k = 0; k < v->len; k++)
+					sprintf(buf + 2 * k, "%02X", (unsigned char) v->s[k]);
+				buf[2 * v->len] = '\0';
+				break;
+			}
+		default:
+			format_datetime(buf, &v->dt, v->kind);
+			break;
+	}
+	*len = strlen(buf);
+	return buf;
+}
+
+static const char *
+kind_name(int kind)
+{
+	static const char *const names[] = {
+		"NULL", "integer", "float", "numeric", "character", "binary",
+		"date", "time", "timestamp"
+	};
+
+	return names[kind];
+}
+
+static void
+conversion_error(tstmt *stmt, tvalue *v, const char *to)
+{
+	if (v->kind == V_STR)
+		stmt_error(stmt, "22018", "invalid character value for cast to %s: \"%.*s\"",
+				   to, (int) (v->len > 100 ? 100 : v->len), v->s);
+	stmt_error(stmt, "07006", "cannot convert %s to %s", kind_name(v->kind), to);
+}
+
+/* A number of v, as i / 10^scale or as float */
+static void
+to_number(tstmt *stmt, tvalue *v, tvalue *n)
+{
+	memset(n, 0, sizeof(*n));
+	switch (v->kind)
+	{
+		case V_INT:
+		case V_FLOAT:
+		case V_NUM:
+			*n = *v;
+			n->owned = false;
+			return;
+		case V_STR:
+			{
+				const char *p = v->s;
+				const char *end = v->s + v->len;
+				int			scale = 0;
+				bool		point = false;
+
+				for (; p < end; p++)
+				{
+					if (*p == '.')
+						point = true;
+					else if (isdigit((unsigned char) *p) && point)
+						scale++;
+				}
+				if (scale > MAXSCALE)
+					scale = MAXSCALE;
+				if (parse_numeric(v->s, v->len, scale, &n->i))
+				{
+					n->kind = scale > 0 ? V_NUM : V_INT;
+					n->scale = scale;
+					return;
+				}
+				if (v->len < 64)
+				{
+					char		buf[64];
+					char	   *e;
+
+					memcpy(buf, v->s, v->len);
+					buf[v->len] = '\0';
+					n->f = strtod(buf, &e);
+					while (isspace((unsigned char) *e))
+						e++;
+					if (e != buf && *e == '\0')
+					{
+						n->kind = V_FLOAT;
+						return;
+					}
+				}
+			}
+			/* fall through */
+		default:
+			conversion_error(stmt, v, "a number");
+	}
+}
+
+static double
+number_float(tvalue *n)
+{
+	if (n->kind == V_FLOAT)
+		return n->f;
+	if (n->kind == V_NUM)
+		return (double) n->i / pow10[n->scale];
+	return (double) n->i;
+}
+
+/* An integer of v, truncated */
+static int64_t
+to_integer(tstmt *stmt, tvalue *v)
+{
+	tvalue		n;
+
+	to_number(stmt, v, &n);
+	if (n.kind == V_NUM)
+		return n.i / pow10[n.scale];
+	if (n.kind == V_FLOAT)
+	{
+		if (!(n.f > -9.3e18 && n.f < 9.3e18))
+			stmt_error(stmt, "22003", "numeric value out of range");
+		return (int64_t) n.f;
+	}
+	return n.i;
+}
+
+/* A date, time or timestamp of v as of kind */
+static void
+to_datetime(tstmt *stmt, tvalue *v, int kind, SQL_TIMESTAMP_STRUCT *dt)
+{
+	if (v->kind == V_STR)
+	{
+		if (!parse_datetime(v->s, v->len, kind, dt) &&
+			!(kind != V_TS && parse_datetime(v->s, v->len, V_TS, dt)))
+			stmt_error(stmt, "22007", "invalid datetime format: \"%.*s\"",
+					   (int) (v->len > 100 ? 100 : v->len), v->s);
+	}
+	else if (v->kind == kind || (v->kind == V_TS && kind != V_TS) ||
+			 (v->kind == V_DATE && kind == V_TS))
+		*dt = v->dt;
+	else
+		conversion_error(stmt, v, kind_name(kind));
+	if (kind == V_DATE)
+		dt->hour = dt->minute = dt->second = dt->fraction = 0;
+	else if (kind == V_TIME)
+		dt->year = dt->month = dt->day = 0;
+}
+
+static int
+cmp_datetime(SQL_TIMESTAMP_STRUCT *a, SQL_TIMESTAMP_STRUCT *b)
+{
+#define CMPFIELD(f) if (a->f != b->f) return a->f < b->f ? -1 : 1
+	CMPFIELD(year);
+	CMPFIELD(month);
+	CMPFIELD(day);
+	CMPFIELD(hour);
+	CMPFIELD(minute);
+	CMPFIELD(second);
+	CMPFIELD(fraction);
+#undef CMPFIELD
+	return 0;
+}
+
+static bool
+is_number(tvalue *v)
+{
+	return v->kind == V_INT || v->kind == V_FLOAT || v->kind == V_NUM;
+}
+
+static bool
+is_datetime(tvalue *v)
+{
+	return v->kind == V_DATE || v->kind == V_TIME || v->kind == V_TS;
+}
+
+/* Compare non-NULL values, strings ignoring trailing spaces */
+static int
+compare_values(tstmt *stmt, tvalue *a, tvalue *b)
+{
+	if ((is_number(a) && (is_number(b) || b->kind == V_STR)) ||
+		(is_number(b) && a->kind == V_STR))
+	{
+		tvalue		x,
+					y;
+
+		to_number(stmt, a, &x);
+		to_number(stmt, b, &y);
+		if (x.kind != V_FLOAT && y.kind != V_FLOAT)
+		{
+			int			scale = x.scale > y.scale ? x.scale : y.scale;
+			int64_t		i,
+						j;
+
+			if (rescale(x.i, x.scale, scale, &i) && rescale(y.i, y.scale, scale, &j))
+				return i < j ? -1 : i > j;
+		}
+		return number_float(&x) < number_float(&y) ? -1 :
+			number_float(&x) > number_float(&y);
+	}
+	if (is_datetime(a) || is_datetime(b))
+	{
+		int			kind = is_datetime(a) ? a->kind : b->kind;
+		SQL_TIMESTAMP_STRUCT x,
+					y;
+
+		if (is_datetime(a) && is_datetime(b) && a->kind != b->kind)
+		{
+			if (a->kind == V_TIME || b->kind == V_TIME)
+				stmt_error(stmt, "22005", "cannot compare %s with %s",
+						   kind_name(a->kind), kind_name(b->kind));
+			kind = V_TS;
+		}
+		to_datetime(stmt, a, kind, &x);
+		to_datetime(stmt, b, kind, &y);
+		return cmp_datetime(&x, &y);
+	}
+	if ((a->kind == V_STR || a->kind == V_BIN) && (b->kind == V_STR || b->kind == V_BIN))
+	{
+		size_t		alen = a->len;
+		size_t		blen = b->len;
+		int			r;
+
+		if (a->kind == V_STR && b->kind == V_STR)
+		{
+			while (alen > 0 && a->s[alen - 1] == ' ')
+				alen--;
+			while (blen > 0 && b->s[blen - 1] == ' ')
+				blen--;
+		}
+		r = memcmp(a->s, b->s, alen < blen ? alen : blen);
+		if (r != 0)
+			return r < 0 ? -1 : 1;
+		return alen < blen ? -1 : alen > blen;
+	}
+	stmt_error(stmt, "22005", "cannot compare %s with %s",
+			   kind_name(a->kind), kind_name(b->kind));
+	return 0;
+}
+
+static void
+range_check(tstmt *stmt, int64_t i, int64_t min, int64_t max)
+{
+	if (i < min || i > max)
+		stmt_error(stmt, "22003", "numeric value out of range");
+}
+
+/* v converted to the type of col, with malloc'd data */
+static tvalue
+coerce_value(tstmt *stmt, tvalue *v, tcolumn *col)
+{
+	tvalue		r;
+	tvalue		n;
+
+	memset(&r, 0, sizeof(r));
+	if (v->kind == V_NULL)
+		return r;
+	switch (col->type)
+	{
+		case SQL_BIT:
+		case SQL_TINYINT:
+		case SQL_SMALLINT:
+		case SQL_INTEGER:
+		case SQL_BIGINT:
+			r.kind = V_INT;
+			r.i = to_integer(stmt, v);
+			if (col->type == SQL_BIT)
+				range_check(stmt, r.i, 0, 1);
+			else if (col->type == SQL_TINYINT)
+				range_check(stmt, r.i, INT8_MIN, INT8_MAX);
+			else if (col->type == SQL_SMALLINT)
+				range_check(stmt, r.i, INT16_MIN, INT16_MAX);
+			else if (col->type == SQL_INTEGER)
+				range_check(stmt, r.i, INT32_MIN, INT32_MAX);
+			break;
+		case SQL_REAL:
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			to_number(stmt, v, &n);
+			r.kind = V_FLOAT;
+			r.f = number_float(&n);
+			if (col->type == SQL_REAL)
+				r.f = (float) r.f;
+			break;
+		case SQL_NUMERIC:
+		case SQL_DECIMAL:
+			to_number(stmt, v, &n);
+			r.kind = V_NUM;
+			r.scale = col->digits;
+			if (n.kind == V_FLOAT)
+			{
+				double		f = n.f * pow10[r.scale];
+
+				if (!(fabs(f) < 9.2e18))
+					stmt_error(stmt, "22003", "numeric value out of range");
+				r.i = llround(f);
+			}
+			else if (!rescale(n.i, n.scale, r.scale, &r.i))
+				stmt_error(stmt, "22003", "numeric value out of range");
+			if (col->size <= MAXSCALE &&
+				(r.i >= pow10[col->size] || r.i <= -pow10[col->size]))
+				stmt_error(stmt, "22003", "numeric value out of range");
+			break;
+		case SQL_TYPE_DATE:
+			r.kind = V_DATE;
+			to_datetime(stmt, v, V_DATE, &r.dt);
+			break;
+		case SQL_TYPE_TIME:
+			r.kind = V_TIME;
+			to_datetime(stmt, v, V_TIME, &r.dt);
+			break;
+		case SQL_TYPE_TIMESTAMP:
+			r.kind = V_TS;
+			to_datetime(stmt, v, V_TS, &r.dt);
+			break;
+		case SQL_BINARY:
+		case SQL_VARBINARY:
+		case SQL_LONGVARBINARY:
+			if (v->kind != V_BIN && v->kind != V_STR)
+				conversion_error(stmt, v, "binary");
+			if (col->type != SQL_LONGVARBINARY && v->len > col->size)
+				stmt_error(stmt, "22001", "string data, right truncation");
+			r.kind = V_BIN;
+			r.len = col->type == SQL_BINARY ? col->size : v->len;
+			r.s = xmalloc(r.len + 1);
+			memset(r.s, 0, r.len + 1);
+			memcpy(r.s, v->s, v->len);
+			r.owned = true;
+			break;
+		default:
+			{
+				size_t		len;
+				const char *text = value_text(stmt, v, SQL_VARCHAR, &len);
+				bool		wide = is_wide_type(col->type);
+				size_t		chars = text_length(text, len, wide);
+				size_t		pad = 0;
+
+				if (col->type != SQL_LONGVARCHAR && col->type != SQL_WLONGVARCHAR)
+				{
+					/* like SQL, trailing spaces can go */
+					while (chars > col->size && len > 0 && text[len - 1] == ' ')
+						len--, chars--;
+					if (chars > col->size)
+						stmt_error(stmt, "22001", "string data, right truncation");
+					if (col->type == SQL_CHAR || col->type == SQL_WCHAR)
+						pad = col->size - chars;
+				}
+				r.kind = V_STR;
+				r.len = len + pad;
+				r.s = xmalloc(r.len + 1);
+				memcpy(r.s, text, len);
+				memset(r.s + len, ' ', pad);
+				r.s[r.len] = '\0';
+				r.owned = true;
+				break;
+			}
+	}
+	return r;
+}
+
+/* Tokens */
+enum
+{
+	T_END, T_IDENT, T_QIDENT, T_STRING, T_NUMBER, T_PARAM, T_OP
+};
+
+typedef struct
+{
+	tstmt	   *stmt;
+	tarena	   *arena;
+	const char *p;
+	int			type;
+	char	   *text;			/* identifiers are lower case */
+	size_t		len;
+	int			nparams;
+} tparser;
+
+static void
+next_token(tparser *ps)
+{
+	const char *p = ps->p;
+	const char *start;
+
+	while (isspace((unsigned char) *p))
+		p++;
+	/* comments */
+	if (p[0] == '-' && p[1] == '-')
+	{
+		while (*p && *p != '\n')
+			p++;
+		ps->p = p;
+		next_token(ps);
+		return;
+	}
+	start = p;
+	if (*p == '\0')
+	{
+		ps->type = T_END;
+		ps->text = "";
+		ps->len = 0;
+		ps->p = p;
+		return;
+	}
+	if (isalpha((unsigned char) *p) || *p == '_')
+	{
+		size_t		k;
+
+		while (isalnum((unsigned char) *p) || *p == '_' || *p == '$')
+			p++;
+		ps->type = T_IDENT;
+		ps->text = astrndup(ps->arena, start, p - start);
+		ps->len = p - start;
+		for (k = 0; k < ps->len; k++)
+			ps->text[k] = tolower((unsigned char) ps->text[k]);
+	}
+	else if (*p == '"' || *p == '\'')
+	{
+		char		quote = *p++;
+		char	   *out = aalloc(ps->arena, strlen(p) + 1);
+		size_t		n = 0;
+
+		for (;;)
+		{
+			if (*p == '\0')
+				stmt_error(ps->stmt, "42000", "syntax error: unterminated quoted text");
+			if (*p == quote)
+			{
+				if (p[1] != quote)
+					break;
+				p++;
+			}
+			out[n++] = *p++;
+		}
+		p++;
+		out[n] = '\0';
+		ps->type = quote == '"' ? T_QIDENT : T_STRING;
+		ps->text = out;
+		ps->len = n;
+	}
+	else if (isdigit((unsigned char) *p) || (*p == '.' && isdigit((unsigned char) p[1])))
+	{
+		while (isdigit((unsigned char) *p))
+			p++;
+		if (*p == '.')
+			for (p++; isdigit((unsigned char) *p); p++);
+		if ((*p == 'e' || *p == 'E') &&
+			(isdigit((unsigned char) p[1]) ||
+			 ((p[1] == '+' || p[1] == '-') && isdigit((unsigned char) p[2]))))
+			for (p += 2; isdigit((unsigned char) *p); p++);
+		ps->type = T_NUMBER;
+		ps->text = astrndup(ps->arena, start, p - start);
+		ps->len = p - start;
+	}
+	else if (*p == '?')
+	{
+		p++;
+		ps->type = T_PARAM;
+		ps->text = "?";
+		ps->len = 1;
+	}
+	else
+	{
+		if ((p[0] == '<' && (p[1] == '=' || p[1] == '>')) ||
+			(p[0] == '>' && p[1] == '=') || (p[0] == '!' && p[1] == '=') ||
+			(p[0] == '|' && p[1] == '|'))
+			p += 2;
+		else if (strchr("(),.*+-/%=<>{};", *p))
+			p++;
+		else
+			stmt_error(ps->stmt, "42000", "syntax error at \"%c\"", *p);
+		ps->type = T_OP;
+		ps->text = astrndup(ps->arena, start, p - start);
+		ps->len = p - start;
+	}
+	ps->p = p;
+}
+
+static bool
+is_kw(tparser *ps, const char *kw)
+{
+	return ps->type == T_IDENT && strcmp(ps->text, kw) == 0;
+}
+
+static bool
+accept_kw(tparser *ps, const char *kw)
+{
+	if (!is_kw(ps, kw))
+		return false;
+	next_token(ps);
+	return true;
+}
+
+static bool
+is_op(tparser *ps, const char *op)
+{
+	return ps->type == T_OP && strcmp(ps->text, op) == 0;
+}
+
+static bool
+accept_op(tparser *ps, const char *op)
+{
+	if (!is_op(ps, op))
+		return false;
+	next_token(ps);
+	return true;
+}
+
+static void
+syntax_error(tparser *ps)
+{
+	if (ps->type == T_END)
+		stmt_error(ps->stmt, "42000", "syntax error at end of statement");
+	stmt_error(ps->stmt, "42000", "syntax error at \"%s\"", ps->text);
+}
+
+static void
+expect_kw(tparser *ps, const char *kw)
+{
+	if (!accept_kw(ps, kw))
+		syntax_error(ps);
+}
+
+static void
+expect_op(tparser *ps, const char *op)
+{
+	if (!accept_op(ps, op))
+		syntax_error(ps);
+}
+
+static const char *const reserved[] = {
+	"select", "from", "where", "order", "by", "and", "or", "not", "as", "is",
+	"null", "in", "like", "between", "values", "set", "asc", "desc", NULL
+};
+
+static char *
+parse_name(tparser *ps)
+{
+	char	   *name = ps->text;
+	int			k;
+
+	if (ps->type == T_IDENT)
+	{
+		for (k = 0; reserved[k]; k++)
+			if (strcmp(name, reserved[k]) == 0)
+				syntax_error(ps);
+	}
+	else if (ps->type != T_QIDENT)
+		syntax_error(ps);
+	if (strlen(name) >= NAMELEN)
+		stmt_error(ps->stmt, "42000", "identifier too long: \"%s\"", name);
+	next_token(ps);
+	return name;
+}
+
+/* Expressions */
+enum
+{
+	E_CONST, E_PARAM, E_COLUMN, E_NEG, E_NOT, E_AND, E_OR, E_CMP, E_ARITH,
+	E_ISNULL, E_LIKE, E_IN, E_BETWEEN, E_FUNC, E_AGG
+};
+
+enum
+{
+	OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_CONCAT
+};
+
+enum
+{
+	F_LENGTH, F_SLEEP, A_COUNT, A_MIN, A_MAX, A_SUM
+};
+
+typedef struct texpr
+{
+	int			kind;
+	int			op;				/* OP_* or F_* and A_* */
+	bool		negate;			/* IS NOT NULL, NOT LIKE, NOT IN, NOT BETWEEN */
+	tvalue		value;			/* E_CONST */
+	int			index;			/* E_PARAM, E_COLUMN once resolved, E_AGG */
+	char	   *name;			/* E_COLUMN, E_FUNC, E_AGG */
+	struct texpr *arg[3];
+	struct texpr **list;		/* E_IN */
+	int			nlist;
+} texpr;
+
+static const struct
+{
+	const char *name;
+	int			kind;
+	int			op;
+	int			nargs;
+}			functions[] = {
+	{"length", E_FUNC, F_LENGTH, 1},
+	{"sleep", E_FUNC, F_SLEEP, 1},
+	{"count", E_AGG, A_COUNT, 1},
+	{"min", E_AGG, A_MIN, 1},
+	{"max", E_AGG, A_MAX, 1},
+	{"sum", E_AGG, A_SUM, 1},
+	{NULL, 0, 0, 0}
+};
+
+static texpr *
+new_expr(tparser *ps, int kind)
+{
+	texpr	   *e = azalloc(ps->arena, sizeof(texpr));
+
+	e->kind = kind;
+	return e;
+}
+
+static texpr *parse_expr(tparser *ps);
+
+static texpr *
+parse_literal(tparser *ps, int kind)
+{
+	texpr	   *e = new_expr(ps, E_CONST);
+
+	if (ps->type != T_STRING)
+		syntax_error(ps);
+	e->value.kind = kind;
+	if (!parse_datetime(ps->text, ps->len, kind, &e->value.dt))
+		stmt_error(ps->stmt, "22007", "invalid %s literal: \"%s\"", kind_name(kind), ps->text);
+	next_token(ps);
+	return e;
+}
+
+static texpr *
+parse_primary(tparser *ps)
+{
+	texpr	   *e;
+
+	if (ps->type == T_NUMBER)
+	{
+		const char *point = strchr(ps->text, '.');
+
+		e = new_expr(ps, E_CONST);
+		if (strpbrk(ps->text, "eE"))
+		{
+			e->value.kind = V_FLOAT;
+			e->value.f = strtod(ps->text, NULL);
+		}
+		else
+		{
+			int			scale = point ? (int) strlen(point + 1) : 0;
+
+			if (scale > MAXSCALE)
+				scale = MAXSCALE;
+			e->value.kind = point ? V_NUM : V_INT;
+			e->value.scale = scale;
+			if (!parse_numeric(ps->text, ps->len, scale, &e->value.i))
+				stmt_error(ps->stmt, "22003", "numeric value out of range: %s", ps->text);
+		}
+		next_token(ps);
+		return e;
+	}
+	if (ps->type == T_STRING)
+	{
+		e = new_expr(ps, E_CONST);
+		e->value.kind = V_STR;
+		e->value.s = ps->text;
+		e->value.len = ps->len;
+		next_token(ps);
+		return e;
+	}
+	if (ps->type == T_PARAM)
+	{
+		e = new_expr(ps, E_PARAM);
+		e->index = ps->nparams++;
+		next_token(ps);
+		return e;
+	}
+	if (accept_op(ps, "("))
+	{
+		if (is_kw(ps, "select"))
+			stmt_error(ps->stmt, "0A000", "subqueries in expressions are not supported");
+		e = parse_expr(ps);
+		expect_op(ps, ")");
+		return e;
+	}
+	if (accept_op(ps, "{"))
+	{
+		/* ODBC escapes */
+		if (accept_kw(ps, "d"))
+			e = parse_literal(ps, V_DATE);
+		else if (accept_kw(ps, "t"))
+			e = parse_literal(ps, V_TIME);
+		else if (accept_kw(ps, "ts"))
+			e = parse_literal(ps, V_TS);
+		else
+			syntax_error(ps);
+		expect_op(ps, "}");
+		return e;
+	}
+	if (ps->type == T_IDENT)
+	{
+		const char *name = ps->text;
+		int			k;
+
+		if (accept_kw(ps, "null"))
+			return new_expr(ps, E_CONST);
+		if (is_kw(ps, "true") || is_kw(ps, "false"))
+		{
+			e = new_expr(ps, E_CONST);
+			e->value.kind = V_INT;
+			e->value.i = is_kw(ps, "true");
+			next_token(ps);
+			return e;
+		}
+		if (ps->p[strspn(ps->p, " \t\r\n")] == '\'')
+		{
+			if (accept_kw(ps, "date"))
+				return parse_literal(ps, V_DATE);
+			if (accept_kw(ps, "time"))
+				return parse_literal(ps, V_TIME);
+			if (accept_kw(ps, "timestamp"))
+				return parse_literal(ps, V_TS);
+		}
+		if (ps->p[strspn(ps->p, " \t\r\n")] == '(')
+		{
+			next_token(ps);
+			expect_op(ps, "(");
+			for (k = 0; functions[k].name; k++)
+				if (strcmp(functions[k].name, name) == 0)
+					break;
+			if (functions[k].name == NULL)
+				stmt_error(ps->stmt, "42883", "function %s does not exist", name);
+			e = new_expr(ps, functions[k].kind);
+			e->op = functions[k].op;
+			e->name = (char *) name;
+			if (e->op == A_COUNT && accept_op(ps, "*"))
+				e->arg[0] = NULL;
+			else
+				e->arg[0] = parse_expr(ps);
+			expect_op(ps, ")");
+			return e;
+		}
+	}
+	if (ps->type == T_IDENT || ps->type == T_QIDENT)
+	{
+		e = new_expr(ps, E_COLUMN);
+		e->name = parse_name(ps);
+		/* the table of a qualified name does not matter */
+		if (accept_op(ps, "."))
+			e->name = parse_name(ps);
+		e->index = -1;
+		return e;
+	}
+	syntax_error(ps);
+	return NULL;
+}
+
+static texpr *
+parse_unary(tparser *ps)
+{
+	if (accept_op(ps, "-"))
+	{
+		texpr	   *e = new_expr(ps, E_NEG);
+
+		e->arg[0] = parse_unary(ps);
+		return e;
+	}
+	accept_op(ps, "+");
+	return parse_primary(ps);
+}
+
+static texpr *
+parse_arith(tparser *ps, int level)
+{
+	static const char *const ops[2][3] = {{"+", "-", "||"}, {"*", "/", "%"}};
+	static const int codes[2][3] = {{OP_ADD, OP_SUB, OP_CONCAT}, {OP_MUL, OP_DIV, OP_MOD}};
+	texpr	   *e = level == 0 ? parse_arith(ps, 1) : parse_unary(ps);
+
+	for (;;)
+	{
+		texpr	   *b;
+		int			k;
+
+		for (k = 0; k < 3; k++)
+			if (is_op(ps, ops[level][k]))
+				break;
+		if (k == 3)
+			return e;
+		next_token(ps);
+		b = new_expr(ps, E_ARITH);
+		b->op = codes[level][k];
+		b->arg[0] = e;
+		b->arg[1] = level == 0 ? parse_arith(ps, 1) : parse_unary(ps);
+		e = b;
+	}
+}
+
+static texpr *
+parse_predicate(tparser *ps)
+{
+	static const char *const ops[] = {"=", "<>", "<", "<=", ">", ">=", "!="};
+	static const int codes[] = {OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE, OP_NE};
+	texpr	   *a = parse_arith(ps, 0);
+	texpr	   *e;
+	int			k;
+
+	for (k = 0; k < 7; k++)
+		if (is_op(ps, ops[k]))
+		{
+			next_token(ps);
+			e = new_expr(ps, E_CMP);
+			e->op = codes[k];
+			e->arg[0] = a;
+			e->arg[1] = parse_arith(ps, 0);
+			return e;
+		}
+	if (accept_kw(ps, "is"))
+	{
+		e = new_expr(ps, E_ISNULL);
+		e->negate = accept_kw(ps, "not");
+		expect_kw(ps, "null");
+		e->arg[0] = a;
+		return e;
+	}
+	e = new_expr(ps, E_CONST);
+	e->negate = accept_kw(ps, "not");
+	if (accept_kw(ps, "like"))
+	{
+		e->kind = E_LIKE;
+		e->arg[1] = parse_arith(ps, 0);
+	}
+	else if (accept_kw(ps, "between"))
+	{
+		e->kind = E_BETWEEN;
+		e->arg[1] = parse_arith(ps, 0);
+		expect_kw(ps, "and");
+		e->arg[2] = parse_arith(ps, 0);
+	}
+	else if (accept_kw(ps, "in"))
+	{
+		int			max = 8;
+
+		e->kind = E_IN;
+		e->list = aalloc(ps->arena, max * sizeof(texpr *));
+		expect_op(ps, "(");
+		do
+		{
+			if (e->nlist == max)
+			{
+				texpr	  **list = aalloc(ps->arena, 2 * max * sizeof(texpr *));
+
+				memcpy(list, e->list, max * sizeof(texpr *));
+				e->list = list;
+				max *= 2;
+			}
+			e->list[e->nlist++] = parse_expr(ps);
+		} while (accept_op(ps, ","));
+		expect_op(ps, ")");
+	}
+	else if (e->negate)
+		syntax_error(ps);
+	else
+		return a;
+	e->arg[0] = a;
+	return e;
+}
+
+static texpr *
+parse_not(tparser *ps)
+{
+	if (accept_kw(ps, "not"))
+	{
+		texpr	   *e = new_expr(ps, E_NOT);
+
+		e->arg[0] = parse_not(ps);
+		return e;
+	}
+	return parse_predicate(ps);
+}
+
+static texpr *
+parse_bool(tparser *ps, int kind)
+{
+	texpr	   *e = kind == E_OR ? parse_bool(ps, E_AND) : parse_not(ps);
+
+	while (accept_kw(ps, kind == E_OR ? "or" : "and"))
+	{
+		texpr	   *b = new_expr(ps, kind);
+
+		b->arg[0] = e;
+		b->arg[1] = kind == E_OR ? parse_bool(ps, E_AND) : parse_not(ps);
+		e = b;
+	}
+	return e;
+}
+
+static texpr *
+parse_expr(tparser *ps)
+{
+	return parse_bool(ps, E_OR);
+}
+
+/* Statements */
+enum
+{
+	SRC_TABLE, SRC_GEN, SRC_QUERY
+};
+
+typedef struct tsource
+{
+	int			kind;
+	char	   *name;
+	long		gen[4];			/* rows, nulls, width, lob */
+	struct tquery *query;
+} tsource;
+
+enum
+{
+	Q_SELECT, Q_INSERT, Q_UPDATE, Q_DELETE, Q_CREATE, Q_DROP,
+	Q_SAVEPOINT, Q_RELEASE, Q_ROLLBACK_TO, Q_SET
+};
+
+typedef struct tquery
+{
+	int			kind;
+	/* SELECT, no targets for * */
+	int			ntargets;
+	texpr	  **targets;
+	char	  **aliases;
+	tsource    *from;
+	texpr	   *where;
+	int			norder;
+	texpr	  **order;
+	bool	   *desc;
+	/* the others */
+	char	   *table;
+	int			ncols;
+	char	  **cols;			/* INSERT and UPDATE */
+	tcolumn    *coldefs;		/* CREATE TABLE */
+	int			nrows;
+	texpr	 ***values;			/* INSERT rows, UPDATE values in values[0] */
+	bool		if_exists;
+	int			nparams;
+	long		delay;			/* the total of sleep() */
+} tquery;
+
+static const long gen_defaults[] = {100, 0, 16, 1000};
+
+#define MAXLIST 1024
+
+static void
+check_list(tparser *ps, int n)
+{
+	if (n == MAXLIST)
+		stmt_error(ps->stmt, "54000", "too many list items");
+}
+
+static long
+parse_integer(tparser *ps)
+{
+	long		v;
+
+	if (ps->type != T_NUMBER || strpbrk(ps->text, ".eE"))
+		syntax_error(ps);
+	v = atol(ps->text);
+	next_token(ps);
+	return v;
+}
+
+static tquery *parse_select(tparser *ps);
+
+static tsource *
+parse_source(tparser *ps)
+{
+	tsource    *src = azalloc(ps->arena, sizeof(tsource));
+
+	if (accept_op(ps, "("))
+	{
+		expect_kw(ps, "select");
+		src->kind = SRC_QUERY;
+		src->query = parse_select(ps);
+		expect_op(ps, ")");
+	}
+	else if (is_kw(ps, "gen") && ps->p[strspn(ps->p, " \t\r\n")] == '(')
+	{
+		int			k;
+
+		next_token(ps);
+		expect_op(ps, "(");
+		src->kind = SRC_GEN;
+		memcpy(src->gen, gen_defaults, sizeof(src->gen));
+		for (k = 0; k < 4; k++)
+		{
+			src->gen[k] = parse_integer(ps);
+			if (src->gen[k] < 0 || (k == 1 && src->gen[k] > 100) ||
+				(k == 2 && src->gen[k] < 1))
+				stmt_error(ps->stmt, "22023", "invalid argument %d of gen()", k + 1);
+			if (!accept_op(ps, ","))
+				break;
+		}
+		expect_op(ps, ")");
+	}
+	else
+	{
+		src->kind = SRC_TABLE;
+		src->name = parse_name(ps);
+	}
+	/* the alias does not matter */
+	if (accept_kw(ps, "as") || ps->type == T_QIDENT ||
+		(ps->type == T_IDENT && !is_kw(ps, "where") && !is_kw(ps, "order")))
+		parse_name(ps);
+	return src;
+}
+
+static tquery *
+parse_select(tparser *ps)
+{
+	tquery	   *q = azalloc(ps->arena, sizeof(tquery));
+
+	q->kind = Q_SELECT;
+	if (!accept_op(ps, "*"))
+	{
+		q->targets = aalloc(ps->arena, MAXLIST * sizeof(texpr *));
+		q->aliases = azalloc(ps->arena, MAXLIST * sizeof(char *));
+		do
+		{
+			check_list(ps, q->ntargets);
+			q->targets[q->ntargets] = parse_expr(ps);
+			if (accept_kw(ps, "as") || ps->type == T_QIDENT ||
+				(ps->type == T_IDENT && !is_kw(ps, "from") &&
+				 !is_kw(ps, "where") && !is_kw(ps, "order")))
+				q->aliases[q->ntargets] = parse_name(ps);
+			q->ntargets++;
+		} while (accept_op(ps, ","));
+	}
+	if (accept_kw(ps, "from"))
+		q->from = parse_source(ps);
+	if (accept_kw(ps, "where"))
+		q->where = parse_expr(ps);
+	if (accept_kw(ps, "order"))
+	{
+		int			k;
+
+		expect_kw(ps, "by");
+		q->desc = azalloc(ps->arena, MAXLIST * sizeof(bool));
+		q->order = aalloc(ps->arena, MAXLIST * sizeof(texpr *));
+		do
+		{
+			check_list(ps, q->norder);
+			k = q->norder++;
+			q->order[k] = parse_expr(ps);
+			if (accept_kw(ps, "desc"))
+				q->desc[k] = true;
+			else
+				accept_kw(ps, "asc");
+		} while (accept_op(ps, ","));
+	}
+	return q;
+}
+
+static const struct
+{
+	const char *name;
+	SQLSMALLINT type;
+	SQLULEN		size;			/* the default */
+	SQLSMALLINT digits;
+}			types[] = {
+	{"bit", SQL_BIT, 1, 0},
+	{"bool", SQL_BIT, 1, 0},
+	{"boolean", SQL_BIT, 1, 0},
+	{"tinyint", SQL_TINYINT, 3, 0},
+	{"smallint", SQL_SMALLINT, 5, 0},
+	{"int2", SQL_SMALLINT, 5, 0},
+	{"int", SQL_INTEGER, 10, 0},
+	{"integer", SQL_INTEGER, 10, 0},
+	{"int4", SQL_INTEGER, 10, 0},
+	{"bigint", SQL_BIGINT, 19, 0},
+	{"int8", SQL_BIGINT, 19, 0},
+	{"real", SQL_REAL, 7, 0},
+	{"float4", SQL_REAL, 7, 0},
+	{"float", SQL_DOUBLE, 15, 0},
+	{"float8", SQL_DOUBLE, 15, 0},
+	{"double", SQL_DOUBLE, 15, 0},
+	{"numeric", SQL_NUMERIC, 18, 0},
+	{"decimal", SQL_DECIMAL, 18, 0},
+	{"char", SQL_CHAR, 1, 0},
+	{"character", SQL_CHAR, 1, 0},
+	{"varchar", SQL_VARCHAR, 255, 0},
+	{"text", SQL_LONGVARCHAR, MAXTEXT, 0},
+	{"clob", SQL_LONGVARCHAR, MAXTEXT, 0},
+	{"nchar", SQL_WCHAR, 1, 0},
+	{"nvarchar", SQL_WVARCHAR, 255, 0},
+	{"ntext", SQL_WLONGVARCHAR, MAXTEXT / 2, 0},
+	{"date", SQL_TYPE_DATE, 10, 0},
+	{"time", SQL_TYPE_TIME, 8, 0},
+	{"timestamp", SQL_TYPE_TIMESTAMP, 26, 6},
+	{"binary", SQL_BINARY, 1, 0},
+	{"varbinary", SQL_VARBINARY, 255, 0},
+	{"bytea", SQL_LONGVARBINARY, MAXTEXT, 0},
+	{"blob", SQL_LONGVARBINARY, MAXTEXT, 0},
+	{NULL, 0, 0, 0}
+};
+
+static void
+parse_type(tparser *ps, tcolumn *col)
+{
+	int			k;
+
+	if (ps->type != T_IDENT)
+		syntax_error(ps);
+	for (k = 0; types[k].name; k++)
+		if (strcmp(types[k].name, ps->text) == 0)
+			break;
+	if (types[k].name == NULL)
+		stmt_error(ps->stmt, "42704", "type \"%s\" does not exist", ps->text);
+	next_token(ps);
+	col->type = types[k].type;
+	col->size = types[k].size;
+	col->digits = types[k].digits;
+	if (col->type == SQL_DOUBLE)
+		accept_kw(ps, "precision");
+	else if (col->type == SQL_CHAR && accept_kw(ps, "varying"))
+	{
+		col->type = SQL_VARCHAR;
+		col->size = 255;
+	}
+	if (accept_op(ps, "("))
+	{
+		long		size = parse_integer(ps);
+
+		if (col->type == SQL_TYPE_TIMESTAMP)
+			col->digits = size;
+		else
+			col->size = size;
+		if ((col->type == SQL_NUMERIC || col->type == SQL_DECIMAL) && accept_op(ps, ","))
+			col->digits = parse_integer(ps);
+		expect_op(ps, ")");
+		if (size < 1 || col->digits < 0 || col->digits > MAXSCALE ||
+			((col->type == SQL_NUMERIC || col->type == SQL_DECIMAL) &&
+			 (size > 38 || col->digits > size)))
+			stmt_error(ps->stmt, "22023", "invalid type modifier");
+	}
+	/* constraints are not checked */
+	for (;;)
+	{
+		if (accept_kw(ps, "not") || accept_kw(ps, "null"))
+			continue;
+		if (accept_kw(ps, "primary") || accept_kw(ps, "unique"))
+		{
+			accept_kw(ps, "key");
+			continue;
+		}
+		break;
+	}
+}
+
+static void
+parse_insert(tparser *ps, tquery *q)
+{
+	expect_kw(ps, "into");
+	q->table = parse_name(ps);
+	if (accept_op(ps, "("))
+	{
+		q->cols = aalloc(ps->arena, MAXLIST * sizeof(char *));
+		do
+		{
+			check_list(ps, q->ncols);
+			q->cols[q->ncols++] = parse_name(ps);
+		} while (accept_op(ps, ","));
+		expect_op(ps, ")");
+	}
+	expect_kw(ps, "values");
+	q->values = aalloc(ps->arena, MAXLIST * sizeof(texpr **));
+	do
+	{
+		int			n = 0;
+		texpr	  **row = azalloc(ps->arena, MAXLIST * sizeof(texpr *));
+
+		check_list(ps, q->nrows);
+		expect_op(ps, "(");
+		do
+		{
+			check_list(ps, n);
+			row[n++] = parse_expr(ps);
+		} while (accept_op(ps, ","));
+		expect_op(ps, ")");
+		if (q->nrows > 0 && n != q->ncols)
+			stmt_error(ps->stmt, "42601", "VALUES lists must all be the same length");
+		if (q->cols && n != q->ncols)
+			stmt_error(ps->stmt, "42601", "INSERT has %s expressions than target columns",
+					   n > q->ncols ? "more" : "fewer");
+		q->ncols = n;
+		q->values[q->nrows++] = row;
+	} while (accept_op(ps, ","));
+}
+
+static tquery *
+parse_statement(tstmt *stmt, const char *sql)
+{
+	tparser		ps;
+	tquery	   *q;
+
+	memset(&ps, 0, sizeof(ps));
+	ps.stmt = stmt;
+	ps.arena = &stmt->parse;
+	ps.p = sql;
+	next_token(&ps);
+	q = azalloc(ps.arena, sizeof(tquery));
+	if (accept_kw(&ps, "select"))
+		q = parse_select(&ps);
+	else if (accept_kw(&ps, "insert"))
+	{
+		q->kind = Q_INSERT;
+		parse_insert(&ps, q);
+	}
+	else if (accept_kw(&ps, "update"))
+	{
+		q->kind = Q_UPDATE;
+		q->table = parse_name(&ps);
+		expect_kw(&ps, "set");
+		q->cols = aalloc(ps.arena, MAXLIST * sizeof(char *));
+		q->values = aalloc(ps.arena, sizeof(texpr **));
+		q->values[0] = aalloc(ps.arena, MAXLIST * sizeof(texpr *));
+		do
+		{
+			check_list(&ps, q->ncols);
+			q->cols[q->ncols] = parse_name(&ps);
+			expect_op(&ps, "=");
+			q->values[0][q->ncols++] = parse_expr(&ps);
+		} while (accept_op(&ps, ","));
+		q->nrows = 1;
+		if (accept_kw(&ps, "where"))
+			q->where = parse_expr(&ps);
+	}
+	else if (accept_kw(&ps, "delete"))
+	{
+		q->kind = Q_DELETE;
+		expect_kw(&ps, "from");
+		q->table = parse_name(&ps);
+		if (accept_kw(&ps, "where"))
+			q->where = parse_expr(&ps);
+	}
+	else if (accept_kw(&ps, "create"))
+	{
+		q->kind = Q_CREATE;
+		expect_kw(&ps, "table");
+		q->table = parse_name(&ps);
+		expect_op(&ps, "(");
+		q->coldefs = azalloc(ps.arena, MAXLIST * sizeof(tcolumn));
+		do
+		{
+			tcolumn    *col = &q->coldefs[q->ncols];
+			int			k;
+
+			check_list(&ps, q->ncols);
+			strcpy(col->name, parse_name(&ps));
+			for (k = 0; k < q->ncols; k++)
+				if (strcmp(q->coldefs[k].name, col->name) == 0)
+					stmt_error(stmt, "42701", "column \"%s\" specified more than once",
+							   col->name);
+			parse_type(&ps, col);
+			q->ncols++;
+		} while (accept_op(&ps, ","));
+		expect_op(&ps, ")");
+	}
+	else if (accept_kw(&ps, "drop"))
+	{
+		q->kind = Q_DROP;
+		expect_kw(&ps, "table");
+		if (accept_kw(&ps, "if"))
+		{
+			expect_kw(&ps, "exists");
+			q->if_exists = true;
+		}
+		q->table = parse_name(&ps);
+	}
+	else if (accept_kw(&ps, "savepoint"))
+	{
+		q->kind = Q_SAVEPOINT;
+		q->table = parse_name(&ps);
+	}
+	else if (accept_kw(&ps, "release"))
+	{
+		q->kind = Q_RELEASE;
+		accept_kw(&ps, "savepoint");
+		q->table = parse_name(&ps);
+	}
+	else if (accept_kw(&ps, "rollback"))
+	{
+		q->kind = Q_ROLLBACK_TO;
+		expect_kw(&ps, "to");
+		accept_kw(&ps, "savepoint");
+		q->table = parse_name(&ps);
+	}
+	else if (accept_kw(&ps, "set"))
+	{
+		/* settings of the session are accepted and ignored */
+		q->kind = Q_SET;
+		while (ps.type != T_END && !is_op(&ps, ";"))
+			next_token(&ps);
+	}
+	else
+		syntax_error(&ps);
+	accept_op(&ps, ";");
+	if (ps.type != T_END)
+		syntax_error(&ps);
+	q->nparams = ps.nparams;
+	return q;
+}
+
+/* Tables, shared by all connections */
+typedef struct ttable
+{
+	struct ttable *next;
+	char		name[NAMELEN];
+	int			ncols;
+	tcolumn    *cols;
+	int			nrows;
+	int			maxrows;
+	tvalue	  **rows;
+} ttable;
+
+static ttable *tables;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The table of that name, with tables_lock held */
+static ttable *
+find_table(const char *name)
+{
+	ttable	   *t;
+
+	for (t = tables; t; t = t->next)
+		if (strcmp(t->name, name) == 0)
+			return t;
+	return NULL;
+}
+
+static void
+unlink_table(ttable *table)
+{
+	ttable	  **t;
+
+	for (t = &tables; *t; t = &(*t)->next)
+		if (*t == table)
+		{
+			*t = table->next;
+			break;
+		}
+}
+
+static void
+free_row(tvalue *row, int ncols)
+{
+	free_values(row, ncols);
+	free(row);
+}
+
+static void
+free_table(ttable *t)
+{
+	int			k;
+
+	for (k = 0; k < t->nrows; k++)
+		free_row(t->rows[k], t->ncols);
+	free(t->rows);
+	free(t->cols);
+	free(t);
+}
+
+static void
+insert_row(ttable *t, int index, tvalue *row)
+{
+	if (t->nrows == t->maxrows)
+	{
+		t->maxrows = t->maxrows ? 2 * t->maxrows : 16;
+		t->rows = xrealloc(t->rows, t->maxrows * sizeof(tvalue *));
+	}
+	memmove(t->rows + index + 1, t->rows + index, (t->nrows - index) * sizeof(tvalue *));
+	t->rows[index] = row;
+	t->nrows++;
+}
+
+static void
+remove_row(ttable *t, int index)
+{
+	memmove(t->rows + index, t->rows + index + 1, (t->nrows - index - 1) * sizeof(tvalue *));
+	t->nrows--;
+}
+
+/* Remember a change for a rollback, with tables_lock held */
+static void
+log_undo(tconn *conn, int op, ttable *table, int index, tvalue *row)
+{
+	tundo	   *u = xmalloc(sizeof(tundo));
+
+	memset(u, 0, sizeof(tundo));
+	u->op = op;
+	u->table = table;
+	u->index = index;
+	u->row = row;
+	u->prev = conn->undo;
+	conn->undo = u;
+}
+
+static void
+commit_undo(tundo *u)
+{
+	switch (u->op)
+	{
+		case U_DELETE:
+		case U_UPDATE:
+			free_row(u->row, u->table->ncols);
+			break;
+		case U_DROP:
+			free_table(u->table);
+			break;
+	}
+	free(u);
+}
+
+/* Undo a change, with tables_lock held; a dropped table is freed last */
+static void
+rollback_undo(tundo *u)
+{
+	switch (u->op)
+	{
+		case U_INSERT:
+			remove_row(u->table, u->index);
+			free_row(u->row, u->table->ncols);
+			break;
+		case U_DELETE:
+			insert_row(u->table, u->index, u->row);
+			break;
+		case U_UPDATE:
+			free_row(u->table->rows[u->index], u->table->ncols);
+			u->table->rows[u->index] = u->row;
+			break;
+		case U_CREATE:
+			unlink_table(u->table);
+			free_table(u->table);
+			break;
+		case U_DROP:
+			u->table->next = tables;
+			tables = u->table;
+			break;
+	}
+	free(u);
+}
+
+/* End the transaction of conn */
+static void
+end_transaction(tconn *conn, bool commit)
+{
+	tundo	   *u = conn->undo;
+	tundo	   *first = NULL;
+
+	pthread_mutex_lock(&tables_lock);
+	if (commit)
+	{
+		/* oldest first, a dropped table goes after the changes of its rows */
+		while (u)
+		{
+			tundo	   *prev = u->prev;
+
+			u->prev = first;
+			first = u;
+			u = prev;
+		}
+		while (first)
+		{
+			tundo	   *next = first->prev;
+
+			commit_undo(first);
+			first = next;
+		}
+	}
+	else
+		while (u)
+		{
+			tundo	   *prev = u->prev;
+
+			rollback_undo(u);
+			u = prev;
+		}
+	conn->undo = NULL;
+	pthread_mutex_unlock(&tables_lock);
+}
+
+/* Roll back to the savepoint name, or release it */
+static bool
+end_savepoint(tconn *conn, const char *name, bool rollback)
+{
+	tundo	   *u;
+	tundo	  **link;
+
+	for (u = conn->undo; u; u = u->prev)
+		if (u->op == U_SAVEPOINT && strcmp(u->name, name) == 0)
+			break;
+	if (u == NULL)
+		return false;
+	pthread_mutex_lock(&tables_lock);
+	if (rollback)
+	{
+		/* the savepoint stays */
+		while (conn->undo != u)
+		{
+			tundo	   *prev = conn->undo->prev;
+
+			rollback_undo(conn->undo);
+			conn->undo = prev;
+		}
+	}
+	else
+	{
+		for (link = &conn->undo; *link != u; link = &(*link)->prev);
+		*link = u->prev;
+		free(u);
+	}
+	pthread_mutex_unlock(&tables_lock);
+	return true;
+}
+
+/* The columns of gen(), sized by its width and lob arguments */
+#define GEN_WIDTH 0
+#define GEN_LOB 1
+
+static const struct
+{
+	const char *name;
+	SQLSMALLINT type;
+	long		size;			/* or -1 - GEN_WIDTH, -1 - GEN_LOB */
+	SQLSMALLINT digits;
+}			gen_columns[] = {
+	{"id", SQL_INTEGER, 10, 0},
+	{"c_bit", SQL_BIT, 1, 0},
+	{"c_int2", SQL_SMALLINT, 5, 0},
+	{"c_int4", SQL_INTEGER, 10, 0},
+	{"c_int8", SQL_BIGINT, 19, 0},
+	{"c_float4", SQL_REAL, 7, 0},
+	{"c_float8", SQL_DOUBLE, 15, 0},
+	{"c_numeric", SQL_NUMERIC, 18, 4},
+	{"c_char", SQL_CHAR, -1 - GEN_WIDTH, 0},
+	{"c_varchar", SQL_VARCHAR, -1 - GEN_WIDTH, 0},
+	{"c_text", SQL_LONGVARCHAR, -1 - GEN_LOB, 0},
+	{"c_wvarchar", SQL_WVARCHAR, -1 - GEN_WIDTH, 0},
+	{"c_wtext", SQL_WLONGVARCHAR, -1 - GEN_LOB, 0},
+	{"c_date", SQL_TYPE_DATE, 10, 0},
+	{"c_time", SQL_TYPE_TIME, 8, 0},
+	{"c_timestamp", SQL_TYPE_TIMESTAMP, 26, 6},
+	{"c_binary", SQL_VARBINARY, -1 - GEN_WIDTH, 0},
+	{"c_blob", SQL_LONGVARBINARY, -1 - GEN_LOB, 0}
+};
+
+#define NGENCOLS (int) (sizeof(gen_columns) / sizeof(gen_columns[0]))
+
+/* a, U+00E4, U+20AC and U+1D11E: one to four bytes, the last two units */
+static const int gen_wchars[] = {0x61, 0xe4, 0x20ac, 0x1d11e};
+
+static void
+gen_string(tvalue *v, long r, long len)
+{
+	long		k;
+
+	v->kind = V_STR;
+	v->len = len;
+	v->s = xmalloc(len + 1);
+	v->owned = true;
+	for (k = 0; k < len; k++)
+		v->s[k] = 'a' + (r + k) % 26;
+	v->s[len] = '\0';
+}
+
+static void
+gen_wstring(tvalue *v, long r, long units)
+{
+	long		k;
+	size_t		n = 0;
+
+	v->kind = V_STR;
+	v->s = xmalloc(4 * units + 1);
+	v->owned = true;
+	for (k = 0;; k++)
+	{
+		int			c = gen_wchars[(r + k) % 4];
+
+		units -= c >= 0x10000 ? 2 : 1;
+		if (units < 0)
+			break;
+		n += utf8_put(v->s + n, c);
+	}
+	v->s[n] = '\0';
+	v->len = n;
+}
+
+static void
+gen_binary(tvalue *v, long len, long r, long step)
+{
+	long		k;
+
+	v->kind = V_BIN;
+	v->len = len;
+	v->s = xmalloc(len + 1);
+	v->owned = true;
+	for (k = 0; k < len; k++)
+		v->s[k] = (r * step + k) % 256;
+	v->s[len] = '\0';
+}
+
+/* The value of column j in row r, counting from 1 */
+static void
+gen_value(const long *gen, long r, int j, tvalue *v)
+{
+	long		width = gen[2];
+	long		lob = gen[3];
+	long		secs;
+
+	memset(v, 0, sizeof(*v));
+	if (j > 0 && gen[1] > 0 && (r * 37 + j * 11) % 100 < gen[1])
+		return;
+	v->kind = V_INT;
+	switch (j)
+	{
+		case 0:
+			v->i = r;
+			break;
+		case 1:
+			v->i = r % 2;
+			break;
+		case 2:
+			v->i = r % 1000 - 500;
+			break;
+		case 3:
+			v->i = r * 1000;
+			break;
+		case 4:
+			v->i = r * 10000000000LL;
+			break;
+		case 5:
+			v->kind = V_FLOAT;
+			v->f = (float) (r / 4.0);
+			break;
+		case 6:
+			v->kind = V_FLOAT;
+			v->f = r / 8.0;
+			break;
+		case 7:
+			v->kind = V_NUM;
+			v->scale = 4;
+			v->i = (r % 2 ? 1 : -1) * r * 12345LL;
+			break;
+		case 8:
+			{
+				char		buf[32];
+				int			n = snprintf(buf, sizeof(buf), "r%ld", r);
+
+				if (n > width)
+					n = width;
+				v->kind = V_STR;
+				v->len = width;
+				v->s = xmalloc(width + 1);
+				v->owned = true;
+				memset(v->s, ' ', width);
+				memcpy(v->s, buf, n);
+				v->s[width] = '\0';
+				break;
+			}
+		case 9:
+			gen_string(v, r, width - r % 4 > 1 ? width - r % 4 : 1);
+			break;
+		case 10:
+			gen_string(v, r, lob - r % 10 > 0 ? lob - r % 10 : 0);
+			break;
+		case 11:
+			gen_wstring(v, r, width);
+			break;
+		case 12:
+			gen_wstring(v, r, lob);
+			break;
+		case 13:
+			v->kind = V_DATE;
+			days_to_date(r, &v->dt);
+			break;
+		case 14:
+			v->kind = V_TIME;
+			secs = r * 3601 % 86400;
+			v->dt.hour = secs / 3600;
+			v->dt.minute = secs / 60 % 60;
+			v->dt.second = secs % 60;
+			break;
+		case 15:
+			v->kind = V_TS;
+			secs = r * 86461;
+			days_to_date(secs / 86400, &v->dt);
+			secs %= 86400;
+			v->dt.hour = secs / 3600;
+			v->dt.minute = secs / 60 % 60;
+			v->dt.second = secs % 60;
+			v->dt.fraction = (r % 1000) * 1000;
+			break;
+		case 16:
+			gen_binary(v, width, r, 1);
+			break;
+		case 17:
+			gen_binary(v, lob - r % 10 > 0 ? lob - r % 10 : 0, r, 7);
+			break;
+	}
+}
+
+/* Evaluation */
+typedef struct
+{
+	tstmt	   *stmt;
+	tvalue	   *row;
+	tvalue	   *params;
+	tvalue	   *aggs;
+} teval;
+
+static tvalue eval(teval *ev, texpr *e);
+
+static bool
+like_match(const char *s, const char *send, const char *p, const char *pend)
+{
+	while (p < pend)
+	{
+		if (*p == '%')
+		{
+			for (p++; s <= send; s++)
+				if (like_match(s, send, p, pend))
+					return true;
+			return false;
+		}
+		if (s == send)
+			return false;
+		if (*p == '_')
+		{
+			/* one character */
+			const unsigned char *u = (const unsigned char *) s;
+
+			if (utf8_next(&u, (const unsigned char *) send) < 0)
+				u++;
+			s = (const char *) u;
+			p++;
+			continue;
+		}
+		if (*p == '\\' && p + 1 < pend)
+			p++;
+		if (*s++ != *p++)
+			return false;
+	}
+	return s == send;
+}
+
+/* The text of a non-NULL value, malloc'd */
+static char *
+text_copy(tstmt *stmt, tvalue *v, size_t *len)
+{
+	const char *text = value_text(stmt, v, SQL_DOUBLE, len);
+	char	   *copy = xmalloc(*len + 1);
+
+	memcpy(copy, text, *len);
+	copy[*len] = '\0';
+	return copy;
+}
+
+static tvalue
+bool_value(int b)
+{
+	tvalue		r;
+
+	memset(&r, 0, sizeof(r));
+	r.kind = b < 0 ? V_NULL : V_INT;
+	r.i = b > 0;
+	return r;
+}
+
+/* true 1, false 0, NULL -1 */
+static int
+truth(teval *ev, texpr *e)
+{
+	tvalue		v = eval(ev, e);
+	int			r;
+
+	if (v.kind == V_NULL)
+		r = -1;
+	else
+		r = to_integer(ev->stmt, &v) != 0;
+	free_value(&v);
+	return r;
+}
+
+static tvalue
+eval_arith(teval *ev, texpr *e, tvalue *a, tvalue *b)
+{
+	tstmt	   *stmt = ev->stmt;
+	tvalue		x,
+				y,
+				r;
+
+	memset(&r, 0, sizeof(r));
+	if (e->op == OP_CONCAT)
+	{
+		size_t		alen,
+					blen;
+		char	   *as = text_copy(stmt, a, &alen);
+		const char *bs = value_text(stmt, b, SQL_DOUBLE, &blen);
+
+		r.kind = V_STR;
+		r.len = alen + blen;
+		r.s = xrealloc(as, r.len + 1);
+		memcpy(r.s + alen, bs, blen);
+		r.s[r.len] = '\0';
+		r.owned = true;
+		return r;
+	}
+	to_number(stmt, a, &x);
+	to_number(stmt, b, &y);
+	if (x.kind == V_FLOAT || y.kind == V_FLOAT ||
+		(e->op == OP_DIV && (x.kind == V_NUM || y.kind == V_NUM)))
+	{
+		double		f = number_float(&x),
+					g = number_float(&y);
+
+		r.kind = V_FLOAT;
+		switch (e->op)
+		{
+			case OP_ADD:
+				r.f = f + g;
+				break;
+			case OP_SUB:
+				r.f = f - g;
+				break;
+			case OP_MUL:
+				r.f = f * g;
+				break;
+			case OP_DIV:
+			case OP_MOD:
+				if (g == 0)
+					stmt_error(stmt, "22012", "division by zero");
+				r.f = e->op == OP_DIV ? f / g : fmod(f, g);
+				break;
+		}
+		return r;
+	}
+	else
+	{
+		int			scale = x.scale > y.scale ? x.scale : y.scale;
+		__int128	i,
+					j,
+					k = 0;
+		int64_t		xi,
+					yi;
+
+		if (e->op == OP_MUL)
+		{
+			scale = x.scale + y.scale;
+			xi = x.i;
+			yi = y.i;
+		}
+		else if (!rescale(x.i, x.scale, scale, &xi) || !rescale(y.i, y.scale, scale, &yi))
+			stmt_error(stmt, "22003", "numeric value out of range");
+		i = xi;
+		j = yi;
+		switch (e->op)
+		{
+			case OP_ADD:
+				k = i + j;
+				break;
+			case OP_SUB:
+				k = i - j;
+				break;
+			case OP_MUL:
+				k = i * j;
+				break;
+			case OP_DIV:
+			case OP_MOD:
+				if (j == 0)
+					stmt_error(stmt, "22012", "division by zero");
+				k = e->op == OP_DIV ? i / j : i % j;
+				break;
+		}
+		if (k > INT64_MAX || k < INT64_MIN || scale > MAXSCALE)
+			stmt_error(stmt, "22003", "numeric value out of range");
+		r.kind = scale > 0 ? V_NUM : V_INT;
+		r.scale = scale;
+		r.i = (int64_t) k;
+		return r;
+	}
+}
+
+static tvalue
+eval(teval *ev, texpr *e)
+{
+	tstmt	   *stmt = ev->stmt;
+	tvalue		a,
+				b,
+				c,
+				r;
+	int			k,
+				t;
+
+	memset(&r, 0, sizeof(r));
+	switch (e->kind)
+	{
+		case E_CONST:
+			return e->value;
+		case E_PARAM:
+			r = ev->params[e->index];
+			r.owned = false;
+			return r;
+		case E_COLUMN:
+			r = ev->row[e->index];
+			r.owned = false;
+			return r;
+		case E_AGG:
+			r = ev->aggs[e->index];
+			r.owned = false;
+			return r;
+		case E_NEG:
+			a = eval(ev, e->arg[0]);
+			if (a.kind == V_NULL)
+				return a;
+			to_number(stmt, &a, &r);
+			free_value(&a);
+			if (r.kind == V_FLOAT)
+				r.f = -r.f;
+			else
+				r.i = -r.i;
+			return r;
+		case E_NOT:
+			t = truth(ev, e->arg[0]);
+			return bool_value(t < 0 ? -1 : !t);
+		case E_AND:
+		case E_OR:
+			t = truth(ev, e->arg[0]);
+			/* no need for the other side */
+			if (t == (e->kind == E_OR))
+				return bool_value(t);
+			k = truth(ev, e->arg[1]);
+			if (k == (e->kind == E_OR))
+				return bool_value(k);
+			return bool_value(t < 0 || k < 0 ? -1 : t);
+		case E_CMP:
+		case E_BETWEEN:
+			a = eval(ev, e->arg[0]);
+			b = eval(ev, e->arg[1]);
+			if (e->kind == E_BETWEEN)
+			{
+				c = eval(ev, e->arg[2]);
+				if (a.kind == V_NULL || b.kind == V_NULL || c.kind == V_NULL)
+					t = -1;
+				else
+					t = compare_values(stmt, &a, &b) >= 0 &&
+						compare_values(stmt, &a, &c) <= 0;
+				free_value(&c);
+				if (t >= 0 && e->negate)
+					t = !t;
+			}
+			else if (a.kind == V_NULL || b.kind == V_NULL)
+				t = -1;
+			else
+			{
+				k = compare_values(stmt, &a, &b);
+				switch (e->op)
+				{
+					case OP_EQ:
+						t = k == 0;
+						break;
+					case OP_NE:
+						t = k != 0;
+						break;
+					case OP_LT:
+						t = k < 0;
+						break;
+					case OP_LE:
+						t = k <= 0;
+						break;
+					case OP_GT:
+						t = k > 0;
+						break;
+					default:
+						t = k >= 0;
+						break;
+				}
+			}
+			free_value(&a);
+			free_value(&b);
+			return bool_value(t);
+		case E_ARITH:
+			a = eval(ev, e->arg[0]);
+			b = eval(ev, e->arg[1]);
+			if (a.kind != V_NULL && b.kind != V_NULL)
+				r = eval_arith(ev, e, &a, &b);
+			free_value(&a);
+			free_value(&b);
+			return r;
+		case E_ISNULL:
+			a = eval(ev, e->arg[0]);
+			t = (a.kind == V_NULL) != e->negate;
+			free_value(&a);
+			return bool_value(t);
+		case E_LIKE:
+			a = eval(ev, e->arg[0]);
+			b = eval(ev, e->arg[1]);
+			if (a.kind == V_NULL || b.kind == V_NULL)
+				t = -1;
+			else
+			{
+				size_t		alen,
+							blen;
+				char	   *as = text_copy(stmt, &a, &alen);
+				const char *bs = value_text(stmt, &b, SQL_DOUBLE, &blen);
+
+				t = like_match(as, as + alen, bs, bs + blen) != e->negate;
+				free(as);
+			}
+			free_value(&a);
+			free_value(&b);
+			return bool_value(t);
+		case E_IN:
+			a = eval(ev, e->arg[0]);
+			t = a.kind == V_NULL ? -1 : 0;
+			for (k = 0; k < e->nlist && t == 0; k++)
+			{
+				b = eval(ev, e->list[k]);
+				if (b.kind == V_NULL)
+					t = -1;
+				else if (compare_values(stmt, &a, &b) == 0)
+					t = 1;
+				free_value(&b);
+			}
+			/* NULL unless found */
+			if (t < 0 && a.kind != V_NULL)
+			{
+				for (; k < e->nlist; k++)
+				{
+					b = eval(ev, e->list[k]);
+					if (b.kind != V_NULL && compare_values(stmt, &a, &b) == 0)
+						t = 1;
+					free_value(&b);
+				}
+			}
+			free_value(&a);
+			if (t >= 0 && e->negate)
+				t = !t;
+			return bool_value(t);
+		case E_FUNC:
+			a = eval(ev, e->arg[0]);
+			if (a.kind != V_NULL)
+			{
+				r.kind = V_INT;
+				if (e->op == F_SLEEP)
+					r.i = to_integer(stmt, &a);
+				else if (a.kind == V_BIN)
+					r.i = a.len;
+				else
+				{
+					size_t		len;
+					const char *text = value_text(stmt, &a, SQL_DOUBLE, &len);
+
+					r.i = text_length(text, len, false);
+				}
+			}
+			free_value(&a);
+			return r;
+	}
+	return r;
+}
+
+/* Cursors, streaming rows in the exec arena of the statement */
+typedef struct tcursor
+{
+	tstmt	   *stmt;
+	int			ncols;
+	tcolumn    *cols;
+	bool	   *needed;			/* gen(): the columns that are read */
+	bool		(*next) (struct tcursor *cur, tvalue *row);
+	long		row;
+	long		nrows;
+	tvalue	  **rows;			/* tables and materialized results */
+	long		gen[4];
+	/* SELECT */
+	struct tcursor *child;
+	tquery	   *query;
+	tvalue	   *srcrow;
+	tvalue	   *params;
+	bool		done;
+} tcursor;
+
+static bool
+rows_next(tcursor *cur, tvalue *row)
+{
+	int			k;
+
+	if (cur->row >= cur->nrows)
+		return false;
+	for (k = 0; k < cur->ncols; k++)
+	{
+		row[k] = cur->rows[cur->row][k];
+		row[k].owned = false;
+	}
+	cur->row++;
+	return true;
+}
+
+static bool
+gen_next(tcursor *cur, tvalue *row)
+{
+	int			k;
+
+	if (cur->row >= cur->gen[0])
+		return false;
+	cur->row++;
+	for (k = 0; k < cur->ncols; k++)
+	{
+		if (cur->needed[k])
+			gen_value(cur->gen, cur->row, k, &row[k]);
+		else
+			memset(&row[k], 0, sizeof(tvalue));
+	}
+	return true;
+}
+
+/* The one row without columns of SELECT without FROM */
+static bool
+single_next(tcursor *cur, tvalue *row)
+{
+	return cur->row++ == 0;
+}
+
+static tcursor *
+new_cursor(tstmt *stmt, int ncols)
+{
+	tcursor    *cur = azalloc(&stmt->exec, sizeof(tcursor));
+
+	cur->stmt = stmt;
+	cur->ncols = ncols;
+	cur->cols = azalloc(&stmt->exec, (ncols + 1) * sizeof(tcolumn));
+	return cur;
+}
+
+static tcursor *open_query(tstmt *stmt, tquery *q, tvalue *params);
+
+static tcursor *
+open_source(tstmt *stmt, tsource *src, tvalue *params)
+{
+	tcursor    *cur;
+	ttable	   *t;
+	int			k;
+	long		r;
+
+	switch (src->kind)
+	{
+		case SRC_GEN:
+			cur = new_cursor(stmt, NGENCOLS);
+			memcpy(cur->gen, src->gen, sizeof(cur->gen));
+			cur->needed = azalloc(&stmt->exec, NGENCOLS * sizeof(bool));
+			for (k = 0; k < NGENCOLS; k++)
+			{
+				tcolumn    *col = &cur->cols[k];
+
+				strcpy(col->name, gen_columns[k].name);
+				col->type = gen_columns[k].type;
+				col->size = gen_columns[k].size >= 0 ? gen_columns[k].size :
+					src->gen[2 + (-1 - gen_columns[k].size)];
+				col->digits = gen_columns[k].digits;
+			}
+			cur->next = gen_next;
+			return cur;
+		case SRC_QUERY:
+			return open_query(stmt, src->query, params);
+	}
+	/* a snapshot of the table */
+	pthread_mutex_lock(&tables_lock);
+	t = find_table(src->name);
+	if (t == NULL)
+	{
+		pthread_mutex_unlock(&tables_lock);
+		stmt_error(stmt, "42S02", "table \"%s\" does not exist", src->name);
+	}
+	cur = new_cursor(stmt, t->ncols);
+	memcpy(cur->cols, t->cols, t->ncols * sizeof(tcolumn));
+	cur->nrows = t->nrows;
+	cur->rows = aalloc(&stmt->exec, (t->nrows + 1) * sizeof(tvalue *));
+	for (r = 0; r < t->nrows; r++)
+	{
+		cur->rows[r] = aalloc(&stmt->exec, (t->ncols + 1) * sizeof(tvalue));
+		for (k = 0; k < t->ncols; k++)
+			cur->rows[r][k] = copy_value(&t->rows[r][k], &stmt->exec);
+	}
+	pthread_mutex_unlock(&tables_lock);
+	cur->next = rows_next;
+	return cur;
+}
+
+/* Find the columns of e in the source, 42S22 if one is missing */
+static void
+resolve_columns(tstmt *stmt, texpr *e, tcursor *src, bool in_agg, bool *has_agg)
+{
+	int			k;
+
+	if (e == NULL)
+		return;
+	if (e->kind == E_COLUMN)
+	{
+		for (k = 0; k < src->ncols; k++)
+			if (strcmp(src->cols[k].name, e->name) == 0)
+				break;
+		if (k == src->ncols)
+			stmt_error(stmt, "42S22", "column \"%s\" does not exist", e->name);
+		e->index = k;
+		if (src->needed)
+			src->needed[k] = true;
+		if (has_agg && !in_agg)
+			stmt_error(stmt, "42803", "column \"%s\" must be used in an aggregate function",
+					   e->name);
+		return;
+	}
+	if (e->kind == E_AGG)
+	{
+		if (in_agg)
+			stmt_error(stmt, "42803", "aggregate function calls cannot be nested");
+		in_agg = true;
+	}
+	for (k = 0; k < 3; k++)
+		resolve_columns(stmt, e->arg[k], src, in_agg, has_agg);
+	for (k = 0; k < e->nlist; k++)
+		resolve_columns(stmt, e->list[k], src, in_agg, has_agg);
+}
+
+static bool
+has_aggregate(texpr *e)
+{
+	int			k;
+
+	if (e == NULL)
+		return false;
+	if (e->kind == E_AGG)
+		return true;
+	for (k = 0; k < 3; k++)
+		if (has_aggregate(e->arg[k]))
+			return true;
+	for (k = 0; k < e->nlist; k++)
+		if (has_aggregate(e->list[k]))
+			return true;
+	return false;
+}
+
+static bool
+is_float_type(SQLSMALLINT type)
+{
+	return type == SQL_REAL || type == SQL_FLOAT || type == SQL_DOUBLE;
+}
+
+static bool
+is_numeric_type(SQLSMALLINT type)
+{
+	return type == SQL_NUMERIC || type == SQL_DECIMAL;
+}
+
+static void
+set_column(tcolumn *col, SQLSMALLINT type, SQLULEN size, SQLSMALLINT digits)
+{
+	col->type = type;
+	col->size = size;
+	col->digits = digits;
+}
+
+/* The result column of e */
+static void
+expr_column(tstmt *stmt, texpr *e, tcursor *src, tcolumn *col)
+{
+	tcolumn		a,
+				b;
+
+	memset(col, 0, sizeof(*col));
+	strcpy(col->name, "?column?");
+	switch (e->kind)
+	{
+		case E_CONST:
+			switch (e->value.kind)
+			{
+				case V_NULL:
+					set_column(col, SQL_VARCHAR, 1, 0);
+					break;
+				case V_INT:
+					if (e->value.i >= INT32_MIN && e->value.i <= INT32_MAX)
+						set_column(col, SQL_INTEGER, 10, 0);
+					else
+						set_column(col, SQL_BIGINT, 19, 0);
+					break;
+				case V_FLOAT:
+					set_column(col, SQL_DOUBLE, 15, 0);
+					break;
+				case V_NUM:
+					set_column(col, SQL_NUMERIC, 18, e->value.scale);
+					break;
+				case V_STR:
+					set_column(col, SQL_VARCHAR,
+							   e->value.len ? text_length(e->value.s, e->value.len, false) : 1, 0);
+					break;
+				case V_DATE:
+					set_column(col, SQL_TYPE_DATE, 10, 0);
+					break;
+				case V_TIME:
+					set_column(col, SQL_TYPE_TIME, 8, 0);
+					break;
+				case V_TS:
+					set_column(col, SQL_TYPE_TIMESTAMP, 26, 6);
+					break;
+			}
+			break;
+		case E_PARAM:
+			if (e->index < stmt->nparams && stmt->params[e->index].sqltype != 0)
+			{
+				tparam	   *p = &stmt->params[e->index];
+
+				set_column(col, p->sqltype, p->size ? p->size : 255, p->digits);
+			}
+			else
+				set_column(col, SQL_VARCHAR, 255, 0);
+			break;
+		case E_COLUMN:
+			*col = src->cols[e->index];
+			break;
+		case E_NEG:
+			expr_column(stmt, e->arg[0], src, col);
+			strcpy(col->name, "?column?");
+			break;
+		case E_ARITH:
+			expr_column(stmt, e->arg[0], src, &a);
+			expr_column(stmt, e->arg[1], src, &b);
+			if (e->op == OP_CONCAT)
+				set_column(col, SQL_VARCHAR, a.size + b.size < MAXTEXT ? a.size + b.size : MAXTEXT, 0);
+			else if (is_float_type(a.type) || is_float_type(b.type) ||
+					 (e->op == OP_DIV && (is_numeric_type(a.type) || is_numeric_type(b.type))))
+				set_column(col, SQL_DOUBLE, 15, 0);
+			else if (is_numeric_type(a.type) || is_numeric_type(b.type))
+				set_column(col, SQL_NUMERIC, 38,
+						   e->op == OP_MUL ? a.digits + b.digits :
+						   a.digits > b.digits ? a.digits : b.digits);
+			else if (a.type == SQL_BIGINT || b.type == SQL_BIGINT)
+				set_column(col, SQL_BIGINT, 19, 0);
+			else
+				set_column(col, SQL_INTEGER, 10, 0);
+			break;
+		case E_FUNC:
+			set_column(col, SQL_INTEGER, 10, 0);
+			strcpy(col->name, e->name);
+			break;
+		case E_AGG:
+			if (e->op == A_COUNT)
+				set_column(col, SQL_BIGINT, 19, 0);
+			else
+			{
+				expr_column(stmt, e->arg[0], src, col);
+				if (e->op == A_SUM)
+				{
+					if (is_numeric_type(col->type))
+						set_column(col, SQL_NUMERIC, 38, col->digits);
+					else if (is_float_type(col->type))
+						set_column(col, SQL_DOUBLE, 15, 0);
+					else
+						set_column(col, SQL_BIGINT, 19, 0);
+				}
+			}
+			strcpy(col->name, e->name);
+			break;
+		default:
+			/* predicates */
+			set_column(col, SQL_BIT, 1, 0);
+			break;
+	}
+}
+
+static void
+number_agg(tstmt *stmt, tvalue *acc, tvalue *v)
+{
+	tvalue		n;
+
+	to_number(stmt, v, &n);
+	if (acc->kind == V_NULL)
+		*acc = n;
+	else if (acc->kind == V_FLOAT || n.kind == V_FLOAT)
+	{
+		acc->f = number_float(acc) + number_float(&n);
+		acc->kind = V_FLOAT;
+	}
+	else
+	{
+		int			scale = acc->scale > n.scale ? acc->scale : n.scale;
+		int64_t		i,
+					j;
+
+		if (!rescale(acc->i, acc->scale, scale, &i) || !rescale(n.i, n.scale, scale, &j) ||
+			__builtin_add_overflow(i, j, &acc->i))
+			stmt_error(stmt, "22003", "numeric value out of range");
+		acc->scale = scale;
+		acc->kind = scale > 0 ? V_NUM : V_INT;
+	}
+}
+
+/* Add the row in ev to the aggregates of e */
+static void
+collect_aggs(teval *ev, texpr *e)
+{
+	int			k;
+
+	if (e == NULL)
+		return;
+	if (e->kind == E_AGG)
+	{
+		tvalue	   *acc = &ev->aggs[e->index];
+		tvalue		v;
+
+		if (e->arg[0] == NULL)
+		{
+			acc->kind = V_INT;
+			acc->i++;
+			return;
+		}
+		v = eval(ev, e->arg[0]);
+		if (v.kind != V_NULL)
+		{
+			if (e->op == A_COUNT)
+			{
+				acc->kind = V_INT;
+				acc->i++;
+			}
+			else if (e->op == A_SUM)
+				number_agg(ev->stmt, acc, &v);
+			else if (acc->kind == V_NULL ||
+					 (compare_values(ev->stmt, &v, acc) < 0) == (e->op == A_MIN))
+			{
+				*acc = copy_value(&v, &ev->stmt->exec);
+			}
+		}
+		free_value(&v);
+		return;
+	}
+	for (k = 0; k < 3; k++)
+		collect_aggs(ev, e->arg[k]);
+	for (k = 0; k < e->nlist; k++)
+		collect_aggs(ev, e->list[k]);
+}
+
+static int
+count_aggs(texpr *e)
+{
+	int			n = 0;
+	int			k;
+
+	if (e == NULL)
+		return 0;
+	if (e->kind == E_AGG)
+		return 1;
+	for (k = 0; k < 3; k++)
+		n += count_aggs(e->arg[k]);
+	for (k = 0; k < e->nlist; k++)
+		n += count_aggs(e->list[k]);
+	return n;
+}
+
+/* Number the aggregates of e, count starts at 0 */
+static void
+init_aggs(texpr *e, tvalue *aggs, int *naggs)
+{
+	int			k;
+
+	if (e == NULL)
+		return;
+	if (e->kind == E_AGG)
+	{
+		tvalue	   *acc = &aggs[e->index = (*naggs)++];
+
+		memset(acc, 0, sizeof(tvalue));
+		if (e->op == A_COUNT)
+			acc->kind = V_INT;
+		return;
+	}
+	for (k = 0; k < 3; k++)
+		init_aggs(e->arg[k], aggs, naggs);
+	for (k = 0; k < e->nlist; k++)
+		init_aggs(e->list[k], aggs, naggs);
+}
+
+static bool
+select_next(tcursor *cur, tvalue *row)
+{
+	tstmt	   *stmt = cur->stmt;
+	tquery	   *q = cur->query;
+	tcursor    *child = cur->child;
+	teval		ev;
+	int			k;
+
+	ev.stmt = stmt;
+	ev.row = cur->srcrow;
+	ev.params = cur->params;
+	ev.aggs = NULL;
+	for (;;)
+	{
+		if (!child->next(child, cur->srcrow))
+			return false;
+		if (q->where == NULL || truth(&ev, q->where) > 0)
+			break;
+		free_values(cur->srcrow, child->ncols);
+	}
+	for (k = 0; k < cur->ncols; k++)
+	{
+		texpr	   *e = q->ntargets ? q->targets[k] : NULL;
+
+		/* a column is handed over as is */
+		if (e == NULL || e->kind == E_COLUMN)
+		{
+			int			i = e ? e->index : k;
+
+			row[k] = cur->srcrow[i];
+			cur->srcrow[i].owned = false;
+		}
+		else
+			row[k] = eval(&ev, e);
+	}
+	free_values(cur->srcrow, child->ncols);
+	return true;
+}
+
+/* Read all rows of cur into the arena */
+static void
+materialize(tcursor *cur)
+{
+	tstmt	   *stmt = cur->stmt;
+	tvalue	   *row = aalloc(&stmt->exec, (cur->ncols + 1) * sizeof(tvalue));
+	long		max = 64;
+	tvalue	  **rows = xmalloc(max * sizeof(tvalue *));
+	long		n = 0;
+	int			k;
+
+	while (cur->next(cur, row))
+	{
+		if (n == max)
+			rows = xrealloc(rows, (max *= 2) * sizeof(tvalue *));
+		rows[n] = aalloc(&stmt->exec, (cur->ncols + 1) * sizeof(tvalue));
+		for (k = 0; k < cur->ncols; k++)
+			rows[n][k] = copy_value(&row[k], &stmt->exec);
+		free_values(row, cur->ncols);
+		n++;
+	}
+	cur->rows = aalloc(&stmt->exec, (n + 1) * sizeof(tvalue *));
+	memcpy(cur->rows, rows, n * sizeof(tvalue *));
+	free(rows);
+	cur->nrows = n;
+	cur->row = 0;
+	cur->next = rows_next;
+}
+
+static int
+compare_rows(tcursor *cur, int *keys, tvalue *a, tvalue *b)
+{
+	tquery	   *q = cur->query;
+	int			k;
+
+	for (k = 0; k < q->norder; k++)
+	{
+		tvalue	   *x = &a[keys[k]];
+		tvalue	   *y = &b[keys[k]];
+		int			r;
+
+		/* NULLs last */
+		if (x->kind == V_NULL || y->kind == V_NULL)
+			r = (x->kind == V_NULL) - (y->kind == V_NULL);
+		else
+			r = compare_values(cur->stmt, x, y);
+		if (q->desc[k])
+			r = -r;
+		if (r != 0)
+			return r;
+	}
+	return 0;
+}
+
+/* A stable merge sort of rows */
+static void
+sort_rows(tcursor *cur, int *keys, tvalue **rows, tvalue **tmp, long n)
+{
+	long		half = n / 2,
+				i = 0,
+				j = half,
+				k = 0;
+
+	if (n < 2)
+		return;
+	sort_rows(cur, keys, rows, tmp, half);
+	sort_rows(cur, keys, rows + half, tmp, n - half);
+	while (i < half && j < n)
+		tmp[k++] = compare_rows(cur, keys, rows[j], rows[i]) < 0 ? rows[j++] : rows[i++];
+	while (i < half)
+		tmp[k++] = rows[i++];
+	while (j < n)
+		tmp[k++] = rows[j++];
+	memcpy(rows, tmp, n * sizeof(tvalue *));
+}
+
+static tcursor *
+open_query(tstmt *stmt, tquery *q, tvalue *params)
+{
+	tcursor    *src;
+	tcursor    *cur;
+	bool		agg = false;
+	int			k;
+
+	if (q->from)
+		src = open_source(stmt, q->from, params);
+	else
+	{
+		src = new_cursor(stmt, 0);
+		src->next = single_next;
+	}
+	for (k = 0; k < q->ntargets; k++)
+		agg |= has_aggregate(q->targets[k]);
+	if (q->where && has_aggregate(q->where))
+		stmt_error(stmt, "42803", "aggregate functions are not allowed in WHERE");
+	for (k = 0; k < q->ntargets; k++)
+		resolve_columns(stmt, q->targets[k], src, false, agg ? &agg : NULL);
+	if (q->ntargets == 0 && src->needed)
+		memset(src->needed, true, src->ncols * sizeof(bool));
+	resolve_columns(stmt, q->where, src, false, NULL);
+
+	cur = new_cursor(stmt, q->ntargets ? q->ntargets : src->ncols);
+	cur->query = q;
+	cur->child = src;
+	cur->params = params;
+	cur->srcrow = azalloc(&stmt->exec, (src->ncols + 1) * sizeof(tvalue));
+	for (k = 0; k < cur->ncols; k++)
+	{
+		if (q->ntargets == 0)
+			cur->cols[k] = src->cols[k];
+		else
+		{
+			expr_column(stmt, q->targets[k], src, &cur->cols[k]);
+			if (q->aliases[k])
+				strcpy(cur->cols[k].name, q->aliases[k]);
+		}
+	}
+	if (agg)
+	{
+		teval		ev;
+		int			naggs = 0;
+		tvalue	   *row;
+
+		/* one row of the aggregates */
+		for (k = 0; k < q->ntargets; k++)
+			naggs += count_aggs(q->targets[k]);
+		ev.stmt = stmt;
+		ev.row = cur->srcrow;
+		ev.params = params;
+		ev.aggs = azalloc(&stmt->exec, (naggs + 1) * sizeof(tvalue));
+		naggs = 0;
+		for (k = 0; k < q->ntargets; k++)
+			init_aggs(q->targets[k], ev.aggs, &naggs);
+		while (src->next(src, cur->srcrow))
+		{
+			if (q->where == NULL || truth(&ev, q->where) > 0)
+			{
+				for (k = 0; k < q->ntargets; k++)
+					collect_aggs(&ev, q->targets[k]);
+			}
+			free_values(cur->srcrow, src->ncols);
+		}
+		row = aalloc(&stmt->exec, (cur->ncols + 1) * sizeof(tvalue));
+		for (k = 0; k < q->ntargets; k++)
+		{
+			tvalue		v = eval(&ev, q->targets[k]);
+
+			row[k] = copy_value(&v, &stmt->exec);
+			free_value(&v);
+		}
+		cur->rows = aalloc(&stmt->exec, sizeof(tvalue *));
+		cur->rows[0] = row;
+		cur->nrows = 1;
+		cur->next = rows_next;
+	}
+	else
+		cur->next = select_next;
+	if (q->norder > 0)
+	{
+		int		   *keys = aalloc(&stmt->exec, q->norder * sizeof(int));
+		tvalue	  **tmp;
+
+		for (k = 0; k < q->norder; k++)
+		{
+			texpr	   *e = q->order[k];
+			int			i;
+
+			keys[k] = -1;
+			if (e->kind == E_CONST && e->value.kind == V_INT &&
+				e->value.i >= 1 && e->value.i <= cur->ncols)
+				keys[k] = e->value.i - 1;
+			else if (e->kind == E_COLUMN)
+				for (i = 0; i < cur->ncols; i++)
+					if (strcmp(cur->cols[i].name, e->name) == 0)
+					{
+						keys[k] = i;
+						break;
+					}
+			if (keys[k] < 0)
+				stmt_error(stmt, "42P10", "ORDER BY must name an output column");
+		}
+		materialize(cur);
+		tmp = xmalloc((cur->nrows + 1) * sizeof(tvalue *));
+		sort_rows(cur, keys, cur->rows, tmp, cur->nrows);
+		free(tmp);
+	}
+	return cur;
+}
+
+/* Execution */
+static SQLLEN
+ctype_size(SQLSMALLINT ctype)
+{
+	switch (ctype)
+	{
+		case SQL_C_BIT:
+		case SQL_C_TINYINT:
+		case SQL_C_STINYINT:
+		case SQL_C_UTINYINT:
+			return 1;
+		case SQL_C_SHORT:
+		case SQL_C_SSHORT:
+		case SQL_C_USHORT:
+			return 2;
+		case SQL_C_LONG:
+		case SQL_C_SLONG:
+		case SQL_C_ULONG:
+			return 4;
+		case SQL_C_SBIGINT:
+		case SQL_C_UBIGINT:
+			return 8;
+		case SQL_C_FLOAT:
+			return sizeof(SQLREAL);
+		case SQL_C_DOUBLE:
+			return sizeof(SQLDOUBLE);
+		case SQL_C_NUMERIC:
+			return sizeof(SQL_NUMERIC_STRUCT);
+		case SQL_C_DATE:
+		case SQL_C_TYPE_DATE:
+			return sizeof(SQL_DATE_STRUCT);
+		case SQL_C_TIME:
+		case SQL_C_TYPE_TIME:
+			return sizeof(SQL_TIME_STRUCT);
+		case SQL_C_TIMESTAMP:
+		case SQL_C_TYPE_TIMESTAMP:
+			return sizeof(SQL_TIMESTAMP_STRUCT);
+	}
+	return 0;
+}
+
+/* The value of parameter k in parameter set row */
+static tvalue
+param_value(tstmt *stmt, int k, SQLULEN row)
+{
+	tparam	   *p;
+	SQLLEN		size;
+	char	   *ptr;
+	SQLLEN		ind;
+	tvalue		v;
+
+	memset(&v, 0, sizeof(v));
+	if (k >= stmt->nparams || stmt->params[k].ctype == 0)
+		stmt_error(stmt, "07002", "parameter %d is not bound", k + 1);
+	p = &stmt->params[k];
+	size = ctype_size(p->ctype);
+	ptr = (char *) p->ptr + row * (size ? size : p->buflen);
+	if (p->ind)
+		ind = p->ind[row];
+	else
+		ind = (p->ctype == SQL_C_CHAR || p->ctype == SQL_C_WCHAR) ? SQL_NTS :
+			p->ctype == SQL_C_BINARY ? p->buflen : size;
+	if (ind == SQL_NULL_DATA || p->ptr == NULL)
+		return v;
+	if (ind == SQL_DATA_AT_EXEC || ind <= SQL_LEN_DATA_AT_EXEC_OFFSET)
+		stmt_error(stmt, "HYC00", "data at execution is not supported");
+	switch (p->ctype)
+	{
+		case SQL_C_CHAR:
+			v.kind = V_STR;
+			v.s = ptr;
+			v.len = ind == SQL_NTS ? strlen(ptr) : (size_t) ind;
+			break;
+		case SQL_C_WCHAR:
+			{
+				SQLWCHAR   *w = (SQLWCHAR *) ptr;
+				size_t		units = 0;
+
+				if (ind == SQL_NTS)
+					while (w[units])
+						units++;
+				else
+					units = ind / sizeof(SQLWCHAR);
+				v.kind = V_STR;
+				v.s = aalloc(&stmt->exec, 3 * units + 1);
+				v.len = utf16_to_utf8(w, units, v.s);
+				break;
+			}
+		case SQL_C_BINARY:
+			v.kind = V_BIN;
+			v.s = ptr;
+			v.len = ind;
+			break;
+		case SQL_C_BIT:
+		case SQL_C_UTINYINT:
+			v.kind = V_INT;
+			v.i = *(unsigned char *) ptr;
+			break;
+		case SQL_C_TINYINT:
+		case SQL_C_STINYINT:
+			v.kind = V_INT;
+			v.i = *(signed char *) ptr;
+			break;
+		case SQL_C_SHORT:
+		case SQL_C_SSHORT:
+			v.kind = V_INT;
+			v.i = *(SQLSMALLINT *) ptr;
+			break;
+		case SQL_C_USHORT:
+			v.kind = V_INT;
+			v.i = *(SQLUSMALLINT *) ptr;
+			break;
+		case SQL_C_LONG:
+		case SQL_C_SLONG:
+			v.kind = V_INT;
+			v.i = *(SQLINTEGER *) ptr;
+			break;
+		case SQL_C_ULONG:
+			v.kind = V_INT;
+			v.i = *(SQLUINTEGER *) ptr;
+			break;
+		case SQL_C_SBIGINT:
+		case SQL_C_UBIGINT:
+			v.kind = V_INT;
+			v.i = *(SQLBIGINT *) ptr;
+			break;
+		case SQL_C_FLOAT:
+			v.kind = V_FLOAT;
+			v.f = *(SQLREAL *) ptr;
+			break;
+		case SQL_C_DOUBLE:
+			v.kind = V_FLOAT;
+			v.f = *(SQLDOUBLE *) ptr;
+			break;
+		case SQL_C_NUMERIC:
+			{
+				SQL_NUMERIC_STRUCT *ns = (SQL_NUMERIC_STRUCT *) ptr;
+				unsigned __int128 u = 0;
+				int			i;
+
+				for (i = SQL_MAX_NUMERIC_LEN - 1; i >= 0; i--)
+					u = (u << 8) | ns->val[i];
+				if (u > INT64_MAX || ns->scale > MAXSCALE || ns->scale < 0)
+					stmt_error(stmt, "22003", "numeric value out of range");
+				v.kind = V_NUM;
+				v.i = ns->sign ? (int64_t) u : -(int64_t) u;
+				v.scale = ns->scale;
+				break;
+			}
+		case SQL_C_DATE:
+		case SQL_C_TYPE_DATE:
+			{
+				SQL_DATE_STRUCT *d = (SQL_DATE_STRUCT *) ptr;
+
+				v.kind = V_DATE;
+				v.dt.year = d->year;
+				v.dt.month = d->month;
+				v.dt.day = d->day;
+				break;
+			}
+		case SQL_C_TIME:
+		case SQL_C_TYPE_TIME:
+			{
+				SQL_TIME_STRUCT *t = (SQL_TIME_STRUCT *) ptr;
+
+				v.kind = V_TIME;
+				v.dt.hour = t->hour;
+				v.dt.minute = t->minute;
+				v.dt.second = t->second;
+				break;
+			}
+		case SQL_C_TIMESTAMP:
+		case SQL_C_TYPE_TIMESTAMP:
+			v.kind = V_TS;
+			v.dt = *(SQL_TIMESTAMP_STRUCT *) ptr;
+			break;
+		default:
+			stmt_error(stmt, "HY003", "program type %d out of range", p->ctype);
+	}
+	if (is_datetime(&v) && !valid_datetime(&v.dt, v.kind))
+		stmt_error(stmt, "22007", "invalid datetime format in parameter %d", k + 1);
+	return v;
+}
+
+static tvalue *
+load_params(tstmt *stmt, tquery *q, SQLULEN row)
+{
+	tvalue	   *params = aalloc(&stmt->exec, (q->nparams + 1) * sizeof(tvalue));
+	int			k;
+
+	for (k = 0; k < q->nparams; k++)
+		params[k] = param_value(stmt, k, row);
+	return params;
+}
+
+/* Change a table, with tables_lock held; the number of rows */
+static long
+modify_table(tstmt *stmt, tquery *q, tvalue *params)
+{
+	tconn	   *conn = stmt->conn;
+	ttable	   *t = find_table(q->table);
+	tcursor		src;
+	teval		ev;
+	int		   *map;
+	long		n = 0;
+	int			i,
+				k;
+
+	if (q->kind == Q_CREATE)
+	{
+		if (t)
+			stmt_error(stmt, "42S01", "table \"%s\" already exists", q->table);
+		t = xmalloc(sizeof(ttable));
+		memset(t, 0, sizeof(ttable));
+		strcpy(t->name, q->table);
+		t->ncols = q->ncols;
+		t->cols = xmalloc(q->ncols * sizeof(tcolumn));
+		memcpy(t->cols, q->coldefs, q->ncols * sizeof(tcolumn));
+		t->next = tables;
+		tables = t;
+		log_undo(conn, U_CREATE, t, 0, NULL);
+		return 0;
+	}
+	if (t == NULL)
+	{
+		if (q->kind == Q_DROP && q->if_exists)
+			return 0;
+		stmt_error(stmt, "42S02", "table \"%s\" does not exist", q->table);
+	}
+	if (q->kind == Q_DROP)
+	{
+		unlink_table(t);
+		log_undo(conn, U_DROP, t, 0, NULL);
+		return 0;
+	}
+	map = aalloc(&stmt->exec, (q->ncols + 1) * sizeof(int));
+	for (k = 0; k < q->ncols; k++)
+	{
+		if (q->cols == NULL)
+		{
+			if (k >= t->ncols)
+				stmt_error(stmt, "42601", "INSERT has more expressions than target columns");
+			map[k] = k;
+			continue;
+		}
+		for (i = 0; i < t->ncols; i++)
+			if (strcmp(t->cols[i].name, q->cols[k]) == 0)
+				break;
+		if (i == t->ncols)
+			stmt_error(stmt, "42S22", "column \"%s\" of table \"%s\" does not exist",
+					   q->cols[k], t->name);
+		map[k] = i;
+	}
+	/* the expressions see the columns of the table, VALUES none */
+	memset(&src, 0, sizeof(src));
+	if (q->kind != Q_INSERT)
+	{
+		src.ncols = t->ncols;
+		src.cols = t->cols;
+	}
+	resolve_columns(stmt, q->where, &src, false, NULL);
+	if (has_aggregate(q->where))
+		stmt_error(stmt, "42803", "aggregate functions are not allowed in WHERE");
+	for (i = 0; i < q->nrows; i++)
+		for (k = 0; k < q->ncols; k++)
+		{
+			resolve_columns(stmt, q->values[i][k], &src, false, NULL);
+			if (has_aggregate(q->values[i][k]))
+				stmt_error(stmt, "42803", "aggregate functions are not allowed here");
+		}
+	ev.stmt = stmt;
+	ev.row = NULL;
+	ev.params = params;
+	ev.aggs = NULL;
+	if (q->kind == Q_INSERT)
+	{
+		for (n = 0; n < q->nrows; n++)
+		{
+			tvalue	   *row = xmalloc((t->ncols + 1) * sizeof(tvalue));
+
+			memset(row, 0, (t->ncols + 1) * sizeof(tvalue));
+			insert_row(t, t->nrows, row);
+			log_undo(conn, U_INSERT, t, t->nrows - 1, row);
+			for (k = 0; k < q->ncols; k++)
+			{
+				tvalue		v = eval(&ev, q->values[n][k]);
+
+				row[map[k]] = coerce_value(stmt, &v, &t->cols[map[k]]);
+				free_value(&v);
+			}
+		}
+		return n;
+	}
+	for (i = 0; i < t->nrows;)
+	{
+		tvalue	   *old = t->rows[i];
+		tvalue	   *row;
+
+		ev.row = old;
+		if (q->where && truth(&ev, q->where) <= 0)
+		{
+			i++;
+			continue;
+		}
+		n++;
+		if (q->kind == Q_DELETE)
+		{
+			remove_row(t, i);
+			log_undo(conn, U_DELETE, t, i, old);
+			continue;
+		}
+		/* the new version is computed from the old one */
+		row = xmalloc((t->ncols + 1) * sizeof(tvalue));
+		for (k = 0; k < t->ncols; k++)
+			row[k] = copy_value(&old[k], NULL);
+		t->rows[i] = row;
+		log_undo(conn, U_UPDATE, t, i, old);
+		for (k = 0; k < q->ncols; k++)
+		{
+			tvalue		v = eval(&ev, q->values[0][k]);
+			tvalue		c = coerce_value(stmt, &v, &t->cols[map[k]]);
+
+			free_value(&v);
+			free_value(&row[map[k]]);
+			row[map[k]] = c;
+		}
+		i++;
+	}
+	return n;
+}
+
+/* Run an INSERT, UPDATE, DELETE, CREATE or DROP as a whole or not at all */
+static void
+run_modify(tstmt *stmt, tquery *q, tvalue *params)
+{
+	tconn	   *conn = stmt->conn;
+	tundo	   *mark = conn->undo;
+	jmp_buf		saved;
+
+	memcpy(saved, stmt->jump, sizeof(jmp_buf));
+	pthread_mutex_lock(&tables_lock);
+	if (setjmp(stmt->jump))
+	{
+		while (conn->undo != mark)
+		{
+			tundo	   *prev = conn->undo->prev;
+
+			rollback_undo(conn->undo);
+			conn->undo = prev;
+		}
+		pthread_mutex_unlock(&tables_lock);
+		memcpy(stmt->jump, saved, sizeof(jmp_buf));
+		longjmp(stmt->jump, 1);
+	}
+	stmt->rowcount += modify_table(stmt, q, params);
+	pthread_mutex_unlock(&tables_lock);
+	memcpy(stmt->jump, saved, sizeof(jmp_buf));
+}
+
+static void
+close_cursor(tstmt *stmt)
+{
+	if (stmt->rowset)
+		free_values(stmt->rowset, stmt->nrows * stmt->ncols);
+	stmt->nrows = 0;
+	stmt->pos = 0;
+	stmt->cursor = NULL;
+	stmt->ncols = 0;
+	stmt->cols = NULL;
+	stmt->gd_offset = NULL;
+	afree(&stmt->exec);
+}
+
+static void
+execute_query(tstmt *stmt)
+{
+	tconn	   *conn = stmt->conn;
+	tquery	   *q = stmt->query;
+	SQLULEN		nsets = q->nparams > 0 ? stmt->paramset_size : 1;
+	tvalue	   *params;
+	SQLULEN		r;
+
+	stmt->rowcount = -1;
+	if (stmt->params_processed)
+		*stmt->params_processed = 0;
+	if (stmt->param_status)
+		for (r = 0; r < nsets; r++)
+			stmt->param_status[r] = SQL_PARAM_UNUSED;
+	switch (q->kind)
+	{
+		case Q_SELECT:
+			if (nsets > 1)
+				stmt_error(stmt, "HYC00", "parameter arrays are only supported for INSERT, UPDATE and DELETE");
+			params = load_params(stmt, q, 0);
+			stmt->cursor = open_query(stmt, q, params);
+			stmt->ncols = stmt->cursor->ncols;
+			stmt->cols = stmt->cursor->cols;
+			stmt->gd_offset = azalloc(&stmt->exec, (stmt->ncols + 1) * sizeof(size_t));
+			break;
+		case Q_SAVEPOINT:
+			if (!conn->savepoints)
+				stmt_error(stmt, "0A000", "savepoints are not supported");
+			if (conn->autocommit)
+				stmt_error(stmt, "25000", "savepoints need a transaction, autocommit is on");
+			pthread_mutex_lock(&tables_lock);
+			log_undo(conn, U_SAVEPOINT, NULL, 0, NULL);
+			strcpy(conn->undo->name, q->table);
+			pthread_mutex_unlock(&tables_lock);
+			break;
+		case Q_RELEASE:
+		case Q_ROLLBACK_TO:
+			if (!conn->savepoints)
+				stmt_error(stmt, "0A000", "savepoints are not supported");
+			if (!end_savepoint(conn, q->table, q->kind == Q_ROLLBACK_TO))
+				stmt_error(stmt, "3B001", "savepoint \"%s\" does not exist", q->table);
+			break;
+		case Q_SET:
+			break;
+		default:
+			stmt->rowcount = 0;
+			for (r = 0; r < nsets; r++)
+			{
+				if (stmt->params_processed)
+					*stmt->params_processed = r + 1;
+				if (stmt->param_status)
+					stmt->param_status[r] = SQL_PARAM_ERROR;
+				params = load_params(stmt, q, r);
+				run_modify(stmt, q, params);
+				if (stmt->param_status)
+					stmt->param_status[r] = SQL_PARAM_SUCCESS;
+			}
+			if (conn->autocommit)
+				end_transaction(conn, true);
+			return;
+	}
+	if (stmt->params_processed)
+		*stmt->params_processed = 1;
+	if (stmt->param_status)
+		stmt->param_status[0] = SQL_PARAM_SUCCESS;
+}
+
+static long
+expr_delay(texpr *e)
+{
+	long		d = 0;
+	int			k;
+
+	if (e == NULL)
+		return 0;
+	if (e->kind == E_FUNC && e->op == F_SLEEP && e->arg[0]->kind == E_CONST &&
+		e->arg[0]->value.kind == V_INT)
+		d += e->arg[0]->value.i;
+	for (k = 0; k < 3; k++)
+		d += expr_delay(e->arg[k]);
+	for (k = 0; k < e->nlist; k++)
+		d += expr_delay(e->list[k]);
+	return d;
+}
+
+/* How long the statement takes, the total of its sleep() calls */
+static long
+query_delay(tquery *q)
+{
+	long		d = expr_delay(q->where);
+	int			k,
+				r;
+
+	for (k = 0; k < q->ntargets; k++)
+		d += expr_delay(q->targets[k]);
+	for (r = 0; r < q->nrows; r++)
+		for (k = 0; k < q->ncols; k++)
+			d += expr_delay(q->values[r][k]);
+	if (q->from && q->from->query)
+		d += query_delay(q->from->query);
+	return d;
+}
+
+static long
+elapsed_ms(tstmt *stmt)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - stmt->start.tv_sec) * 1000 +
+		(now.tv_nsec - stmt->start.tv_nsec) / 1000000;
+}
+
+/*
+ * Execute the statement once its delay is over. An asynchronous one
+ * returns SQL_STILL_EXECUTING until then, the application calls again.
+ */
+static SQLRETURN
+run_statement(tstmt *stmt)
+{
+	long		timeout = stmt->query_timeout * 1000;
+
+	if (stmt->state != S_EXECUTING)
+	{
+		close_cursor(stmt);
+		__atomic_store_n(&stmt->cancelled, 0, __ATOMIC_SEQ_CST);
+		clock_gettime(CLOCK_MONOTONIC, &stmt->start);
+		stmt->state = S_EXECUTING;
+	}
+	for (;;)
+	{
+		long		elapsed = elapsed_ms(stmt);
+		long		wait = stmt->query->delay - elapsed;
+
+		if (__atomic_load_n(&stmt->cancelled, __ATOMIC_SEQ_CST))
+		{
+			stmt->state = S_IDLE;
+			stmt_error(stmt, "HY008", "operation canceled");
+		}
+		if (wait <= 0)
+			break;
+		if (timeout > 0 && elapsed >= timeout)
+		{
+			stmt->state = S_IDLE;
+			stmt_error(stmt, "HYT00", "timeout expired");
+		}
+		if (stmt->async)
+			return SQL_STILL_EXECUTING;
+		if (timeout > 0 && timeout - elapsed < wait)
+			wait = timeout - elapsed;
+		usleep((wait < 5 ? wait : 5) * 1000);
+	}
+	stmt->state = S_IDLE;
+	execute_query(stmt);
+	return stmt->warning ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+}
+
+/* Results */
+static SQLSMALLINT
+default_ctype(SQLSMALLINT type)
+{
+	switch (type)
+	{
+		case SQL_WCHAR:
+		case SQL_WVARCHAR:
+		case SQL_WLONGVARCHAR:
+			return SQL_C_WCHAR;
+		case SQL_BIT:
+			return SQL_C_BIT;
+		case SQL_TINYINT:
+			return SQL_C_STINYINT;
+		case SQL_SMALLINT:
+			return SQL_C_SSHORT;
+		case SQL_INTEGER:
+			return SQL_C_SLONG;
+		case SQL_BIGINT:
+			return SQL_C_SBIGINT;
+		case SQL_REAL:
+			return SQL_C_FLOAT;
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			return SQL_C_DOUBLE;
+		case SQL_TYPE_DATE:
+			return SQL_C_TYPE_DATE;
+		case SQL_TYPE_TIME:
+			return SQL_C_TYPE_TIME;
+		case SQL_TYPE_TIMESTAMP:
+			return SQL_C_TYPE_TIMESTAMP;
+		case SQL_BINARY:
+		case SQL_VARBINARY:
+		case SQL_LONGVARBINARY:
+			return SQL_C_BINARY;
+	}
+	return SQL_C_CHAR;
+}
+
+/* Character and binary data, piecewise if offset is given */
+static SQLRETURN
+put_bytes(tstmt *stmt, tvalue *v, tcolumn *col, SQLSMALLINT ctype, char *ptr,
+		  SQLLEN buflen, SQLLEN *ind, size_t *offset)
+{
+	const char *data;
+	char	   *copy = NULL;
+	size_t		len;
+	size_t		term = 0;
+	size_t		start = offset ? *offset : 0;
+	size_t		remaining;
+	size_t		room;
+
+	if (ctype == SQL_C_BINARY)
+	{
+		if (v->kind != V_BIN && v->kind != V_STR)
+			conversion_error(stmt, v, "SQL_C_BINARY");
+		data = v->s;
+		len = v->len;
+	}
+	else
+	{
+		data = value_text(stmt, v, col->type, &len);
+		term = 1;
+		if (ctype == SQL_C_WCHAR)
+		{
+			SQLWCHAR   *w;
+
+			if (data != v->s)
+				data = copy = text_copy(stmt, v, &len);
+			w = (SQLWCHAR *) scratch(stmt, (2 * len + 1) * sizeof(SQLWCHAR));
+			len = utf8_to_utf16(data, len, w) * sizeof(SQLWCHAR);
+			data = (char *) w;
+			term = sizeof(SQLWCHAR);
+		}
+	}
+	remaining = len - start;
+	room = buflen > (SQLLEN) term ? buflen - term : 0;
+	if (term == sizeof(SQLWCHAR))
+		room -= room % sizeof(SQLWCHAR);
+	if (room > remaining)
+		room = remaining;
+	if (ptr)
+	{
+		memcpy(ptr, data + start, room);
+		if (term && buflen >= (SQLLEN) term)
+			memset(ptr + room, 0, term);
+	}
+	free(copy);
+	if (ind)
+		*ind = (offset && stmt->conn->no_total && room < remaining) ?
+			SQL_NO_TOTAL : (SQLLEN) remaining;
+	if (room < remaining)
+	{
+		if (offset)
+			*offset += room;
+		stmt_warning(stmt, "01004", "string data, right truncation");
+		return SQL_SUCCESS_WITH_INFO;
+	}
+	if (offset)
+		*offset = GD_DONE;
+	return SQL_SUCCESS;
+}
+
+/* Store v as ctype in ptr, from *offset on for SQLGetData() */
+static SQLRETURN
+put_value(tstmt *stmt, tvalue *v, tcolumn *col, tbind *b, SQLSMALLINT ctype,
+		  char *ptr, SQLLEN buflen, SQLLEN *ind, size_t *offset)
+{
+	SQL_TIMESTAMP_STRUCT dt = {0};
+	tvalue		n;
+	int64_t		i = 0;
+
+	if (offset && *offset == GD_DONE)
+		return SQL_NO_DATA;
+	if (v->kind == V_NULL)
+	{
+		if (ind == NULL)
+			stmt_error(stmt, "22002", "indicator variable required but not supplied");
+		*ind = SQL_NULL_DATA;
+		if (offset)
+			*offset = GD_DONE;
+		return SQL_SUCCESS;
+	}
+	if (ctype == SQL_C_DEFAULT)
+		ctype = default_ctype(col->type);
+	if (ctype == SQL_C_CHAR || ctype == SQL_C_WCHAR || ctype == SQL_C_BINARY)
+		return put_bytes(stmt, v, col, ctype, ptr, buflen, ind, offset);
+	switch (ctype)
+	{
+		case SQL_C_BIT:
+		case SQL_C_TINYINT:
+		case SQL_C_STINYINT:
+		case SQL_C_UTINYINT:
+		case SQL_C_SHORT:
+		case SQL_C_SSHORT:
+		case SQL_C_USHORT:
+		case SQL_C_LONG:
+		case SQL_C_SLONG:
+		case SQL_C_ULONG:
+		case SQL_C_SBIGINT:
+		case SQL_C_UBIGINT:
+			i = to_integer(stmt, v);
+			break;
+		case SQL_C_FLOAT:
+		case SQL_C_DOUBLE:
+		case SQL_C_NUMERIC:
+			to_number(stmt, v, &n);
+			break;
+		case SQL_C_DATE:
+		case SQL_C_TYPE_DATE:
+			to_datetime(stmt, v, V_DATE, &dt);
+			break;
+		case SQL_C_TIME:
+		case SQL_C_TYPE_TIME:
+			to_datetime(stmt, v, V_TIME, &dt);
+			break;
+		case SQL_C_TIMESTAMP:
+		case SQL_C_TYPE_TIMESTAMP:
+			to_datetime(stmt, v, V_TS, &dt);
+			break;
+		default:
+			stmt_error(stmt, "HY003", "program type %d out of range", ctype);
+	}
+	if (ptr)
+	{
+		switch (ctype)
+		{
+			case SQL_C_BIT:
+				range_check(stmt, i, 0, 1);
+				*(unsigned char *) ptr = i;
+				break;
+			case SQL_C_TINYINT:
+			case SQL_C_STINYINT:
+				range_check(stmt, i, INT8_MIN, INT8_MAX);
+				*(signed char *) ptr = i;
+				break;
+			case SQL_C_UTINYINT:
+				range_check(stmt, i, 0, UINT8_MAX);
+				*(unsigned char *) ptr = i;
+				break;
+			case SQL_C_SHORT:
+			case SQL_C_SSHORT:
+				range_check(stmt, i, INT16_MIN, INT16_MAX);
+				*(SQLSMALLINT *) ptr = i;
+				break;
+			case SQL_C_USHORT:
+				range_check(stmt, i, 0, UINT16_MAX);
+				*(SQLUSMALLINT *) ptr = i;
+				break;
+			case SQL_C_LONG:
+			case SQL_C_SLONG:
+				range_check(stmt, i, INT32_MIN, INT32_MAX);
+				*(SQLINTEGER *) ptr = i;
+				break;
+			case SQL_C_ULONG:
+				range_check(stmt, i, 0, UINT32_MAX);
+				*(SQLUINTEGER *) ptr = i;
+				break;
+			case SQL_C_SBIGINT:
+			case SQL_C_UBIGINT:
+				*(SQLBIGINT *) ptr = i;
+				break;
+			case SQL_C_FLOAT:
+				*(SQLREAL *) ptr = number_float(&n);
+				break;
+			case SQL_C_DOUBLE:
+				*(SQLDOUBLE *) ptr = number_float(&n);
+				break;
+			case SQL_C_NUMERIC:
+				{
+					SQL_NUMERIC_STRUCT *ns = (SQL_NUMERIC_STRUCT *) ptr;
+					int			precision = b && b->precision ? b->precision : 38;
+					int			scale = b ? b->scale : 0;
+					uint64_t	u;
+					int			k;
+
+					if (scale < 0 || scale > MAXSCALE)
+						stmt_error(stmt, "HY104", "invalid precision or scale value");
+					if (n.kind == V_FLOAT)
+					{
+						double		f = n.f * pow10[scale];
+
+						if (!(fabs(f) < 9.2e18))
+							stmt_error(stmt, "22003", "numeric value out of range");
+						i = llround(f);
+					}
+					else if (!rescale(n.i, n.scale, scale, &i))
+						stmt_error(stmt, "22003", "numeric value out of range");
+					u = i < 0 ? -(uint64_t) i : (uint64_t) i;
+					if (precision <= MAXSCALE && u >= (uint64_t) pow10[precision])
+						stmt_error(stmt, "22003", "numeric value out of range");
+					ns->precision = precision;
+					ns->scale = scale;
+					ns->sign = i >= 0;
+					for (k = 0; k < SQL_MAX_NUMERIC_LEN; k++, u >>= 8)
+						ns->val[k] = u & 0xff;
+					break;
+				}
+			case SQL_C_DATE:
+			case SQL_C_TYPE_DATE:
+				{
+					SQL_DATE_STRUCT *d = (SQL_DATE_STRUCT *) ptr;
+
+					d->year = dt.year;
+					d->month = dt.month;
+					d->day = dt.day;
+					break;
+				}
+			case SQL_C_TIME:
+			case SQL_C_TYPE_TIME:
+				{
+					SQL_TIME_STRUCT *t = (SQL_TIME_STRUCT *) ptr;
+
+					t->hour = dt.hour;
+					t->minute = dt.minute;
+					t->second = dt.second;
+					break;
+				}
+			default:
+				*(SQL_TIMESTAMP_STRUCT *) ptr = dt;
+				break;
+		}
+	}
+	if (ind)
+		*ind = ctype_size(ctype);
+	if (offset)
+		*offset = GD_DONE;
+	return SQL_SUCCESS;
+}
+
+static SQLRETURN
+fetch_rowset(tstmt *stmt)
+{
+	SQLULEN		size = stmt->row_array_size;
+	SQLULEN		offset = stmt->bind_offset ? *stmt->bind_offset : 0;
+	int			ncols = stmt->ncols;
+	SQLULEN		k;
+	int			c;
+
+	if (stmt->cursor == NULL)
+		stmt_error(stmt, "24000", "invalid cursor state");
+	free_values(stmt->rowset, stmt->nrows * ncols);
+	stmt->nrows = 0;
+	if ((SQLULEN) stmt->rowsetcap < size * ncols)
+	{
+		stmt->rowsetcap = size * ncols;
+		stmt->rowset = xrealloc(stmt->rowset, stmt->rowsetcap * sizeof(tvalue));
+	}
+	while ((SQLULEN) stmt->nrows < size &&
+		   stmt->cursor->next(stmt->cursor, &stmt->rowset[stmt->nrows * ncols]))
+		stmt->nrows++;
+	stmt->pos = 0;
+	memset(stmt->gd_offset, 0, ncols * sizeof(size_t));
+	if (stmt->rows_fetched)
+		*stmt->rows_fetched = stmt->nrows;
+	if (stmt->row_status)
+		for (k = 0; k < size; k++)
+			stmt->row_status[k] = k < (SQLULEN) stmt->nrows ? SQL_ROW_SUCCESS : SQL_ROW_NOROW;
+	if (stmt->nrows == 0)
+		return SQL_NO_DATA;
+	for (c = 1; c <= ncols && c < stmt->nbinds; c++)
+	{
+		tbind	   *b = &stmt->binds[c];
+		SQLLEN		elem = ctype_size(b->ctype) ? ctype_size(b->ctype) : b->buflen;
+
+		if (b->ptr == NULL)
+			continue;
+		for (k = 0; k < (SQLULEN) stmt->nrows; k++)
+		{
+			char	   *ptr = (char *) b->ptr + offset + k * elem;
+			SQLLEN	   *ind = b->ind ? (SQLLEN *) ((char *) b->ind + offset) + k : NULL;
+
+			if (put_value(stmt, &stmt->rowset[k * ncols + c - 1], &stmt->cols[c - 1], b,
+						  b->ctype, ptr, b->buflen, ind, NULL) == SQL_SUCCESS_WITH_INFO &&
+				stmt->row_status)
+				stmt->row_status[k] = SQL_ROW_SUCCESS_WITH_INFO;
+		}
+	}
+	return stmt->warning ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+}
+
+static SQLLEN
+octet_length(tcolumn *col)
+{
+	if (is_wide_type(col->type))
+		return col->size >= MAXTEXT / 2 ? MAXTEXT : (SQLLEN) col->size * sizeof(SQLWCHAR);
+	if (is_char_type(col->type) || is_binary_type(col->type))
+		return col->size;
+	if (is_numeric_type(col->type))
+		return col->size + 2;
+	switch (col->type)
+	{
+		case SQL_BIT:
+		case SQL_TINYINT:
+			return 1;
+		case SQL_SMALLINT:
+			return 2;
+		case SQL_INTEGER:
+		case SQL_REAL:
+			return 4;
+		case SQL_TYPE_DATE:
+		case SQL_TYPE_TIME:
+			return 6;
+		case SQL_TYPE_TIMESTAMP:
+			return 16;
+	}
+	return 8;
+}
+
+/* The SQL type as the application knows it */
+static SQLSMALLINT
+app_type(tstmt *stmt, SQLSMALLINT type)
+{
+	if (stmt->conn->env->version == SQL_OV_ODBC2)
+	{
+		if (type == SQL_TYPE_DATE)
+			return SQL_DATE;
+		if (type == SQL_TYPE_TIME)
+			return SQL_TIME;
+		if (type == SQL_TYPE_TIMESTAMP)
+			return SQL_TIMESTAMP;
+	}
+	return type;
+}
+
+/* Copy a string result, SQL_SUCCESS_WITH_INFO if it does not fit */
+static SQLRETURN
+put_string(tdiag *d, const char *s, SQLPOINTER buf, SQLINTEGER buflen, SQLLEN *outlen)
+{
+	SQLINTEGER	len = strlen(s);
+
+	if (outlen)
+		*outlen = len;
+	if (buf && buflen > 0)
+	{
+		SQLINTEGER	n = len < buflen ? len : buflen - 1;
+
+		memcpy(buf, s, n);
+		((char *) buf)[n] = '\0';
+	}
+	if (buf && len >= buflen)
+	{
+		diag(d, "01004", "string data, right truncation");
+		return SQL_SUCCESS_WITH_INFO;
+	}
+	return SQL_SUCCESS;
+}
+
+static SQLRETURN
+put_string_s(tdiag *d, const char *s, SQLPOINTER buf, SQLINTEGER buflen, SQLSMALLINT *outlen)
+{
+	SQLLEN		len;
+	SQLRETURN	ret = put_string(d, s, buf, buflen, &len);
+
+	if (outlen)
+		*outlen = len;
+	return ret;
+}
+
+static void
+start_call(tstmt *stmt)
+{
+	stmt->diag.set = false;
+	stmt->warning = false;
+}
+
+static void
+free_stmt(tstmt *stmt)
+{
+	close_cursor(stmt);
+	afree(&stmt->parse);
+	free(stmt->binds);
+	free(stmt->params);
+	free(stmt->rowset);
+	free(stmt->scratch);
+	free(stmt);
+}
+
+/* Handles */
+SQLRETURN SQL_API
+SQLAllocHandle(SQLSMALLINT HandleType, SQLHANDLE InputHandle, SQLHANDLE *OutputHandle)
+{
+	if (OutputHandle == NULL)
+		return SQL_ERROR;
+	*OutputHandle = SQL_NULL_HANDLE;
+	switch (HandleType)
+	{
+		case SQL_HANDLE_ENV:
+			{
+				tenv	   *env = xmalloc(sizeof(tenv));
+
+				memset(env, 0, sizeof(tenv));
+				env->version = SQL_OV_ODBC3;
+				*OutputHandle = env;
+				return SQL_SUCCESS;
+			}
+		case SQL_HANDLE_DBC:
+			{
+				tconn	   *conn = xmalloc(sizeof(tconn));
+
+				memset(conn, 0, sizeof(tconn));
+				conn->env = InputHandle;
+				conn->autocommit = true;
+				*OutputHandle = conn;
+				return SQL_SUCCESS;
+			}
+		case SQL_HANDLE_STMT:
+			{
+				tconn	   *conn = InputHandle;
+				tstmt	   *stmt;
+
+				if (!conn->connected)
+				{
+					diag(&conn->diag, "08003", "connection not open");
+					return SQL_ERROR;
+				}
+				stmt = xmalloc(sizeof(tstmt));
+				memset(stmt, 0, sizeof(tstmt));
+				stmt->conn = conn;
+				stmt->ard.kind = D_ARD;
+				stmt->apd.kind = D_APD;
+				stmt->ird.kind = D_IRD;
+				stmt->ipd.kind = D_IPD;
+				stmt->ard.stmt = stmt->apd.stmt = stmt->ird.stmt = stmt->ipd.stmt = stmt;
+				stmt->row_array_size = 1;
+				stmt->paramset_size = 1;
+				*OutputHandle = stmt;
+				return SQL_SUCCESS;
+			}
+		case SQL_HANDLE_DESC:
+			diag(&((tconn *) InputHandle)->diag, "HYC00",
+				 "explicit descriptors are not supported");
+			return SQL_ERROR;
+	}
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLFreeHandle(SQLSMALLINT HandleType, SQLHANDLE Handle)
+{
+	if (Handle == SQL_NULL_HANDLE)
+		return SQL_INVALID_HANDLE;
+	switch (HandleType)
+	{
+		case SQL_HANDLE_ENV:
+			free(Handle);
+			return SQL_SUCCESS;
+		case SQL_HANDLE_DBC:
+			{
+				tconn	   *conn = Handle;
+
+				if (conn->undo)
+					end_transaction(conn, false);
+				free(conn);
+				return SQL_SUCCESS;
+			}
+		case SQL_HANDLE_STMT:
+			free_stmt(Handle);
+			return SQL_SUCCESS;
+	}
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLFreeStmt(SQLHSTMT StatementHandle, SQLUSMALLINT Option)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	switch (Option)
+	{
+		case SQL_CLOSE:
+			stmt->state = S_IDLE;
+			close_cursor(stmt);
+			break;
+		case SQL_DROP:
+			free_stmt(stmt);
+			break;
+		case SQL_UNBIND:
+			free(stmt->binds);
+			stmt->binds = NULL;
+			stmt->nbinds = 0;
+			break;
+		case SQL_RESET_PARAMS:
+			free(stmt->params);
+			stmt->params = NULL;
+			stmt->nparams = 0;
+			break;
+		default:
+			diag(&stmt->diag, "HY092", "invalid option %d", Option);
+			return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLSetEnvAttr(SQLHENV EnvironmentHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+			  SQLINTEGER StringLength)
+{
+	tenv	   *env = EnvironmentHandle;
+
+	env->diag.set = false;
+	switch (Attribute)
+	{
+		case SQL_ATTR_ODBC_VERSION:
+			env->version = (SQLINTEGER) (SQLLEN) Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_CONNECTION_POOLING:
+		case SQL_ATTR_CP_MATCH:
+		case SQL_ATTR_OUTPUT_NTS:
+			return SQL_SUCCESS;
+	}
+	diag(&env->diag, "HY092", "invalid attribute %d", (int) Attribute);
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLGetEnvAttr(SQLHENV EnvironmentHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+			  SQLINTEGER BufferLength, SQLINTEGER *StringLength)
+{
+	tenv	   *env = EnvironmentHandle;
+
+	env->diag.set = false;
+	switch (Attribute)
+	{
+		case SQL_ATTR_ODBC_VERSION:
+			*(SQLINTEGER *) Value = env->version;
+			return SQL_SUCCESS;
+		case SQL_ATTR_CONNECTION_POOLING:
+			*(SQLUINTEGER *) Value = SQL_CP_OFF;
+			return SQL_SUCCESS;
+		case SQL_ATTR_CP_MATCH:
+			*(SQLUINTEGER *) Value = SQL_CP_STRICT_MATCH;
+			return SQL_SUCCESS;
+		case SQL_ATTR_OUTPUT_NTS:
+			*(SQLINTEGER *) Value = SQL_TRUE;
+			return SQL_SUCCESS;
+	}
+	diag(&env->diag, "HY092", "invalid attribute %d", (int) Attribute);
+	return SQL_ERROR;
+}
+
+/* Connections */
+
+/* The value of key in a connection string, false if it is not there */
+static bool
+connstr_value(const char *connstr, const char *key, char *buf, int buflen)
+{
+	const char *p = connstr;
+	size_t		keylen = strlen(key);
+
+	while (p && *p)
+	{
+		const char *eq = strchr(p, '=');
+		const char *end;
+		const char *k = p;
+
+		if (eq == NULL)
+			break;
+		while (isspace((unsigned char) *k))
+			k++;
+		if (*++eq == '{')
+		{
+			end = strchr(++eq, '}');
+			if (end == NULL)
+				end = eq + strlen(eq);
+		}
+		else
+			end = eq + strcspn(eq, ";");
+		if (strncasecmp(k, key, keylen) == 0 &&
+			(k[keylen] == '=' || isspace((unsigned char) k[keylen])))
+		{
+			snprintf(buf, buflen, "%.*s", (int) (end - eq), eq);
+			return true;
+		}
+		p = strchr(end, ';');
+		if (p)
+			p++;
+	}
+	return false;
+}
+
+static void
+get_option(tconn *conn, const char *connstr, const char *key, const char *def,
+		   char *buf, int buflen)
+{
+	if (connstr && connstr_value(connstr, key, buf, buflen))
+		return;
+	if (conn->dsn[0])
+		SQLGetPrivateProfileString(conn->dsn, key, def, buf, buflen, "odbc.ini");
+	else
+		snprintf(buf, buflen, "%s", def);
+}
+
+static bool
+bool_option(tconn *conn, const char *connstr, const char *key, const char *def)
+{
+	char		buf[32];
+
+	get_option(conn, connstr, key, def, buf, sizeof(buf));
+	return strcasecmp(buf, "yes") == 0 || strcasecmp(buf, "true") == 0 ||
+		strcasecmp(buf, "on") == 0 || strcmp(buf, "1") == 0;
+}
+
+static SQLRETURN
+open_connection(tconn *conn, const char *connstr)
+{
+	char		buf[32];
+
+	if (conn->connected)
+	{
+		diag(&conn->diag, "08002", "connection name in use");
+		return SQL_ERROR;
+	}
+	conn->async = bool_option(conn, connstr, "Async", "yes");
+	conn->no_total = bool_option(conn, connstr, "NoTotal", "no");
+	conn->param_arrays = bool_option(conn, connstr, "ParamArrays", "yes");
+	conn->savepoints = bool_option(conn, connstr, "Savepoints", "yes");
+	get_option(conn, connstr, "GetDataExtensions", "15", buf, sizeof(buf));
+	conn->getdata_ext = strtoul(buf, NULL, 0);
+	get_option(conn, connstr, "MaxRowArraySize", "0", buf, sizeof(buf));
+	conn->max_rowset = strtoul(buf, NULL, 0);
+	conn->connected = true;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLConnect(SQLHDBC ConnectionHandle, SQLCHAR *ServerName, SQLSMALLINT NameLength1,
+		   SQLCHAR *UserName, SQLSMALLINT NameLength2,
+		   SQLCHAR *Authentication, SQLSMALLINT NameLength3)
+{
+	tconn	   *conn = ConnectionHandle;
+	int			len = NameLength1 == SQL_NTS ? (int) strlen((char *) ServerName) : NameLength1;
+
+	conn->diag.set = false;
+	snprintf(conn->dsn, sizeof(conn->dsn), "%.*s", len, (char *) ServerName);
+	return open_connection(conn, NULL);
+}
+
+SQLRETURN SQL_API
+SQLDriverConnect(SQLHDBC ConnectionHandle, SQLHWND WindowHandle,
+				 SQLCHAR *InConnectionString, SQLSMALLINT StringLength1,
+				 SQLCHAR *OutConnectionString, SQLSMALLINT BufferLength,
+				 SQLSMALLINT *StringLength2Ptr, SQLUSMALLINT DriverCompletion)
+{
+	tconn	   *conn = ConnectionHandle;
+	int			len = StringLength1 == SQL_NTS ?
+		(int) strlen((char *) InConnectionString) : StringLength1;
+	char	   *connstr = xmalloc(len + 1);
+	SQLRETURN	ret;
+
+	conn->diag.set = false;
+	memcpy(connstr, InConnectionString, len);
+	connstr[len] = '\0';
+	if (!connstr_value(connstr, "DSN", conn->dsn, sizeof(conn->dsn)))
+		conn->dsn[0] = '\0';
+	ret = open_connection(conn, connstr);
+	if (ret == SQL_SUCCESS && (OutConnectionString || StringLength2Ptr))
+		ret = put_string_s(&conn->diag, connstr, OutConnectionString, BufferLength,
+						   StringLength2Ptr);
+	free(connstr);
+	return ret;
+}
+
+SQLRETURN SQL_API
+SQLDisconnect(SQLHDBC ConnectionHandle)
+{
+	tconn	   *conn = ConnectionHandle;
+
+	conn->diag.set = false;
+	if (conn->undo && !conn->autocommit)
+	{
+		diag(&conn->diag, "25000", "invalid transaction state");
+		return SQL_ERROR;
+	}
+	if (conn->undo)
+		end_transaction(conn, true);
+	conn->connected = false;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLGetInfo(SQLHDBC ConnectionHandle, SQLUSMALLINT InfoType, SQLPOINTER InfoValue,
+		   SQLSMALLINT BufferLength, SQLSMALLINT *StringLength)
+{
+	tconn	   *conn = ConnectionHandle;
+	const char *s = NULL;
+	SQLUINTEGER u = 0;
+	SQLUSMALLINT us = 0;
+	bool		small = false;
+
+	conn->diag.set = false;
+	switch (InfoType)
+	{
+		case SQL_DRIVER_NAME:
+			s = DRIVER_NAME ".so";
+			break;
+		case SQL_DRIVER_VER:
+		case SQL_DBMS_VER:
+			s = "01.00.0000";
+			break;
+		case SQL_DRIVER_ODBC_VER:
+			s = "03.52";
+			break;
+		case SQL_DBMS_NAME:
+			s = DRIVER_NAME;
+			break;
+		case SQL_DATA_SOURCE_NAME:
+			s = conn->dsn;
+			break;
+		case SQL_SERVER_NAME:
+		case SQL_DATABASE_NAME:
+		case SQL_USER_NAME:
+			s = "";
+			break;
+		case SQL_IDENTIFIER_QUOTE_CHAR:
+			s = "\"";
+			break;
+		case SQL_DATA_SOURCE_READ_ONLY:
+		case SQL_NEED_LONG_DATA_LEN:
+		case SQL_ROW_UPDATES:
+			s = "N";
+			break;
+		case SQL_GETDATA_EXTENSIONS:
+			u = conn->getdata_ext;
+			break;
+		case SQL_SQL92_PREDICATES:
+			u = SQL_SP_COMPARISON | SQL_SP_LIKE | SQL_SP_IN | SQL_SP_BETWEEN |
+				SQL_SP_ISNULL | SQL_SP_ISNOTNULL;
+			break;
+		case SQL_ASYNC_MODE:
+			u = conn->async ? SQL_AM_STATEMENT : SQL_AM_NONE;
+			break;
+		case SQL_PARAM_ARRAY_ROW_COUNTS:
+			u = SQL_PARC_BATCH;
+			break;
+		case SQL_PARAM_ARRAY_SELECTS:
+			u = SQL_PAS_NO_SELECT;
+			break;
+		case SQL_SCROLL_OPTIONS:
+			u = SQL_SO_FORWARD_ONLY;
+			break;
+		case SQL_DEFAULT_TXN_ISOLATION:
+		case SQL_TXN_ISOLATION_OPTION:
+			u = SQL_TXN_READ_COMMITTED;
+			break;
+		case SQL_TXN_CAPABLE:
+			small = true;
+			us = SQL_TC_ALL;
+			break;
+		case SQL_CURSOR_COMMIT_BEHAVIOR:
+		case SQL_CURSOR_ROLLBACK_BEHAVIOR:
+			small = true;
+			us = SQL_CB_PRESERVE;
+			break;
+		case SQL_IDENTIFIER_CASE:
+			small = true;
+			us = SQL_IC_LOWER;
+			break;
+		case SQL_QUOTED_IDENTIFIER_CASE:
+			small = true;
+			us = SQL_IC_SENSITIVE;
+			break;
+		case SQL_MAX_CONCURRENT_ACTIVITIES:
+		case SQL_MAX_DRIVER_CONNECTIONS:
+			small = true;
+			us = 0;
+			break;
+		case SQL_MAX_COLUMN_NAME_LEN:
+		case SQL_MAX_TABLE_NAME_LEN:
+			small = true;
+			us = NAMELEN - 1;
+			break;
+		default:
+			diag(&conn->diag, "HY096", "information type %d out of range", InfoType);
+			return SQL_ERROR;
+	}
+	if (s)
+		return put_string_s(&conn->diag, s, InfoValue, BufferLength, StringLength);
+	if (small)
+	{
+		if (InfoValue)
+			*(SQLUSMALLINT *) InfoValue = us;
+		if (StringLength)
+			*StringLength = sizeof(SQLUSMALLINT);
+	}
+	else
+	{
+		if (InfoValue)
+			*(SQLUINTEGER *) InfoValue = u;
+		if (StringLength)
+			*StringLength = sizeof(SQLUINTEGER);
+	}
+	return SQL_SUCCESS;
+}
+
+static const SQLUSMALLINT supported_functions[] = {
+	SQL_API_SQLALLOCHANDLE, SQL_API_SQLBINDCOL, SQL_API_SQLBINDPARAMETER,
+	SQL_API_SQLCANCEL, SQL_API_SQLCLOSECURSOR, SQL_API_SQLCOLATTRIBUTE,
+	SQL_API_SQLCONNECT, SQL_API_SQLDESCRIBECOL, SQL_API_SQLDESCRIBEPARAM,
+	SQL_API_SQLDISCONNECT, SQL_API_SQLDRIVERCONNECT, SQL_API_SQLENDTRAN,
+	SQL_API_SQLEXECDIRECT, SQL_API_SQLEXECUTE, SQL_API_SQLFETCH,
+	SQL_API_SQLFETCHSCROLL, SQL_API_SQLFREEHANDLE, SQL_API_SQLFREESTMT,
+	SQL_API_SQLGETCONNECTATTR, SQL_API_SQLGETDATA, SQL_API_SQLGETDESCFIELD,
+	SQL_API_SQLGETDIAGFIELD, SQL_API_SQLGETDIAGREC, SQL_API_SQLGETENVATTR,
+	SQL_API_SQLGETFUNCTIONS, SQL_API_SQLGETINFO, SQL_API_SQLGETSTMTATTR,
+	SQL_API_SQLMORERESULTS, SQL_API_SQLNUMPARAMS, SQL_API_SQLNUMRESULTCOLS,
+	SQL_API_SQLPREPARE, SQL_API_SQLROWCOUNT, SQL_API_SQLSETCONNECTATTR,
+	SQL_API_SQLSETDESCFIELD, SQL_API_SQLSETENVATTR, SQL_API_SQLSETPOS,
+	SQL_API_SQLSETSTMTATTR
+};
+
+#define NFUNCTIONS (int) (sizeof(supported_functions) / sizeof(supported_functions[0]))
+
+SQLRETURN SQL_API
+SQLGetFunctions(SQLHDBC ConnectionHandle, SQLUSMALLINT FunctionId, SQLUSMALLINT *Supported)
+{
+	tconn	   *conn = ConnectionHandle;
+	int			k;
+
+	conn->diag.set = false;
+	if (FunctionId == SQL_API_ODBC3_ALL_FUNCTIONS)
+	{
+		memset(Supported, 0, SQL_API_ODBC3_ALL_FUNCTIONS_SIZE * sizeof(SQLUSMALLINT));
+		for (k = 0; k < NFUNCTIONS; k++)
+			Supported[supported_functions[k] >> 4] |= 1 << (supported_functions[k] & 0xf);
+		return SQL_SUCCESS;
+	}
+	if (FunctionId == SQL_API_ALL_FUNCTIONS)
+	{
+		memset(Supported, 0, 100 * sizeof(SQLUSMALLINT));
+		for (k = 0; k < NFUNCTIONS; k++)
+			if (supported_functions[k] < 100)
+				Supported[supported_functions[k]] = SQL_TRUE;
+		return SQL_SUCCESS;
+	}
+	*Supported = SQL_FALSE;
+	for (k = 0; k < NFUNCTIONS; k++)
+		if (supported_functions[k] == FunctionId)
+			*Supported = SQL_TRUE;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLSetConnectAttr(SQLHDBC ConnectionHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+				  SQLINTEGER StringLength)
+{
+	tconn	   *conn = ConnectionHandle;
+
+	conn->diag.set = false;
+	switch (Attribute)
+	{
+		case SQL_ATTR_AUTOCOMMIT:
+			conn->autocommit = (SQLULEN) Value == SQL_AUTOCOMMIT_ON;
+			/* switching it on commits */
+			if (conn->autocommit && conn->undo)
+				end_transaction(conn, true);
+			return SQL_SUCCESS;
+		case SQL_ATTR_LOGIN_TIMEOUT:
+		case SQL_ATTR_CONNECTION_TIMEOUT:
+			conn->login_timeout = (SQLULEN) Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_TXN_ISOLATION:
+		case SQL_ATTR_ACCESS_MODE:
+			return SQL_SUCCESS;
+	}
+	diag(&conn->diag, "HY092", "invalid attribute %d", (int) Attribute);
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLGetConnectAttr(SQLHDBC ConnectionHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+				  SQLINTEGER BufferLength, SQLINTEGER *StringLength)
+{
+	tconn	   *conn = ConnectionHandle;
+	SQLUINTEGER u;
+
+	conn->diag.set = false;
+	switch (Attribute)
+	{
+		case SQL_ATTR_AUTOCOMMIT:
+			u = conn->autocommit ? SQL_AUTOCOMMIT_ON : SQL_AUTOCOMMIT_OFF;
+			break;
+		case SQL_ATTR_CONNECTION_DEAD:
+			u = conn->connected ? SQL_CD_FALSE : SQL_CD_TRUE;
+			break;
+		case SQL_ATTR_LOGIN_TIMEOUT:
+		case SQL_ATTR_CONNECTION_TIMEOUT:
+			u = conn->login_timeout;
+			break;
+		case SQL_ATTR_TXN_ISOLATION:
+			u = SQL_TXN_READ_COMMITTED;
+			break;
+		case SQL_ATTR_ACCESS_MODE:
+			u = SQL_MODE_READ_WRITE;
+			break;
+		default:
+			diag(&conn->diag, "HY092", "invalid attribute %d", (int) Attribute);
+			return SQL_ERROR;
+	}
+	*(SQLUINTEGER *) Value = u;
+	if (StringLength)
+		*StringLength = sizeof(SQLUINTEGER);
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLEndTran(SQLSMALLINT HandleType, SQLHANDLE Handle, SQLSMALLINT CompletionType)
+{
+	tconn	   *conn = Handle;
+
+	if (HandleType != SQL_HANDLE_DBC)
+		return SQL_SUCCESS;
+	conn->diag.set = false;
+	end_transaction(conn, CompletionType == SQL_COMMIT);
+	return SQL_SUCCESS;
+}
+
+/* Statements */
+SQLRETURN SQL_API
+SQLSetStmtAttr(SQLHSTMT StatementHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+			   SQLINTEGER StringLength)
+{
+	tstmt	   *stmt = StatementHandle;
+	SQLULEN		u = (SQLULEN) Value;
+
+	start_call(stmt);
+	switch (Attribute)
+	{
+		case SQL_ATTR_ROW_ARRAY_SIZE:
+		case SQL_ROWSET_SIZE:
+			if (u == 0)
+				break;
+			if (stmt->conn->max_rowset && u > stmt->conn->max_rowset)
+			{
+				stmt->row_array_size = stmt->conn->max_rowset;
+				diag(&stmt->diag, "01S02", "option value changed to %lu",
+					 (unsigned long) stmt->row_array_size);
+				return SQL_SUCCESS_WITH_INFO;
+			}
+			stmt->row_array_size = u;
+			return SQL_SUCCESS;
+		case SQL_ATTR_ROWS_FETCHED_PTR:
+			stmt->rows_fetched = Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_ROW_STATUS_PTR:
+			stmt->row_status = Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_ROW_BIND_OFFSET_PTR:
+			stmt->bind_offset = Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_ROW_BIND_TYPE:
+		case SQL_ATTR_PARAM_BIND_TYPE:
+			if (u != SQL_BIND_BY_COLUMN)
+			{
+				diag(&stmt->diag, "HYC00", "only column-wise binding is supported");
+				return SQL_ERROR;
+			}
+			return SQL_SUCCESS;
+		case SQL_ATTR_PARAMSET_SIZE:
+			if (u == 0)
+				break;
+			if (u > 1 && !stmt->conn->param_arrays)
+			{
+				diag(&stmt->diag, "HYC00", "arrays of parameters are not supported");
+				return SQL_ERROR;
+			}
+			stmt->paramset_size = u;
+			return SQL_SUCCESS;
+		case SQL_ATTR_PARAMS_PROCESSED_PTR:
+			stmt->params_processed = Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_PARAM_STATUS_PTR:
+			stmt->param_status = Value;
+			return SQL_SUCCESS;
+		case SQL_ATTR_ASYNC_ENABLE:
+			if (u == SQL_ASYNC_ENABLE_ON && !stmt->conn->async)
+			{
+				diag(&stmt->diag, "HYC00", "asynchronous execution is not supported");
+				return SQL_ERROR;
+			}
+			stmt->async = u == SQL_ASYNC_ENABLE_ON;
+			return SQL_SUCCESS;
+		case SQL_ATTR_QUERY_TIMEOUT:
+			stmt->query_timeout = u;
+			return SQL_SUCCESS;
+		case SQL_ATTR_CURSOR_TYPE:
+			if (u != SQL_CURSOR_FORWARD_ONLY)
+			{
+				diag(&stmt->diag, "01S02", "option value changed to forward only");
+				return SQL_SUCCESS_WITH_INFO;
+			}
+			return SQL_SUCCESS;
+		case SQL_ATTR_CONCURRENCY:
+		case SQL_ATTR_NOSCAN:
+		case SQL_ATTR_MAX_LENGTH:
+		case SQL_ATTR_RETRIEVE_DATA:
+		case SQL_ATTR_USE_BOOKMARKS:
+			return SQL_SUCCESS;
+		default:
+			diag(&stmt->diag, "HY092", "invalid attribute %d", (int) Attribute);
+			return SQL_ERROR;
+	}
+	diag(&stmt->diag, "HY024", "invalid attribute value");
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLGetStmtAttr(SQLHSTMT StatementHandle, SQLINTEGER Attribute, SQLPOINTER Value,
+			   SQLINTEGER BufferLength, SQLINTEGER *StringLength)
+{
+	tstmt	   *stmt = StatementHandle;
+	SQLPOINTER	p;
+	SQLULEN		u;
+
+	start_call(stmt);
+	switch (Attribute)
+	{
+		case SQL_ATTR_APP_ROW_DESC:
+			p = &stmt->ard;
+			break;
+		case SQL_ATTR_APP_PARAM_DESC:
+			p = &stmt->apd;
+			break;
+		case SQL_ATTR_IMP_ROW_DESC:
+			p = &stmt->ird;
+			break;
+		case SQL_ATTR_IMP_PARAM_DESC:
+			p = &stmt->ipd;
+			break;
+		case SQL_ATTR_ROWS_FETCHED_PTR:
+			p = stmt->rows_fetched;
+			break;
+		case SQL_ATTR_ROW_STATUS_PTR:
+			p = stmt->row_status;
+			break;
+		case SQL_ATTR_ROW_BIND_OFFSET_PTR:
+			p = stmt->bind_offset;
+			break;
+		case SQL_ATTR_PARAMS_PROCESSED_PTR:
+			p = stmt->params_processed;
+			break;
+		case SQL_ATTR_PARAM_STATUS_PTR:
+			p = stmt->param_status;
+			break;
+		default:
+			switch (Attribute)
+			{
+				case SQL_ATTR_ROW_ARRAY_SIZE:
+				case SQL_ROWSET_SIZE:
+					u = stmt->row_array_size;
+					break;
+				case SQL_ATTR_PARAMSET_SIZE:
+					u = stmt->paramset_size;
+					break;
+				case SQL_ATTR_ASYNC_ENABLE:
+					u = stmt->async ? SQL_ASYNC_ENABLE_ON : SQL_ASYNC_ENABLE_OFF;
+					break;
+				case SQL_ATTR_QUERY_TIMEOUT:
+					u = stmt->query_timeout;
+					break;
+				case SQL_ATTR_ROW_BIND_TYPE:
+				case SQL_ATTR_PARAM_BIND_TYPE:
+					u = SQL_BIND_BY_COLUMN;
+					break;
+				case SQL_ATTR_CURSOR_TYPE:
+					u = SQL_CURSOR_FORWARD_ONLY;
+					break;
+				case SQL_ATTR_CONCURRENCY:
+					u = SQL_CONCUR_READ_ONLY;
+					break;
+				case SQL_ATTR_ROW_NUMBER:
+					u = stmt->pos + 1;
+					break;
+				default:
+					diag(&stmt->diag, "HY092", "invalid attribute %d", (int) Attribute);
+					return SQL_ERROR;
+			}
+			*(SQLULEN *) Value = u;
+			if (StringLength)
+				*StringLength = sizeof(SQLULEN);
+			return SQL_SUCCESS;
+	}
+	*(SQLPOINTER *) Value = p;
+	if (StringLength)
+		*StringLength = sizeof(SQLPOINTER);
+	return SQL_SUCCESS;
+}
+
+/* The ARD record of column, allocated on demand */
+static tbind *
+get_bind(tstmt *stmt, int column)
+{
+	if (column >= stmt->nbinds)
+	{
+		int			n = column + 16;
+
+		stmt->binds = xrealloc(stmt->binds, n * sizeof(tbind));
+		memset(stmt->binds + stmt->nbinds, 0, (n - stmt->nbinds) * sizeof(tbind));
+		stmt->nbinds = n;
+	}
+	return &stmt->binds[column];
+}
+
+SQLRETURN SQL_API
+SQLSetDescField(SQLHDESC DescriptorHandle, SQLSMALLINT RecNumber, SQLSMALLINT FieldIdentifier,
+				SQLPOINTER Value, SQLINTEGER BufferLength)
+{
+	tdesc	   *desc = DescriptorHandle;
+	tstmt	   *stmt = desc->stmt;
+	tbind	   *b;
+
+	desc->diag.set = false;
+	if (desc->kind == D_IRD)
+	{
+		diag(&desc->diag, "HY016", "cannot modify an implementation row descriptor");
+		return SQL_ERROR;
+	}
+	if (desc->kind != D_ARD)
+		return SQL_SUCCESS;
+	switch (FieldIdentifier)
+	{
+		case SQL_DESC_ARRAY_SIZE:
+			stmt->row_array_size = (SQLULEN) Value;
+			return SQL_SUCCESS;
+		case SQL_DESC_BIND_OFFSET_PTR:
+			stmt->bind_offset = Value;
+			return SQL_SUCCESS;
+		case SQL_DESC_ARRAY_STATUS_PTR:
+			stmt->row_status = Value;
+			return SQL_SUCCESS;
+		case SQL_DESC_BIND_TYPE:
+			return SQL_SUCCESS;
+		case SQL_DESC_COUNT:
+			if ((SQLLEN) Value < stmt->nbinds)
+			{
+				int			k;
+
+				for (k = (SQLLEN) Value + 1; k < stmt->nbinds; k++)
+					memset(&stmt->binds[k], 0, sizeof(tbind));
+			}
+			return SQL_SUCCESS;
+	}
+	if (RecNumber < 1)
+	{
+		diag(&desc->diag, "07009", "invalid descriptor index");
+		return SQL_ERROR;
+	}
+	b = get_bind(stmt, RecNumber);
+	switch (FieldIdentifier)
+	{
+		/* all but the deferred fields unbind the record */
+		case SQL_DESC_TYPE:
+		case SQL_DESC_CONCISE_TYPE:
+			b->ctype = (SQLSMALLINT) (SQLLEN) Value;
+			b->ptr = NULL;
+			break;
+		case SQL_DESC_PRECISION:
+			b->precision = (SQLSMALLINT) (SQLLEN) Value;
+			b->ptr = NULL;
+			break;
+		case SQL_DESC_SCALE:
+			b->scale = (SQLSMALLINT) (SQLLEN) Value;
+			b->ptr = NULL;
+			break;
+		case SQL_DESC_OCTET_LENGTH:
+			b->buflen = (SQLLEN) Value;
+			b->ptr = NULL;
+			break;
+		case SQL_DESC_DATA_PTR:
+			b->ptr = Value;
+			break;
+		case SQL_DESC_INDICATOR_PTR:
+		case SQL_DESC_OCTET_LENGTH_PTR:
+			b->ind = Value;
+			break;
+		default:
+			diag(&desc->diag, "HY091", "invalid descriptor field %d", FieldIdentifier);
+			return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLGetDescField(SQLHDESC DescriptorHandle, SQLSMALLINT RecNumber, SQLSMALLINT FieldIdentifier,
+				SQLPOINTER Value, SQLINTEGER BufferLength, SQLINTEGER *StringLength)
+{
+	tdesc	   *desc = DescriptorHandle;
+	tstmt	   *stmt = desc->stmt;
+	tbind	   *b;
+
+	desc->diag.set = false;
+	if (FieldIdentifier == SQL_DESC_COUNT)
+	{
+		SQLSMALLINT n = 0;
+
+		if (desc->kind == D_IRD)
+			n = stmt->ncols;
+		else if (desc->kind == D_ARD)
+		{
+			for (n = stmt->nbinds - 1; n > 0; n--)
+				if (stmt->binds[n].ptr)
+					break;
+		}
+		*(SQLSMALLINT *) Value = n;
+		return SQL_SUCCESS;
+	}
+	if (desc->kind != D_ARD || RecNumber < 1)
+	{
+		diag(&desc->diag, "HY091", "invalid descriptor field %d", FieldIdentifier);
+		return SQL_ERROR;
+	}
+	b = get_bind(stmt, RecNumber);
+	switch (FieldIdentifier)
+	{
+		case SQL_DESC_TYPE:
+		case SQL_DESC_CONCISE_TYPE:
+			*(SQLSMALLINT *) Value = b->ctype;
+			break;
+		case SQL_DESC_PRECISION:
+			*(SQLSMALLINT *) Value = b->precision;
+			break;
+		case SQL_DESC_SCALE:
+			*(SQLSMALLINT *) Value = b->scale;
+			break;
+		case SQL_DESC_OCTET_LENGTH:
+			*(SQLLEN *) Value = b->buflen;
+			break;
+		case SQL_DESC_DATA_PTR:
+			*(SQLPOINTER *) Value = b->ptr;
+			break;
+		case SQL_DESC_INDICATOR_PTR:
+		case SQL_DESC_OCTET_LENGTH_PTR:
+			*(SQLPOINTER *) Value = b->ind;
+			break;
+		default:
+			diag(&desc->diag, "HY091", "invalid descriptor field %d", FieldIdentifier);
+			return SQL_ERROR;
+	}
+	return SQL_SUCCESS;
+}
+
+/* Parse the statement text into stmt->query */
+static void
+prepare_text(tstmt *stmt, SQLCHAR *text, SQLINTEGER len)
+{
+	char	   *sql;
+
+	if (stmt->state == S_EXECUTING)
+		stmt_error(stmt, "HY010", "function sequence error");
+	close_cursor(stmt);
+	stmt->query = NULL;
+	afree(&stmt->parse);
+	if (len == SQL_NTS)
+		len = strlen((char *) text);
+	sql = astrndup(&stmt->parse, (char *) text, len);
+	stmt->query = parse_statement(stmt, sql);
+	stmt->query->delay = query_delay(stmt->query);
+}
+
+/* An error of an execution; an autocommit keeps the parameter sets done */
+static SQLRETURN
+exec_failed(tstmt *stmt)
+{
+	tconn	   *conn = stmt->conn;
+
+	if (conn->autocommit && conn->undo)
+		end_transaction(conn, true);
+	return SQL_ERROR;
+}
+
+SQLRETURN SQL_API
+SQLPrepare(SQLHSTMT StatementHandle, SQLCHAR *StatementText, SQLINTEGER TextLength)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (setjmp(stmt->jump))
+		return SQL_ERROR;
+	prepare_text(stmt, StatementText, TextLength);
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLExecute(SQLHSTMT StatementHandle)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (setjmp(stmt->jump))
+		return exec_failed(stmt);
+	if (stmt->query == NULL)
+		stmt_error(stmt, "HY010", "function sequence error");
+	return run_statement(stmt);
+}
+
+SQLRETURN SQL_API
+SQLExecDirect(SQLHSTMT StatementHandle, SQLCHAR *StatementText, SQLINTEGER TextLength)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (setjmp(stmt->jump))
+		return exec_failed(stmt);
+	/* the same call again polls an asynchronous execution */
+	if (stmt->state != S_EXECUTING)
+		prepare_text(stmt, StatementText, TextLength);
+	return run_statement(stmt);
+}
+
+SQLRETURN SQL_API
+SQLCancel(SQLHSTMT StatementHandle)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	/* may come from another thread, the flag is all it touches */
+	__atomic_store_n(&stmt->cancelled, 1, __ATOMIC_SEQ_CST);
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLNumParams(SQLHSTMT StatementHandle, SQLSMALLINT *ParameterCount)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (stmt->query == NULL)
+	{
+		diag(&stmt->diag, "HY010", "function sequence error");
+		return SQL_ERROR;
+	}
+	*ParameterCount = stmt->query->nparams;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLDescribeParam(SQLHSTMT StatementHandle, SQLUSMALLINT ParameterNumber,
+				 SQLSMALLINT *DataTypePtr, SQLULEN *ParameterSizePtr,
+				 SQLSMALLINT *DecimalDigitsPtr, SQLSMALLINT *NullablePtr)
+{
+	tstmt	   *stmt = StatementHandle;
+	tquery	   *q = stmt->query;
+	tcolumn		col;
+	int			r,
+				k;
+
+	start_call(stmt);
+	if (q == NULL)
+	{
+		diag(&stmt->diag, "HY010", "function sequence error");
+		return SQL_ERROR;
+	}
+	if (ParameterNumber < 1 || ParameterNumber > q->nparams)
+	{
+		diag(&stmt->diag, "07009", "invalid descriptor index");
+		return SQL_ERROR;
+	}
+	memset(&col, 0, sizeof(col));
+	set_column(&col, SQL_VARCHAR, 255, 0);
+	/* a parameter that is a value of an INSERT has the type of its column */
+	for (r = 0; q->kind == Q_INSERT && r < q->nrows; r++)
+		for (k = 0; k < q->ncols; k++)
+		{
+			texpr	   *e = q->values[r][k];
+			ttable	   *t;
+			int			i = k;
+
+			if (e->kind != E_PARAM || e->index != ParameterNumber - 1)
+				continue;
+			pthread_mutex_lock(&tables_lock);
+			t = find_table(q->table);
+			if (t && q->cols)
+				for (i = 0; i < t->ncols; i++)
+					if (strcmp(t->cols[i].name, q->cols[k]) == 0)
+						break;
+			if (t && i < t->ncols)
+				col = t->cols[i];
+			pthread_mutex_unlock(&tables_lock);
+		}
+	if (DataTypePtr)
+		*DataTypePtr = app_type(stmt, col.type);
+	if (ParameterSizePtr)
+		*ParameterSizePtr = col.size;
+	if (DecimalDigitsPtr)
+		*DecimalDigitsPtr = col.digits;
+	if (NullablePtr)
+		*NullablePtr = SQL_NULLABLE;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLBindParameter(SQLHSTMT StatementHandle, SQLUSMALLINT ParameterNumber,
+				 SQLSMALLINT InputOutputType, SQLSMALLINT ValueType,
+				 SQLSMALLINT ParameterType, SQLULEN ColumnSize,
+				 SQLSMALLINT DecimalDigits, SQLPOINTER ParameterValuePtr,
+				 SQLLEN BufferLength, SQLLEN *StrLen_or_IndPtr)
+{
+	tstmt	   *stmt = StatementHandle;
+	tparam	   *p;
+
+	start_call(stmt);
+	if (ParameterNumber < 1)
+	{
+		diag(&stmt->diag, "07009", "invalid descriptor index");
+		return SQL_ERROR;
+	}
+	if (InputOutputType != SQL_PARAM_INPUT)
+	{
+		diag(&stmt->diag, "HYC00", "only input parameters are supported");
+		return SQL_ERROR;
+	}
+	if (ParameterNumber > stmt->nparams)
+	{
+		int			n = ParameterNumber + 16;
+
+		stmt->params = xrealloc(stmt->params, n * sizeof(tparam));
+		memset(stmt->params + stmt->nparams, 0, (n - stmt->nparams) * sizeof(tparam));
+		stmt->nparams = n;
+	}
+	p = &stmt->params[ParameterNumber - 1];
+	/* dates and times of ODBC 2 are the same */
+	if (ParameterType == SQL_DATE)
+		ParameterType = SQL_TYPE_DATE;
+	else if (ParameterType == SQL_TIME)
+		ParameterType = SQL_TYPE_TIME;
+	else if (ParameterType == SQL_TIMESTAMP)
+		ParameterType = SQL_TYPE_TIMESTAMP;
+	p->ctype = ValueType == SQL_C_DEFAULT ? default_ctype(ParameterType) : ValueType;
+	p->sqltype = ParameterType;
+	p->size = ColumnSize;
+	p->digits = DecimalDigits;
+	p->ptr = ParameterValuePtr;
+	p->buflen = BufferLength;
+	p->ind = StrLen_or_IndPtr;
+	return SQL_SUCCESS;
+}
+
+/* Results */
+SQLRETURN SQL_API
+SQLNumResultCols(SQLHSTMT StatementHandle, SQLSMALLINT *ColumnCount)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	*ColumnCount = stmt->ncols;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLDescribeCol(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber,
+			   SQLCHAR *ColumnName, SQLSMALLINT BufferLength, SQLSMALLINT *NameLength,
+			   SQLSMALLINT *DataType, SQLULEN *ColumnSize,
+			   SQLSMALLINT *DecimalDigits, SQLSMALLINT *Nullable)
+{
+	tstmt	   *stmt = StatementHandle;
+	tcolumn    *col;
+
+	start_call(stmt);
+	if (ColumnNumber < 1 || ColumnNumber > stmt->ncols)
+	{
+		diag(&stmt->diag, "07009", "invalid descriptor index");
+		return SQL_ERROR;
+	}
+	col = &stmt->cols[ColumnNumber - 1];
+	if (DataType)
+		*DataType = app_type(stmt, col->type);
+	if (ColumnSize)
+		*ColumnSize = col->size;
+	if (DecimalDigits)
+		*DecimalDigits = col->digits;
+	if (Nullable)
+		*Nullable = SQL_NULLABLE;
+	return put_string_s(&stmt->diag, col->name, ColumnName, BufferLength, NameLength);
+}
+
+static const char *
+type_name(SQLSMALLINT type)
+{
+	int			k;
+
+	for (k = 0; types[k].name; k++)
+		if (types[k].type == type)
+			return types[k].name;
+	return "varchar";
+}
+
+SQLRETURN SQL_API
+SQLColAttribute(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber,
+				SQLUSMALLINT FieldIdentifier, SQLPOINTER CharacterAttribute,
+				SQLSMALLINT BufferLength, SQLSMALLINT *StringLength,
+				SQLLEN *NumericAttribute)
+{
+	tstmt	   *stmt = StatementHandle;
+	tcolumn    *col;
+	SQLLEN		n;
+
+	start_call(stmt);
+	if (FieldIdentifier == SQL_DESC_COUNT || FieldIdentifier == SQL_COLUMN_COUNT)
+	{
+		if (NumericAttribute)
+			*NumericAttribute = stmt->ncols;
+		return SQL_SUCCESS;
+	}
+	if (ColumnNumber < 1 || ColumnNumber > stmt->ncols)
+	{
+		diag(&stmt->diag, "07009", "invalid descriptor index");
+		return SQL_ERROR;
+	}
+	col = &stmt->cols[ColumnNumber - 1];
+	switch (FieldIdentifier)
+	{
+		case SQL_DESC_NAME:
+		case SQL_DESC_LABEL:
+		case SQL_COLUMN_NAME:
+			return put_string_s(&stmt->diag, col->name, CharacterAttribute,
+								BufferLength, StringLength);
+		case SQL_DESC_TYPE_NAME:
+			return put_string_s(&stmt->diag, type_name(col->type), CharacterAttribute,
+								BufferLength, StringLength);
+		case SQL_DESC_OCTET_LENGTH:
+			n = octet_length(col);
+			break;
+		case SQL_DESC_LENGTH:
+		case SQL_DESC_PRECISION:
+		case SQL_COLUMN_LENGTH:
+		case SQL_COLUMN_PRECISION:
+			n = col->size;
+			break;
+		case SQL_DESC_DISPLAY_SIZE:
+			n = is_numeric_type(col->type) ? col->size + 2 : col->size;
+			break;
+		case SQL_DESC_TYPE:
+		case SQL_DESC_CONCISE_TYPE:
+			n = app_type(stmt, col->type);
+			break;
+		case SQL_DESC_SCALE:
+		case SQL_COLUMN_SCALE:
+			n = col->digits;
+			break;
+		case SQL_DESC_NULLABLE:
+			n = SQL_NULLABLE;
+			break;
+		case SQL_DESC_UNSIGNED:
+			n = !is_numeric_type(col->type) && !is_float_type(col->type) &&
+				col->type != SQL_TINYINT && col->type != SQL_SMALLINT &&
+				col->type != SQL_INTEGER && col->type != SQL_BIGINT;
+			break;
+		case SQL_DESC_FIXED_PREC_SCALE:
+		case SQL_DESC_AUTO_UNIQUE_VALUE:
+			n = SQL_FALSE;
+			break;
+		case SQL_DESC_SEARCHABLE:
+			n = SQL_PRED_SEARCHABLE;
+			break;
+		case SQL_DESC_UPDATABLE:
+			n = SQL_ATTR_READONLY;
+			break;
+		default:
+			diag(&stmt->diag, "HY091", "invalid descriptor field %d", FieldIdentifier);
+			return SQL_ERROR;
+	}
+	if (NumericAttribute)
+		*NumericAttribute = n;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLBindCol(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLSMALLINT TargetType,
+		   SQLPOINTER TargetValue, SQLLEN BufferLength, SQLLEN *StrLen_or_Ind)
+{
+	tstmt	   *stmt = StatementHandle;
+	tbind	   *b;
+
+	start_call(stmt);
+	if (ColumnNumber < 1)
+	{
+		diag(&stmt->diag, "07009", "bookmark columns are not supported");
+		return SQL_ERROR;
+	}
+	b = get_bind(stmt, ColumnNumber);
+	if (TargetValue == NULL)
+	{
+		memset(b, 0, sizeof(tbind));
+		return SQL_SUCCESS;
+	}
+	b->ctype = TargetType;
+	b->ptr = TargetValue;
+	b->buflen = BufferLength;
+	b->ind = StrLen_or_Ind;
+	if (TargetType == SQL_C_NUMERIC)
+	{
+		b->precision = 38;
+		b->scale = 0;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLFetch(SQLHSTMT StatementHandle)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (setjmp(stmt->jump))
+		return SQL_ERROR;
+	return fetch_rowset(stmt);
+}
+
+SQLRETURN SQL_API
+SQLFetchScroll(SQLHSTMT StatementHandle, SQLSMALLINT FetchOrientation, SQLLEN FetchOffset)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (FetchOrientation != SQL_FETCH_NEXT)
+	{
+		diag(&stmt->diag, "HY106", "fetch type out of range");
+		return SQL_ERROR;
+	}
+	if (setjmp(stmt->jump))
+		return SQL_ERROR;
+	return fetch_rowset(stmt);
+}
+
+static SQLRETURN
+get_data(tstmt *stmt, int column, SQLSMALLINT ctype, SQLPOINTER ptr, SQLLEN buflen,
+		 SQLLEN *ind)
+{
+	SQLUINTEGER ext = stmt->conn->getdata_ext;
+	tbind	   *b = NULL;
+	int			c;
+
+	if (stmt->cursor == NULL || stmt->nrows == 0)
+		stmt_error(stmt, "24000", "invalid cursor state");
+	if (column < 1 || column > stmt->ncols)
+		stmt_error(stmt, "07009", "invalid descriptor index");
+	if (stmt->row_array_size > 1 && !(ext & SQL_GD_BLOCK))
+		stmt_error(stmt, "HYC00", "SQLGetData() needs a rowset of one row");
+	if (column < stmt->nbinds)
+		b = &stmt->binds[column];
+	if (b && b->ptr && !(ext & SQL_GD_BOUND))
+		stmt_error(stmt, "07009", "column %d is bound", column);
+	if (!(ext & SQL_GD_ANY_COLUMN))
+		for (c = column + 1; c <= stmt->ncols && c < stmt->nbinds; c++)
+			if (stmt->binds[c].ptr)
+				stmt_error(stmt, "07009", "column %d is before the bound column %d",
+						   column, c);
+	if (!(ext & SQL_GD_ANY_ORDER))
+		for (c = column + 1; c <= stmt->ncols; c++)
+			if (stmt->gd_offset[c - 1] != 0)
+				stmt_error(stmt, "07009", "column %d is before a column already read",
+						   column);
+	if (ctype == SQL_ARD_TYPE)
+	{
+		if (b == NULL || b->ctype == 0)
+			stmt_error(stmt, "07009", "column %d has no type in the ARD", column);
+		ctype = b->ctype;
+	}
+	return put_value(stmt, &stmt->rowset[stmt->pos * stmt->ncols + column - 1],
+					 &stmt->cols[column - 1], b, ctype, ptr, buflen, ind,
+					 &stmt->gd_offset[column - 1]);
+}
+
+SQLRETURN SQL_API
+SQLGetData(SQLHSTMT StatementHandle, SQLUSMALLINT ColumnNumber, SQLSMALLINT TargetType,
+		   SQLPOINTER TargetValue, SQLLEN BufferLength, SQLLEN *StrLen_or_Ind)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (setjmp(stmt->jump))
+		return SQL_ERROR;
+	return get_data(stmt, ColumnNumber, TargetType, TargetValue, BufferLength,
+					StrLen_or_Ind);
+}
+
+SQLRETURN SQL_API
+SQLSetPos(SQLHSTMT StatementHandle, SQLSETPOSIROW RowNumber, SQLUSMALLINT Operation,
+		  SQLUSMALLINT LockType)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (Operation != SQL_POSITION)
+	{
+		diag(&stmt->diag, "HYC00", "only SQL_POSITION is supported");
+		return SQL_ERROR;
+	}
+	if (stmt->cursor == NULL || stmt->nrows == 0)
+	{
+		diag(&stmt->diag, "24000", "invalid cursor state");
+		return SQL_ERROR;
+	}
+	if (RowNumber < 1 || RowNumber > (SQLSETPOSIROW) stmt->nrows)
+	{
+		diag(&stmt->diag, "HY107", "row value out of range");
+		return SQL_ERROR;
+	}
+	stmt->pos = RowNumber - 1;
+	memset(stmt->gd_offset, 0, stmt->ncols * sizeof(size_t));
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLRowCount(SQLHSTMT StatementHandle, SQLLEN *RowCount)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	*RowCount = stmt->rowcount;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQL_API
+SQLMoreResults(SQLHSTMT StatementHandle)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	close_cursor(stmt);
+	return SQL_NO_DATA;
+}
+
+SQLRETURN SQL_API
+SQLCloseCursor(SQLHSTMT StatementHandle)
+{
+	tstmt	   *stmt = StatementHandle;
+
+	start_call(stmt);
+	if (stmt->cursor == NULL)
+	{
+		diag(&stmt->diag, "24000", "invalid cursor state");
+		return SQL_ERROR;
+	}
+	close_cursor(stmt);
+	return SQL_SUCCESS;
+}
+
+/* Diagnostics */
+static tdiag *
+handle_diag(SQLSMALLINT HandleType, SQLHANDLE Handle)
+{
+	switch (HandleType)
+	{
+		case SQL_HANDLE_ENV:
+			return &((tenv *) Handle)->diag;
+		case SQL_HANDLE_DBC:
+			return &((tconn *) Handle)->diag;
+		case SQL_HANDLE_STMT:
+			return &((tstmt *) Handle)->diag;
+		case SQL_HANDLE_DESC:
+			return &((tdesc *) Handle)->diag;
+	}
+	return NULL;
+}
+
+SQLRETURN SQL_API
+SQLGetDiagRec(SQLSMALLINT HandleType, SQLHANDLE Handle, SQLSMALLINT RecNumber,
+			  SQLCHAR *Sqlstate, SQLINTEGER *NativeError, SQLCHAR *MessageText,
+			  SQLSMALLINT BufferLength, SQLSMALLINT *TextLength)
+{
+	tdiag	   *d = handle_diag(HandleType, Handle);
+	tdiag		ignored;
+
+	if (d == NULL)
+		return SQL_INVALID_HANDLE;
+	if (RecNumber < 1)
+		return SQL_ERROR;
+	if (!d->set || RecNumber > 1)
+		return SQL_NO_DATA;
+	if (Sqlstate)
+		strcpy((char *) Sqlstate, d->state);
+	if (NativeError)
+		*NativeError = 0;
+	return put_string_s(&ignored, d->msg, MessageText, BufferLength, TextLength);
+}
+
+SQLRETURN SQL_API
+SQLGetDiagField(SQLSMALLINT HandleType, SQLHANDLE Handle, SQLSMALLINT RecNumber,
+				SQLSMALLINT DiagIdentifier, SQLPOINTER DiagInfo, SQLSMALLINT BufferLength,
+				SQLSMALLINT *StringLength)
+{
+	tdiag	   *d = handle_diag(HandleType, Handle);
+	tdiag		ignored;
+
+	if (d == NULL)
+		return SQL_INVALID_HANDLE;
+	switch (DiagIdentifier)
+	{
+		case SQL_DIAG_NUMBER:
+			*(SQLINTEGER *) DiagInfo = d->set ? 1 : 0;
+			return SQL_SUCCESS;
+		case SQL_DIAG_RETURNCODE:
+			*(SQLRETURN *) DiagInfo = !d->set ? SQL_SUCCESS :
+				strncmp(d->state, "01", 2) == 0 ? SQL_SUCCESS_WITH_INFO : SQL_ERROR;
+			return SQL_SUCCESS;
+		case SQL_DIAG_ROW_COUNT:
+			if (HandleType != SQL_HANDLE_STMT)
+				return SQL_ERROR;
+			*(SQLLEN *) DiagInfo = ((tstmt *) Handle)->rowcount;
+			return SQL_SUCCESS;
+		case SQL_DIAG_CURSOR_ROW_COUNT:
+		case SQL_DIAG_DYNAMIC_FUNCTION_CODE:
+			if (HandleType != SQL_HANDLE_STMT)
+				return SQL_ERROR;
+			*(SQLINTEGER *) DiagInfo = 0;
+			return SQL_SUCCESS;
+		case SQL_DIAG_DYNAMIC_FUNCTION:
+			return put_string_s(&ignored, "", DiagInfo, BufferLength, StringLength);
+	}
+	if (RecNumber < 1)
+		return SQL_ERROR;
+	if (!d->set || RecNumber > 1)
+		return SQL_NO_DATA;
+	switch (DiagIdentifier)
+	{
+		case SQL_DIAG_SQLSTATE:
+			return put_string_s(&ignored, d->state, DiagInfo, BufferLength, StringLength);
+		case SQL_DIAG_MESSAGE_TEXT:
+			return put_string_s(&ignored, d->msg, DiagInfo, BufferLength, StringLength);
+		case SQL_DIAG_NATIVE:
+			*(SQLINTEGER *) DiagInfo = 0;
+			return SQL_SUCCESS;
+		case SQL_DIAG_CLASS_ORIGIN:
+		case SQL_DIAG_SUBCLASS_ORIGIN:
+			return put_string_s(&ignored, strncmp(d->state, "IM", 2) == 0 ? "ODBC 3.0" : "ISO 9075",
+								DiagInfo, BufferLength, StringLength);
+		case SQL_DIAG_CONNECTION_NAME:
+		case SQL_DIAG_SERVER_NAME:
+			return put_string_s(&ignored, DRIVER_NAME, DiagInfo, BufferLength, StringLength);
+		case SQL_DIAG_ROW_NUMBER:
+			*(SQLLEN *) DiagInfo = SQL_ROW_NUMBER_UNKNOWN;
+			return SQL_SUCCESS;
+		case SQL_DIAG_COLUMN_NUMBER:
+			*(SQLINTEGER *) DiagInfo = SQL_COLUMN_NUMBER_UNKNOWN;
+			return SQL_SUCCESS;
+	}
+	return SQL_ERROR;
+}